@@ -0,0 +1,716 @@
+/*=========================================================================
+
+  Module: vtkBSplineGridTransform.cxx
+
+  Copyright (c) 2016 David Gobbi
+  All rights reserved.
+  See Copyright.txt or http://dgobbi.github.io/bsd3.txt for details.
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notice for more information.
+
+=========================================================================*/
+#include "vtkBSplineGridTransform.h"
+
+#include <vtkObjectFactory.h>
+#include <vtkDoubleArray.h>
+#include <vtkImageData.h>
+#include <vtkPointData.h>
+#include <vtkMultiThreader.h>
+
+// C header files
+#include <math.h>
+
+// C++ header files
+#include <vector>
+
+vtkStandardNewMacro(vtkBSplineGridTransform);
+
+//----------------------------------------------------------------------------
+namespace {
+
+// Compute the cubic B-spline weights for the four control points that
+// support a point along one axis of the grid.  The index of the first
+// control point is returned in "base", and the number of control points
+// in the support is returned (this is one if the grid is flat along the
+// axis, and zero if the point is entirely outside of the grid).  The
+// derivatives of the weights are computed if "dw" is not null.
+int vtkBSplineGridSupport(
+  double x, double origin, double spacing, int dim,
+  int *base, double w[4], double dw[4])
+{
+  if (dim <= 1)
+    {
+    *base = 0;
+    w[0] = 1.0;
+    if (dw)
+      {
+      dw[0] = 0.0;
+      }
+    return dim;
+    }
+
+  double t = (x - origin)/spacing;
+  double tf = floor(t);
+  double f = t - tf;
+  int b = static_cast<int>(tf) - 1;
+  *base = b;
+
+  if (b + 3 < 0 || b >= dim)
+    {
+    return 0;
+    }
+
+  double f2 = f*f;
+  double f3 = f2*f;
+  double g = 1.0 - f;
+
+  w[0] = g*g*g/6.0;
+  w[1] = (3.0*f3 - 6.0*f2 + 4.0)/6.0;
+  w[2] = (-3.0*f3 + 3.0*f2 + 3.0*f + 1.0)/6.0;
+  w[3] = f3/6.0;
+
+  if (dw)
+    {
+    dw[0] = -0.5*g*g/spacing;
+    dw[1] = (1.5*f2 - 2.0*f)/spacing;
+    dw[2] = (-1.5*f2 + f + 0.5)/spacing;
+    dw[3] = 0.5*f2/spacing;
+    }
+
+  return 4;
+}
+
+// Refine the grid along one axis by B-spline subdivision.  The output
+// grid has 2*n - 3 points along the axis, where the odd points are at the
+// positions of the old points, and the even points are at the midpoints.
+void vtkBSplineGridRefineAxis(
+  const double *in, const int inDims[3], int axis,
+  double *out, const int outDims[3])
+{
+  int inc[3];
+  inc[0] = 3;
+  inc[1] = 3*inDims[0];
+  inc[2] = 3*inDims[0]*inDims[1];
+  int n = inDims[axis];
+
+  int idx[3];
+  for (idx[2] = 0; idx[2] < outDims[2]; idx[2]++)
+    {
+    for (idx[1] = 0; idx[1] < outDims[1]; idx[1]++)
+      {
+      for (idx[0] = 0; idx[0] < outDims[0]; idx[0]++)
+        {
+        int j = idx[axis];
+        int k = (j + 1)/2;
+
+        // offset of the row of input points along the axis
+        int tmp = idx[axis];
+        idx[axis] = 0;
+        const double *inPtr = in + idx[0]*inc[0] + idx[1]*inc[1] +
+                              idx[2]*inc[2];
+        idx[axis] = tmp;
+
+        double c[3] = { 0.0, 0.0, 0.0 };
+        int kk[3];
+        double ww[3];
+        int m = 0;
+        if (j & 1)
+          {
+          kk[0] = k - 1; ww[0] = 0.125;
+          kk[1] = k;     ww[1] = 0.75;
+          kk[2] = k + 1; ww[2] = 0.125;
+          m = 3;
+          }
+        else
+          {
+          kk[0] = k;     ww[0] = 0.5;
+          kk[1] = k + 1; ww[1] = 0.5;
+          m = 2;
+          }
+        for (int l = 0; l < m; l++)
+          {
+          if (kk[l] >= 0 && kk[l] < n)
+            {
+            const double *p = inPtr + kk[l]*inc[axis];
+            c[0] += ww[l]*p[0];
+            c[1] += ww[l]*p[1];
+            c[2] += ww[l]*p[2];
+            }
+          }
+
+        *out++ = c[0];
+        *out++ = c[1];
+        *out++ = c[2];
+        }
+      }
+    }
+}
+
+// The information that is needed by ComputeDisplacementField threads.
+struct vtkBSplineGridThreadStruct
+{
+  vtkBSplineGridTransform *Transform;
+  vtkImageData *Field;
+  int NumberOfThreads;
+};
+
+template<class T>
+void vtkBSplineGridFillRows(
+  vtkBSplineGridTransform *self, vtkImageData *field,
+  int firstRow, int lastRow)
+{
+  int extent[6];
+  double origin[3];
+  double spacing[3];
+  field->GetExtent(extent);
+  field->GetOrigin(origin);
+  field->GetSpacing(spacing);
+
+  int nx = extent[1] - extent[0] + 1;
+  int ny = extent[3] - extent[2] + 1;
+  vtkIdType rowSize = 3*nx;
+
+  std::vector<double> row(3*self->GetGridDimensions()[0] + 3);
+
+  T *outPtr = static_cast<T *>(
+    field->GetPointData()->GetScalars()->GetVoidPointer(0));
+  outPtr += rowSize*firstRow;
+
+  for (int r = firstRow; r < lastRow; r++)
+    {
+    double y = origin[1] + spacing[1]*(extent[2] + r % ny);
+    double z = origin[2] + spacing[2]*(extent[4] + r / ny);
+    self->ComputeRowCoefficients(y, z, &row[0]);
+    for (int i = 0; i < nx; i++)
+      {
+      double x = origin[0] + spacing[0]*(extent[0] + i);
+      double d[3];
+      self->EvaluateRow(&row[0], x, d);
+      outPtr[0] = static_cast<T>(d[0]);
+      outPtr[1] = static_cast<T>(d[1]);
+      outPtr[2] = static_cast<T>(d[2]);
+      outPtr += 3;
+      }
+    }
+}
+
+VTK_THREAD_RETURN_TYPE vtkBSplineGridThreadExecute(void *arg)
+{
+  vtkMultiThreader::ThreadInfo *ti =
+    static_cast<vtkMultiThreader::ThreadInfo *>(arg);
+  vtkBSplineGridThreadStruct *ts =
+    static_cast<vtkBSplineGridThreadStruct *>(ti->UserData);
+
+  int extent[6];
+  ts->Field->GetExtent(extent);
+  int numRows = (extent[3] - extent[2] + 1)*(extent[5] - extent[4] + 1);
+  int firstRow = (numRows*ti->ThreadID)/ts->NumberOfThreads;
+  int lastRow = (numRows*(ti->ThreadID + 1))/ts->NumberOfThreads;
+
+  if (ts->Field->GetScalarType() == VTK_FLOAT)
+    {
+    vtkBSplineGridFillRows<float>(
+      ts->Transform, ts->Field, firstRow, lastRow);
+    }
+  else
+    {
+    vtkBSplineGridFillRows<double>(
+      ts->Transform, ts->Field, firstRow, lastRow);
+    }
+
+  return VTK_THREAD_RETURN_VALUE;
+}
+
+} // end anonymous namespace
+
+//----------------------------------------------------------------------------
+vtkBSplineGridTransform::vtkBSplineGridTransform()
+{
+  for (int i = 0; i < 3; i++)
+    {
+    this->GridDimensions[i] = 0;
+    this->GridOrigin[i] = 0.0;
+    this->GridSpacing[i] = 1.0;
+    }
+  this->NumberOfThreads = 0;
+
+  this->Coefficients = vtkDoubleArray::New();
+  this->Coefficients->SetNumberOfComponents(3);
+}
+
+//----------------------------------------------------------------------------
+vtkBSplineGridTransform::~vtkBSplineGridTransform()
+{
+  this->Coefficients->Delete();
+}
+
+//----------------------------------------------------------------------------
+void vtkBSplineGridTransform::PrintSelf(ostream& os, vtkIndent indent)
+{
+  this->Superclass::PrintSelf(os, indent);
+
+  os << indent << "GridDimensions: " << this->GridDimensions[0] << " "
+     << this->GridDimensions[1] << " " << this->GridDimensions[2] << "\n";
+  os << indent << "GridOrigin: " << this->GridOrigin[0] << " "
+     << this->GridOrigin[1] << " " << this->GridOrigin[2] << "\n";
+  os << indent << "GridSpacing: " << this->GridSpacing[0] << " "
+     << this->GridSpacing[1] << " " << this->GridSpacing[2] << "\n";
+  os << indent << "NumberOfThreads: " << this->NumberOfThreads << "\n";
+  os << indent << "Coefficients: " << this->Coefficients << "\n";
+}
+
+//----------------------------------------------------------------------------
+vtkAbstractTransform *vtkBSplineGridTransform::MakeTransform()
+{
+  return vtkBSplineGridTransform::New();
+}
+
+//----------------------------------------------------------------------------
+void vtkBSplineGridTransform::InternalDeepCopy(vtkAbstractTransform *transform)
+{
+  vtkBSplineGridTransform *t =
+    static_cast<vtkBSplineGridTransform *>(transform);
+
+  this->SetInverseTolerance(t->InverseTolerance);
+  this->SetInverseIterations(t->InverseIterations);
+  this->InverseFlag = t->InverseFlag;
+
+  for (int i = 0; i < 3; i++)
+    {
+    this->GridDimensions[i] = t->GridDimensions[i];
+    this->GridOrigin[i] = t->GridOrigin[i];
+    this->GridSpacing[i] = t->GridSpacing[i];
+    }
+  this->NumberOfThreads = t->NumberOfThreads;
+  this->Coefficients->DeepCopy(t->Coefficients);
+
+  this->Modified();
+}
+
+//----------------------------------------------------------------------------
+void vtkBSplineGridTransform::SetGridGeometry(
+  const int dims[3], const double origin[3], const double spacing[3])
+{
+  for (int i = 0; i < 3; i++)
+    {
+    this->GridDimensions[i] = (dims[i] > 0 ? dims[i] : 0);
+    this->GridOrigin[i] = origin[i];
+    this->GridSpacing[i] = spacing[i];
+    }
+
+  vtkIdType n = this->GetNumberOfControlPoints();
+  this->Coefficients->SetNumberOfTuples(n);
+  double *coeffs = this->Coefficients->GetPointer(0);
+  for (vtkIdType i = 0; i < 3*n; i++)
+    {
+    coeffs[i] = 0.0;
+    }
+
+  this->Modified();
+}
+
+//----------------------------------------------------------------------------
+void vtkBSplineGridTransform::SetGridGeometryFromBounds(
+  const double bounds[6], double spacing, int dimensionality)
+{
+  int dims[3];
+  double origin[3];
+  double gridSpacing[3];
+
+  for (int i = 0; i < 3; i++)
+    {
+    double size = bounds[2*i + 1] - bounds[2*i];
+    gridSpacing[i] = spacing;
+    if (i < dimensionality)
+      {
+      // one extra control point below, and two above, the bounds
+      dims[i] = static_cast<int>(floor(size/spacing)) + 4;
+      origin[i] = bounds[2*i] - spacing;
+      }
+    else
+      {
+      dims[i] = 1;
+      origin[i] = bounds[2*i];
+      }
+    }
+
+  this->SetGridGeometry(dims, origin, gridSpacing);
+}
+
+//----------------------------------------------------------------------------
+vtkIdType vtkBSplineGridTransform::GetNumberOfControlPoints()
+{
+  return (static_cast<vtkIdType>(this->GridDimensions[0])*
+          this->GridDimensions[1]*this->GridDimensions[2]);
+}
+
+//----------------------------------------------------------------------------
+void vtkBSplineGridTransform::Refine()
+{
+  vtkIdType n = this->GetNumberOfControlPoints();
+  if (n == 0)
+    {
+    return;
+    }
+
+  int dims[3];
+  dims[0] = this->GridDimensions[0];
+  dims[1] = this->GridDimensions[1];
+  dims[2] = this->GridDimensions[2];
+
+  std::vector<double> grid(this->Coefficients->GetPointer(0),
+                           this->Coefficients->GetPointer(0) + 3*n);
+
+  // subdivide one axis at a time
+  for (int axis = 0; axis < 3; axis++)
+    {
+    if (dims[axis] > 1)
+      {
+      int newDims[3] = { dims[0], dims[1], dims[2] };
+      newDims[axis] = 2*dims[axis] - 3;
+      std::vector<double> refined(
+        3*static_cast<size_t>(newDims[0])*newDims[1]*newDims[2]);
+      vtkBSplineGridRefineAxis(&grid[0], dims, axis, &refined[0], newDims);
+      grid.swap(refined);
+      dims[axis] = newDims[axis];
+      this->GridOrigin[axis] += 0.5*this->GridSpacing[axis];
+      this->GridSpacing[axis] *= 0.5;
+      }
+    }
+
+  this->GridDimensions[0] = dims[0];
+  this->GridDimensions[1] = dims[1];
+  this->GridDimensions[2] = dims[2];
+
+  n = this->GetNumberOfControlPoints();
+  this->Coefficients->SetNumberOfTuples(n);
+  double *coeffs = this->Coefficients->GetPointer(0);
+  for (vtkIdType i = 0; i < 3*n; i++)
+    {
+    coeffs[i] = grid[i];
+    }
+
+  this->Modified();
+}
+
+//----------------------------------------------------------------------------
+double vtkBSplineGridTransform::GetMaximumCoefficient()
+{
+  vtkIdType n = this->GetNumberOfControlPoints();
+  const double *c = this->Coefficients->GetPointer(0);
+  double m = 0.0;
+  for (vtkIdType i = 0; i < n; i++)
+    {
+    double d = c[0]*c[0] + c[1]*c[1] + c[2]*c[2];
+    m = (d > m ? d : m);
+    c += 3;
+    }
+  return sqrt(m);
+}
+
+//----------------------------------------------------------------------------
+void vtkBSplineGridTransform::ComputeRowCoefficients(
+  double y, double z, double *row)
+{
+  int nx = this->GridDimensions[0];
+  int ny = this->GridDimensions[1];
+  int nz = this->GridDimensions[2];
+  for (int i = 0; i < 3*nx; i++)
+    {
+    row[i] = 0.0;
+    }
+
+  int by, bz;
+  double wy[4], wz[4];
+  int my = vtkBSplineGridSupport(y, this->GridOrigin[1], this->GridSpacing[1],
+                                 ny, &by, wy, NULL);
+  int mz = vtkBSplineGridSupport(z, this->GridOrigin[2], this->GridSpacing[2],
+                                 nz, &bz, wz, NULL);
+
+  const double *coeffs = this->Coefficients->GetPointer(0);
+  for (int k = 0; k < mz; k++)
+    {
+    int iz = bz + k;
+    if (iz < 0 || iz >= nz)
+      {
+      continue;
+      }
+    for (int j = 0; j < my; j++)
+      {
+      int iy = by + j;
+      if (iy < 0 || iy >= ny)
+        {
+        continue;
+        }
+      double w = wy[j]*wz[k];
+      const double *c = coeffs + 3*(static_cast<vtkIdType>(iz)*ny + iy)*nx;
+      for (int i = 0; i < 3*nx; i++)
+        {
+        row[i] += w*c[i];
+        }
+      }
+    }
+}
+
+//----------------------------------------------------------------------------
+void vtkBSplineGridTransform::EvaluateRow(
+  const double *row, double x, double displacement[3])
+{
+  int nx = this->GridDimensions[0];
+  int bx;
+  double wx[4];
+  int mx = vtkBSplineGridSupport(x, this->GridOrigin[0], this->GridSpacing[0],
+                                 nx, &bx, wx, NULL);
+
+  displacement[0] = 0.0;
+  displacement[1] = 0.0;
+  displacement[2] = 0.0;
+  for (int i = 0; i < mx; i++)
+    {
+    int ix = bx + i;
+    if (ix >= 0 && ix < nx)
+      {
+      const double *c = row + 3*ix;
+      displacement[0] += wx[i]*c[0];
+      displacement[1] += wx[i]*c[1];
+      displacement[2] += wx[i]*c[2];
+      }
+    }
+}
+
+//----------------------------------------------------------------------------
+void vtkBSplineGridTransform::AddToRowDerivative(
+  double *rowDerivative, double x, const double derivative[3])
+{
+  int nx = this->GridDimensions[0];
+  int bx;
+  double wx[4];
+  int mx = vtkBSplineGridSupport(x, this->GridOrigin[0], this->GridSpacing[0],
+                                 nx, &bx, wx, NULL);
+
+  for (int i = 0; i < mx; i++)
+    {
+    int ix = bx + i;
+    if (ix >= 0 && ix < nx)
+      {
+      double *c = rowDerivative + 3*ix;
+      c[0] += wx[i]*derivative[0];
+      c[1] += wx[i]*derivative[1];
+      c[2] += wx[i]*derivative[2];
+      }
+    }
+}
+
+//----------------------------------------------------------------------------
+void vtkBSplineGridTransform::AccumulateRowDerivative(
+  double y, double z, const double *rowDerivative, double *derivative)
+{
+  int nx = this->GridDimensions[0];
+  int ny = this->GridDimensions[1];
+  int nz = this->GridDimensions[2];
+
+  int by, bz;
+  double wy[4], wz[4];
+  int my = vtkBSplineGridSupport(y, this->GridOrigin[1], this->GridSpacing[1],
+                                 ny, &by, wy, NULL);
+  int mz = vtkBSplineGridSupport(z, this->GridOrigin[2], this->GridSpacing[2],
+                                 nz, &bz, wz, NULL);
+
+  for (int k = 0; k < mz; k++)
+    {
+    int iz = bz + k;
+    if (iz < 0 || iz >= nz)
+      {
+      continue;
+      }
+    for (int j = 0; j < my; j++)
+      {
+      int iy = by + j;
+      if (iy < 0 || iy >= ny)
+        {
+        continue;
+        }
+      double w = wy[j]*wz[k];
+      double *c = derivative + 3*(static_cast<vtkIdType>(iz)*ny + iy)*nx;
+      for (int i = 0; i < 3*nx; i++)
+        {
+        c[i] += w*rowDerivative[i];
+        }
+      }
+    }
+}
+
+//----------------------------------------------------------------------------
+void vtkBSplineGridTransform::ComputeDisplacementField(vtkImageData *field)
+{
+  vtkDataArray *scalars = field->GetPointData()->GetScalars();
+  if (scalars == NULL || scalars->GetNumberOfComponents() != 3 ||
+      (scalars->GetDataType() != VTK_FLOAT &&
+       scalars->GetDataType() != VTK_DOUBLE))
+    {
+    vtkErrorMacro("ComputeDisplacementField: The field must have three "
+                  "components of type float or double.");
+    return;
+    }
+
+  int extent[6];
+  field->GetExtent(extent);
+  int numRows = (extent[3] - extent[2] + 1)*(extent[5] - extent[4] + 1);
+  if (numRows <= 0 || extent[1] < extent[0])
+    {
+    return;
+    }
+
+  int numThreads = this->NumberOfThreads;
+  if (numThreads <= 0)
+    {
+    numThreads = vtkMultiThreader::GetGlobalDefaultNumberOfThreads();
+    }
+  numThreads = (numThreads < numRows ? numThreads : numRows);
+
+  vtkBSplineGridThreadStruct ts;
+  ts.Transform = this;
+  ts.Field = field;
+  ts.NumberOfThreads = numThreads;
+
+  vtkMultiThreader *threader = vtkMultiThreader::New();
+  threader->SetNumberOfThreads(numThreads);
+  threader->SetSingleMethod(vtkBSplineGridThreadExecute, &ts);
+  threader->SingleMethodExecute();
+  threader->Delete();
+
+  scalars->Modified();
+}
+
+//----------------------------------------------------------------------------
+void vtkBSplineGridTransform::ForwardTransformPoint(
+  const double in[3], double out[3])
+{
+  out[0] = in[0];
+  out[1] = in[1];
+  out[2] = in[2];
+
+  int *dims = this->GridDimensions;
+  int b[3], m[3];
+  double w[3][4];
+  for (int a = 0; a < 3; a++)
+    {
+    m[a] = vtkBSplineGridSupport(in[a], this->GridOrigin[a],
+                                 this->GridSpacing[a], dims[a],
+                                 &b[a], w[a], NULL);
+    }
+
+  const double *coeffs = this->Coefficients->GetPointer(0);
+  for (int k = 0; k < m[2]; k++)
+    {
+    int iz = b[2] + k;
+    if (iz < 0 || iz >= dims[2]) { continue; }
+    for (int j = 0; j < m[1]; j++)
+      {
+      int iy = b[1] + j;
+      if (iy < 0 || iy >= dims[1]) { continue; }
+      double wyz = w[1][j]*w[2][k];
+      for (int i = 0; i < m[0]; i++)
+        {
+        int ix = b[0] + i;
+        if (ix < 0 || ix >= dims[0]) { continue; }
+        double wxyz = w[0][i]*wyz;
+        const double *c = coeffs +
+          3*((static_cast<vtkIdType>(iz)*dims[1] + iy)*dims[0] + ix);
+        out[0] += wxyz*c[0];
+        out[1] += wxyz*c[1];
+        out[2] += wxyz*c[2];
+        }
+      }
+    }
+}
+
+//----------------------------------------------------------------------------
+void vtkBSplineGridTransform::ForwardTransformPoint(
+  const float in[3], float out[3])
+{
+  double point[3];
+  point[0] = in[0];
+  point[1] = in[1];
+  point[2] = in[2];
+  this->ForwardTransformPoint(point, point);
+  out[0] = static_cast<float>(point[0]);
+  out[1] = static_cast<float>(point[1]);
+  out[2] = static_cast<float>(point[2]);
+}
+
+//----------------------------------------------------------------------------
+void vtkBSplineGridTransform::ForwardTransformDerivative(
+  const double in[3], double out[3], double derivative[3][3])
+{
+  for (int r = 0; r < 3; r++)
+    {
+    out[r] = in[r];
+    derivative[r][0] = 0.0;
+    derivative[r][1] = 0.0;
+    derivative[r][2] = 0.0;
+    derivative[r][r] = 1.0;
+    }
+
+  int *dims = this->GridDimensions;
+  int b[3], m[3];
+  double w[3][4];
+  double dw[3][4];
+  for (int a = 0; a < 3; a++)
+    {
+    m[a] = vtkBSplineGridSupport(in[a], this->GridOrigin[a],
+                                 this->GridSpacing[a], dims[a],
+                                 &b[a], w[a], dw[a]);
+    }
+
+  const double *coeffs = this->Coefficients->GetPointer(0);
+  for (int k = 0; k < m[2]; k++)
+    {
+    int iz = b[2] + k;
+    if (iz < 0 || iz >= dims[2]) { continue; }
+    for (int j = 0; j < m[1]; j++)
+      {
+      int iy = b[1] + j;
+      if (iy < 0 || iy >= dims[1]) { continue; }
+      for (int i = 0; i < m[0]; i++)
+        {
+        int ix = b[0] + i;
+        if (ix < 0 || ix >= dims[0]) { continue; }
+        double wxyz = w[0][i]*w[1][j]*w[2][k];
+        double dx = dw[0][i]*w[1][j]*w[2][k];
+        double dy = w[0][i]*dw[1][j]*w[2][k];
+        double dz = w[0][i]*w[1][j]*dw[2][k];
+        const double *c = coeffs +
+          3*((static_cast<vtkIdType>(iz)*dims[1] + iy)*dims[0] + ix);
+        for (int r = 0; r < 3; r++)
+          {
+          out[r] += wxyz*c[r];
+          derivative[r][0] += dx*c[r];
+          derivative[r][1] += dy*c[r];
+          derivative[r][2] += dz*c[r];
+          }
+        }
+      }
+    }
+}
+
+//----------------------------------------------------------------------------
+void vtkBSplineGridTransform::ForwardTransformDerivative(
+  const float in[3], float out[3], float derivative[3][3])
+{
+  double point[3];
+  double matrix[3][3];
+  point[0] = in[0];
+  point[1] = in[1];
+  point[2] = in[2];
+  this->ForwardTransformDerivative(point, point, matrix);
+  for (int r = 0; r < 3; r++)
+    {
+    out[r] = static_cast<float>(point[r]);
+    derivative[r][0] = static_cast<float>(matrix[r][0]);
+    derivative[r][1] = static_cast<float>(matrix[r][1]);
+    derivative[r][2] = static_cast<float>(matrix[r][2]);
+    }
+}
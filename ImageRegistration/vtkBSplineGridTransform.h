@@ -0,0 +1,159 @@
+/*=========================================================================
+
+  Module: vtkBSplineGridTransform.h
+
+  Copyright (c) 2016 David Gobbi
+  All rights reserved.
+  See Copyright.txt or http://dgobbi.github.io/bsd3.txt for details.
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notice for more information.
+
+=========================================================================*/
+// .NAME vtkBSplineGridTransform - Free-form deformation with B-splines.
+// .SECTION Description
+// This transform displaces each point by a cubic B-spline that is defined
+// by a regular grid of control points.  Because the support of each control
+// point is only four grid cells wide along each axis, a change to one
+// control point only affects the displacement within a small region, and
+// the derivative of a similarity metric with respect to the control points
+// can be computed with a single pass over the image.  The grid can be
+// refined to half of its spacing without changing the displacement, which
+// allows a deformable registration to proceed from coarse to fine.
+// Points that lie outside of the grid are not displaced.
+// .SECTION See Also
+// vtkImageRegistration
+
+#ifndef vtkBSplineGridTransform_h
+#define vtkBSplineGridTransform_h
+
+#include "vtkWarpTransform.h"
+
+class vtkDoubleArray;
+class vtkImageData;
+
+class VTK_EXPORT vtkBSplineGridTransform : public vtkWarpTransform
+{
+public:
+  static vtkBSplineGridTransform *New();
+  vtkTypeMacro(vtkBSplineGridTransform, vtkWarpTransform);
+  void PrintSelf(ostream& os, vtkIndent indent);
+
+  // Description:
+  // Set the dimensions, origin, and spacing of the control point grid.
+  // This will also set all of the control points to zero.  A dimension
+  // of one can be used to make the grid 2D, and a dimension of zero
+  // will result in an identity transform.
+  void SetGridGeometry(const int dims[3], const double origin[3],
+                       const double spacing[3]);
+
+  // Description:
+  // Set up a grid that covers the given bounds with the given spacing.
+  // If dimensionality is 2, then the grid will only deform x and y.
+  void SetGridGeometryFromBounds(const double bounds[6], double spacing,
+                                 int dimensionality);
+
+  // Description:
+  // Get the geometry of the control point grid.
+  vtkGetVector3Macro(GridDimensions, int);
+  vtkGetVector3Macro(GridOrigin, double);
+  vtkGetVector3Macro(GridSpacing, double);
+
+  // Description:
+  // Get the control point coefficients.  There are three components per
+  // control point, and the x index increments fastest.  Call Modified()
+  // on the transform after changing the coefficients.
+  vtkDoubleArray *GetCoefficients() { return this->Coefficients; }
+
+  // Description:
+  // Get the number of control points.
+  vtkIdType GetNumberOfControlPoints();
+
+  // Description:
+  // Halve the grid spacing.  The new control points are computed by
+  // B-spline subdivision, so the displacement is unchanged.
+  void Refine();
+
+  // Description:
+  // Get the largest displacement of any control point.
+  double GetMaximumCoefficient();
+
+  // Description:
+  // Compute the displacement at every point of the supplied image, which
+  // must have three scalar components of type float or double.  This is
+  // done in parallel, and each row is computed from a single sum over the
+  // control points that support that row.
+  void ComputeDisplacementField(vtkImageData *field);
+
+  // Description:
+  // Set the number of threads for ComputeDisplacementField().  The default
+  // value of zero will use the default number of threads for VTK.
+  vtkSetMacro(NumberOfThreads, int);
+  vtkGetMacro(NumberOfThreads, int);
+
+  // Description:
+  // Sum the control points over their y and z support for the row of
+  // points at the given y and z position.  The resulting "row" array must
+  // have room for three values per control point along x, and can be
+  // passed to EvaluateRow() to get the displacement at any point along
+  // the row.  This is what makes dense evaluation inexpensive.
+  void ComputeRowCoefficients(double y, double z, double *row);
+
+  // Description:
+  // Compute the displacement at position x, given the row coefficients.
+  void EvaluateRow(const double *row, double x, double displacement[3]);
+
+  // Description:
+  // Add a derivative with respect to the displacement at position x along
+  // a row to a row of derivatives, which should be initialized to zero.
+  // Once the whole row has been done, call AccumulateRowDerivative() to
+  // add the row's derivatives to those for the control points.
+  void AddToRowDerivative(double *rowDerivative, double x,
+                          const double derivative[3]);
+
+  // Description:
+  // Add a row of derivatives from AddToRowDerivative() to the derivatives
+  // for the control points, which must have the same size and layout as
+  // the coefficients.  Only the control points that support the row are
+  // touched.
+  void AccumulateRowDerivative(double y, double z,
+                               const double *rowDerivative,
+                               double *derivative);
+
+  // Description:
+  // Make another transform of the same type.
+  vtkAbstractTransform *MakeTransform();
+
+protected:
+  vtkBSplineGridTransform();
+  ~vtkBSplineGridTransform();
+
+  // Description:
+  // Copy this transform from another of the same type.
+  void InternalDeepCopy(vtkAbstractTransform *transform);
+
+  // Description:
+  // Internal functions for calculating the transformation.
+  void ForwardTransformPoint(const float in[3], float out[3]);
+  void ForwardTransformPoint(const double in[3], double out[3]);
+
+  void ForwardTransformDerivative(const float in[3], float out[3],
+                                  float derivative[3][3]);
+  void ForwardTransformDerivative(const double in[3], double out[3],
+                                  double derivative[3][3]);
+
+  int GridDimensions[3];
+  double GridOrigin[3];
+  double GridSpacing[3];
+  int NumberOfThreads;
+
+  vtkDoubleArray *Coefficients;
+
+private:
+  // Copy constructor and assigment operator are purposely not implemented
+  vtkBSplineGridTransform(const vtkBSplineGridTransform&);
+  void operator=(const vtkBSplineGridTransform&);
+};
+
+#endif /* vtkBSplineGridTransform_h */
@@ -13,6 +13,8 @@
 =========================================================================*/
 #include "vtkFunctionMinimizer.h"
 
+#include <string>
+
 //----------------------------------------------------------------------------
 vtkFunctionMinimizer::vtkFunctionMinimizer()
 {
@@ -375,3 +377,103 @@ void vtkFunctionMinimizer::Minimize()
       }
     }
 }
+
+//----------------------------------------------------------------------------
+void vtkFunctionMinimizer::SaveState(ostream& os)
+{
+  int n = this->NumberOfParameters;
+  std::streamsize precision = os.precision(17);
+
+  os << "NumberOfParameters " << n << "\n";
+  os << "ParameterValues";
+  for (int i = 0; i < n; i++)
+    {
+    os << " " << this->ParameterValues[i];
+    }
+  os << "\n";
+  os << "ParameterScales";
+  for (int i = 0; i < n; i++)
+    {
+    os << " " << this->ParameterScales[i];
+    }
+  os << "\n";
+  os << "FunctionValue " << this->FunctionValue << "\n";
+  os << "Iterations " << this->Iterations << "\n";
+  os << "FunctionEvaluations " << this->FunctionEvaluations << "\n";
+
+  os.precision(precision);
+}
+
+//----------------------------------------------------------------------------
+int vtkFunctionMinimizer::RestoreState(istream& is)
+{
+  int n = 0;
+  if (!vtkFunctionMinimizer::ReadStateKeyword(is, "NumberOfParameters") ||
+      !(is >> n))
+    {
+    vtkErrorMacro("RestoreState: Unable to read state.");
+    return 0;
+    }
+  if (n != this->NumberOfParameters)
+    {
+    vtkErrorMacro("RestoreState: State has " << n << " parameters, but "
+                  << this->NumberOfParameters << " parameters are set.");
+    return 0;
+    }
+
+  // read into temporaries, so nothing changes if an error occurs
+  double *values = new double[2*n + 1];
+  double *scales = values + n;
+  double fval = 0.0;
+  int iterations = 0;
+  int evaluations = 0;
+
+  int success = vtkFunctionMinimizer::ReadStateKeyword(is, "ParameterValues");
+  for (int i = 0; i < n && success; i++)
+    {
+    success = !(is >> values[i]).fail();
+    }
+  success = (success &&
+             vtkFunctionMinimizer::ReadStateKeyword(is, "ParameterScales"));
+  for (int i = 0; i < n && success; i++)
+    {
+    success = !(is >> scales[i]).fail();
+    }
+  success = (success &&
+    vtkFunctionMinimizer::ReadStateKeyword(is, "FunctionValue") &&
+    !(is >> fval).fail() &&
+    vtkFunctionMinimizer::ReadStateKeyword(is, "Iterations") &&
+    !(is >> iterations).fail() &&
+    vtkFunctionMinimizer::ReadStateKeyword(is, "FunctionEvaluations") &&
+    !(is >> evaluations).fail());
+
+  if (success)
+    {
+    for (int i = 0; i < n; i++)
+      {
+      this->ParameterValues[i] = values[i];
+      this->ParameterScales[i] = scales[i];
+      }
+    this->FunctionValue = fval;
+    this->Iterations = iterations;
+    this->FunctionEvaluations = evaluations;
+    this->AbortFlag = 0;
+    this->Modified();
+    }
+  else
+    {
+    vtkErrorMacro("RestoreState: Unable to read state.");
+    }
+
+  delete [] values;
+
+  return success;
+}
+
+//----------------------------------------------------------------------------
+int vtkFunctionMinimizer::ReadStateKeyword(istream& is, const char *keyword)
+{
+  std::string word;
+  is >> word;
+  return (!is.fail() && word == keyword);
+}
@@ -139,6 +139,28 @@ public:
   // minimization code, but it is provided here as a public method.
   void EvaluateFunction();
 
+  // Description:
+  // Save the state of the minimizer to a stream, so that a minimization
+  // that has been interrupted can be resumed with RestoreState().  The
+  // state includes the parameter values and scales, the function value,
+  // the iteration and evaluation counts, and any internal state that the
+  // subclass keeps between iterations.
+  virtual void SaveState(ostream& os);
+
+  // Description:
+  // Restore a state that was saved with SaveState().  The parameters
+  // must already have been set, and their number must match the saved
+  // state.  Returns zero if the state could not be read.  After the
+  // state is restored, Iterate() will continue where the minimization
+  // left off.
+  virtual int RestoreState(istream& is);
+
+  // Description:
+  // Read a keyword from the stream, and return zero if it does not
+  // match the expected keyword.  This is used by RestoreState(), and
+  // by the classes that save a minimizer state as part of their own.
+  static int ReadStateKeyword(istream& is, const char *keyword);
+
 protected:
   vtkFunctionMinimizer();
   ~vtkFunctionMinimizer();
@@ -15,10 +15,14 @@
 
 #include "vtkGaussianInterpolator.h"
 #include "vtkImageInterpolatorInternals.h"
+#include "vtkInterpolationWeightsCache.h"
 #include "vtkImageData.h"
 #include "vtkDataArray.h"
 #include "vtkObjectFactory.h"
 
+#include <vector>
+#include <algorithm>
+
 #include "vtkTemplateAliasMacro.h"
 // turn off 64-bit ints when templating over all types, because
 // they cannot be faithfully represented by doubles
@@ -891,12 +895,131 @@ void vtkGaussianInterpolatorGetInterpolationFunc(
 //----------------------------------------------------------------------------
 // Interpolation for precomputed weights
 
+//----------------------------------------------------------------------------
+// Scratch space for separable interpolation with precomputed weights.
+// The input is summed over the z kernel to produce a plane, the plane is
+// summed over the y kernel to produce a row, and the row is summed over
+// the x kernel to produce the output.  The plane is reused for all rows
+// with the same z index, and the row is reused for all spans with the same
+// y index, so the cost is linear in the kernel size rather than cubic.
+// Each thread computes its own weights, so each has its own scratch space.
+template<class F>
+struct vtkGaussSeparableInfo
+{
+  // the distinct x and y offsets used by the kernels, and for every
+  // tap of the x and y kernels, the index of its offset in these lists
+  std::vector<vtkIdType> OffsetsX;
+  std::vector<vtkIdType> OffsetsY;
+  std::vector<int> IndexX;
+  std::vector<int> IndexY;
+  // the stride between the x offsets, if evenly spaced, or zero
+  vtkIdType StrideX;
+  // for each output x index, the first tap of the x kernel if the taps
+  // are consecutive in the row, or -1 if they must be gathered
+  std::vector<int> StartX;
+
+  // the input summed over the z kernel, for the x and y offsets
+  std::vector<F> Plane;
+  int PlaneZ;
+  bool PlaneValid;
+
+  // the plane summed over the y kernel, for the x offsets
+  std::vector<F> Row;
+  int RowY;
+  bool RowValid;
+};
+
+//----------------------------------------------------------------------------
+// Build the list of distinct offsets for the x or y kernel.
+void vtkGaussSeparableOffsets(
+  const vtkInterpolationWeights *weights, int j,
+  std::vector<vtkIdType> *offsets, std::vector<int> *index)
+{
+  int step = weights->KernelSize[j];
+  int i0 = weights->WeightExtent[2*j];
+  vtkIdType size = step*(weights->WeightExtent[2*j+1] - i0 + 1);
+  const vtkIdType *positions = weights->Positions[j] + step*i0;
+
+  offsets->assign(positions, positions + size);
+  std::sort(offsets->begin(), offsets->end());
+  offsets->erase(std::unique(offsets->begin(), offsets->end()),
+                 offsets->end());
+
+  index->resize(size);
+  for (vtkIdType i = 0; i < size; i++)
+    {
+    (*index)[i] = static_cast<int>(
+      std::lower_bound(offsets->begin(), offsets->end(), positions[i]) -
+      offsets->begin());
+    }
+}
+
+//----------------------------------------------------------------------------
+template<class F>
+vtkGaussSeparableInfo<F> *vtkGaussSeparableNew(
+  const vtkInterpolationWeights *weights)
+{
+  vtkGaussSeparableInfo<F> *sep = new vtkGaussSeparableInfo<F>;
+  vtkGaussSeparableOffsets(weights, 0, &sep->OffsetsX, &sep->IndexX);
+  vtkGaussSeparableOffsets(weights, 1, &sep->OffsetsY, &sep->IndexY);
+
+  // check whether the x offsets are evenly spaced
+  size_t nx = sep->OffsetsX.size();
+  sep->StrideX = 0;
+  if (nx > 1)
+    {
+    sep->StrideX = sep->OffsetsX[1] - sep->OffsetsX[0];
+    for (size_t b = 2; b < nx; b++)
+      {
+      if (sep->OffsetsX[b] - sep->OffsetsX[b-1] != sep->StrideX)
+        {
+        sep->StrideX = 0;
+        break;
+        }
+      }
+    }
+
+  // find the x kernels whose taps are consecutive, which is the case
+  // everywhere except near the borders unless the x axis is reversed
+  int stepX = weights->KernelSize[0];
+  size_t countX = sep->IndexX.size()/stepX;
+  sep->StartX.resize(countX);
+  for (size_t i = 0; i < countX; i++)
+    {
+    const int *indexX = &sep->IndexX[i*stepX];
+    int start = indexX[0];
+    for (int l = 1; l < stepX && start >= 0; l++)
+      {
+      if (indexX[l] != indexX[0] + l)
+        {
+        start = -1;
+        }
+      }
+    sep->StartX[i] = start;
+    }
+
+  int numscalars = weights->NumberOfComponents;
+  sep->Plane.resize(sep->OffsetsY.size()*nx*numscalars);
+  sep->Row.resize(nx*numscalars);
+  sep->PlaneZ = 0;
+  sep->PlaneValid = false;
+  sep->RowY = 0;
+  sep->RowValid = false;
+
+  return sep;
+}
+
+//----------------------------------------------------------------------------
 template <class F, class T>
 struct vtkImageGaussRowInterpolate
 {
   static void General(
     vtkInterpolationWeights *weights, int idX, int idY, int idZ,
     F *outPtr, int n);
+
+  static void Separable(
+    vtkInterpolationWeights *weights, int idX, int idY, int idZ,
+    F *outPtr, int n);
 };
 
 
@@ -907,6 +1030,13 @@ void vtkImageGaussRowInterpolate<F, T>::General(
   vtkInterpolationWeights *weights, int idX, int idY, int idZ,
   F *outPtr, int n)
 {
+  if (weights->ExtraInfo)
+    {
+    vtkImageGaussRowInterpolate<F, T>::Separable(
+      weights, idX, idY, idZ, outPtr, n);
+    return;
+    }
+
   int stepX = weights->KernelSize[0];
   int stepY = weights->KernelSize[1];
   int stepZ = weights->KernelSize[2];
@@ -967,6 +1097,149 @@ void vtkImageGaussRowInterpolate<F, T>::General(
     }
 }
 
+//--------------------------------------------------------------------------
+// separable summation, one kernel at a time
+template<class F, class T>
+void vtkImageGaussRowInterpolate<F, T>::Separable(
+  vtkInterpolationWeights *weights, int idX, int idY, int idZ,
+  F *outPtr, int n)
+{
+  vtkGaussSeparableInfo<F> *sep =
+    static_cast<vtkGaussSeparableInfo<F> *>(weights->ExtraInfo);
+  const T *inPtr = static_cast<const T *>(weights->Pointer);
+  int numscalars = weights->NumberOfComponents;
+  int stepX = weights->KernelSize[0];
+  int stepY = weights->KernelSize[1];
+  int stepZ = weights->KernelSize[2];
+  int nx = static_cast<int>(sep->OffsetsX.size());
+  int ny = static_cast<int>(sep->OffsetsY.size());
+  vtkIdType rowSize = static_cast<vtkIdType>(nx)*numscalars;
+
+  // sum the input over the z kernel
+  if (!sep->PlaneValid || sep->PlaneZ != idZ)
+    {
+    const F *fZ = static_cast<F *>(weights->Weights[2]) + idZ*stepZ;
+    const vtkIdType *factZ = weights->Positions[2] + idZ*stepZ;
+    F *plane = &sep->Plane[0];
+    std::fill(sep->Plane.begin(), sep->Plane.end(), static_cast<F>(0));
+    bool contiguous = (sep->StrideX == numscalars || nx == 1);
+
+    for (int k = 0; k < stepZ; k++)
+      {
+      F w = fZ[k];
+      const T *inPtrZ = inPtr + factZ[k];
+      F *planePtr = plane;
+      for (int a = 0; a < ny; a++)
+        {
+        const T *inPtrY = inPtrZ + sep->OffsetsY[a];
+        if (contiguous)
+          {
+          const T *tmpPtr = inPtrY + sep->OffsetsX[0];
+          for (vtkIdType m = 0; m < rowSize; m++)
+            {
+            planePtr[m] += w*tmpPtr[m];
+            }
+          planePtr += rowSize;
+          }
+        else
+          {
+          for (int b = 0; b < nx; b++)
+            {
+            const T *tmpPtr = inPtrY + sep->OffsetsX[b];
+            for (int c = 0; c < numscalars; c++)
+              {
+              *planePtr++ += w*tmpPtr[c];
+              }
+            }
+          }
+        }
+      }
+
+    sep->PlaneZ = idZ;
+    sep->PlaneValid = true;
+    sep->RowValid = false;
+    }
+
+  // sum the plane over the y kernel
+  F *row = &sep->Row[0];
+  if (!sep->RowValid || sep->RowY != idY)
+    {
+    int i0 = weights->WeightExtent[2];
+    const F *fY = static_cast<F *>(weights->Weights[1]) + idY*stepY;
+    const int *indexY = &sep->IndexY[(idY - i0)*stepY];
+    std::fill(sep->Row.begin(), sep->Row.end(), static_cast<F>(0));
+
+    for (int j = 0; j < stepY; j++)
+      {
+      F w = fY[j];
+      const F *planePtr = &sep->Plane[indexY[j]*rowSize];
+      for (vtkIdType m = 0; m < rowSize; m++)
+        {
+        row[m] += w*planePtr[m];
+        }
+      }
+
+    sep->RowY = idY;
+    sep->RowValid = true;
+    }
+
+  // sum the row over the x kernel, where the taps are usually
+  // consecutive so the row can be read directly instead of gathered
+  int i0 = weights->WeightExtent[0];
+  const F *fX = static_cast<F *>(weights->Weights[0]) + idX*stepX;
+  const int *indexX = &sep->IndexX[(idX - i0)*stepX];
+  const int *startX = &sep->StartX[idX - i0];
+  for (int i = n; i > 0; --i)
+    {
+    int start = *startX++;
+    if (start >= 0 && numscalars == 1)
+      {
+      const F *rowPtr = row + start;
+      F val = 0;
+      for (int l = 0; l < stepX; l++)
+        {
+        val += fX[l]*rowPtr[l];
+        }
+      *outPtr++ = val;
+      }
+    else if (start >= 0)
+      {
+      const F *rowPtr = row + start*numscalars;
+      for (int c = 0; c < numscalars; c++)
+        {
+        outPtr[c] = 0;
+        }
+      for (int l = 0; l < stepX; l++)
+        {
+        F w = fX[l];
+        for (int c = 0; c < numscalars; c++)
+          {
+          outPtr[c] += w*rowPtr[c];
+          }
+        rowPtr += numscalars;
+        }
+      outPtr += numscalars;
+      }
+    else
+      {
+      for (int c = 0; c < numscalars; c++)
+        {
+        const F *rowPtr = row + c;
+        F val = 0;
+        int l = 0;
+        do
+          {
+          val += fX[l]*rowPtr[indexX[l]*numscalars];
+          }
+        while (++l < stepX);
+        *outPtr++ = val;
+        }
+      }
+    fX += stepX;
+    indexX += stepX;
+    }
+}
+
 //----------------------------------------------------------------------------
 // get row interpolation function for different interpolation modes
 // and different scalar types
@@ -1173,6 +1446,34 @@ void vtkGaussianInterpolatorPrecomputeWeights(
     }
 }
 
+//----------------------------------------------------------------------------
+// Get the weights from the cache, or compute them and add them to the cache.
+template<class F>
+void vtkGaussianInterpolatorCachedWeights(
+  vtkInterpolationWeightsCache *cache, const F newmat[16],
+  const int outExt[6], int clipExt[6], const F bounds[6],
+  vtkInterpolationWeights *weights)
+{
+  if (!cache->Find(newmat, outExt, bounds, weights, clipExt))
+    {
+    vtkGaussianInterpolatorPrecomputeWeights(
+      newmat, outExt, clipExt, bounds, weights);
+    cache->Insert(weights, clipExt);
+    }
+
+  // use separable summation if it needs fewer operations per sample,
+  // the lookup tables are not needed anymore so ExtraInfo can be reused
+  // (the scratch space is not cached, since each thread needs its own)
+  weights->ExtraInfo = NULL;
+  int kx = weights->KernelSize[0];
+  int ky = weights->KernelSize[1];
+  int kz = weights->KernelSize[2];
+  if (clipExt[0] <= clipExt[1] && kx*ky*kz > kx + ky + kz)
+    {
+    weights->ExtraInfo = vtkGaussSeparableNew<F>(weights);
+    }
+}
+
 
 //----------------------------------------------------------------------------
 } // ends anonymous namespace
@@ -1216,8 +1517,15 @@ void vtkGaussianInterpolator::PrecomputeWeightsForExtent(
 {
   weights = new vtkInterpolationWeights(*this->InterpolationInfo);
 
-  vtkGaussianInterpolatorPrecomputeWeights(
-    matrix, extent, newExtent, this->StructuredBoundsDouble, weights);
+  // the parameters that were used to build the kernel lookup tables
+  vtkInterpolationWeightsCache cache(this->GetClassName());
+  cache.AddParameter(this->KernelType);
+  cache.AddParameter(this->Renormalization);
+  cache.AddParameters(this->RadiusFactors, 3);
+  cache.AddParameters(this->LastBlurFactors, 3);
+
+  vtkGaussianInterpolatorCachedWeights(
+    &cache, matrix, extent, newExtent, this->StructuredBoundsDouble, weights);
 }
 
 //----------------------------------------------------------------------------
@@ -1227,15 +1535,39 @@ void vtkGaussianInterpolator::PrecomputeWeightsForExtent(
 {
   weights = new vtkInterpolationWeights(*this->InterpolationInfo);
 
-  vtkGaussianInterpolatorPrecomputeWeights(
-    matrix, extent, newExtent, this->StructuredBoundsFloat, weights);
+  // the parameters that were used to build the kernel lookup tables
+  vtkInterpolationWeightsCache cache(this->GetClassName());
+  cache.AddParameter(this->KernelType);
+  cache.AddParameter(this->Renormalization);
+  cache.AddParameters(this->RadiusFactors, 3);
+  cache.AddParameters(this->LastBlurFactors, 3);
+
+  vtkGaussianInterpolatorCachedWeights(
+    &cache, matrix, extent, newExtent, this->StructuredBoundsFloat, weights);
 }
 
 //----------------------------------------------------------------------------
 void vtkGaussianInterpolator::FreePrecomputedWeights(
   vtkInterpolationWeights *&weights)
 {
-  this->Superclass::FreePrecomputedWeights(weights);
+  // free the scratch space for separable summation
+  if (weights->ExtraInfo)
+    {
+    if (weights->WeightType == VTK_FLOAT)
+      {
+      delete static_cast<vtkGaussSeparableInfo<float> *>(weights->ExtraInfo);
+      }
+    else
+      {
+      delete static_cast<vtkGaussSeparableInfo<double> *>(weights->ExtraInfo);
+      }
+    weights->ExtraInfo = NULL;
+    }
+
+  if (!vtkInterpolationWeightsCache::Release(weights))
+    {
+    this->Superclass::FreePrecomputedWeights(weights);
+    }
 }
 
 //----------------------------------------------------------------------------
@@ -25,6 +25,9 @@
 // These kernels are described in the following publication:
 // [1] C. Robert Appledorn, "A New Approach to the Interpolation of Sampled
 //     Data," IEEE Transactions on Medical Imaging, 15(3):369-376, 1996.
+// When the output is sampled on a regular grid, the kernel is applied
+// separably (one axis at a time), so that the cost is proportional to
+// the width of the kernel rather than to its volume.
 // .SECTION Thanks
 // Thanks to David Gobbi, Department of Radiology, University of Calgary
 // for providing this class.
@@ -153,7 +156,10 @@ public:
   // extent and the structured coordinates of the input.  This
   // matrix must perform only permutations, scales, and translation,
   // i.e. each of the three columns must have only one non-zero value.
-  // A new extent is provided for out-of-bounds checks.
+  // A new extent is provided for out-of-bounds checks.  The weights
+  // are cached, so if the same matrix and extent are used again with
+  // the same kernel and input geometry (even by a different interpolator)
+  // then the weights will not have to be recomputed.
   // THIS METHOD IS THREAD SAFE.
   virtual void PrecomputeWeightsForExtent(
     const double matrix[16], const int extent[6], int newExtent[6],
@@ -94,8 +94,8 @@ void vtkImageCorrelationRatioExecute(
   double xshift = -binOrigin;
   double xscale = 1.0/binSpacing;
 
-  // iterate over all spans in the stencil
-  while (!inIter.IsAtEnd())
+  // iterate over all spans in the stencil, unless aborted
+  while (!inIter.IsAtEnd() && !self->GetAbortExecute())
     {
     if (inIter.IsInStencil())
       {
@@ -151,8 +151,8 @@ void vtkImageCorrelationRatioExecuteInt(
   int xmin = 0;
   int xmax = numBins - 1;
 
-  // iterate over all spans in the stencil
-  while (!inIter.IsAtEnd())
+  // iterate over all spans in the stencil, unless aborted
+  while (!inIter.IsAtEnd() && !self->GetAbortExecute())
     {
     if (inIter.IsInStencil())
       {
@@ -86,6 +86,57 @@ void vtkImageCrossCorrelation::PrintSelf(ostream& os, vtkIndent indent)
 // begin anonymous namespace
 namespace {
 
+//----------------------------------------------------------------------------
+// Add the sums x, y, x*x, y*y, x*y over a span.
+template<class T1, class T2>
+void vtkImageCrossCorrelationSpan(
+  const T1 *inPtr, int pixelInc, const T2 *inPtr1, int pixelInc1,
+  vtkIdType n, double sums[5])
+{
+  double xSum = 0;
+  double ySum = 0;
+  double xxSum = 0;
+  double yySum = 0;
+  double xySum = 0;
+
+  for (vtkIdType i = 0; i < n; i++)
+    {
+    double x = *inPtr;
+    double y = *inPtr1;
+
+    xSum += x;
+    ySum += y;
+    xxSum += x*x;
+    yySum += y*y;
+    xySum += x*y;
+
+    inPtr += pixelInc;
+    inPtr1 += pixelInc1;
+    }
+
+  sums[0] += xSum;
+  sums[1] += ySum;
+  sums[2] += xxSum;
+  sums[3] += yySum;
+  sums[4] += xySum;
+}
+
+// For float data, do the per-voxel arithmetic in single precision.
+inline void vtkImageCrossCorrelationSpan(
+  const float *inPtr, int pixelInc, const float *inPtr1, int pixelInc1,
+  vtkIdType n, double sums[5])
+{
+  if (pixelInc == 1 && pixelInc1 == 1)
+    {
+    vtkImageSimilarityMetricCrossSums(inPtr, inPtr1, n, sums);
+    }
+  else
+    {
+    vtkImageCrossCorrelationSpan<float, float>(
+      inPtr, pixelInc, inPtr1, pixelInc1, n, sums);
+    }
+}
+
 //----------------------------------------------------------------------------
 template<class T1, class T2>
 void vtkImageCrossCorrelationExecute(
@@ -103,15 +154,11 @@ void vtkImageCrossCorrelationExecute(
   int pixelInc = inData0->GetNumberOfScalarComponents();
   int pixelInc1 = inData1->GetNumberOfScalarComponents();
 
-  double xSum = 0;
-  double ySum = 0;
-  double xxSum = 0;
-  double yySum = 0;
-  double xySum = 0;
+  double sums[5] = { 0.0, 0.0, 0.0, 0.0, 0.0 };
   double count = 0;
 
-  // iterate over all spans in the stencil
-  while (!inIter.IsAtEnd())
+  // iterate over all spans in the stencil, unless aborted
+  while (!inIter.IsAtEnd() && !self->GetAbortExecute())
     {
     if (inIter.IsInStencil())
       {
@@ -119,33 +166,22 @@ void vtkImageCrossCorrelationExecute(
       T1 *inPtrEnd = inIter.EndSpan();
       inPtr1 = inIter1.BeginSpan();
 
-      // iterate over all voxels in the span
-      while (inPtr != inPtrEnd)
-        {
-        double x = *inPtr;
-        double y = *inPtr1;
-
-        xSum += x;
-        ySum += y;
-        xxSum += x*x;
-        yySum += y*y;
-        xySum += x*y;
-        count++;
-
-        inPtr += pixelInc;
-        inPtr1 += pixelInc1;
-        }
+      vtkIdType n = static_cast<vtkIdType>(inPtrEnd - inPtr)/pixelInc;
+      vtkImageCrossCorrelationSpan(
+        inPtr, pixelInc, inPtr1, pixelInc1, n, sums);
+      count += n;
       }
     inIter.NextSpan();
     inIter1.NextSpan();
     }
 
-  output[0] = xSum;
-  output[1] = ySum;
-  output[2] = xxSum;
-  output[3] = yySum;
-  output[4] = xySum;
-  output[5] = count;
+  // add to the sums, since a thread can execute more than one piece
+  output[0] += sums[0];
+  output[1] += sums[1];
+  output[2] += sums[2];
+  output[3] += sums[3];
+  output[4] += sums[4];
+  output[5] += count;
 }
 
 //----------------------------------------------------------------------------
@@ -0,0 +1,624 @@
+/*=========================================================================
+
+  Module: vtkImageGaussianPyramid.cxx
+
+  Copyright (c) 2016 David Gobbi
+  All rights reserved.
+  See Copyright.txt or http://dgobbi.github.io/bsd3.txt for details.
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notice for more information.
+
+=========================================================================*/
+#include "vtkImageGaussianPyramid.h"
+
+#include <vtkObjectFactory.h>
+#include <vtkImageData.h>
+#include <vtkPointData.h>
+#include <vtkDataArray.h>
+#include <vtkInformation.h>
+#include <vtkInformationVector.h>
+#include <vtkStreamingDemandDrivenPipeline.h>
+#include <vtkMultiThreader.h>
+#include <vtkTemplateAliasMacro.h>
+#include <vtkTypeTraits.h>
+#include <vtkVersion.h>
+
+// C header files
+#include <math.h>
+
+// C++ header files
+#include <vector>
+
+vtkStandardNewMacro(vtkImageGaussianPyramid);
+
+//----------------------------------------------------------------------------
+vtkImageGaussianPyramid::vtkImageGaussianPyramid()
+{
+  for (int i = 0; i < 3; i++)
+    {
+    this->OutputSpacing[i] = 0.0;
+    this->BlurFactors[i] = 1.0;
+    }
+  this->Interpolate = 1;
+  this->NumberOfThreads = 0;
+}
+
+//----------------------------------------------------------------------------
+vtkImageGaussianPyramid::~vtkImageGaussianPyramid()
+{
+}
+
+//----------------------------------------------------------------------------
+void vtkImageGaussianPyramid::PrintSelf(ostream& os, vtkIndent indent)
+{
+  this->Superclass::PrintSelf(os, indent);
+
+  os << indent << "OutputSpacing: " << this->OutputSpacing[0] << " "
+     << this->OutputSpacing[1] << " " << this->OutputSpacing[2] << "\n";
+  os << indent << "BlurFactors: " << this->BlurFactors[0] << " "
+     << this->BlurFactors[1] << " " << this->BlurFactors[2] << "\n";
+  os << indent << "Interpolate: "
+     << (this->Interpolate ? "On\n" : "Off\n");
+  os << indent << "NumberOfThreads: " << this->NumberOfThreads << "\n";
+}
+
+//----------------------------------------------------------------------------
+void vtkImageGaussianPyramid::ComputeOutputGeometry(
+  int axis, const int inExt[6], const double inSpacing[3],
+  const double inOrigin[3], int outExt[6], double outSpacing[3],
+  double outOrigin[3], double *start, double *step)
+{
+  int n = inExt[2*axis+1] - inExt[2*axis] + 1;
+  double s = inSpacing[axis];
+  double t = fabs(this->OutputSpacing[axis]);
+  if (t == 0 || s == 0)
+    {
+    t = s;
+    }
+  else if (s < 0)
+    {
+    t = -t;
+    }
+
+  // the step between output samples, in input voxels
+  double r = (s != 0 ? t/s : 1.0);
+
+  // the number of output samples that fit within the input
+  int m = n;
+  if (n > 0 && r != 1.0)
+    {
+    m = static_cast<int>(floor((n - 1)/r + 1e-6)) + 1;
+    }
+
+  // center the output samples within the input
+  *start = 0.5*((n - 1) - (m - 1)*r);
+  *step = r;
+
+  outExt[2*axis] = inExt[2*axis];
+  outExt[2*axis+1] = inExt[2*axis] + m - 1;
+  outSpacing[axis] = t;
+  outOrigin[axis] = inOrigin[axis] + (inExt[2*axis] + *start)*s -
+    inExt[2*axis]*t;
+}
+
+//----------------------------------------------------------------------------
+int vtkImageGaussianPyramid::RequestInformation(
+  vtkInformation *vtkNotUsed(request),
+  vtkInformationVector **inputVector,
+  vtkInformationVector *outputVector)
+{
+  vtkInformation *inInfo = inputVector[0]->GetInformationObject(0);
+  vtkInformation *outInfo = outputVector->GetInformationObject(0);
+
+  int inExt[6];
+  double inSpacing[3];
+  double inOrigin[3];
+  inInfo->Get(vtkStreamingDemandDrivenPipeline::WHOLE_EXTENT(), inExt);
+  inInfo->Get(vtkDataObject::SPACING(), inSpacing);
+  inInfo->Get(vtkDataObject::ORIGIN(), inOrigin);
+
+  int outExt[6];
+  double outSpacing[3];
+  double outOrigin[3];
+  for (int j = 0; j < 3; j++)
+    {
+    double start, step;
+    this->ComputeOutputGeometry(j, inExt, inSpacing, inOrigin,
+                                outExt, outSpacing, outOrigin,
+                                &start, &step);
+    }
+
+  outInfo->Set(vtkStreamingDemandDrivenPipeline::WHOLE_EXTENT(), outExt, 6);
+  outInfo->Set(vtkDataObject::SPACING(), outSpacing, 3);
+  outInfo->Set(vtkDataObject::ORIGIN(), outOrigin, 3);
+
+  return 1;
+}
+
+//----------------------------------------------------------------------------
+int vtkImageGaussianPyramid::RequestUpdateExtent(
+  vtkInformation *vtkNotUsed(request),
+  vtkInformationVector **inputVector,
+  vtkInformationVector *vtkNotUsed(outputVector))
+{
+  // the whole input is needed, since the filter is recursive
+  vtkInformation *inInfo = inputVector[0]->GetInformationObject(0);
+  int inExt[6];
+  inInfo->Get(vtkStreamingDemandDrivenPipeline::WHOLE_EXTENT(), inExt);
+  inInfo->Set(vtkStreamingDemandDrivenPipeline::UPDATE_EXTENT(), inExt, 6);
+
+  return 1;
+}
+
+//----------------------------------------------------------------------------
+namespace {
+
+// Compute the Young-van Vliet coefficients for the parameter "q",
+// normalized so that the recursion is w[i] = a[0]*x[i] + a[1]*w[i-1]
+// + a[2]*w[i-2] + a[3]*w[i-3].
+void vtkGaussianPyramidCoefficientsForQ(double q, double a[4])
+{
+  double q2 = q*q;
+  double q3 = q2*q;
+  double b0 = 1.57825 + 2.44413*q + 1.4281*q2 + 0.422205*q3;
+  double b1 = 2.44413*q + 2.85619*q2 + 1.26661*q3;
+  double b2 = -(1.4281*q2 + 1.26661*q3);
+  double b3 = 0.422205*q3;
+  a[1] = b1/b0;
+  a[2] = b2/b0;
+  a[3] = b3/b0;
+  a[0] = 1.0 - (a[1] + a[2] + a[3]);
+}
+
+// Compute the variance of the forward-backward filter, which is twice
+// the second cumulant of the forward filter.
+double vtkGaussianPyramidVariance(const double a[4])
+{
+  double s1 = a[1] + 2*a[2] + 3*a[3];
+  double s2 = a[1] + 4*a[2] + 9*a[3];
+  return 2*(s2*a[0] + s1*s1)/(a[0]*a[0]);
+}
+
+// Compute the coefficients for a given standard deviation.  Rather than
+// using the Young-van Vliet formula for "q", which gives a standard
+// deviation that is about ten percent too large, search for the "q"
+// that gives the exact variance.
+void vtkGaussianPyramidCoefficients(double sigma, double a[4])
+{
+  double lo = 0.0;
+  double hi = 2.0*sigma + 2.0;
+  for (int i = 0; i < 50; i++)
+    {
+    double q = 0.5*(lo + hi);
+    vtkGaussianPyramidCoefficientsForQ(q, a);
+    if (vtkGaussianPyramidVariance(a) < sigma*sigma)
+      {
+      lo = q;
+      }
+    else
+      {
+      hi = q;
+      }
+    }
+  vtkGaussianPyramidCoefficientsForQ(lo, a);
+}
+
+// Compute the Triggs-Sdika matrix, which gives the initial state of
+// the backward recursion from the final state of the forward recursion.
+void vtkGaussianPyramidBoundaryMatrix(const double a[4], double M[9])
+{
+  double a1 = a[1];
+  double a2 = a[2];
+  double a3 = a[3];
+  double scale = a[0]/((1.0 + a1 - a2 + a3)*(1.0 - a1 - a2 - a3)*
+                       (1.0 + a2 + (a1 - a3)*a3));
+  M[0] = scale*(-a3*a1 + 1.0 - a3*a3 - a2);
+  M[1] = scale*(a3 + a1)*(a2 + a3*a1);
+  M[2] = scale*a3*(a1 + a3*a2);
+  M[3] = scale*(a1 + a3*a2);
+  M[4] = -scale*(a2 - 1.0)*(a2 + a3*a1);
+  M[5] = -scale*a3*(a3*a1 + a3*a3 + a2 - 1.0);
+  M[6] = scale*(a3*a1 + a2 + a1*a1 - a2*a2);
+  M[7] = scale*(a1*a2 + a3*a2*a2 - a1*a3*a3 - a3*a3*a3 - a3*a2 + a3);
+  M[8] = scale*a3*(a1 + a3*a2);
+}
+
+// Blur a line in-place, "w" is workspace of the same size.  The edge
+// voxels are treated as if they repeat infinitely.
+void vtkGaussianPyramidBlurLine(
+  double *x, double *w, int n, const double a[4], const double M[9])
+{
+  double a0 = a[0];
+  double a1 = a[1];
+  double a2 = a[2];
+  double a3 = a[3];
+
+  // forward recursion, at steady state for the first value
+  double w1 = x[0];
+  double w2 = w1;
+  double w3 = w1;
+  for (int i = 0; i < n; i++)
+    {
+    double v = a0*x[i] + a1*w1 + a2*w2 + a3*w3;
+    w3 = w2;
+    w2 = w1;
+    w1 = v;
+    w[i] = v;
+    }
+
+  // initialize the backward recursion (w1, w2, w3 are the final states)
+  double u = x[n-1];
+  double u1 = w1 - u;
+  double u2 = w2 - u;
+  double u3 = w3 - u;
+  double y1 = u + M[0]*u1 + M[1]*u2 + M[2]*u3;
+  double y2 = u + M[3]*u1 + M[4]*u2 + M[5]*u3;
+  double y3 = u + M[6]*u1 + M[7]*u2 + M[8]*u3;
+
+  // backward recursion
+  x[n-1] = y1;
+  for (int i = n - 2; i >= 0; i--)
+    {
+    double v = a0*w[i] + a1*y1 + a2*y2 + a3*y3;
+    y3 = y2;
+    y2 = y1;
+    y1 = v;
+    x[i] = v;
+    }
+}
+
+// Convert to the output type, with rounding and clamping for integers.
+template<class T>
+void vtkGaussianPyramidConvert(double v, T *p)
+{
+  double minval = static_cast<double>(vtkTypeTraits<T>::Min());
+  double maxval = static_cast<double>(vtkTypeTraits<T>::Max());
+  v = (v > minval ? v : minval);
+  v = (v < maxval ? v : maxval);
+  *p = static_cast<T>(floor(v + 0.5));
+}
+
+void vtkGaussianPyramidConvert(double v, float *p)
+{
+  *p = static_cast<float>(v);
+}
+
+void vtkGaussianPyramidConvert(double v, double *p)
+{
+  *p = v;
+}
+
+// The type of the working buffers.  Float is exact for integer types of
+// up to 16 bits, but double is needed for larger integer types and for
+// double images, so that their precision is not lost.
+template<bool>
+struct vtkGaussianPyramidPrecision
+{
+  typedef float Type;
+};
+
+template<>
+struct vtkGaussianPyramidPrecision<true>
+{
+  typedef double Type;
+};
+
+template<class T>
+struct vtkGaussianPyramidWorkType
+{
+  typedef typename vtkGaussianPyramidPrecision<(sizeof(T) > 2)>::Type Type;
+};
+
+template<>
+struct vtkGaussianPyramidWorkType<float>
+{
+  typedef float Type;
+};
+
+template<class T, class W>
+void vtkGaussianPyramidCopyIn(const T *inPtr, W *outPtr, vtkIdType n)
+{
+  for (vtkIdType i = 0; i < n; i++)
+    {
+    outPtr[i] = static_cast<W>(inPtr[i]);
+    }
+}
+
+template<class W, class T>
+void vtkGaussianPyramidCopyOut(const W *inPtr, T *outPtr, vtkIdType n)
+{
+  for (vtkIdType i = 0; i < n; i++)
+    {
+    vtkGaussianPyramidConvert(inPtr[i], &outPtr[i]);
+    }
+}
+
+// Everything that is needed for one pass along one axis.
+template<class W>
+struct vtkImageGaussianPyramidThreadStruct
+{
+  const W *InPtr;
+  W *OutPtr;
+  int InDims[3];
+  int OutDims[3];
+  int NumberOfComponents;
+  int Axis;
+  bool Blur;
+  bool Interpolate;
+  double Coefficients[4];
+  double Matrix[9];
+  double Start;
+  double Step;
+  int NumberOfThreads;
+};
+
+template<class W>
+VTK_THREAD_RETURN_TYPE vtkImageGaussianPyramidThreadExecute(void *arg)
+{
+  vtkMultiThreader::ThreadInfo *ti =
+    static_cast<vtkMultiThreader::ThreadInfo *>(arg);
+  vtkImageGaussianPyramidThreadStruct<W> *ts =
+    static_cast<vtkImageGaussianPyramidThreadStruct<W> *>(ti->UserData);
+
+  int axis = ts->Axis;
+  int axis1 = (axis + 1) % 3;
+  int axis2 = (axis + 2) % 3;
+  int nc = ts->NumberOfComponents;
+  int n = ts->InDims[axis];
+  int m = ts->OutDims[axis];
+
+  vtkIdType inInc[3];
+  vtkIdType outInc[3];
+  inInc[0] = nc;
+  inInc[1] = inInc[0]*ts->InDims[0];
+  inInc[2] = inInc[1]*ts->InDims[1];
+  outInc[0] = nc;
+  outInc[1] = outInc[0]*ts->OutDims[0];
+  outInc[2] = outInc[1]*ts->OutDims[1];
+
+  // each thread does a contiguous block of lines
+  vtkIdType numLines =
+    static_cast<vtkIdType>(ts->InDims[axis1])*ts->InDims[axis2]*nc;
+  vtkIdType firstLine = (numLines*ti->ThreadID)/ts->NumberOfThreads;
+  vtkIdType lastLine = (numLines*(ti->ThreadID + 1))/ts->NumberOfThreads;
+
+  std::vector<double> line(n);
+  std::vector<double> work(n);
+
+  for (vtkIdType l = firstLine; l < lastLine; l++)
+    {
+    int c = static_cast<int>(l % nc);
+    vtkIdType rest = l/nc;
+    int i1 = static_cast<int>(rest % ts->InDims[axis1]);
+    int i2 = static_cast<int>(rest/ts->InDims[axis1]);
+
+    const W *inPtr = ts->InPtr + c + i1*inInc[axis1] + i2*inInc[axis2];
+    W *outPtr = ts->OutPtr + c + i1*outInc[axis1] + i2*outInc[axis2];
+
+    vtkIdType inStep = inInc[axis];
+    for (int i = 0; i < n; i++)
+      {
+      line[i] = inPtr[i*inStep];
+      }
+
+    if (ts->Blur)
+      {
+      vtkGaussianPyramidBlurLine(
+        &line[0], &work[0], n, ts->Coefficients, ts->Matrix);
+      }
+
+    // resample the line
+    vtkIdType outStep = outInc[axis];
+    double x = ts->Start;
+    for (int i = 0; i < m; i++)
+      {
+      double v;
+      if (ts->Interpolate)
+        {
+        int j = static_cast<int>(floor(x));
+        double f = x - j;
+        if (j < 0)
+          {
+          j = 0;
+          f = 0.0;
+          }
+        if (j >= n - 1)
+          {
+          j = n - 1;
+          f = 0.0;
+          }
+        v = line[j];
+        if (f != 0.0)
+          {
+          v += f*(line[j+1] - v);
+          }
+        }
+      else
+        {
+        int j = static_cast<int>(floor(x + 0.5));
+        j = (j > 0 ? j : 0);
+        j = (j < n - 1 ? j : n - 1);
+        v = line[j];
+        }
+      outPtr[i*outStep] = static_cast<W>(v);
+      x += ts->Step;
+      }
+    }
+
+  return VTK_THREAD_RETURN_VALUE;
+}
+
+// Blur and decimate the image, using working buffers of a type that
+// can hold the input values without loss of precision.
+template<class T>
+void vtkGaussianPyramidExecute(
+  vtkImageGaussianPyramid *self, const T *inPtr, T *outPtr,
+  const int inDims[3], int nc, const int outExt[6], const double sigma[3],
+  const double start[3], const double step[3], bool interpolate,
+  int numThreads)
+{
+  typedef typename vtkGaussianPyramidWorkType<T>::Type W;
+
+  int dims[3];
+  dims[0] = inDims[0];
+  dims[1] = inDims[1];
+  dims[2] = inDims[2];
+  vtkIdType n = static_cast<vtkIdType>(dims[0])*dims[1]*dims[2]*nc;
+
+  std::vector<W> buffer(n);
+  std::vector<W> nextBuffer;
+  vtkGaussianPyramidCopyIn(inPtr, &buffer[0], n);
+
+  // blur and decimate along each axis in turn
+  for (int axis = 0; axis < 3; axis++)
+    {
+    if (sigma[axis] == 0.0 && step[axis] == 1.0)
+      {
+      continue;
+      }
+
+    vtkImageGaussianPyramidThreadStruct<W> ts;
+    ts.NumberOfComponents = nc;
+    ts.Axis = axis;
+    for (int j = 0; j < 3; j++)
+      {
+      ts.InDims[j] = dims[j];
+      ts.OutDims[j] = dims[j];
+      }
+    ts.OutDims[axis] = outExt[2*axis+1] - outExt[2*axis] + 1;
+    ts.Blur = (sigma[axis] > 0.0 && dims[axis] > 1);
+    ts.Interpolate = interpolate;
+    ts.Start = start[axis];
+    ts.Step = step[axis];
+    if (ts.Blur)
+      {
+      vtkGaussianPyramidCoefficients(sigma[axis], ts.Coefficients);
+      vtkGaussianPyramidBoundaryMatrix(ts.Coefficients, ts.Matrix);
+      }
+
+    vtkIdType m = static_cast<vtkIdType>(ts.OutDims[0])*ts.OutDims[1]*
+      ts.OutDims[2]*nc;
+    nextBuffer.resize(m);
+    ts.InPtr = &buffer[0];
+    ts.OutPtr = &nextBuffer[0];
+
+    vtkIdType numLines = n/dims[axis];
+    int threads = numThreads;
+    if (threads > numLines)
+      {
+      threads = static_cast<int>(numLines);
+      }
+
+    // the threader limits the number of threads to VTK_MAX_THREADS
+    vtkMultiThreader *threader = vtkMultiThreader::New();
+    threader->SetNumberOfThreads(threads);
+    ts.NumberOfThreads = threader->GetNumberOfThreads();
+    threader->SetSingleMethod(vtkImageGaussianPyramidThreadExecute<W>, &ts);
+    threader->SingleMethodExecute();
+    threader->Delete();
+
+    buffer.swap(nextBuffer);
+    dims[axis] = ts.OutDims[axis];
+    n = m;
+
+    self->UpdateProgress((axis + 1)/3.0);
+    }
+
+  vtkGaussianPyramidCopyOut(&buffer[0], outPtr, n);
+}
+
+} // end anonymous namespace
+
+//----------------------------------------------------------------------------
+int vtkImageGaussianPyramid::RequestData(
+  vtkInformation *vtkNotUsed(request),
+  vtkInformationVector **inputVector,
+  vtkInformationVector *outputVector)
+{
+  vtkInformation *inInfo = inputVector[0]->GetInformationObject(0);
+  vtkInformation *outInfo = outputVector->GetInformationObject(0);
+
+  vtkImageData *input = vtkImageData::SafeDownCast(
+    inInfo->Get(vtkDataObject::DATA_OBJECT()));
+  vtkImageData *output = vtkImageData::SafeDownCast(
+    outInfo->Get(vtkDataObject::DATA_OBJECT()));
+
+  int inExt[6];
+  double inSpacing[3];
+  double inOrigin[3];
+  input->GetExtent(inExt);
+  input->GetSpacing(inSpacing);
+  input->GetOrigin(inOrigin);
+
+  int outExt[6];
+  double outSpacing[3];
+  double outOrigin[3];
+  double start[3];
+  double step[3];
+  double sigma[3];
+  bool identity = true;
+  for (int j = 0; j < 3; j++)
+    {
+    this->ComputeOutputGeometry(j, inExt, inSpacing, inOrigin,
+                                outExt, outSpacing, outOrigin,
+                                &start[j], &step[j]);
+
+    // the input is assumed to have a blur of half a voxel already
+    double b = this->BlurFactors[j];
+    sigma[j] = 0.0;
+    if (this->Interpolate && b > 1.0)
+      {
+      sigma[j] = 0.5*sqrt(b*b - 1.0);
+      }
+
+    identity &= (sigma[j] == 0.0 && step[j] == 1.0);
+    }
+
+  vtkDataArray *inScalars = input->GetPointData()->GetScalars();
+  if (!inScalars)
+    {
+    return 1;
+    }
+
+  output->SetExtent(outExt);
+  if (identity)
+    {
+    // no blurring or resampling is needed
+    output->GetPointData()->SetScalars(inScalars);
+    return 1;
+    }
+
+#if VTK_MAJOR_VERSION >= 6
+  this->AllocateOutputData(output, outInfo, outExt);
+#else
+  this->AllocateOutputData(output, outExt);
+#endif
+  vtkDataArray *outScalars = output->GetPointData()->GetScalars();
+
+  int nc = inScalars->GetNumberOfComponents();
+  int dims[3];
+  dims[0] = inExt[1] - inExt[0] + 1;
+  dims[1] = inExt[3] - inExt[2] + 1;
+  dims[2] = inExt[5] - inExt[4] + 1;
+
+  int numThreads = this->NumberOfThreads;
+  if (numThreads <= 0)
+    {
+    numThreads = vtkMultiThreader::GetGlobalDefaultNumberOfThreads();
+    }
+
+  void *inPtr = inScalars->GetVoidPointer(0);
+  void *outPtr = outScalars->GetVoidPointer(0);
+  switch (inScalars->GetDataType())
+    {
+    vtkTemplateAliasMacro(
+      vtkGaussianPyramidExecute(
+        this, static_cast<const VTK_TT *>(inPtr),
+        static_cast<VTK_TT *>(outPtr), dims, nc, outExt,
+        sigma, start, step, (this->Interpolate != 0), numThreads));
+    }
+
+  return 1;
+}
@@ -0,0 +1,111 @@
+/*=========================================================================
+
+  Module: vtkImageGaussianPyramid.h
+
+  Copyright (c) 2016 David Gobbi
+  All rights reserved.
+  See Copyright.txt or http://dgobbi.github.io/bsd3.txt for details.
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notice for more information.
+
+=========================================================================*/
+// .NAME vtkImageGaussianPyramid - Blur and decimate an image.
+// .SECTION Description
+// This filter computes one level of a Gaussian pyramid: it blurs the
+// image with a Gaussian and then resamples it at the requested output
+// spacing.  The blurring is done with a recursive (IIR) Gaussian filter
+// along each axis, as described by Young and van Vliet, so the cost per
+// voxel does not depend on the amount of blurring.  The boundaries are
+// handled as if the edge voxels were repeated, using the method of Triggs
+// and Sdika.  The rows are divided between the threads, and each axis is
+// decimated right after it is blurred, so that the later axes have less
+// data to process.  The work is done in float, unless the input is double
+// or an integer type that float cannot represent exactly, in which case
+// it is done in double.
+// [1] I.T. Young and L.J. van Vliet, "Recursive implementation of the
+//     Gaussian filter," Signal Processing, 44:139-151, 1995.
+// [2] B. Triggs and M. Sdika, "Boundary conditions for Young-van Vliet
+//     recursive filtering," IEEE Trans. Signal Processing, 54(6), 2006.
+// .SECTION See Also
+// vtkImageResize, vtkGaussianInterpolator
+
+#ifndef vtkImageGaussianPyramid_h
+#define vtkImageGaussianPyramid_h
+
+#include "vtkImageAlgorithm.h"
+
+class VTK_EXPORT vtkImageGaussianPyramid : public vtkImageAlgorithm
+{
+public:
+  static vtkImageGaussianPyramid *New();
+  vtkTypeMacro(vtkImageGaussianPyramid, vtkImageAlgorithm);
+  void PrintSelf(ostream& os, vtkIndent indent);
+
+  // Description:
+  // Set the spacing for the output.  A value of zero for any component
+  // means that the input spacing will be used along that axis.  The
+  // output samples are centered within the bounds of the input.
+  vtkSetVector3Macro(OutputSpacing, double);
+  vtkGetVector3Macro(OutputSpacing, double);
+
+  // Description:
+  // Set the blur factors along each axis, in units of the input spacing.
+  // A blur factor of 2 blurs the image to half its original resolution.
+  // Since the input is assumed to already have a blur of half a voxel,
+  // the standard deviation of the Gaussian (in voxels) is half of the
+  // square root of one less than the square of the blur factor.  The
+  // default blur factors of 1.0 result in no blurring.
+  vtkSetVector3Macro(BlurFactors, double);
+  vtkGetVector3Macro(BlurFactors, double);
+
+  // Description:
+  // Turn interpolation on or off (default: On).  If interpolation is off,
+  // then the image is not blurred, and nearest-neighbor interpolation is
+  // used to decimate the image.  This is useful for label images.
+  vtkSetMacro(Interpolate, int);
+  vtkBooleanMacro(Interpolate, int);
+  vtkGetMacro(Interpolate, int);
+
+  // Description:
+  // Set the number of threads.  The default value of zero will use the
+  // default number of threads.
+  vtkSetMacro(NumberOfThreads, int);
+  vtkGetMacro(NumberOfThreads, int);
+
+protected:
+  vtkImageGaussianPyramid();
+  ~vtkImageGaussianPyramid();
+
+  virtual int RequestInformation(vtkInformation *,
+                                 vtkInformationVector **,
+                                 vtkInformationVector *);
+  virtual int RequestUpdateExtent(vtkInformation *,
+                                  vtkInformationVector **,
+                                  vtkInformationVector *);
+  virtual int RequestData(vtkInformation *,
+                          vtkInformationVector **,
+                          vtkInformationVector *);
+
+  // Description:
+  // Compute the output extent and origin along one axis, as well as the
+  // position of the first output sample and the step between samples,
+  // in units of the input spacing.
+  void ComputeOutputGeometry(
+    int axis, const int inExt[6], const double inSpacing[3],
+    const double inOrigin[3], int outExt[6], double outSpacing[3],
+    double outOrigin[3], double *start, double *step);
+
+  double OutputSpacing[3];
+  double BlurFactors[3];
+  int Interpolate;
+  int NumberOfThreads;
+
+private:
+  // Copy constructor and assigment operator are purposely not implemented
+  vtkImageGaussianPyramid(const vtkImageGaussianPyramid&);
+  void operator=(const vtkImageGaussianPyramid&);
+};
+
+#endif /* vtkImageGaussianPyramid_h */
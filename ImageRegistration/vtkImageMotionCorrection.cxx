@@ -0,0 +1,832 @@
+/*=========================================================================
+
+  Module: vtkImageMotionCorrection.cxx
+
+  Copyright (c) 2016 David Gobbi
+  All rights reserved.
+  See Copyright.txt or http://dgobbi.github.io/bsd3.txt for details.
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notice for more information.
+
+=========================================================================*/
+#include "vtkImageMotionCorrection.h"
+#include "vtkImageRegistration.h"
+#include "vtkImageGaussianPyramid.h"
+
+#include <vtkObjectFactory.h>
+#include <vtkImageData.h>
+#include <vtkPointData.h>
+#include <vtkFieldData.h>
+#include <vtkDataSetAttributes.h>
+#include <vtkDoubleArray.h>
+#include <vtkMatrix4x4.h>
+#include <vtkLinearTransform.h>
+#include <vtkTransform.h>
+#include <vtkInformation.h>
+#include <vtkInformationVector.h>
+#include <vtkStreamingDemandDrivenPipeline.h>
+#include <vtkMultiThreader.h>
+#include <vtkTemplateAliasMacro.h>
+#include <vtkVersion.h>
+
+// C++ header files
+#include <vector>
+#include <math.h>
+
+// A macro to assist VTK 5 backwards compatibility
+#if VTK_MAJOR_VERSION >= 6
+#define SET_INPUT_DATA SetInputData
+#else
+#define SET_INPUT_DATA SetInput
+#endif
+
+vtkStandardNewMacro(vtkImageMotionCorrection);
+vtkCxxSetObjectMacro(vtkImageMotionCorrection,InitialMatrix,vtkMatrix4x4);
+
+//----------------------------------------------------------------------------
+vtkImageMotionCorrection::vtkImageMotionCorrection()
+{
+  this->MetricType = vtkImageRegistration::MutualInformation;
+  this->OptimizerType = vtkImageRegistration::Powell;
+  this->InterpolatorType = vtkImageRegistration::Linear;
+  this->TransformType = vtkImageRegistration::Rigid;
+  this->TransformDimensionality = 3;
+  this->JointHistogramSize[0] = 64;
+  this->JointHistogramSize[1] = 64;
+  this->ImageRangePercentiles[0] = 0.0;
+  this->ImageRangePercentiles[1] = 100.0;
+  this->CostTolerance = 1e-4;
+  this->TransformTolerance = 1e-1;
+  this->MaximumNumberOfEvaluations = 1000;
+  this->NumberOfLevels = 2;
+  this->InterpolationMode = VTK_RESLICE_LINEAR;
+  this->NumberOfThreads = 0;
+
+  this->InitialMatrix = 0;
+  this->FrameMatrices = vtkDoubleArray::New();
+  this->FrameMatrices->SetName("FrameMatrices");
+  this->FrameMatrices->SetNumberOfComponents(16);
+
+  this->SetNumberOfInputPorts(2);
+}
+
+//----------------------------------------------------------------------------
+vtkImageMotionCorrection::~vtkImageMotionCorrection()
+{
+  if (this->InitialMatrix)
+    {
+    this->InitialMatrix->Delete();
+    }
+  this->FrameMatrices->Delete();
+}
+
+//----------------------------------------------------------------------------
+void vtkImageMotionCorrection::PrintSelf(ostream& os, vtkIndent indent)
+{
+  this->Superclass::PrintSelf(os, indent);
+
+  os << indent << "MetricType: " << this->MetricType << "\n";
+  os << indent << "OptimizerType: " << this->OptimizerType << "\n";
+  os << indent << "InterpolatorType: " << this->InterpolatorType << "\n";
+  os << indent << "TransformType: " << this->TransformType << "\n";
+  os << indent << "TransformDimensionality: "
+     << this->TransformDimensionality << "\n";
+  os << indent << "JointHistogramSize: " << this->JointHistogramSize[0]
+     << " " << this->JointHistogramSize[1] << "\n";
+  os << indent << "ImageRangePercentiles: "
+     << this->ImageRangePercentiles[0] << " "
+     << this->ImageRangePercentiles[1] << "\n";
+  os << indent << "CostTolerance: " << this->CostTolerance << "\n";
+  os << indent << "TransformTolerance: " << this->TransformTolerance << "\n";
+  os << indent << "MaximumNumberOfEvaluations: "
+     << this->MaximumNumberOfEvaluations << "\n";
+  os << indent << "NumberOfLevels: " << this->NumberOfLevels << "\n";
+  os << indent << "InterpolationMode: " << this->InterpolationMode << "\n";
+  os << indent << "NumberOfThreads: " << this->NumberOfThreads << "\n";
+  os << indent << "InitialMatrix: " << this->InitialMatrix << "\n";
+  os << indent << "FrameMatrices: " << this->FrameMatrices << "\n";
+}
+
+//----------------------------------------------------------------------------
+void vtkImageMotionCorrection::SetReferenceImage(vtkImageData *input)
+{
+#if VTK_MAJOR_VERSION >= 6
+  this->SetInputDataInternal(0, input);
+#else
+  this->SetNthInputConnection(0, 0, (input ? input->GetProducerPort() : 0));
+#endif
+}
+
+//----------------------------------------------------------------------------
+vtkImageData *vtkImageMotionCorrection::GetReferenceImage()
+{
+  if (this->GetNumberOfInputConnections(0) < 1)
+    {
+    return NULL;
+    }
+  return vtkImageData::SafeDownCast(this->GetExecutive()->GetInputData(0, 0));
+}
+
+//----------------------------------------------------------------------------
+void vtkImageMotionCorrection::SetSeries(vtkImageData *input)
+{
+#if VTK_MAJOR_VERSION >= 6
+  this->SetInputDataInternal(1, input);
+#else
+  this->SetNthInputConnection(1, 0, (input ? input->GetProducerPort() : 0));
+#endif
+}
+
+//----------------------------------------------------------------------------
+vtkImageData *vtkImageMotionCorrection::GetSeries()
+{
+  if (this->GetNumberOfInputConnections(1) < 1)
+    {
+    return NULL;
+    }
+  return vtkImageData::SafeDownCast(this->GetExecutive()->GetInputData(1, 0));
+}
+
+//----------------------------------------------------------------------------
+void vtkImageMotionCorrection::GetFrameMatrix(int frame, vtkMatrix4x4 *matrix)
+{
+  if (frame < 0 || frame >= this->FrameMatrices->GetNumberOfTuples())
+    {
+    vtkErrorMacro("GetFrameMatrix: Frame " << frame << " out of range.");
+    matrix->Identity();
+    return;
+    }
+
+  matrix->DeepCopy(this->FrameMatrices->GetPointer(16*frame));
+}
+
+//----------------------------------------------------------------------------
+int vtkImageMotionCorrection::FillInputPortInformation(
+  int vtkNotUsed(port), vtkInformation* info)
+{
+  info->Set(vtkAlgorithm::INPUT_REQUIRED_DATA_TYPE(), "vtkImageData");
+  return 1;
+}
+
+//----------------------------------------------------------------------------
+int vtkImageMotionCorrection::RequestInformation(
+  vtkInformation *vtkNotUsed(request),
+  vtkInformationVector **inputVector,
+  vtkInformationVector *outputVector)
+{
+  vtkInformation *refInfo = inputVector[0]->GetInformationObject(0);
+  vtkInformation *seriesInfo = inputVector[1]->GetInformationObject(0);
+  vtkInformation *outInfo = outputVector->GetInformationObject(0);
+
+  // the output has the geometry of the reference image
+  int extent[6];
+  double spacing[3];
+  double origin[3];
+  refInfo->Get(vtkStreamingDemandDrivenPipeline::WHOLE_EXTENT(), extent);
+  refInfo->Get(vtkDataObject::SPACING(), spacing);
+  refInfo->Get(vtkDataObject::ORIGIN(), origin);
+  outInfo->Set(vtkStreamingDemandDrivenPipeline::WHOLE_EXTENT(), extent, 6);
+  outInfo->Set(vtkDataObject::SPACING(), spacing, 3);
+  outInfo->Set(vtkDataObject::ORIGIN(), origin, 3);
+
+  // the output has the scalar type and the frames of the series
+  int scalarType = VTK_DOUBLE;
+  int numComponents = 1;
+  vtkInformation *scalarInfo = vtkDataObject::GetActiveFieldInformation(
+    seriesInfo, vtkDataObject::FIELD_ASSOCIATION_POINTS,
+    vtkDataSetAttributes::SCALARS);
+  if (scalarInfo)
+    {
+    scalarType = scalarInfo->Get(vtkDataObject::FIELD_ARRAY_TYPE());
+    if (scalarInfo->Has(vtkDataObject::FIELD_NUMBER_OF_COMPONENTS()))
+      {
+      numComponents = scalarInfo->Get(
+        vtkDataObject::FIELD_NUMBER_OF_COMPONENTS());
+      }
+    }
+  vtkDataObject::SetPointDataActiveScalarInfo(
+    outInfo, scalarType, numComponents);
+
+  return 1;
+}
+
+//----------------------------------------------------------------------------
+int vtkImageMotionCorrection::RequestUpdateExtent(
+  vtkInformation *vtkNotUsed(request),
+  vtkInformationVector **inputVector,
+  vtkInformationVector *vtkNotUsed(outputVector))
+{
+  // both inputs are needed in their entirety
+  for (int port = 0; port < 2; port++)
+    {
+    vtkInformation *inInfo = inputVector[port]->GetInformationObject(0);
+    int inExt[6];
+    inInfo->Get(vtkStreamingDemandDrivenPipeline::WHOLE_EXTENT(), inExt);
+    inInfo->Set(vtkStreamingDemandDrivenPipeline::UPDATE_EXTENT(), inExt, 6);
+    }
+
+  return 1;
+}
+
+//----------------------------------------------------------------------------
+namespace {
+
+// Copy one component from an interleaved array to another.
+template<class T>
+void vtkImageMotionCorrectionCopy(
+  const T *inPtr, int inIncrement, T *outPtr, int outIncrement,
+  vtkIdType n)
+{
+  for (vtkIdType i = 0; i < n; i++)
+    {
+    *outPtr = *inPtr;
+    inPtr += inIncrement;
+    outPtr += outIncrement;
+    }
+}
+
+// Copy the data from component "inComp" of array "inArray" into
+// component "outComp" of array "outArray", the types must match.
+void vtkImageMotionCorrectionCopyComponent(
+  vtkDataArray *inArray, int inComp, vtkDataArray *outArray, int outComp)
+{
+  vtkIdType n = inArray->GetNumberOfTuples();
+  int inInc = inArray->GetNumberOfComponents();
+  int outInc = outArray->GetNumberOfComponents();
+  void *inPtr = inArray->GetVoidPointer(inComp);
+  void *outPtr = outArray->GetVoidPointer(outComp);
+
+  switch (inArray->GetDataType())
+    {
+    vtkTemplateAliasMacro(
+      vtkImageMotionCorrectionCopy(
+        static_cast<const VTK_TT *>(inPtr), inInc,
+        static_cast<VTK_TT *>(outPtr), outInc, n));
+    }
+}
+
+struct vtkImageMotionCorrectionThreadStruct;
+
+// The work for the two threads of a worker: the registration of the frame
+// in one slot, and the loading of the next frame into the other slot.
+struct vtkImageMotionCorrectionTask
+{
+  vtkImageMotionCorrectionThreadStruct *Shared;
+  int Worker;
+  int Slot;
+  vtkMatrix4x4 *Matrix;  // NULL if there is no frame to register
+  int NextFrame;         // -1 if there is no frame to load
+};
+
+// Everything that is needed by the worker threads.  All of the objects
+// are created in the main thread.  Each worker has two slots for frames,
+// so that the next frame can be loaded and blurred while the current
+// frame is registered.  For each slot there is a frame image and, for
+// each level, a filter to blur the frame.  Each worker also has its own
+// reslice filter, and for each level its own registration with its own
+// copy of the reference image.
+struct vtkImageMotionCorrectionThreadStruct
+{
+  vtkImageMotionCorrection *Filter;
+  vtkImageData *Series;
+  vtkImageData *Output;
+  double *Matrices;
+  int NumberOfFrames;
+  int NumberOfWorkers;
+  std::vector<vtkImageData *> Frames;
+  std::vector<std::vector<vtkImageGaussianPyramid *> > TargetBlurs;
+  std::vector<std::vector<vtkImageRegistration *> > Registrations;
+  std::vector<vtkImageReslice *> Reslicers;
+  std::vector<vtkTransform *> Transforms;
+  std::vector<vtkMultiThreader *> Prefetchers;
+  std::vector<vtkImageMotionCorrectionTask> Tasks;
+};
+
+// Get the contiguous block of frames [firstFrame, lastFrame) for a worker.
+void vtkImageMotionCorrectionGetBlock(
+  vtkImageMotionCorrectionThreadStruct *ts, int worker,
+  int *firstFrame, int *lastFrame)
+{
+  int n = ts->NumberOfFrames;
+  int m = ts->NumberOfWorkers;
+  *firstFrame = (n*worker)/m;
+  *lastFrame = (n*(worker + 1))/m;
+}
+
+// Set the number of threads that a worker uses for the registration.
+void vtkImageMotionCorrectionSetThreads(
+  vtkImageMotionCorrectionThreadStruct *ts, int worker, int numThreads)
+{
+  size_t numLevels = ts->Registrations[worker].size();
+  for (size_t level = 0; level < numLevels; level++)
+    {
+    ts->Registrations[worker][level]->SetNumberOfThreads(numThreads);
+    for (int slot = 0; slot < 2; slot++)
+      {
+      vtkImageGaussianPyramid *blur = ts->TargetBlurs[2*worker + slot][level];
+      if (blur)
+        {
+        blur->SetNumberOfThreads(numThreads);
+        }
+      }
+    }
+}
+
+// Copy a frame of the series into a slot of a worker, and blur it for
+// each level of the registration.
+void vtkImageMotionCorrectionLoadFrame(
+  vtkImageMotionCorrectionThreadStruct *ts, int worker, int slot, int i)
+{
+  vtkImageData *frame = ts->Frames[2*worker + slot];
+  vtkDataArray *seriesScalars = ts->Series->GetPointData()->GetScalars();
+  vtkDataArray *frameScalars = frame->GetPointData()->GetScalars();
+
+  vtkImageMotionCorrectionCopyComponent(seriesScalars, i, frameScalars, 0);
+  frameScalars->Modified();
+  frame->Modified();
+
+  std::vector<vtkImageGaussianPyramid *>& blurs =
+    ts->TargetBlurs[2*worker + slot];
+  for (size_t level = 0; level < blurs.size(); level++)
+    {
+    if (blurs[level])
+      {
+#if VTK_MAJOR_VERSION >= 6
+      blurs[level]->UpdateWholeExtent();
+#else
+      blurs[level]->GetOutput()->SetUpdateExtentToWholeExtent();
+      blurs[level]->Update();
+#endif
+      }
+    }
+}
+
+// Connect the registrations of a worker to the frame in a slot.  This
+// changes the pipeline of both slots, so it must not be done while a
+// frame is being loaded.
+void vtkImageMotionCorrectionConnectFrame(
+  vtkImageMotionCorrectionThreadStruct *ts, int worker, int slot)
+{
+  size_t numLevels = ts->Registrations[worker].size();
+  for (size_t level = 0; level < numLevels; level++)
+    {
+    vtkImageRegistration *registration = ts->Registrations[worker][level];
+    vtkImageGaussianPyramid *blur = ts->TargetBlurs[2*worker + slot][level];
+    if (blur)
+      {
+      registration->SetTargetImageInputConnection(blur->GetOutputPort());
+      }
+    else
+      {
+      registration->SetTargetImage(ts->Frames[2*worker + slot]);
+      }
+    }
+}
+
+// Register the connected frame of a worker coarse-to-fine, starting from
+// the given matrix.  On return, the matrix holds the result.
+void vtkImageMotionCorrectionRegisterFrame(
+  vtkImageMotionCorrectionThreadStruct *ts, int worker, vtkMatrix4x4 *matrix)
+{
+  size_t numLevels = ts->Registrations[worker].size();
+  for (size_t level = 0; level < numLevels; level++)
+    {
+    vtkImageRegistration *registration = ts->Registrations[worker][level];
+    registration->Initialize(matrix);
+    registration->UpdateRegistration();
+    matrix->DeepCopy(registration->GetTransform()->GetMatrix());
+    }
+}
+
+VTK_THREAD_RETURN_TYPE vtkImageMotionCorrectionTaskExecute(void *arg)
+{
+  vtkMultiThreader::ThreadInfo *ti =
+    static_cast<vtkMultiThreader::ThreadInfo *>(arg);
+  vtkImageMotionCorrectionTask *task =
+    static_cast<vtkImageMotionCorrectionTask *>(ti->UserData);
+
+  // the two slots have separate pipelines, so the threads never update
+  // the same filters
+  if (ti->ThreadID == 0 && task->Matrix)
+    {
+    vtkImageMotionCorrectionRegisterFrame(
+      task->Shared, task->Worker, task->Matrix);
+    }
+  else if (ti->ThreadID == 1 && task->NextFrame >= 0)
+    {
+    vtkImageMotionCorrectionLoadFrame(
+      task->Shared, task->Worker, 1 - task->Slot, task->NextFrame);
+    }
+
+  return VTK_THREAD_RETURN_VALUE;
+}
+
+// Register the frame in a slot of a worker (unless the matrix is NULL),
+// while the next frame (unless it is -1) is loaded into the other slot.
+void vtkImageMotionCorrectionRegisterAndLoad(
+  vtkImageMotionCorrectionThreadStruct *ts, int worker, int slot,
+  vtkMatrix4x4 *matrix, int nextFrame)
+{
+  if (matrix)
+    {
+    vtkImageMotionCorrectionConnectFrame(ts, worker, slot);
+    if (nextFrame < 0)
+      {
+      vtkImageMotionCorrectionRegisterFrame(ts, worker, matrix);
+      return;
+      }
+    }
+  else if (nextFrame < 0)
+    {
+    return;
+    }
+
+  vtkImageMotionCorrectionTask *task = &ts->Tasks[worker];
+  task->Shared = ts;
+  task->Worker = worker;
+  task->Slot = slot;
+  task->Matrix = matrix;
+  task->NextFrame = nextFrame;
+
+  vtkMultiThreader *threader = ts->Prefetchers[worker];
+  threader->SetSingleMethod(vtkImageMotionCorrectionTaskExecute, task);
+  threader->SingleMethodExecute();
+}
+
+// Store the matrix for a frame in row-major order.
+void vtkImageMotionCorrectionStoreMatrix(
+  vtkImageMotionCorrectionThreadStruct *ts, int i, vtkMatrix4x4 *matrix)
+{
+  double *elements = ts->Matrices + 16*i;
+  for (int j = 0; j < 16; j++)
+    {
+    elements[j] = matrix->Element[j/4][j%4];
+    }
+}
+
+VTK_THREAD_RETURN_TYPE vtkImageMotionCorrectionThreadExecute(void *arg)
+{
+  vtkMultiThreader::ThreadInfo *ti =
+    static_cast<vtkMultiThreader::ThreadInfo *>(arg);
+  vtkImageMotionCorrectionThreadStruct *ts =
+    static_cast<vtkImageMotionCorrectionThreadStruct *>(ti->UserData);
+
+  // each thread does a contiguous block of frames
+  int threadId = ti->ThreadID;
+  int firstFrame, lastFrame;
+  vtkImageMotionCorrectionGetBlock(ts, threadId, &firstFrame, &lastFrame);
+
+  vtkImageReslice *reslice = ts->Reslicers[threadId];
+  vtkTransform *transform = ts->Transforms[threadId];
+  vtkDataArray *outScalars = ts->Output->GetPointData()->GetScalars();
+
+  // the first frame of the block was registered before the threads
+  // were started
+  vtkMatrix4x4 *matrix = vtkMatrix4x4::New();
+  matrix->DeepCopy(ts->Matrices + 16*firstFrame);
+
+  int slot = 0;
+  vtkImageMotionCorrectionLoadFrame(ts, threadId, slot, firstFrame);
+
+  for (int i = firstFrame; i < lastFrame; i++)
+    {
+    if (ts->Filter->GetAbortExecute())
+      {
+      break;
+      }
+
+    // warm start from the previous frame, and load the next frame
+    // while this frame is being registered
+    int nextFrame = (i + 1 < lastFrame ? i + 1 : -1);
+    vtkImageMotionCorrectionRegisterAndLoad(
+      ts, threadId, slot, (i > firstFrame ? matrix : NULL), nextFrame);
+    if (i > firstFrame)
+      {
+      vtkImageMotionCorrectionStoreMatrix(ts, i, matrix);
+      }
+
+    // resample the frame onto the reference
+    reslice->SET_INPUT_DATA(ts->Frames[2*threadId + slot]);
+    transform->SetMatrix(matrix);
+    reslice->Update();
+    vtkImageMotionCorrectionCopyComponent(
+      reslice->GetOutput()->GetPointData()->GetScalars(), 0, outScalars, i);
+
+    if (threadId == 0)
+      {
+      ts->Filter->UpdateProgress((i - firstFrame + 1)*1.0/
+                                 (lastFrame - firstFrame));
+      }
+
+    slot = 1 - slot;
+    }
+
+  matrix->Delete();
+
+  return VTK_THREAD_RETURN_VALUE;
+}
+
+} // end anonymous namespace
+
+//----------------------------------------------------------------------------
+int vtkImageMotionCorrection::RequestData(
+  vtkInformation *vtkNotUsed(request),
+  vtkInformationVector **inputVector,
+  vtkInformationVector *outputVector)
+{
+  vtkInformation *refInfo = inputVector[0]->GetInformationObject(0);
+  vtkInformation *seriesInfo = inputVector[1]->GetInformationObject(0);
+  vtkInformation *outInfo = outputVector->GetInformationObject(0);
+
+  vtkImageData *reference = vtkImageData::SafeDownCast(
+    refInfo->Get(vtkDataObject::DATA_OBJECT()));
+  vtkImageData *series = vtkImageData::SafeDownCast(
+    seriesInfo->Get(vtkDataObject::DATA_OBJECT()));
+  vtkImageData *output = vtkImageData::SafeDownCast(
+    outInfo->Get(vtkDataObject::DATA_OBJECT()));
+
+  // the output covers the whole reference image
+  int outExt[6];
+  reference->GetExtent(outExt);
+  output->SetExtent(outExt);
+#if VTK_MAJOR_VERSION >= 6
+  this->AllocateOutputData(output, outInfo, outExt);
+#else
+  this->AllocateOutputData(output, outExt);
+#endif
+
+  int numFrames = series->GetNumberOfScalarComponents();
+  int scalarType = series->GetScalarType();
+
+  this->FrameMatrices->SetNumberOfTuples(numFrames);
+  output->GetFieldData()->AddArray(this->FrameMatrices);
+
+  // compute the reference range once, rather than once per frame, with
+  // the same percentiles that the registrations use for the frames
+  static const double noExpansion[2] = { 0.0, 0.0 };
+  double referenceRange[2];
+  vtkImageRegistration::ComputePercentileRange(
+    reference, NULL, this->ImageRangePercentiles, noExpansion,
+    referenceRange);
+  if (referenceRange[0] >= referenceRange[1])
+    {
+    referenceRange[1] = referenceRange[0] + 1.0;
+    }
+
+  // divide the threads between the frames
+  int numThreads = this->NumberOfThreads;
+  if (numThreads <= 0)
+    {
+    numThreads = vtkMultiThreader::GetGlobalDefaultNumberOfThreads();
+    }
+  int numWorkers = (numThreads < numFrames ? numThreads : numFrames);
+  numWorkers = (numWorkers < VTK_MAX_THREADS ? numWorkers : VTK_MAX_THREADS);
+  int threadsPerWorker = 1;
+  if (numWorkers > 0)
+    {
+    threadsPerWorker = numThreads/numWorkers;
+    }
+
+  // get information about the images
+  double referenceSpacing[3], seriesSpacing[3];
+  reference->GetSpacing(referenceSpacing);
+  series->GetSpacing(seriesSpacing);
+  for (int j = 0; j < 3; j++)
+    {
+    referenceSpacing[j] = fabs(referenceSpacing[j]);
+    seriesSpacing[j] = fabs(seriesSpacing[j]);
+    }
+
+  double minSpacing = referenceSpacing[0];
+  if (minSpacing > referenceSpacing[1])
+    {
+    minSpacing = referenceSpacing[1];
+    }
+  if (minSpacing > referenceSpacing[2])
+    {
+    minSpacing = referenceSpacing[2];
+    }
+
+  int interpolate =
+    (this->InterpolatorType != vtkImageRegistration::Nearest);
+
+  // blur and downsample the reference once for each level, rather than
+  // once per frame, the final level is the reference itself
+  int numLevels = this->NumberOfLevels;
+  std::vector<double> blurFactors(numLevels);
+  std::vector<vtkImageData *> referenceLevels(numLevels);
+  vtkImageGaussianPyramid *referenceBlur = vtkImageGaussianPyramid::New();
+  referenceBlur->SET_INPUT_DATA(reference);
+  referenceBlur->SetInterpolate(interpolate);
+  referenceBlur->SetNumberOfThreads(numThreads);
+
+  for (int level = 0; level < numLevels; level++)
+    {
+    double blurFactor = (1 << (numLevels - level - 1));
+    blurFactors[level] = blurFactor;
+    referenceLevels[level] = vtkImageData::New();
+
+    if (blurFactor < 1.1)
+      {
+      referenceLevels[level]->ShallowCopy(reference);
+      continue;
+      }
+
+    double spacing[3];
+    for (int j = 0; j < 3; j++)
+      {
+      spacing[j] = blurFactor*minSpacing;
+      if (spacing[j] < referenceSpacing[j])
+        {
+        spacing[j] = referenceSpacing[j];
+        }
+      }
+
+    referenceBlur->SetBlurFactors(
+      spacing[0]/referenceSpacing[0],
+      spacing[1]/referenceSpacing[1],
+      spacing[2]/referenceSpacing[2]);
+    referenceBlur->SetOutputSpacing(spacing);
+#if VTK_MAJOR_VERSION >= 6
+    referenceBlur->UpdateWholeExtent();
+#else
+    referenceBlur->GetOutput()->SetUpdateExtentToWholeExtent();
+    referenceBlur->Update();
+#endif
+    referenceLevels[level]->ShallowCopy(referenceBlur->GetOutput());
+    }
+
+  referenceBlur->Delete();
+
+  vtkImageMotionCorrectionThreadStruct ts;
+  ts.Filter = this;
+  ts.Series = series;
+  ts.Output = output;
+  ts.Matrices = this->FrameMatrices->GetPointer(0);
+  ts.NumberOfFrames = numFrames;
+  ts.NumberOfWorkers = numWorkers;
+  ts.Registrations.resize(numWorkers);
+  ts.TargetBlurs.resize(2*numWorkers);
+  ts.Tasks.resize(numWorkers);
+
+  for (int t = 0; t < numWorkers; t++)
+    {
+    // two frames, one to register and one to load
+    for (int slot = 0; slot < 2; slot++)
+      {
+      vtkImageData *frame = vtkImageData::New();
+      frame->SetExtent(series->GetExtent());
+      frame->SetSpacing(series->GetSpacing());
+      frame->SetOrigin(series->GetOrigin());
+#if VTK_MAJOR_VERSION >= 6
+      frame->AllocateScalars(scalarType, 1);
+#else
+      frame->SetScalarType(scalarType);
+      frame->SetNumberOfScalarComponents(1);
+      frame->AllocateScalars();
+#endif
+      ts.Frames.push_back(frame);
+
+      // the frame is blurred, but keeps its full resolution
+      for (int level = 0; level < numLevels; level++)
+        {
+        double blurFactor = blurFactors[level];
+        vtkImageGaussianPyramid *targetBlur = NULL;
+        if (blurFactor >= 1.1)
+          {
+          targetBlur = vtkImageGaussianPyramid::New();
+          targetBlur->SET_INPUT_DATA(frame);
+          targetBlur->SetInterpolate(interpolate);
+          targetBlur->SetBlurFactors(
+            blurFactor*minSpacing/seriesSpacing[0],
+            blurFactor*minSpacing/seriesSpacing[1],
+            blurFactor*minSpacing/seriesSpacing[2]);
+          }
+        ts.TargetBlurs[2*t + slot].push_back(targetBlur);
+        }
+      }
+
+    vtkTransform *transform = vtkTransform::New();
+
+    vtkImageReslice *reslice = vtkImageReslice::New();
+    reslice->SET_INPUT_DATA(ts.Frames[2*t]);
+    reslice->SetOutputExtent(outExt);
+    reslice->SetResliceTransform(transform);
+    reslice->SetInterpolationMode(this->InterpolationMode);
+    reslice->SetNumberOfThreads(threadsPerWorker);
+
+    for (int level = 0; level < numLevels; level++)
+      {
+      double blurFactor = blurFactors[level];
+
+      // the reference is shared via a shallow copy
+      vtkImageData *refCopy = vtkImageData::New();
+      refCopy->ShallowCopy(referenceLevels[level]);
+
+      // the target is set for each frame, see RegisterFrame
+      vtkImageRegistration *registration = vtkImageRegistration::New();
+      registration->SetSourceImage(refCopy);
+      registration->SetSourceImageRange(referenceRange);
+      registration->SetMetricType(this->MetricType);
+      registration->SetOptimizerType(this->OptimizerType);
+      registration->SetInterpolatorType(this->InterpolatorType);
+      registration->SetTransformType(this->TransformType);
+      registration->SetTransformDimensionality(this->TransformDimensionality);
+      registration->SetJointHistogramSize(this->JointHistogramSize);
+      registration->SetImageRangePercentiles(this->ImageRangePercentiles);
+      registration->SetCostTolerance(this->CostTolerance);
+      registration->SetTransformTolerance(
+        this->TransformTolerance*blurFactor);
+      registration->SetMaximumNumberOfEvaluations(
+        this->MaximumNumberOfEvaluations);
+
+      // the output has the geometry of the full-resolution reference
+      if (level == numLevels - 1)
+        {
+        reslice->SetInformationInput(refCopy);
+        }
+
+      ts.Registrations[t].push_back(registration);
+
+      // the registration and the reslice filter hold the reference
+      refCopy->Delete();
+      }
+
+    // the threads that register one frame and load the next
+    vtkMultiThreader *prefetcher = vtkMultiThreader::New();
+    prefetcher->SetNumberOfThreads(2);
+
+    ts.Reslicers.push_back(reslice);
+    ts.Transforms.push_back(transform);
+    ts.Prefetchers.push_back(prefetcher);
+
+    vtkImageMotionCorrectionSetThreads(&ts, t, threadsPerWorker);
+    }
+
+  for (int level = 0; level < numLevels; level++)
+    {
+    referenceLevels[level]->Delete();
+    }
+
+  if (numWorkers > 0)
+    {
+    // register the first frame of each block in sequence with all of the
+    // threads, each starting from the first frame of the previous block,
+    // while the first frame of the next block is loaded
+    vtkMatrix4x4 *matrix = vtkMatrix4x4::New();
+    if (this->InitialMatrix)
+      {
+      matrix->DeepCopy(this->InitialMatrix);
+      }
+    vtkImageMotionCorrectionSetThreads(&ts, 0, numThreads);
+    int firstFrame, lastFrame;
+    vtkImageMotionCorrectionGetBlock(&ts, 0, &firstFrame, &lastFrame);
+    vtkImageMotionCorrectionLoadFrame(&ts, 0, 0, firstFrame);
+    for (int t = 0; t < numWorkers && !this->AbortExecute; t++)
+      {
+      int nextFrame = -1;
+      if (t + 1 < numWorkers)
+        {
+        vtkImageMotionCorrectionGetBlock(&ts, t + 1, &nextFrame, &lastFrame);
+        }
+      vtkImageMotionCorrectionRegisterAndLoad(
+        &ts, 0, t % 2, matrix, nextFrame);
+      vtkImageMotionCorrectionStoreMatrix(&ts, firstFrame, matrix);
+      firstFrame = nextFrame;
+      }
+    vtkImageMotionCorrectionSetThreads(&ts, 0, threadsPerWorker);
+    matrix->Delete();
+
+    vtkMultiThreader *threader = vtkMultiThreader::New();
+    threader->SetNumberOfThreads(numWorkers);
+    threader->SetSingleMethod(vtkImageMotionCorrectionThreadExecute, &ts);
+    threader->SingleMethodExecute();
+    threader->Delete();
+    }
+
+  for (int t = 0; t < numWorkers; t++)
+    {
+    for (int level = 0; level < numLevels; level++)
+      {
+      ts.Registrations[t][level]->Delete();
+      }
+    for (int slot = 0; slot < 2; slot++)
+      {
+      for (int level = 0; level < numLevels; level++)
+        {
+        if (ts.TargetBlurs[2*t + slot][level])
+          {
+          ts.TargetBlurs[2*t + slot][level]->Delete();
+          }
+        }
+      ts.Frames[2*t + slot]->Delete();
+      }
+    ts.Reslicers[t]->Delete();
+    ts.Transforms[t]->Delete();
+    ts.Prefetchers[t]->Delete();
+    }
+
+  return 1;
+}
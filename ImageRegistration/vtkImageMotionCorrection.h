@@ -0,0 +1,207 @@
+/*=========================================================================
+
+  Module: vtkImageMotionCorrection.h
+
+  Copyright (c) 2016 David Gobbi
+  All rights reserved.
+  See Copyright.txt or http://dgobbi.github.io/bsd3.txt for details.
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notice for more information.
+
+=========================================================================*/
+// .NAME vtkImageMotionCorrection - Motion correction for an image series.
+// .SECTION Description
+// This filter registers every frame of a time series to a reference
+// image, and resamples the frames onto the reference image geometry in
+// order to produce a motion-corrected series.  The frames of the series
+// must be stored as the scalar components of the series image, which is
+// how the MINC and NIFTI readers provide 4D data.  A series that does
+// not fit in memory can be corrected in pieces, see SetInitialMatrix().
+// The frames are split into contiguous blocks that are registered in
+// parallel.  Before the blocks are started, the first frame of each block
+// is registered with all of the threads, starting from the transform that
+// was found for the first frame of the previous block.  Within a block,
+// the registration of each frame starts from the transform that was found
+// for the previous frame, and the next frame is copied from the series
+// and blurred by another thread while the frame is being registered.
+// Each frame is registered coarse-to-fine, see SetNumberOfLevels().
+// .SECTION See Also
+// vtkImageRegistration
+
+#ifndef vtkImageMotionCorrection_h
+#define vtkImageMotionCorrection_h
+
+#include "vtkImageAlgorithm.h"
+#include "vtkImageReslice.h" // for the interpolation mode constants
+
+class vtkDoubleArray;
+class vtkMatrix4x4;
+
+class VTK_EXPORT vtkImageMotionCorrection : public vtkImageAlgorithm
+{
+public:
+  static vtkImageMotionCorrection *New();
+  vtkTypeMacro(vtkImageMotionCorrection, vtkImageAlgorithm);
+  void PrintSelf(ostream& os, vtkIndent indent);
+
+  // Description:
+  // The reference image.  Every frame of the series will be registered
+  // to this image, and the output will have the same geometry.
+  void SetReferenceImageInputConnection(vtkAlgorithmOutput *input) {
+    this->SetInputConnection(0, input); }
+  void SetReferenceImage(vtkImageData *input);
+  vtkImageData *GetReferenceImage();
+
+  // Description:
+  // The series, with one scalar component per frame.
+  void SetSeriesInputConnection(vtkAlgorithmOutput *input) {
+    this->SetInputConnection(1, input); }
+  void SetSeries(vtkImageData *input);
+  vtkImageData *GetSeries();
+
+  // Description:
+  // Set the registration metric, as defined in vtkImageRegistration.
+  // The default is MutualInformation.
+  vtkSetMacro(MetricType, int);
+  vtkGetMacro(MetricType, int);
+
+  // Description:
+  // Set the optimizer, as defined in vtkImageRegistration.
+  // The default is Powell.
+  vtkSetMacro(OptimizerType, int);
+  vtkGetMacro(OptimizerType, int);
+
+  // Description:
+  // Set the interpolator used during the registration, as defined in
+  // vtkImageRegistration.  The default is Linear.
+  vtkSetMacro(InterpolatorType, int);
+  vtkGetMacro(InterpolatorType, int);
+
+  // Description:
+  // Set the transform type, as defined in vtkImageRegistration.
+  // The default is Rigid.
+  vtkSetMacro(TransformType, int);
+  vtkGetMacro(TransformType, int);
+
+  // Description:
+  // Set the transform dimensionality.  The default is 3D.
+  vtkSetMacro(TransformDimensionality, int);
+  vtkGetMacro(TransformDimensionality, int);
+
+  // Description:
+  // Set the size of the joint histogram for mutual information.
+  // The default size is 64 by 64.
+  vtkSetVector2Macro(JointHistogramSize, int);
+  vtkGetVector2Macro(JointHistogramSize, int);
+
+  // Description:
+  // Set the percentiles for computing the ranges of the reference image
+  // and of the frames, see vtkImageRegistration.  The default is 0 and
+  // 100, which gives the full range of the data.
+  vtkSetVector2Macro(ImageRangePercentiles, double);
+  vtkGetVector2Macro(ImageRangePercentiles, double);
+
+  // Description:
+  // Set the tolerances for the optimizer.  See vtkImageRegistration.
+  vtkSetMacro(CostTolerance, double);
+  vtkGetMacro(CostTolerance, double);
+  vtkSetMacro(TransformTolerance, double);
+  vtkGetMacro(TransformTolerance, double);
+
+  // Description:
+  // Set the maximum number of metric evaluations for each frame, at each
+  // level of the registration.  The default is 1000.
+  vtkSetMacro(MaximumNumberOfEvaluations, int);
+  vtkGetMacro(MaximumNumberOfEvaluations, int);
+
+  // Description:
+  // Set the number of levels for the coarse-to-fine registration.  At
+  // the first level, the images are blurred, and the reference image is
+  // downsampled, by a factor of 2 to the power of NumberOfLevels minus one.
+  // The blurring is halved at each following level, and the final level
+  // is at full resolution.  The blurred reference images are computed
+  // only once, and are shared by all of the frames.  The default is 2.
+  vtkSetClampMacro(NumberOfLevels, int, 1, 4);
+  vtkGetMacro(NumberOfLevels, int);
+
+  // Description:
+  // Set the matrix that the registration of the first frame starts from.
+  // When a long series is corrected in pieces, this should be set to the
+  // matrix for the last frame of the previous piece.  The default is NULL,
+  // which means that the identity matrix is used.
+  void SetInitialMatrix(vtkMatrix4x4 *matrix);
+  vtkMatrix4x4 *GetInitialMatrix() { return this->InitialMatrix; }
+
+  // Description:
+  // Set the interpolation mode that is used to resample the frames
+  // to produce the output.  The default is linear interpolation.
+  vtkSetClampMacro(InterpolationMode, int,
+                   VTK_RESLICE_NEAREST, VTK_RESLICE_CUBIC);
+  vtkGetMacro(InterpolationMode, int);
+  void SetInterpolationModeToNearestNeighbor() {
+    this->SetInterpolationMode(VTK_RESLICE_NEAREST); }
+  void SetInterpolationModeToLinear() {
+    this->SetInterpolationMode(VTK_RESLICE_LINEAR); }
+  void SetInterpolationModeToCubic() {
+    this->SetInterpolationMode(VTK_RESLICE_CUBIC); }
+
+  // Description:
+  // Set the number of threads.  The frames are divided between the threads,
+  // and any spare threads are used within the registration of each frame.
+  // The default value of zero will use the default number of threads.
+  vtkSetMacro(NumberOfThreads, int);
+  vtkGetMacro(NumberOfThreads, int);
+
+  // Description:
+  // Get the registration matrices for all of the frames, after the filter
+  // has executed.  There are sixteen components per tuple, one tuple per
+  // frame, and each tuple is a 4x4 matrix in row-major order that maps the
+  // reference coordinates to the frame coordinates.  This array is also
+  // added to the field data of the output, with the name "FrameMatrices".
+  vtkDoubleArray *GetFrameMatrices() { return this->FrameMatrices; }
+
+  // Description:
+  // Get the registration matrix for one frame.
+  void GetFrameMatrix(int frame, vtkMatrix4x4 *matrix);
+
+protected:
+  vtkImageMotionCorrection();
+  ~vtkImageMotionCorrection();
+
+  virtual int RequestInformation(vtkInformation *,
+                                 vtkInformationVector **,
+                                 vtkInformationVector *);
+  virtual int RequestUpdateExtent(vtkInformation *,
+                                  vtkInformationVector **,
+                                  vtkInformationVector *);
+  virtual int RequestData(vtkInformation *,
+                          vtkInformationVector **,
+                          vtkInformationVector *);
+  virtual int FillInputPortInformation(int port, vtkInformation *info);
+
+  int MetricType;
+  int OptimizerType;
+  int InterpolatorType;
+  int TransformType;
+  int TransformDimensionality;
+  int JointHistogramSize[2];
+  double ImageRangePercentiles[2];
+  double CostTolerance;
+  double TransformTolerance;
+  int MaximumNumberOfEvaluations;
+  int NumberOfLevels;
+  int InterpolationMode;
+  int NumberOfThreads;
+
+  vtkMatrix4x4 *InitialMatrix;
+  vtkDoubleArray *FrameMatrices;
+
+private:
+  // Copy constructor and assigment operator are purposely not implemented
+  vtkImageMotionCorrection(const vtkImageMotionCorrection&);
+  void operator=(const vtkImageMotionCorrection&);
+};
+
+#endif /* vtkImageMotionCorrection_h */
@@ -168,10 +168,10 @@ void vtkImageMutualInformationExecute(
   double yshift = -binOrigin[1];
   double xscale = 1.0/binSpacing[0];
   double yscale = 1.0/binSpacing[1];
-  int outIncY = numBins[1];
+  int outIncY = numBins[0];
 
-  // iterate over all spans in the stencil
-  while (!inIter.IsAtEnd())
+  // iterate over all spans in the stencil, unless aborted
+  while (!inIter.IsAtEnd() && !self->GetAbortExecute())
     {
     if (inIter.IsInStencil())
       {
@@ -231,10 +231,10 @@ void vtkImageMutualInformationExecutePreScaled(
 
   int xmax = numBins[0] - 1;
   int ymax = numBins[1] - 1;
-  int outIncY = numBins[1];
+  int outIncY = numBins[0];
 
-  // iterate over all spans in the stencil
-  while (!inIter.IsAtEnd())
+  // iterate over all spans in the stencil, unless aborted
+  while (!inIter.IsAtEnd() && !self->GetAbortExecute())
     {
     if (inIter.IsInStencil())
       {
@@ -264,6 +264,63 @@ void vtkImageMutualInformationExecutePreScaled(
     }
 }
 
+//----------------------------------------------------------------------------
+// The second input is in fixed-point bin coordinates with 8 fractional bits,
+// i.e. it was quantized before it was interpolated.  The first input is
+// either in bin coordinates (xShift = 0) or in the same fixed-point
+// coordinates as the second input (xShift = 8).
+template<class T>
+void vtkImageMutualInformationExecuteFixedPoint(
+  vtkImageMutualInformation *self,
+  vtkImageData *inData0, vtkImageData *inData1, vtkImageStencilData *stencil,
+  T *inPtr, unsigned short *inPtr1, const int extent[6],
+  vtkIdType *outPtr, const int numBins[2], vtkIdType pieceId, int xShift)
+{
+  int *ext = const_cast<int *>(extent);
+  vtkImageStencilIterator<T>
+    inIter(inData0, stencil, ext, ((pieceId == 0) ? self : NULL));
+  vtkImageStencilIterator<unsigned short>
+    inIter1(inData1, stencil, ext, NULL);
+
+  int pixelInc = inData0->GetNumberOfScalarComponents();
+  int pixelInc1 = inData1->GetNumberOfScalarComponents();
+
+  int xRound = (1 << xShift) >> 1;
+  int xmax = numBins[0] - 1;
+  int ymax = numBins[1] - 1;
+  int outIncY = numBins[0];
+
+  // iterate over all spans in the stencil, unless aborted
+  while (!inIter.IsAtEnd() && !self->GetAbortExecute())
+    {
+    if (inIter.IsInStencil())
+      {
+      inPtr = inIter.BeginSpan();
+      T *inPtrEnd = inIter.EndSpan();
+      inPtr1 = inIter1.BeginSpan();
+
+      // iterate over all voxels in the span
+      while (inPtr != inPtrEnd)
+        {
+        int x = (*inPtr + xRound) >> xShift;
+        int y = (*inPtr1 + 128) >> 8;
+
+        x = (x < xmax ? x : xmax);
+        y = (y < ymax ? y : ymax);
+
+        vtkIdType *outPtr1 = outPtr + y*outIncY + x;
+
+        (*outPtr1)++;
+
+        inPtr += pixelInc;
+        inPtr1 += pixelInc1;
+        }
+      }
+    inIter.NextSpan();
+    inIter1.NextSpan();
+    }
+}
+
 //----------------------------------------------------------------------------
 // copy one row of the joint histogram to the output, with conversion
 // but without type range checking
@@ -431,6 +488,34 @@ void vtkImageMutualInformation::PieceRequestData(
       static_cast<unsigned char *>(inPtr1),
       extent, outPtr, numBins, pieceId);
     }
+  else if (vtkMath::Floor(binOrigin[0] + 0.5) == 0 &&
+           vtkMath::Floor(binOrigin[1] + 0.5) == 0 &&
+           vtkMath::Floor(binOrigin[0] + binSpacing[0]*maxX + 0.5) == maxX &&
+           vtkMath::Floor(binSpacing[1] + 0.5) == 256 &&
+           maxX <= 255 && maxY <= 255 &&
+           inData0->GetScalarType() == VTK_UNSIGNED_CHAR &&
+           inData1->GetScalarType() == VTK_UNSIGNED_SHORT)
+    {
+    vtkImageMutualInformationExecuteFixedPoint(
+      this, inData0, inData1, stencil,
+      static_cast<unsigned char *>(inPtr0),
+      static_cast<unsigned short *>(inPtr1),
+      extent, outPtr, numBins, pieceId, 0);
+    }
+  else if (vtkMath::Floor(binOrigin[0] + 0.5) == 0 &&
+           vtkMath::Floor(binOrigin[1] + 0.5) == 0 &&
+           vtkMath::Floor(binSpacing[0] + 0.5) == 256 &&
+           vtkMath::Floor(binSpacing[1] + 0.5) == 256 &&
+           maxX <= 255 && maxY <= 255 &&
+           inData0->GetScalarType() == VTK_UNSIGNED_SHORT &&
+           inData1->GetScalarType() == VTK_UNSIGNED_SHORT)
+    {
+    vtkImageMutualInformationExecuteFixedPoint(
+      this, inData0, inData1, stencil,
+      static_cast<unsigned short *>(inPtr0),
+      static_cast<unsigned short *>(inPtr1),
+      extent, outPtr, numBins, pieceId, 8);
+    }
   else switch (inData0->GetScalarType())
     {
     vtkTemplateAliasMacro(
@@ -30,6 +30,14 @@
 // to have some voxel values that are outliers, then a winsorized range
 // should be used (that is, a range that excludes the outliers).
 //
+// If the first input is unsigned char with a range that is equal to the
+// bin indices, then the binning is done with integer arithmetic.  The
+// same is true if the second input is unsigned short with 8 fractional
+// bits, i.e. with a range of zero to 256 times the last bin index, which
+// allows the second input to be interpolated after it has been quantized.
+// If both inputs are unsigned short with 8 fractional bits, then both of
+// them can be interpolated after quantization (for symmetric registration).
+//
 // References:
 //
 //  [1] D. Mattes, D.R. Haynor, H. Vesselle, T. Lewellen and W. Eubank,
@@ -22,12 +22,16 @@
 #include <vtkImageStencilData.h>
 #include <vtkMath.h>
 #include <vtkDoubleArray.h>
+#include <vtkIdTypeArray.h>
 #include <vtkTransform.h>
+#include <vtkGeneralTransform.h>
 #include <vtkMatrixToLinearTransform.h>
 #include <vtkMatrix4x4.h>
 #include <vtkImageReslice.h>
 #include <vtkImageShiftScale.h>
 #include <vtkCommand.h>
+#include <vtkMultiThreader.h>
+#include <vtkMutexLock.h>
 #include <vtkPointData.h>
 #include <vtkCellData.h>
 #include <vtkInformation.h>
@@ -39,6 +43,9 @@
 #include <vtkImageSincInterpolator.h>
 #include <vtkVersion.h>
 
+// Transform header files
+#include "vtkBSplineGridTransform.h"
+
 // Interpolator header files
 #include "vtkLabelInterpolator.h"
 
@@ -52,9 +59,17 @@
 #include "vtkImageCorrelationRatio.h"
 #include "vtkImageCrossCorrelation.h"
 #include "vtkImageNeighborhoodCorrelation.h"
+#include "vtkImageSimilarityMetricInternals.h"
 
 // C header files
 #include <math.h>
+#include <string.h>
+
+// C++ header files
+#include <algorithm>
+#include <map>
+#include <string>
+#include <vector>
 
 // A macro to assist VTK 5 backwards compatibility
 #if VTK_MAJOR_VERSION >= 6
@@ -65,6 +80,26 @@
 #define SET_STENCIL_DATA SetStencil
 #endif
 
+// The type for modification times
+#if VTK_MAJOR_VERSION >= 7
+typedef vtkMTimeType vtkImageRegistrationMTime;
+#else
+typedef unsigned long vtkImageRegistrationMTime;
+#endif
+
+// The range of an image, as computed by ComputeImageRange()
+struct vtkImageRangeCacheEntry
+{
+  vtkImageData *Data;
+  vtkImageStencilData *Stencil;
+  vtkImageRegistrationMTime DataTime;
+  vtkImageRegistrationMTime StencilTime;
+  double Percentiles[2];
+  double Range[2];
+  double Quartiles[2];
+  double Count;
+};
+
 // A helper class for the optimizer
 struct vtkImageRegistrationInfo
 {
@@ -73,6 +108,23 @@ struct vtkImageRegistrationInfo
   vtkImageSimilarityMetric *Metric;
   vtkMatrix4x4 *InitialMatrix;
 
+  // if set, rigid transforms are written directly into this matrix
+  vtkMatrix4x4 *ResliceMatrix;
+
+  // if set, the reslice output is limited to the overlap of the images
+  vtkImageReslice *Reslice;
+  int SourceExtent[6];
+  double SourceOrigin[3];
+  double SourceSpacing[3];
+  double TargetBounds[6];
+
+  // if set, the images are resampled into the halfway space
+  vtkMatrix4x4 *HalfMatrix;
+  vtkMatrix4x4 *InverseHalfMatrix;
+  // if set, the source stencil is resampled into the halfway space
+  vtkImageStencilData *SourceStencil;
+  vtkImageStencilData *HalfwayStencil;
+
   vtkDoubleArray *MetricValues;
   vtkDoubleArray *CostValues;
   vtkDoubleArray *ParameterValues;
@@ -85,8 +137,396 @@ struct vtkImageRegistrationInfo
   double Center[3];
 
   int NumberOfEvaluations;
+  double InitialCost;
+
+  // the trajectory, one entry per iteration, for the convergence monitor
+  std::vector<double> CostHistory;
+  std::vector<double> StepHistory;
+  std::vector<int> EvaluationHistory;
+  std::vector<double> LastParameters;
+
+  // for deformable registration
+  vtkBSplineGridTransform *Deformation;
+  vtkImageData *DeformableSource;
+  vtkImageData *DeformableTarget;
+  vtkImageStencilData *DeformableStencil;
+  int DeformableMetric;
+  int DeformableBins[2];  // source bins, target bins
+  double DeformableRange[2][2];
+  double DeformableStats[5];
+  std::vector<double> DeformableTable;
+  std::vector<double> Gradient;
+  double DeformableCost;
+  double DeformableStep;
+  double DeformableMaximumStep;
+  int DeformableIterations;
+  int NumberOfThreads;
+
+  // the prepared target images, which are shared via a cache
+  std::vector<vtkImageData *> PreparedImages;
+
+  // the image ranges that have been computed
+  std::vector<vtkImageRangeCacheEntry> ImageRanges;
+
+  // for running the registration on a worker thread
+  vtkMultiThreader *Threader;
+  vtkMutexLock *ThreadLock;
+  int ThreadId;
+  int ThreadRunning;
+  int ThreadResult;
+
+  static VTK_THREAD_RETURN_TYPE ThreadExecute(void *arg);
+};
+
+//----------------------------------------------------------------------------
+VTK_THREAD_RETURN_TYPE vtkImageRegistrationInfo::ThreadExecute(void *arg)
+{
+  vtkMultiThreader::ThreadInfo *ti =
+    static_cast<vtkMultiThreader::ThreadInfo *>(arg);
+  vtkImageRegistration *self =
+    static_cast<vtkImageRegistration *>(ti->UserData);
+  vtkImageRegistrationInfo *info = self->RegistrationInfo;
+
+  int result = self->ExecuteRegistration();
+
+  info->ThreadLock->Lock();
+  info->ThreadResult = result;
+  info->ThreadRunning = 0;
+  info->ThreadLock->Unlock();
+
+  return VTK_THREAD_RETURN_VALUE;
+}
+
+namespace {
+
+//----------------------------------------------------------------------------
+// A reslice filter that can bind each thread to the same CPU as the metric
+// thread that will compare the same slab of the output.
+class vtkImageRegistrationReslice : public vtkImageReslice
+{
+public:
+  static vtkImageRegistrationReslice *New();
+  vtkTypeMacro(vtkImageRegistrationReslice, vtkImageReslice);
+
+  bool ThreadAffinity;
+
+protected:
+  vtkImageRegistrationReslice() : ThreadAffinity(false) {}
+
+  void ThreadedRequestData(vtkInformation *request,
+                           vtkInformationVector **inputVector,
+                           vtkInformationVector *outputVector,
+                           vtkImageData ***inData,
+                           vtkImageData **outData,
+                           int outExt[6], int threadId)
+  {
+    vtkImageSimilarityMetricThreadAffinity affinity(
+      this->ThreadAffinity ? threadId : -1);
+
+    this->Superclass::ThreadedRequestData(
+      request, inputVector, outputVector, inData, outData, outExt, threadId);
+  }
+};
+
+vtkStandardNewMacro(vtkImageRegistrationReslice);
+
+//----------------------------------------------------------------------------
+// Copy an image slab by slab, where each slab is copied by the CPU that
+// will process that slab, in order to place it in that CPU's local memory.
+struct vtkImageRegistrationPlaceInfo
+{
+  vtkThreadedImageAlgorithm *Splitter;
+  vtkImageData *Input;
+  vtkImageData *Output;
+  int Extent[6];
+};
+
+VTK_THREAD_RETURN_TYPE vtkImageRegistrationPlaceSlab(void *arg)
+{
+  vtkMultiThreader::ThreadInfo *ti =
+    static_cast<vtkMultiThreader::ThreadInfo *>(arg);
+  vtkImageRegistrationPlaceInfo *info =
+    static_cast<vtkImageRegistrationPlaceInfo *>(ti->UserData);
+
+  int splitExt[6];
+  int total = info->Splitter->SplitExtent(
+    splitExt, info->Extent, ti->ThreadID, ti->NumberOfThreads);
+
+  if (ti->ThreadID < total &&
+      splitExt[1] >= splitExt[0] &&
+      splitExt[3] >= splitExt[2] &&
+      splitExt[5] >= splitExt[4])
+    {
+    vtkImageSimilarityMetricThreadAffinity affinity(ti->ThreadID);
+
+    size_t rowSize = (splitExt[1] - splitExt[0] + 1);
+    rowSize *= info->Input->GetScalarSize();
+    rowSize *= info->Input->GetNumberOfScalarComponents();
+
+    for (int z = splitExt[4]; z <= splitExt[5]; z++)
+      {
+      for (int y = splitExt[2]; y <= splitExt[3]; y++)
+        {
+        memcpy(info->Output->GetScalarPointer(splitExt[0], y, z),
+               info->Input->GetScalarPointer(splitExt[0], y, z), rowSize);
+        }
+      }
+    }
+
+  return VTK_THREAD_RETURN_VALUE;
+}
+
+void vtkImageRegistrationPlaceImage(
+  vtkImageData *input, vtkImageData *output,
+  vtkThreadedImageAlgorithm *splitter, int numberOfThreads)
+{
+  output->Initialize();
+  output->CopyStructure(input);
+#if VTK_MAJOR_VERSION >= 6
+  output->AllocateScalars(input->GetScalarType(),
+                          input->GetNumberOfScalarComponents());
+#else
+  output->SetScalarType(input->GetScalarType());
+  output->SetNumberOfScalarComponents(input->GetNumberOfScalarComponents());
+  output->AllocateScalars();
+#endif
+
+  vtkImageRegistrationPlaceInfo info;
+  info.Splitter = splitter;
+  info.Input = input;
+  info.Output = output;
+  input->GetExtent(info.Extent);
+
+  vtkMultiThreader *threader = vtkMultiThreader::New();
+  threader->SetNumberOfThreads(numberOfThreads);
+  threader->SetSingleMethod(vtkImageRegistrationPlaceSlab, &info);
+  threader->SingleMethodExecute();
+  threader->Delete();
+}
+
+//----------------------------------------------------------------------------
+// A cache of prepared (typecast, quantized, or prefiltered) images, so
+// that registrations that use the same image share a single copy and the
+// preparation is only done once, even if Initialize() is called again.
+// The key is the identity and the modification time of the input, plus
+// the parameters of the operation.  Each registration holds a reference
+// to the entries that it uses, and an entry is removed when the last
+// registration that uses it releases it.
+enum { vtkPreparedShiftScale, vtkPreparedBSpline };
+
+struct vtkPreparedImageKey
+{
+  vtkImageData *Input;
+  vtkImageRegistrationMTime InputTime;
+  int Operation;
+  int ScalarType;
+  int Clamp;
+  double Shift;
+  double Scale;
+
+  bool operator<(const vtkPreparedImageKey& other) const
+  {
+    if (this->Input != other.Input) { return (this->Input < other.Input); }
+    if (this->InputTime != other.InputTime)
+      {
+      return (this->InputTime < other.InputTime);
+      }
+    if (this->Operation != other.Operation)
+      {
+      return (this->Operation < other.Operation);
+      }
+    if (this->ScalarType != other.ScalarType)
+      {
+      return (this->ScalarType < other.ScalarType);
+      }
+    if (this->Clamp != other.Clamp) { return (this->Clamp < other.Clamp); }
+    if (this->Shift != other.Shift) { return (this->Shift < other.Shift); }
+    return (this->Scale < other.Scale);
+  }
+};
+
+// Each entry has its own lock, which is held while the image is computed,
+// so that the image is only computed once but unrelated images can be
+// computed at the same time.
+struct vtkPreparedImageEntry
+{
+  vtkImageData *Image;
+  int Users;
+  vtkSimpleMutexLock Lock;
+
+  vtkPreparedImageEntry() : Image(NULL), Users(0) {}
+};
+
+typedef std::map<vtkPreparedImageKey, vtkPreparedImageEntry *>
+  vtkPreparedImageMap;
+
+// The cache is created on first use, and it owns its entries.
+class vtkPreparedImageCache
+{
+public:
+  static vtkPreparedImageCache *GetInstance()
+  {
+    static vtkPreparedImageCache cache;
+    return &cache;
+  }
+
+  ~vtkPreparedImageCache()
+  {
+    for (vtkPreparedImageMap::iterator iter = this->Entries.begin();
+         iter != this->Entries.end(); ++iter)
+      {
+      if (iter->second->Image)
+        {
+        iter->second->Image->Delete();
+        }
+      delete iter->second;
+      }
+  }
+
+  // Get an entry, and add a user to it.  The entry is created if
+  // it does not exist, in which case its Image will be NULL.
+  vtkPreparedImageEntry *Acquire(const vtkPreparedImageKey& key)
+  {
+    this->Lock.Lock();
+    vtkPreparedImageEntry *entry = NULL;
+    vtkPreparedImageMap::iterator iter = this->Entries.find(key);
+    if (iter != this->Entries.end())
+      {
+      entry = iter->second;
+      }
+    else
+      {
+      entry = new vtkPreparedImageEntry;
+      this->Entries.insert(std::make_pair(key, entry));
+      }
+    entry->Users++;
+    this->Lock.Unlock();
+    return entry;
+  }
+
+  // Store the image in an entry once it has been computed.  The entry's
+  // own lock must also be held by the caller.
+  void SetImage(vtkPreparedImageEntry *entry, vtkImageData *image)
+  {
+    this->Lock.Lock();
+    entry->Image = image;
+    this->Lock.Unlock();
+  }
+
+  // Remove a user from the entry that holds each image.  Entries that
+  // have no more users are deleted.
+  void Release(const std::vector<vtkImageData *>& images)
+  {
+    this->Lock.Lock();
+    for (size_t i = 0; i < images.size(); i++)
+      {
+      vtkPreparedImageMap::iterator iter = this->Entries.begin();
+      while (iter != this->Entries.end() &&
+             iter->second->Image != images[i])
+        {
+        ++iter;
+        }
+      if (iter != this->Entries.end() && --iter->second->Users == 0)
+        {
+        iter->second->Image->Delete();
+        delete iter->second;
+        this->Entries.erase(iter);
+        }
+      }
+    this->Lock.Unlock();
+  }
+
+private:
+  vtkPreparedImageCache() {}
+
+  vtkPreparedImageMap Entries;
+  vtkSimpleMutexLock Lock;
+};
+
+// Get the prepared image from the cache, or compute it.  Only the lock
+// for the entry is held while the image is computed.
+vtkImageData *vtkPrepareImage(
+  vtkImageRegistrationInfo *info, vtkImageData *input, int operation,
+  int scalarType, double shift, double scale, int clamp)
+{
+  vtkPreparedImageKey key;
+  key.Input = input;
+  key.InputTime = input->GetMTime();
+  key.Operation = operation;
+  key.ScalarType = scalarType;
+  key.Clamp = clamp;
+  key.Shift = shift;
+  key.Scale = scale;
+
+  vtkPreparedImageCache *cache = vtkPreparedImageCache::GetInstance();
+  vtkPreparedImageEntry *entry = cache->Acquire(key);
+
+  entry->Lock.Lock();
+
+  if (entry->Image == NULL)
+    {
+    vtkImageData *image = vtkImageData::New();
+    if (operation == vtkPreparedBSpline)
+      {
+      vtkImageBSplineCoefficients *bspline =
+        vtkImageBSplineCoefficients::New();
+      bspline->SET_INPUT_DATA(input);
+      bspline->SetOutputScalarType(scalarType);
+      bspline->Update();
+      image->ShallowCopy(bspline->GetOutput());
+      bspline->Delete();
+      }
+    else
+      {
+      vtkImageShiftScale *shiftScale = vtkImageShiftScale::New();
+      shiftScale->SET_INPUT_DATA(input);
+      shiftScale->SetOutputScalarType(scalarType);
+      shiftScale->SetClampOverflow(clamp);
+      shiftScale->SetShift(shift);
+      shiftScale->SetScale(scale);
+      shiftScale->Update();
+      image->ShallowCopy(shiftScale->GetOutput());
+      shiftScale->Delete();
+      }
+    cache->SetImage(entry, image);
+    }
+
+  vtkImageData *image = entry->Image;
+
+  entry->Lock.Unlock();
+
+  info->PreparedImages.push_back(image);
+  return image;
+}
+
+// Release prepared images that were returned by vtkPrepareImage().
+void vtkReleasePreparedImages(std::vector<vtkImageData *>& images)
+{
+  vtkPreparedImageCache::GetInstance()->Release(images);
+  images.clear();
+}
+
+// Release the images that were held before a new initialization, but not
+// until the new initialization has acquired the images that it needs.
+class vtkPreparedImageRelease
+{
+public:
+  vtkPreparedImageRelease(std::vector<vtkImageData *>& images)
+  {
+    this->Images.swap(images);
+  }
+
+  ~vtkPreparedImageRelease()
+  {
+    vtkReleasePreparedImages(this->Images);
+  }
+
+private:
+  std::vector<vtkImageData *> Images;
 };
 
+} // end anonymous namespace
+
 //----------------------------------------------------------------------------
 vtkImageRegistration* vtkImageRegistration::New()
 {
@@ -112,17 +552,40 @@ vtkImageRegistration::vtkImageRegistration()
   this->TransformType = vtkImageRegistration::Rigid;
   this->InitializerType = vtkImageRegistration::None;
   this->TransformDimensionality = 3;
+  this->SourceSliceThickness = 0.0;
+  this->DeformableGridSpacing = 0.0;
+  this->NumberOfThreads = 0;
+  this->SinglePrecision = false;
+  this->ThreadAffinity = false;
+  this->Symmetric = false;
+  this->SliceToVolume = false;
 
   this->Transform = vtkTransform::New();
+  this->Deformation = vtkBSplineGridTransform::New();
+  this->DeformableTransform = vtkGeneralTransform::New();
+  this->DeformableTransform->PostMultiply();
+  this->DeformableTransform->Concatenate(this->Deformation);
+  this->DeformableTransform->Concatenate(this->Transform);
   this->Metric = NULL;
   this->Optimizer = NULL;
   this->Interpolator = NULL;
 
   this->RegistrationInfo = new vtkImageRegistrationInfo;
   this->RegistrationInfo->Transform = NULL;
+  this->RegistrationInfo->Threader = NULL;
+  this->RegistrationInfo->ThreadLock = vtkMutexLock::New();
+  this->RegistrationInfo->ThreadId = -1;
+  this->RegistrationInfo->ThreadRunning = 0;
+  this->RegistrationInfo->ThreadResult = 0;
   this->RegistrationInfo->Optimizer = NULL;
   this->RegistrationInfo->Metric = NULL;
   this->RegistrationInfo->InitialMatrix = NULL;
+  this->RegistrationInfo->ResliceMatrix = NULL;
+  this->RegistrationInfo->Reslice = NULL;
+  this->RegistrationInfo->HalfMatrix = NULL;
+  this->RegistrationInfo->InverseHalfMatrix = NULL;
+  this->RegistrationInfo->SourceStencil = NULL;
+  this->RegistrationInfo->HalfwayStencil = NULL;
   this->RegistrationInfo->MetricValues = NULL;
   this->RegistrationInfo->CostValues = NULL;
   this->RegistrationInfo->ParameterValues = NULL;
@@ -131,19 +594,38 @@ vtkImageRegistration::vtkImageRegistration()
   this->RegistrationInfo->OptimizerType = 0;
   this->RegistrationInfo->MetricType = 0;
   this->RegistrationInfo->NumberOfEvaluations = 0;
+  this->RegistrationInfo->InitialCost = 0.0;
+  this->RegistrationInfo->Deformation = this->Deformation;
+  this->RegistrationInfo->DeformableSource = NULL;
+  this->RegistrationInfo->DeformableTarget = NULL;
+  this->RegistrationInfo->DeformableStencil = NULL;
+  this->RegistrationInfo->DeformableMetric = 0;
+  this->RegistrationInfo->DeformableCost = 0.0;
+  this->RegistrationInfo->DeformableStep = 0.0;
+  this->RegistrationInfo->DeformableMaximumStep = 0.0;
+  this->RegistrationInfo->DeformableIterations = 0;
+  this->RegistrationInfo->NumberOfThreads = 1;
 
   this->JointHistogramSize[0] = 64;
   this->JointHistogramSize[1] = 64;
+  this->EffectiveJointHistogramSize[0] = 64;
+  this->EffectiveJointHistogramSize[1] = 64;
+  this->AutomaticHistogramSize = false;
+  this->ImageRangePercentiles[0] = 0.0;
+  this->ImageRangePercentiles[1] = 100.0;
   this->SourceImageRange[0] = 0.0;
   this->SourceImageRange[1] = -1.0;
   this->TargetImageRange[0] = 0.0;
   this->TargetImageRange[1] = -1.0;
 
   this->InitialTransformMatrix = vtkMatrix4x4::New();
-  this->ImageReslice = vtkImageReslice::New();
-  this->ImageBSpline = vtkImageBSplineCoefficients::New();
-  this->TargetImageTypecast = vtkImageShiftScale::New();
-  this->SourceImageTypecast = vtkImageShiftScale::New();
+  this->ResliceMatrix = vtkMatrix4x4::New();
+  this->ImageReslice = vtkImageRegistrationReslice::New();
+  this->SourceReslice = vtkImageRegistrationReslice::New();
+  this->HalfMatrix = vtkMatrix4x4::New();
+  this->InverseHalfMatrix = vtkMatrix4x4::New();
+  this->HalfwayStencil = vtkImageStencilData::New();
+  this->SourceImageCopy = vtkImageData::New();
 
   this->MetricValue = 0.0;
   this->CostValue = 0.0;
@@ -158,6 +640,11 @@ vtkImageRegistration::vtkImageRegistration()
   this->MaximumNumberOfIterations = 500;
   this->MaximumNumberOfEvaluations = 5000;
 
+  this->ConvergenceMonitor = false;
+  this->ConvergenceWindow = 3;
+  this->ConvergenceThreshold = 1.0;
+  this->StoppedByConvergenceMonitor = false;
+
   // we have the image inputs and the optional stencil input
   this->SetNumberOfInputPorts(3);
   this->SetNumberOfOutputPorts(0);
@@ -166,6 +653,19 @@ vtkImageRegistration::vtkImageRegistration()
 //----------------------------------------------------------------------------
 vtkImageRegistration::~vtkImageRegistration()
 {
+  // stop the worker thread, if there is one
+  if (this->RegistrationInfo->ThreadId >= 0)
+    {
+    this->AbortRegistration();
+    this->WaitForRegistration();
+    }
+  if (this->RegistrationInfo->Threader)
+    {
+    this->RegistrationInfo->Threader->Delete();
+    }
+  this->RegistrationInfo->ThreadLock->Delete();
+  vtkReleasePreparedImages(this->RegistrationInfo->PreparedImages);
+
   // delete vtk objects
   if (this->Optimizer)
     {
@@ -179,6 +679,14 @@ vtkImageRegistration::~vtkImageRegistration()
     {
     this->Interpolator->Delete();
     }
+  if (this->DeformableTransform)
+    {
+    this->DeformableTransform->Delete();
+    }
+  if (this->Deformation)
+    {
+    this->Deformation->Delete();
+    }
   if (this->Transform)
     {
     this->Transform->Delete();
@@ -205,21 +713,33 @@ vtkImageRegistration::~vtkImageRegistration()
     {
     this->InitialTransformMatrix->Delete();
     }
+  if (this->ResliceMatrix)
+    {
+    this->ResliceMatrix->Delete();
+    }
   if (this->ImageReslice)
     {
     this->ImageReslice->Delete();
     }
-  if (this->SourceImageTypecast)
+  if (this->SourceReslice)
+    {
+    this->SourceReslice->Delete();
+    }
+  if (this->HalfMatrix)
+    {
+    this->HalfMatrix->Delete();
+    }
+  if (this->InverseHalfMatrix)
     {
-    this->SourceImageTypecast->Delete();
+    this->InverseHalfMatrix->Delete();
     }
-  if (this->TargetImageTypecast)
+  if (this->HalfwayStencil)
     {
-    this->TargetImageTypecast->Delete();
+    this->HalfwayStencil->Delete();
     }
-  if (this->ImageBSpline)
+  if (this->SourceImageCopy)
     {
-    this->ImageBSpline->Delete();
+    this->SourceImageCopy->Delete();
     }
 }
 
@@ -234,6 +754,20 @@ void vtkImageRegistration::PrintSelf(ostream& os, vtkIndent indent)
   os << indent << "TransformType: " << this->TransformType << "\n";
   os << indent << "TransformDimensionality: "
      << this->TransformDimensionality << "\n";
+  os << indent << "NumberOfThreads: " << this->NumberOfThreads << "\n";
+  os << indent << "SinglePrecision: "
+     << (this->SinglePrecision ? "On\n" : "Off\n");
+  os << indent << "ThreadAffinity: "
+     << (this->ThreadAffinity ? "On\n" : "Off\n");
+  os << indent << "Symmetric: "
+     << (this->Symmetric ? "On\n" : "Off\n");
+  os << indent << "SourceSliceThickness: "
+     << this->SourceSliceThickness << "\n";
+  os << indent << "SliceToVolume: "
+     << (this->SliceToVolume ? "On\n" : "Off\n");
+  os << indent << "DeformableGridSpacing: "
+     << this->DeformableGridSpacing << "\n";
+  os << indent << "Deformation: " << this->Deformation << "\n";
   os << indent << "InitializerType: " << this->InitializerType << "\n";
   os << indent << "CostTolerance: " << this->CostTolerance << "\n";
   os << indent << "TransformTolerance: " << this->TransformTolerance << "\n";
@@ -241,12 +775,27 @@ void vtkImageRegistration::PrintSelf(ostream& os, vtkIndent indent)
      << this->MaximumNumberOfIterations << "\n";
   os << indent << "MaximumNumberOfEvaluations: "
      << this->MaximumNumberOfEvaluations << "\n";
+  os << indent << "ConvergenceMonitor: "
+     << (this->ConvergenceMonitor ? "On\n" : "Off\n");
+  os << indent << "ConvergenceWindow: " << this->ConvergenceWindow << "\n";
+  os << indent << "ConvergenceThreshold: "
+     << this->ConvergenceThreshold << "\n";
+  os << indent << "StoppedByConvergenceMonitor: "
+     << (this->StoppedByConvergenceMonitor ? "On\n" : "Off\n");
   os << indent << "JointHistogramSize: " << this->JointHistogramSize[0] << " "
      << this->JointHistogramSize[1] << "\n";
+  os << indent << "AutomaticHistogramSize: "
+     << (this->AutomaticHistogramSize ? "On\n" : "Off\n");
+  os << indent << "EffectiveJointHistogramSize: "
+     << this->EffectiveJointHistogramSize[0] << " "
+     << this->EffectiveJointHistogramSize[1] << "\n";
   os << indent << "SourceImageRange: " << this->SourceImageRange[0] << " "
      << this->SourceImageRange[1] << "\n";
   os << indent << "TargetImageRange: " << this->TargetImageRange[0] << " "
      << this->TargetImageRange[1] << "\n";
+  os << indent << "ImageRangePercentiles: "
+     << this->ImageRangePercentiles[0] << " "
+     << this->ImageRangePercentiles[1] << "\n";
   os << indent << "MetricValue: " << this->MetricValue << "\n";
   os << indent << "CostValue: " << this->CostValue << "\n";
   os << indent << "CollectValues: "
@@ -264,6 +813,12 @@ vtkLinearTransform *vtkImageRegistration::GetTransform()
   return this->Transform;
 }
 
+//----------------------------------------------------------------------------
+vtkAbstractTransform *vtkImageRegistration::GetDeformableTransform()
+{
+  return this->DeformableTransform;
+}
+
 //----------------------------------------------------------------------------
 int vtkImageRegistration::GetNumberOfEvaluations()
 {
@@ -491,115 +1046,1439 @@ void vtkSetTransformParameters(vtkImageRegistrationInfo *registrationInfo)
 }
 
 //--------------------------------------------------------------------------
-void vtkEvaluateFunction(void * arg)
+// Compute the matrix for a Translation or Rigid transform in closed form,
+// i.e. M = T(center + t) * M0 * R(r) * T(-center), without going through
+// the vtkTransform concatenation.  The InitialMatrix must be affine.
+void vtkComputeRigidMatrix(
+  vtkImageRegistrationInfo *registrationInfo, double matrix[16])
 {
-  vtkImageRegistrationInfo *registrationInfo =
-    static_cast<vtkImageRegistrationInfo*>(arg);
-
-  vtkFunctionMinimizer *optimizer = registrationInfo->Optimizer;
-  vtkImageSimilarityMetric *metric = registrationInfo->Metric;
+  vtkFunctionMinimizer* optimizer = registrationInfo->Optimizer;
+  int transformType = registrationInfo->TransformType;
+  int transformDim = registrationInfo->TransformDimensionality;
+  const double *center = registrationInfo->Center;
 
-  vtkSetTransformParameters(registrationInfo);
+  int pcount = 0;
 
-  registrationInfo->Metric->Update();
+  double t[3];
+  t[0] = optimizer->GetParameterValue(pcount++);
+  t[1] = optimizer->GetParameterValue(pcount++);
+  t[2] = 0.0;
+  if (transformDim > 2)
+    {
+    t[2] = optimizer->GetParameterValue(pcount++);
+    }
 
-  optimizer->SetFunctionValue(metric->GetCost());
+  double rx = 0.0;
+  double ry = 0.0;
+  double rz = 0.0;
 
-  if (registrationInfo->MetricValues)
+  if (transformType > vtkImageRegistration::Translation)
     {
-    registrationInfo->MetricValues->InsertNextValue(metric->GetValue());
+    if (transformDim > 2)
+      {
+      rx = optimizer->GetParameterValue(pcount++);
+      ry = optimizer->GetParameterValue(pcount++);
+      }
+    rz = optimizer->GetParameterValue(pcount++);
     }
-  if (registrationInfo->CostValues)
+
+  // the rotation matrix, via the quaternion (see vtkTransformRotation)
+  double rot[3][3] = { { 1.0, 0.0, 0.0 }, { 0.0, 1.0, 0.0 },
+                       { 0.0, 0.0, 1.0 } };
+  double theta2 = rx*rx + ry*ry + rz*rz;
+  if (theta2 > 0)
     {
-    registrationInfo->CostValues->InsertNextValue(metric->GetCost());
+    double theta = sqrt(theta2);
+    double n = sin(0.5*theta);
+    double w = cos(0.5*theta);
+    double f = n/theta;
+    double x = f*rx;
+    double y = f*ry;
+    double z = f*rz;
+
+    double s = w*w - x*x - y*y - z*z;
+
+    rot[0][0] = x*x*2 + s;
+    rot[0][1] = (x*y - w*z)*2;
+    rot[0][2] = (x*z + w*y)*2;
+    rot[1][0] = (x*y + w*z)*2;
+    rot[1][1] = y*y*2 + s;
+    rot[1][2] = (y*z - w*x)*2;
+    rot[2][0] = (x*z - w*y)*2;
+    rot[2][1] = (y*z + w*x)*2;
+    rot[2][2] = z*z*2 + s;
     }
-  if (registrationInfo->ParameterValues)
+
+  // multiply the initial matrix by the rotation, and compute the
+  // translation that keeps the center fixed before applying t
+  const double (*m0)[4] = registrationInfo->InitialMatrix->Element;
+  for (int i = 0; i < 3; i++)
     {
-    double parameters[12];
-    int n = optimizer->GetNumberOfParameters();
-    for (int i = 0; i < n; i++)
+    double *row = &matrix[4*i];
+    double tc = center[i] + t[i];
+    for (int j = 0; j < 3; j++)
       {
-      parameters[i] = optimizer->GetParameterValue(i);
+      row[j] = m0[i][0]*rot[0][j] + m0[i][1]*rot[1][j] + m0[i][2]*rot[2][j];
+      tc -= row[j]*center[j];
       }
-    registrationInfo->ParameterValues->InsertNextTuple(parameters);
+    row[3] = tc;
     }
-
-  registrationInfo->NumberOfEvaluations++;
+  matrix[12] = 0.0;
+  matrix[13] = 0.0;
+  matrix[14] = 0.0;
+  matrix[15] = 1.0;
 }
 
-} // end anonymous namespace
-
 //--------------------------------------------------------------------------
-void vtkImageRegistration::ComputeImageRange(
-  vtkImageData *data, vtkImageStencilData *stencil, double range[2])
+// Limit the output extent of the reslice filter to the part of the source
+// that is overlapped by the transformed target, since the voxels outside
+// of the overlap would be excluded from the metric by the stencil anyway.
+void vtkSetResliceExtent(vtkImageRegistrationInfo *registrationInfo)
 {
-  vtkImageHistogramStatistics *hist =
-    vtkImageHistogramStatistics::New();
-  hist->SET_STENCIL_DATA(stencil);
-  hist->SET_INPUT_DATA(data);
-  hist->SetActiveComponent(0);
-  hist->Update();
+  vtkImageReslice *reslice = registrationInfo->Reslice;
+  if (reslice == NULL)
+    {
+    return;
+    }
 
-  range[0] = hist->GetMinimum();
-  range[1] = hist->GetMaximum();
+  const int *sourceExtent = registrationInfo->SourceExtent;
+  int extent[6];
+  for (int k = 0; k < 6; k++)
+    {
+    extent[k] = sourceExtent[k];
+    }
 
-  if (range[0] >= range[1])
+  vtkMatrix4x4 *matrix = registrationInfo->ResliceMatrix;
+  if (matrix == NULL)
     {
-    range[1] = range[0] + 1.0;
+    matrix = registrationInfo->Transform->GetMatrix();
     }
 
-  hist->SET_INPUT_DATA(NULL);
-  hist->Delete();
+  // the footprint is only computed for affine transforms
+  const double (*m)[4] = matrix->Element;
+  if (m[3][0] == 0.0 && m[3][1] == 0.0 && m[3][2] == 0.0 && m[3][3] == 1.0)
+    {
+    // the transform goes from source to target, so invert it and
+    // find the bounding box of the target corners in the source
+    double inv[16];
+    vtkMatrix4x4::Invert(*matrix->Element, inv);
+
+    const double *bounds = registrationInfo->TargetBounds;
+    double lo[3] = { VTK_DOUBLE_MAX, VTK_DOUBLE_MAX, VTK_DOUBLE_MAX };
+    double hi[3] = { -VTK_DOUBLE_MAX, -VTK_DOUBLE_MAX, -VTK_DOUBLE_MAX };
+    for (int corner = 0; corner < 8; corner++)
+      {
+      double p[3];
+      p[0] = bounds[(corner & 1)];
+      p[1] = bounds[2 + ((corner >> 1) & 1)];
+      p[2] = bounds[4 + ((corner >> 2) & 1)];
+      for (int i = 0; i < 3; i++)
+        {
+        const double *row = &inv[4*i];
+        double x = row[0]*p[0] + row[1]*p[1] + row[2]*p[2] + row[3];
+        lo[i] = (x < lo[i] ? x : lo[i]);
+        hi[i] = (x > hi[i] ? x : hi[i]);
+        }
+      }
+
+    // convert to structured coords, with a margin of one voxel
+    bool overlap = true;
+    for (int i = 0; i < 3; i++)
+      {
+      double origin = registrationInfo->SourceOrigin[i];
+      double spacing = registrationInfo->SourceSpacing[i];
+      double a = (lo[i] - origin)/spacing;
+      double b = (hi[i] - origin)/spacing;
+      if (a > b)
+        {
+        double tmp = a;
+        a = b;
+        b = tmp;
+        }
+      // clamp before converting to int, to avoid overflow
+      double amin = sourceExtent[2*i] - 2;
+      double bmax = sourceExtent[2*i + 1] + 2;
+      a = (a > amin ? a : amin);
+      a = (a < bmax ? a : bmax);
+      b = (b > amin ? b : amin);
+      b = (b < bmax ? b : bmax);
+      int lower = vtkMath::Floor(a) - 1;
+      int upper = vtkMath::Floor(b) + 2;
+      extent[2*i] = (lower > extent[2*i] ? lower : extent[2*i]);
+      extent[2*i + 1] = (upper < extent[2*i + 1] ? upper : extent[2*i + 1]);
+      overlap &= (extent[2*i] <= extent[2*i + 1]);
+      }
+
+    // if there is no overlap, leave it to the metric to deal with
+    if (!overlap)
+      {
+      for (int k = 0; k < 6; k++)
+        {
+        extent[k] = sourceExtent[k];
+        }
+      }
+    }
+
+  reslice->SetOutputExtent(extent);
 }
 
 //--------------------------------------------------------------------------
-void vtkImageRegistration::Initialize(vtkMatrix4x4 *matrix)
+// Compute the square root of a 4x4 matrix, and the inverse of the square
+// root, with the Denman-Beavers iteration.  The matrix must not have any
+// negative real eigenvalues, i.e. rotations must be less than 180 degrees.
+void vtkMatrixSquareRoot(
+  const double a[16], double root[16], double inverseRoot[16])
 {
-  // update our inputs
-  this->Update();
-
-  int transformDim = this->TransformDimensionality;
-  if (transformDim < 2) { transformDim = 2; }
-  if (transformDim > 3) { transformDim = 3; }
-
-  vtkImageData *targetImage = this->GetTargetImage();
-  vtkImageData *sourceImage = this->GetSourceImage();
+  double *y = root;
+  double *z = inverseRoot;
+  double yi[16];
+  double zi[16];
 
-  if (targetImage == NULL || sourceImage == NULL)
+  for (int k = 0; k < 16; k++)
     {
-    vtkErrorMacro("Initialize: Input images are not set");
-    return;
+    y[k] = a[k];
+    z[k] = ((k % 5) == 0 ? 1.0 : 0.0);
     }
 
-  // get the source image center
-  double bounds[6];
-  double center[3];
-  double size[3];
-  sourceImage->GetBounds(bounds);
-  center[0] = 0.5*(bounds[0] + bounds[1]);
-  center[1] = 0.5*(bounds[2] + bounds[3]);
-  center[2] = 0.5*(bounds[4] + bounds[5]);
-  size[0] = (bounds[1] - bounds[0]);
-  size[1] = (bounds[3] - bounds[2]);
-  size[2] = (bounds[5] - bounds[4]);
-
-  vtkTransform *transform = this->Transform;
-  vtkMatrix4x4 *initialMatrix = this->InitialTransformMatrix;
+  for (int iter = 0; iter < 50; iter++)
+    {
+    vtkMatrix4x4::Invert(y, yi);
+    vtkMatrix4x4::Invert(z, zi);
 
-  // create an initial transform
-  initialMatrix->Identity();
-  transform->Identity();
+    double delta = 0.0;
+    double norm = 0.0;
+    for (int k = 0; k < 16; k++)
+      {
+      double yk = 0.5*(y[k] + zi[k]);
+      z[k] = 0.5*(z[k] + yi[k]);
+      delta += fabs(yk - y[k]);
+      norm += fabs(yk);
+      y[k] = yk;
+      }
 
-  // the initial translation
-  double tx = 0.0;
-  double ty = 0.0;
-  double tz = 0.0;
+    if (delta <= 1e-14*norm)
+      {
+      break;
+      }
+    }
+}
 
-  // initialize from the supplied matrix
-  if (matrix)
+//--------------------------------------------------------------------------
+// Get the range [lo, hi] of the indices i within [i0, i1] for which the
+// rounded value of a + b*i lies within [n1, n2].  The range is computed
+// from the endpoints, and then checked against the rounding that is used
+// for each voxel.  Returns false if the range is empty.
+bool vtkStencilIndexRange(
+  double a, double b, int n1, int n2, int i0, int i1, int *lo, int *hi)
+{
+  int l = i0;
+  int h = i1;
+  if (b != 0)
     {
-    // move the translation into tx, ty, tz variables
-    tx = matrix->Element[0][3];
+    double t1 = (n1 - 0.5 - a)/b;
+    double t2 = (n2 + 0.5 - a)/b;
+    double tmin = (t1 < t2 ? t1 : t2);
+    double tmax = (t1 < t2 ? t2 : t1);
+    if (tmin > i0)
+      {
+      l = (tmin > i1 ? i1 : vtkMath::Floor(tmin));
+      }
+    if (tmax < i1)
+      {
+      h = (tmax < i0 ? i0 : vtkMath::Ceil(tmax));
+      }
+    }
+
+  while (l <= h)
+    {
+    int n = vtkMath::Floor(a + b*l + 0.5);
+    if (n >= n1 && n <= n2)
+      {
+      break;
+      }
+    l++;
+    }
+  while (h >= l)
+    {
+    int n = vtkMath::Floor(a + b*h + 0.5);
+    if (n >= n1 && n <= n2)
+      {
+      break;
+      }
+    h--;
+    }
+
+  *lo = l;
+  *hi = h;
+  return (l <= h);
+}
+
+//--------------------------------------------------------------------------
+// Resample a stencil with nearest-neighbor interpolation.  The matrix
+// maps the output coordinates to the input coordinates, and both stencils
+// use the given sampling grid (the input stencil can have any extent).
+// Each output row is split into segments that map to a single input row,
+// and the endpoints of the input spans are mapped back to the output row,
+// so the cost depends on the number of spans rather than on the number
+// of voxels.
+void vtkResampleStencil(
+  vtkImageStencilData *input, vtkMatrix4x4 *matrix,
+  const double origin[3], const double spacing[3], const int extent[6],
+  vtkImageStencilData *output)
+{
+  output->SetOrigin(origin[0], origin[1], origin[2]);
+  output->SetSpacing(spacing[0], spacing[1], spacing[2]);
+  output->SetExtent(const_cast<int *>(extent));
+  output->AllocateExtents();
+
+  // convert the matrix into one that maps index to index
+  double m[3][4];
+  for (int i = 0; i < 3; i++)
+    {
+    for (int j = 0; j < 3; j++)
+      {
+      m[i][j] = matrix->Element[i][j]*spacing[j]/spacing[i];
+      }
+    m[i][3] = (matrix->Element[i][3] - origin[i] +
+               matrix->Element[i][0]*origin[0] +
+               matrix->Element[i][1]*origin[1] +
+               matrix->Element[i][2]*origin[2])/spacing[i];
+    }
+
+  int inExt[6];
+  input->GetExtent(inExt);
+
+  std::vector<std::pair<int, int> > spans;
+
+  for (int k = extent[4]; k <= extent[5]; k++)
+    {
+    for (int j = extent[2]; j <= extent[3]; j++)
+      {
+      // the input index along the row is a[ii] + b[ii]*i
+      double a[3];
+      double b[3];
+      for (int ii = 0; ii < 3; ii++)
+        {
+        a[ii] = m[ii][1]*j + m[ii][2]*k + m[ii][3];
+        b[ii] = m[ii][0];
+        }
+
+      spans.clear();
+      int i = extent[0];
+      while (i <= extent[1])
+        {
+        // find the segment of the row that maps to one input row
+        int jj = vtkMath::Floor(a[1] + b[1]*i + 0.5);
+        int kk = vtkMath::Floor(a[2] + b[2]*i + 0.5);
+        int lo, hi, segEnd;
+        vtkStencilIndexRange(a[1], b[1], jj, jj, i, extent[1], &lo, &hi);
+        segEnd = hi;
+        vtkStencilIndexRange(a[2], b[2], kk, kk, i, extent[1], &lo, &hi);
+        segEnd = (hi < segEnd ? hi : segEnd);
+
+        // map each input span in that row back to the segment
+        int iter = 0;
+        int r1, r2;
+        while (input->GetNextExtent(
+                 r1, r2, inExt[0], inExt[1], jj, kk, iter))
+          {
+          if (r1 <= r2 &&
+              vtkStencilIndexRange(a[0], b[0], r1, r2, i, segEnd, &lo, &hi))
+            {
+            spans.push_back(std::make_pair(lo, hi));
+            }
+          }
+
+        i = segEnd + 1;
+        }
+
+      // the spans are reversed if the row maps backwards, and spans from
+      // neighboring segments might touch, so sort and merge them
+      std::sort(spans.begin(), spans.end());
+      size_t n = spans.size();
+      size_t s = 0;
+      while (s < n)
+        {
+        int r1 = spans[s].first;
+        int r2 = spans[s].second;
+        for (s++; s < n && spans[s].first <= r2 + 1; s++)
+          {
+          r2 = (spans[s].second > r2 ? spans[s].second : r2);
+          }
+        output->InsertNextExtent(r1, r2, j, k);
+        }
+      }
+    }
+
+  output->Modified();
+}
+
+//--------------------------------------------------------------------------
+// For symmetric registration, split the transform into two halves.  The
+// target is resampled with one half, and the source with the inverse.
+void vtkSetHalfMatrices(vtkImageRegistrationInfo *registrationInfo)
+{
+  vtkMatrix4x4 *matrix = registrationInfo->ResliceMatrix;
+  if (matrix == NULL)
+    {
+    matrix = registrationInfo->Transform->GetMatrix();
+    }
+
+  vtkMatrix4x4 *half = registrationInfo->HalfMatrix;
+  vtkMatrix4x4 *inverseHalf = registrationInfo->InverseHalfMatrix;
+  vtkMatrixSquareRoot(*matrix->Element, *half->Element, *inverseHalf->Element);
+  half->Modified();
+  inverseHalf->Modified();
+
+  // the source stencil must be moved into the halfway space
+  if (registrationInfo->SourceStencil)
+    {
+    vtkResampleStencil(
+      registrationInfo->SourceStencil, inverseHalf,
+      registrationInfo->SourceOrigin, registrationInfo->SourceSpacing,
+      registrationInfo->SourceExtent, registrationInfo->HalfwayStencil);
+    }
+}
+
+//--------------------------------------------------------------------------
+void vtkEvaluateFunction(void * arg)
+{
+  vtkImageRegistrationInfo *registrationInfo =
+    static_cast<vtkImageRegistrationInfo*>(arg);
+
+  vtkFunctionMinimizer *optimizer = registrationInfo->Optimizer;
+  vtkImageSimilarityMetric *metric = registrationInfo->Metric;
+
+  vtkMatrix4x4 *resliceMatrix = registrationInfo->ResliceMatrix;
+  if (resliceMatrix)
+    {
+    // fast path: the only modified object is the reslice matrix
+    vtkComputeRigidMatrix(registrationInfo, *resliceMatrix->Element);
+    resliceMatrix->Modified();
+    }
+  else
+    {
+    vtkSetTransformParameters(registrationInfo);
+    }
+
+  if (registrationInfo->HalfMatrix)
+    {
+    vtkSetHalfMatrices(registrationInfo);
+    }
+  else
+    {
+    vtkSetResliceExtent(registrationInfo);
+    }
+
+  registrationInfo->Metric->Update();
+
+  optimizer->SetFunctionValue(metric->GetCost());
+
+  if (registrationInfo->MetricValues)
+    {
+    registrationInfo->MetricValues->InsertNextValue(metric->GetValue());
+    }
+  if (registrationInfo->CostValues)
+    {
+    registrationInfo->CostValues->InsertNextValue(metric->GetCost());
+    }
+  if (registrationInfo->ParameterValues)
+    {
+    double parameters[12];
+    int n = optimizer->GetNumberOfParameters();
+    for (int i = 0; i < n; i++)
+      {
+      parameters[i] = optimizer->GetParameterValue(i);
+      }
+    registrationInfo->ParameterValues->InsertNextTuple(parameters);
+    }
+
+  if (registrationInfo->NumberOfEvaluations == 0)
+    {
+    registrationInfo->InitialCost = metric->GetCost();
+    }
+
+  registrationInfo->NumberOfEvaluations++;
+}
+
+//--------------------------------------------------------------------------
+// Fit a line to the cost as a function of the evaluation count over the
+// last "window" iterations.  Compute the improvement that can be expected
+// if as many evaluations are done again, and compare to the noise floor.
+bool vtkCheckConvergence(
+  vtkImageRegistrationInfo *registrationInfo, int window,
+  double threshold, double costTolerance)
+{
+  size_t n = registrationInfo->CostHistory.size();
+  size_t m = static_cast<size_t>(window) + 1;
+  if (window < 2 || n < m)
+    {
+    return false;
+    }
+
+  const double *y = &registrationInfo->CostHistory[n - m];
+  const double *step = &registrationInfo->StepHistory[n - m];
+  const int *x = &registrationInfo->EvaluationHistory[n - m];
+
+  // the optimizer must no longer be taking large steps
+  for (size_t i = 1; i < m; i++)
+    {
+    if (step[i] >= 1.0)
+      {
+      return false;
+      }
+    }
+
+  // least-squares fit (centered on the means for accuracy)
+  double xm = 0.0;
+  double ym = 0.0;
+  for (size_t i = 0; i < m; i++)
+    {
+    xm += x[i];
+    ym += y[i];
+    }
+  xm /= m;
+  ym /= m;
+
+  double sxx = 0.0;
+  double sxy = 0.0;
+  for (size_t i = 0; i < m; i++)
+    {
+    double dx = x[i] - xm;
+    sxx += dx*dx;
+    sxy += dx*(y[i] - ym);
+    }
+  if (sxx <= 0.0)
+    {
+    // no evaluations were done in the window
+    return true;
+    }
+  double slope = sxy/sxx;
+
+  // the residual of the fit gives the jitter in the cost trajectory
+  double r2 = 0.0;
+  for (size_t i = 0; i < m; i++)
+    {
+    double r = y[i] - ym - slope*(x[i] - xm);
+    r2 += r*r;
+    }
+  double noise = sqrt(r2/(m - 2));
+
+  // the cost tolerance provides a lower bound for the noise floor
+  double noiseFloor = costTolerance*fabs(y[m - 1]);
+  noise = (noise > noiseFloor ? noise : noiseFloor);
+
+  // expected improvement for the same number of evaluations again
+  double gain = -slope*(x[m - 1] - x[0]);
+
+  return (gain <= threshold*noise);
+}
+
+//--------------------------------------------------------------------------
+// Deformable registration.  The cost is computed with one pass over the
+// source voxels, and the derivative of the cost with respect to all of the
+// control points is computed with a second pass.  Each voxel only adds to
+// the derivatives of the control points that support it.
+
+// The metrics that can be used for deformable registration
+enum
+{
+  vtkDeformableSquaredDifference,
+  vtkDeformableCorrelation,
+  vtkDeformableMutualInformation
+};
+
+// Sums that are accumulated by each thread
+struct vtkDeformableSums
+{
+  double Count;
+  double Sum[5];
+  std::vector<double> Histogram;
+  std::vector<double> Derivative;
+};
+
+struct vtkDeformableThreadStruct
+{
+  vtkImageRegistrationInfo *Info;
+  vtkImageRegistration *Registration;
+  bool ComputeDerivative;
+  int NumberOfThreads;
+  double Matrix[16];
+  std::vector<vtkDeformableSums> Sums;
+};
+
+// Trilinear interpolation of the target, with the gradient in index
+// coordinates.  Returns false if the point is outside of the target.
+bool vtkDeformableInterpolate(
+  const float *ptr, const int dims[3], const vtkIdType inc[3],
+  const double idx[3], double *value, double grad[3])
+{
+  int i0[3];
+  vtkIdType d[3];
+  double f[3];
+  for (int a = 0; a < 3; a++)
+    {
+    if (dims[a] == 1)
+      {
+      if (idx[a] < -0.5 || idx[a] > 0.5)
+        {
+        return false;
+        }
+      i0[a] = 0;
+      d[a] = 0;
+      f[a] = 0.0;
+      }
+    else
+      {
+      if (idx[a] < 0.0 || idx[a] > dims[a] - 1)
+        {
+        return false;
+        }
+      int i = static_cast<int>(idx[a]);
+      i = (i < dims[a] - 1 ? i : dims[a] - 2);
+      i0[a] = i;
+      d[a] = inc[a];
+      f[a] = idx[a] - i;
+      }
+    }
+
+  const float *p = ptr + i0[0]*inc[0] + i0[1]*inc[1] + i0[2]*inc[2];
+  double v000 = p[0];
+  double v100 = p[d[0]];
+  double v010 = p[d[1]];
+  double v110 = p[d[0] + d[1]];
+  double v001 = p[d[2]];
+  double v101 = p[d[0] + d[2]];
+  double v011 = p[d[1] + d[2]];
+  double v111 = p[d[0] + d[1] + d[2]];
+
+  double fx = f[0], fy = f[1], fz = f[2];
+  double rx = 1.0 - fx, ry = 1.0 - fy, rz = 1.0 - fz;
+
+  // interpolate along x first
+  double v00 = rx*v000 + fx*v100;
+  double v10 = rx*v010 + fx*v110;
+  double v01 = rx*v001 + fx*v101;
+  double v11 = rx*v011 + fx*v111;
+  double v0 = ry*v00 + fy*v10;
+  double v1 = ry*v01 + fy*v11;
+  *value = rz*v0 + fz*v1;
+
+  grad[0] = (rz*(ry*(v100 - v000) + fy*(v110 - v010)) +
+             fz*(ry*(v101 - v001) + fy*(v111 - v011)));
+  grad[1] = rz*(v10 - v00) + fz*(v11 - v01);
+  grad[2] = v1 - v0;
+  for (int a = 0; a < 3; a++)
+    {
+    grad[a] = (d[a] ? grad[a] : 0.0);
+    }
+
+  return true;
+}
+
+void vtkDeformableExecuteRows(vtkDeformableThreadStruct *ts, int threadId)
+{
+  vtkImageRegistrationInfo *info = ts->Info;
+  vtkBSplineGridTransform *deformation = info->Deformation;
+  vtkImageData *source = info->DeformableSource;
+  vtkImageData *target = info->DeformableTarget;
+  vtkImageStencilData *stencil = info->DeformableStencil;
+  vtkDeformableSums *sums = &ts->Sums[threadId];
+  bool computeDerivative = ts->ComputeDerivative;
+  int metricType = info->DeformableMetric;
+  const double *m = ts->Matrix;
+
+  int extent[6];
+  double origin[3];
+  double spacing[3];
+  source->GetExtent(extent);
+  source->GetOrigin(origin);
+  source->GetSpacing(spacing);
+  int sourceComponents = source->GetNumberOfScalarComponents();
+
+  int ny = extent[3] - extent[2] + 1;
+  int numRows = ny*(extent[5] - extent[4] + 1);
+  int firstRow = (numRows*threadId)/ts->NumberOfThreads;
+  int lastRow = (numRows*(threadId + 1))/ts->NumberOfThreads;
+
+  int targetExtent[6];
+  int targetDims[3];
+  double targetOrigin[3];
+  double targetSpacing[3];
+  vtkIdType targetInc[3];
+  target->GetExtent(targetExtent);
+  target->GetOrigin(targetOrigin);
+  target->GetSpacing(targetSpacing);
+  target->GetIncrements(targetInc);
+  for (int a = 0; a < 3; a++)
+    {
+    targetDims[a] = targetExtent[2*a + 1] - targetExtent[2*a] + 1;
+    }
+  const float *targetPtr = static_cast<const float *>(
+    target->GetScalarPointer());
+
+  // the values computed by the first pass
+  double n = info->DeformableStats[0];
+  double sourceMean = info->DeformableStats[1];
+  double targetMean = info->DeformableStats[2];
+  double ratio = info->DeformableStats[3];
+  double norm = info->DeformableStats[4];
+  const double *table = (info->DeformableTable.empty() ?
+                         NULL : &info->DeformableTable[0]);
+
+  // the histogram bins for mutual information
+  int sourceBins = info->DeformableBins[0];
+  int targetBins = info->DeformableBins[1];
+  double sourceMin = info->DeformableRange[0][0];
+  double targetMin = info->DeformableRange[1][0];
+  double sourceScale = sourceBins/(info->DeformableRange[0][1] - sourceMin);
+  double targetScale = targetBins/(info->DeformableRange[1][1] - targetMin);
+
+  int nx = deformation->GetGridDimensions()[0];
+  std::vector<double> row(3*nx + 3);
+  std::vector<double> rowDerivative(3*nx + 3);
+
+  for (int r = firstRow; r < lastRow; r++)
+    {
+    if (ts->Registration->GetAbortExecute())
+      {
+      break;
+      }
+
+    int j = extent[2] + r % ny;
+    int k = extent[4] + r / ny;
+    double y = origin[1] + spacing[1]*j;
+    double z = origin[2] + spacing[2]*k;
+    deformation->ComputeRowCoefficients(y, z, &row[0]);
+
+    bool rowHasDerivative = false;
+    if (computeDerivative)
+      {
+      std::fill(rowDerivative.begin(), rowDerivative.end(), 0.0);
+      }
+
+    // loop over the spans of the stencil (or the whole row)
+    int iter = 0;
+    int r1 = extent[0];
+    int r2 = extent[1];
+    bool moreSpans = true;
+    while (moreSpans)
+      {
+      if (stencil)
+        {
+        if (!stencil->GetNextExtent(r1, r2, extent[0], extent[1], j, k, iter))
+          {
+          break;
+          }
+        }
+      else
+        {
+        moreSpans = false;
+        }
+
+      const float *sourcePtr = static_cast<const float *>(
+        source->GetScalarPointer(r1, j, k));
+
+      for (int i = r1; i <= r2; i++, sourcePtr += sourceComponents)
+        {
+        // deform the source point, then apply the linear transform
+        double x = origin[0] + spacing[0]*i;
+        double u[3];
+        deformation->EvaluateRow(&row[0], x, u);
+        double p[3];
+        p[0] = x + u[0];
+        p[1] = y + u[1];
+        p[2] = z + u[2];
+        double idx[3];
+        for (int a = 0; a < 3; a++)
+          {
+          const double *mrow = &m[4*a];
+          double q = mrow[0]*p[0] + mrow[1]*p[1] + mrow[2]*p[2] + mrow[3];
+          idx[a] = (q - targetOrigin[a])/targetSpacing[a] - targetExtent[2*a];
+          }
+
+        double t;
+        double g[3];
+        if (!vtkDeformableInterpolate(
+              targetPtr, targetDims, targetInc, idx, &t, g))
+          {
+          continue;
+          }
+        double s = *sourcePtr;
+
+        int sb = 0;
+        int tb = 0;
+        if (metricType == vtkDeformableMutualInformation)
+          {
+          sb = static_cast<int>((s - sourceMin)*sourceScale);
+          sb = (sb < 0 ? 0 : (sb < sourceBins ? sb : sourceBins - 1));
+          tb = static_cast<int>((t - targetMin)*targetScale);
+          tb = (tb < 0 ? 0 : (tb < targetBins ? tb : targetBins - 1));
+          }
+
+        if (!computeDerivative)
+          {
+          sums->Count += 1.0;
+          if (metricType == vtkDeformableSquaredDifference)
+            {
+            sums->Sum[0] += (t - s)*(t - s);
+            }
+          else if (metricType == vtkDeformableCorrelation)
+            {
+            sums->Sum[0] += s;
+            sums->Sum[1] += t;
+            sums->Sum[2] += s*s;
+            sums->Sum[3] += t*t;
+            sums->Sum[4] += s*t;
+            }
+          else
+            {
+            sums->Histogram[sb*targetBins + tb] += 1.0;
+            }
+          continue;
+          }
+
+        // the derivative of the cost with respect to the target value
+        double dcost = 0.0;
+        if (metricType == vtkDeformableSquaredDifference)
+          {
+          dcost = 2.0*(t - s)/n;
+          }
+        else if (metricType == vtkDeformableCorrelation)
+          {
+          dcost = -((s - sourceMean) - ratio*(t - targetMean))/norm;
+          }
+        else
+          {
+          dcost = -table[sb*targetBins + tb]/n;
+          }
+
+        // chain rule: the derivative with respect to the displacement
+        double gw[3];
+        for (int a = 0; a < 3; a++)
+          {
+          gw[a] = g[a]/targetSpacing[a];
+          }
+        double d[3];
+        for (int c = 0; c < 3; c++)
+          {
+          d[c] = dcost*(m[c]*gw[0] + m[4 + c]*gw[1] + m[8 + c]*gw[2]);
+          }
+        if (info->TransformDimensionality <= 2)
+          {
+          d[2] = 0.0;
+          }
+
+        deformation->AddToRowDerivative(&rowDerivative[0], x, d);
+        rowHasDerivative = true;
+        }
+      }
+
+    if (rowHasDerivative)
+      {
+      deformation->AccumulateRowDerivative(
+        y, z, &rowDerivative[0], &sums->Derivative[0]);
+      }
+    }
+}
+
+VTK_THREAD_RETURN_TYPE vtkDeformableThreadExecute(void *arg)
+{
+  vtkMultiThreader::ThreadInfo *ti =
+    static_cast<vtkMultiThreader::ThreadInfo *>(arg);
+  vtkDeformableThreadStruct *ts =
+    static_cast<vtkDeformableThreadStruct *>(ti->UserData);
+
+  vtkDeformableExecuteRows(ts, ti->ThreadID);
+
+  return VTK_THREAD_RETURN_VALUE;
+}
+
+// Run one pass over the source image with the given number of threads.
+void vtkDeformableExecute(
+  vtkImageRegistrationInfo *info, vtkImageRegistration *self,
+  bool computeDerivative, vtkDeformableSums *total)
+{
+  vtkImageData *source = info->DeformableSource;
+  int extent[6];
+  source->GetExtent(extent);
+  int numRows = (extent[3] - extent[2] + 1)*(extent[5] - extent[4] + 1);
+  int numThreads = info->NumberOfThreads;
+  numThreads = (numThreads < numRows ? numThreads : numRows);
+  numThreads = (numThreads > 1 ? numThreads : 1);
+
+  vtkDeformableThreadStruct ts;
+  ts.Info = info;
+  ts.Registration = self;
+  ts.ComputeDerivative = computeDerivative;
+  ts.NumberOfThreads = numThreads;
+  vtkMatrix4x4 *matrix = info->Transform->GetMatrix();
+  for (int i = 0; i < 16; i++)
+    {
+    ts.Matrix[i] = matrix->Element[i/4][i%4];
+    }
+
+  size_t histogramSize = 0;
+  if (!computeDerivative &&
+      info->DeformableMetric == vtkDeformableMutualInformation)
+    {
+    histogramSize = static_cast<size_t>(info->DeformableBins[0])*
+                    info->DeformableBins[1];
+    }
+  size_t derivativeSize = 0;
+  if (computeDerivative)
+    {
+    derivativeSize = 3*info->Deformation->GetNumberOfControlPoints();
+    }
+
+  ts.Sums.resize(numThreads);
+  for (int t = 0; t < numThreads; t++)
+    {
+    vtkDeformableSums *sums = &ts.Sums[t];
+    sums->Count = 0.0;
+    for (int l = 0; l < 5; l++)
+      {
+      sums->Sum[l] = 0.0;
+      }
+    sums->Histogram.assign(histogramSize, 0.0);
+    sums->Derivative.assign(derivativeSize, 0.0);
+    }
+
+  if (numThreads > 1)
+    {
+    vtkMultiThreader *threader = vtkMultiThreader::New();
+    threader->SetNumberOfThreads(numThreads);
+    threader->SetSingleMethod(vtkDeformableThreadExecute, &ts);
+    threader->SingleMethodExecute();
+    threader->Delete();
+    }
+  else
+    {
+    vtkDeformableExecuteRows(&ts, 0);
+    }
+
+  // add together the results from all the threads
+  *total = ts.Sums[0];
+  for (int t = 1; t < numThreads; t++)
+    {
+    vtkDeformableSums *sums = &ts.Sums[t];
+    total->Count += sums->Count;
+    for (int l = 0; l < 5; l++)
+      {
+      total->Sum[l] += sums->Sum[l];
+      }
+    for (size_t l = 0; l < histogramSize; l++)
+      {
+      total->Histogram[l] += sums->Histogram[l];
+      }
+    for (size_t l = 0; l < derivativeSize; l++)
+      {
+      total->Derivative[l] += sums->Derivative[l];
+      }
+    }
+}
+
+// Compute the cost for the current deformation, and store the values
+// that are needed to compute the derivative.
+double vtkDeformableComputeCost(
+  vtkImageRegistrationInfo *info, vtkImageRegistration *self)
+{
+  vtkDeformableSums total;
+  vtkDeformableExecute(info, self, false, &total);
+
+  double n = total.Count;
+  double cost = VTK_DOUBLE_MAX;
+  double *stats = info->DeformableStats;
+  stats[0] = n;
+  stats[1] = 0.0;
+  stats[2] = 0.0;
+  stats[3] = 0.0;
+  stats[4] = 1.0;
+  info->DeformableTable.clear();
+
+  if (n > 0)
+    {
+    if (info->DeformableMetric == vtkDeformableSquaredDifference)
+      {
+      cost = total.Sum[0]/n;
+      }
+    else if (info->DeformableMetric == vtkDeformableCorrelation)
+      {
+      double sourceMean = total.Sum[0]/n;
+      double targetMean = total.Sum[1]/n;
+      double sss = total.Sum[2] - n*sourceMean*sourceMean;
+      double stt = total.Sum[3] - n*targetMean*targetMean;
+      double sst = total.Sum[4] - n*sourceMean*targetMean;
+      if (sss > 0 && stt > 0)
+        {
+        double norm = sqrt(sss*stt);
+        cost = -sst/norm;
+        stats[1] = sourceMean;
+        stats[2] = targetMean;
+        stats[3] = sst/stt;
+        stats[4] = norm;
+        }
+      }
+    else
+      {
+      int sourceBins = info->DeformableBins[0];
+      int targetBins = info->DeformableBins[1];
+      const double *h = &total.Histogram[0];
+      std::vector<double> sourceSum(sourceBins, 0.0);
+      std::vector<double> targetSum(targetBins, 0.0);
+      for (int sb = 0; sb < sourceBins; sb++)
+        {
+        for (int tb = 0; tb < targetBins; tb++)
+          {
+          double c = h[sb*targetBins + tb];
+          sourceSum[sb] += c;
+          targetSum[tb] += c;
+          }
+        }
+
+      // the entropies
+      double hs = 0.0;
+      double ht = 0.0;
+      double hst = 0.0;
+      for (int sb = 0; sb < sourceBins; sb++)
+        {
+        double p = sourceSum[sb]/n;
+        hs -= (p > 0 ? p*log(p) : 0.0);
+        for (int tb = 0; tb < targetBins; tb++)
+          {
+          double q = h[sb*targetBins + tb]/n;
+          hst -= (q > 0 ? q*log(q) : 0.0);
+          }
+        }
+      for (int tb = 0; tb < targetBins; tb++)
+        {
+        double p = targetSum[tb]/n;
+        ht -= (p > 0 ? p*log(p) : 0.0);
+        }
+
+      if (info->MetricType ==
+          vtkImageRegistration::NormalizedMutualInformation)
+        {
+        cost = (hst > 0 ? -(hs + ht)/hst : 0.0);
+        }
+      else
+        {
+        cost = -(hs + ht - hst);
+        }
+
+      // the derivative of the pointwise mutual information with respect
+      // to the target value, from differences between adjacent bins
+      std::vector<double> logp(targetBins);
+      double binWidth =
+        (info->DeformableRange[1][1] - info->DeformableRange[1][0])/
+        targetBins;
+      info->DeformableTable.resize(
+        static_cast<size_t>(sourceBins)*targetBins);
+      for (int sb = 0; sb < sourceBins; sb++)
+        {
+        for (int tb = 0; tb < targetBins; tb++)
+          {
+          logp[tb] = log((h[sb*targetBins + tb] + 1.0)/
+                         (targetSum[tb] + sourceBins));
+          }
+        double *dptr = &info->DeformableTable[sb*targetBins];
+        for (int tb = 0; tb < targetBins; tb++)
+          {
+          int t0 = (tb > 0 ? tb - 1 : tb);
+          int t1 = (tb < targetBins - 1 ? tb + 1 : tb);
+          dptr[tb] = (t1 > t0 ?
+                      (logp[t1] - logp[t0])/((t1 - t0)*binWidth) : 0.0);
+          }
+        }
+      }
+    }
+
+  if (info->MetricValues)
+    {
+    info->MetricValues->InsertNextValue(cost);
+    }
+  if (info->CostValues)
+    {
+    info->CostValues->InsertNextValue(cost);
+    }
+  if (info->NumberOfEvaluations == 0)
+    {
+    info->InitialCost = cost;
+    }
+  info->NumberOfEvaluations++;
+
+  return cost;
+}
+
+// Compute the derivative of the cost with respect to the control points,
+// this must be done immediately after computing the cost.
+void vtkDeformableComputeDerivative(
+  vtkImageRegistrationInfo *info, vtkImageRegistration *self)
+{
+  vtkDeformableSums total;
+  if (info->DeformableStats[0] > 0)
+    {
+    vtkDeformableExecute(info, self, true, &total);
+    info->Gradient.swap(total.Derivative);
+    }
+  else
+    {
+    info->Gradient.assign(
+      3*info->Deformation->GetNumberOfControlPoints(), 0.0);
+    }
+}
+
+// Take one step of gradient descent.  The step size is the largest
+// distance that any control point will move, it is increased after
+// every successful step and decreased after every unsuccessful step.
+// Returns zero when the registration has converged.
+int vtkDeformableIterate(
+  vtkImageRegistrationInfo *info, vtkImageRegistration *self,
+  double costTolerance, double transformTolerance)
+{
+  vtkBSplineGridTransform *deformation = info->Deformation;
+
+  // compute the derivative at the starting point
+  if (info->Gradient.empty())
+    {
+    info->DeformableCost = vtkDeformableComputeCost(info, self);
+    if (self->GetAbortExecute())
+      {
+      return 0;
+      }
+    vtkDeformableComputeDerivative(info, self);
+    if (self->GetAbortExecute())
+      {
+      info->Gradient.clear();
+      return 0;
+      }
+    }
+
+  size_t n = info->Gradient.size();
+  double *coeffs = deformation->GetCoefficients()->GetPointer(0);
+  const double *gradient = (n > 0 ? &info->Gradient[0] : NULL);
+
+  double gmax = 0.0;
+  for (size_t i = 0; i < n; i += 3)
+    {
+    double g2 = (gradient[i]*gradient[i] + gradient[i + 1]*gradient[i + 1] +
+                 gradient[i + 2]*gradient[i + 2]);
+    gmax = (g2 > gmax ? g2 : gmax);
+    }
+  gmax = sqrt(gmax);
+  if (gmax <= 0)
+    {
+    return 0;
+    }
+
+  std::vector<double> lastCoeffs(coeffs, coeffs + n);
+  double f = info->DeformableStep/gmax;
+  for (size_t i = 0; i < n; i++)
+    {
+    coeffs[i] -= f*gradient[i];
+    }
+  deformation->Modified();
+
+  double cost = vtkDeformableComputeCost(info, self);
+  info->DeformableIterations++;
+
+  if (!self->GetAbortExecute() && cost < info->DeformableCost)
+    {
+    double improvement = info->DeformableCost - cost;
+    info->DeformableCost = cost;
+    vtkDeformableComputeDerivative(info, self);
+    if (self->GetAbortExecute())
+      {
+      // recompute the derivative when the registration is resumed
+      info->Gradient.clear();
+      return 0;
+      }
+    info->DeformableStep *= 1.5;
+    if (info->DeformableStep > info->DeformableMaximumStep)
+      {
+      info->DeformableStep = info->DeformableMaximumStep;
+      }
+    return (improvement > costTolerance*fabs(cost));
+    }
+
+  // go back to the last position and try a smaller step
+  for (size_t i = 0; i < n; i++)
+    {
+    coeffs[i] = lastCoeffs[i];
+    }
+  deformation->Modified();
+  info->DeformableStep *= 0.5;
+
+  return (!self->GetAbortExecute() &&
+          info->DeformableStep >= transformTolerance);
+}
+
+} // end anonymous namespace
+
+//--------------------------------------------------------------------------
+namespace {
+
+// Find a percentile from the histogram of vtkImageHistogramStatistics
+double vtkHistogramPercentile(
+  vtkImageHistogramStatistics *hist, double percentile)
+{
+  vtkIdTypeArray *histogram = hist->GetHistogram();
+  vtkIdType numBins = histogram->GetNumberOfTuples();
+  double target = 0.01*percentile*hist->GetTotal();
+  double sum = 0.0;
+  vtkIdType bin = 0;
+  while (bin < numBins - 1)
+    {
+    sum += histogram->GetValue(bin);
+    if (sum >= target)
+      {
+      break;
+      }
+    bin++;
+    }
+  return hist->GetBinOrigin() + bin*hist->GetBinSpacing();
+}
+
+// Compute the range and quartiles of an image with one histogram pass
+void vtkComputeImageStatistics(
+  vtkImageData *data, vtkImageStencilData *stencil,
+  const double percentiles[2], const double expansion[2],
+  double range[2], double quartiles[2], double *count)
+{
+  vtkImageHistogramStatistics *hist =
+    vtkImageHistogramStatistics::New();
+  hist->SET_STENCIL_DATA(stencil);
+  hist->SET_INPUT_DATA(data);
+  hist->SetActiveComponent(0);
+  hist->SetAutoRangePercentiles(percentiles[0], percentiles[1]);
+  hist->SetAutoRangeExpansionFactors(expansion[0], expansion[1]);
+  hist->Update();
+
+  // the minimum, maximum, and percentiles all come from the same pass
+  if (percentiles[0] <= 0.0 && percentiles[1] >= 100.0)
+    {
+    range[0] = hist->GetMinimum();
+    range[1] = hist->GetMaximum();
+    }
+  else
+    {
+    hist->GetAutoRange(range);
+    }
+
+  if (quartiles)
+    {
+    quartiles[0] = vtkHistogramPercentile(hist, 25.0);
+    quartiles[1] = vtkHistogramPercentile(hist, 75.0);
+    }
+  if (count)
+    {
+    *count = static_cast<double>(hist->GetTotal());
+    }
+
+  hist->SET_STENCIL_DATA(NULL);
+  hist->SET_INPUT_DATA(NULL);
+  hist->Delete();
+}
+
+} // end anonymous namespace
+
+//--------------------------------------------------------------------------
+void vtkImageRegistration::ComputePercentileRange(
+  vtkImageData *data, vtkImageStencilData *stencil,
+  const double percentiles[2], const double expansion[2], double range[2])
+{
+  vtkComputeImageStatistics(
+    data, stencil, percentiles, expansion, range, NULL, NULL);
+}
+
+//--------------------------------------------------------------------------
+void vtkImageRegistration::ComputeImageRange(
+  vtkImageData *data, vtkImageStencilData *stencil, double range[2])
+{
+  this->ComputeImageStatistics(data, stencil, range, NULL, NULL);
+}
+
+//--------------------------------------------------------------------------
+void vtkImageRegistration::ComputeImageStatistics(
+  vtkImageData *data, vtkImageStencilData *stencil,
+  double range[2], double quartiles[2], double *count)
+{
+  // check whether the range for this image has already been computed
+  std::vector<vtkImageRangeCacheEntry>& cache =
+    this->RegistrationInfo->ImageRanges;
+  vtkImageRegistrationMTime dataTime = data->GetMTime();
+  vtkImageRegistrationMTime stencilTime =
+    (stencil ? stencil->GetMTime() : 0);
+  const double *percentiles = this->ImageRangePercentiles;
+
+  for (size_t i = 0; i < cache.size(); i++)
+    {
+    const vtkImageRangeCacheEntry& entry = cache[i];
+    if (entry.Data == data && entry.DataTime == dataTime &&
+        entry.Stencil == stencil && entry.StencilTime == stencilTime &&
+        entry.Percentiles[0] == percentiles[0] &&
+        entry.Percentiles[1] == percentiles[1])
+      {
+      range[0] = entry.Range[0];
+      range[1] = entry.Range[1];
+      if (quartiles)
+        {
+        quartiles[0] = entry.Quartiles[0];
+        quartiles[1] = entry.Quartiles[1];
+        }
+      if (count)
+        {
+        *count = entry.Count;
+        }
+      return;
+      }
+    }
+
+  static const double noExpansion[2] = { 0.0, 0.0 };
+  vtkImageRangeCacheEntry entry;
+  vtkComputeImageStatistics(
+    data, stencil, percentiles, noExpansion, entry.Range, entry.Quartiles,
+    &entry.Count);
+
+  if (entry.Range[0] >= entry.Range[1])
+    {
+    entry.Range[1] = entry.Range[0] + 1.0;
+    }
+
+  range[0] = entry.Range[0];
+  range[1] = entry.Range[1];
+  if (quartiles)
+    {
+    quartiles[0] = entry.Quartiles[0];
+    quartiles[1] = entry.Quartiles[1];
+    }
+  if (count)
+    {
+    *count = entry.Count;
+    }
+
+  // keep the most recent ranges (e.g. for the source and target)
+  entry.Data = data;
+  entry.Stencil = stencil;
+  entry.DataTime = dataTime;
+  entry.StencilTime = stencilTime;
+  entry.Percentiles[0] = percentiles[0];
+  entry.Percentiles[1] = percentiles[1];
+  if (cache.size() >= 4)
+    {
+    cache.erase(cache.begin());
+    }
+  cache.push_back(entry);
+}
+
+//--------------------------------------------------------------------------
+void vtkImageRegistration::ComputeJointHistogramSize(
+  vtkImageData *source, vtkImageData *target)
+{
+  int *size = this->EffectiveJointHistogramSize;
+  size[0] = this->JointHistogramSize[0];
+  size[1] = this->JointHistogramSize[1];
+
+  if (!this->AutomaticHistogramSize)
+    {
+    return;
+    }
+
+  // the number of samples is the number of source voxels in the stencil
+  double range[2][2];
+  double quartiles[2][2];
+  double count = 0.0;
+  this->ComputeImageStatistics(
+    source, this->GetSourceImageStencil(), range[0], quartiles[0], &count);
+  this->ComputeImageStatistics(
+    target, NULL, range[1], quartiles[1], NULL);
+
+  // use any ranges that were set explicitly
+  if (this->SourceImageRange[0] < this->SourceImageRange[1])
+    {
+    range[0][0] = this->SourceImageRange[0];
+    range[0][1] = this->SourceImageRange[1];
+    }
+  if (this->TargetImageRange[0] < this->TargetImageRange[1])
+    {
+    range[1][0] = this->TargetImageRange[0];
+    range[1][1] = this->TargetImageRange[1];
+    }
+
+  count = (count > 1.0 ? count : 1.0);
+  for (int i = 0; i < 2; i++)
+    {
+    // the Freedman-Diaconis bin width, for a 2D histogram
+    double iqr = quartiles[i][1] - quartiles[i][0];
+    double bins = 0.0;
+    if (iqr > 0.0)
+      {
+      double width = 2.0*iqr/pow(count, 0.25);
+      bins = ceil((range[i][1] - range[i][0])/width);
+      }
+    else
+      {
+      // Sturges' rule
+      bins = ceil(log(count)/log(2.0)) + 1.0;
+      }
+    bins = (bins > 16.0 ? bins : 16.0);
+    bins = (bins < 256.0 ? bins : 256.0);
+    size[i] = static_cast<int>(bins);
+    }
+}
+
+//--------------------------------------------------------------------------
+void vtkImageRegistration::Initialize(vtkMatrix4x4 *matrix)
+{
+  // update our inputs
+  this->Update();
+
+  // the previously prepared images are released on return
+  vtkPreparedImageRelease previousImages(
+    this->RegistrationInfo->PreparedImages);
+
+  int transformDim = this->TransformDimensionality;
+  if (transformDim < 2) { transformDim = 2; }
+  if (transformDim > 3) { transformDim = 3; }
+
+  vtkImageData *targetImage = this->GetTargetImage();
+  vtkImageData *sourceImage = this->GetSourceImage();
+
+  if (targetImage == NULL || sourceImage == NULL)
+    {
+    vtkErrorMacro("Initialize: Input images are not set");
+    return;
+    }
+
+  // get the source image center
+  double bounds[6];
+  double center[3];
+  double size[3];
+  sourceImage->GetBounds(bounds);
+  center[0] = 0.5*(bounds[0] + bounds[1]);
+  center[1] = 0.5*(bounds[2] + bounds[3]);
+  center[2] = 0.5*(bounds[4] + bounds[5]);
+  size[0] = (bounds[1] - bounds[0]);
+  size[1] = (bounds[3] - bounds[2]);
+  size[2] = (bounds[5] - bounds[4]);
+
+  vtkTransform *transform = this->Transform;
+  vtkMatrix4x4 *initialMatrix = this->InitialTransformMatrix;
+
+  // create an initial transform
+  initialMatrix->Identity();
+  transform->Identity();
+
+  // the initial translation
+  double tx = 0.0;
+  double ty = 0.0;
+  double tz = 0.0;
+
+  // initialize from the supplied matrix
+  if (matrix)
+    {
+    // move the translation into tx, ty, tz variables
+    tx = matrix->Element[0][3];
     ty = matrix->Element[1][3];
     tz = matrix->Element[2][3];
 
@@ -644,6 +2523,23 @@ void vtkImageRegistration::Initialize(vtkMatrix4x4 *matrix)
     tz = 0.0;
     }
 
+  // choose the joint histogram size for these images
+  this->ComputeJointHistogramSize(sourceImage, targetImage);
+
+  if (this->TransformType == vtkImageRegistration::Deformable)
+    {
+    this->InitializeDeformable(matrix, sourceImage, targetImage);
+    return;
+    }
+
+  // the deformation is only used for Deformable registration
+  int gridDims[3] = { 0, 0, 0 };
+  double gridSpacing[3] = { 1.0, 1.0, 1.0 };
+  this->Deformation->SetGridGeometry(gridDims, center, gridSpacing);
+  this->RegistrationInfo->DeformableSource = NULL;
+  this->RegistrationInfo->DeformableTarget = NULL;
+  this->RegistrationInfo->DeformableStencil = NULL;
+
   // do the setup for mutual information
   double sourceImageRange[2];
   double targetImageRange[2];
@@ -666,47 +2562,66 @@ void vtkImageRegistration::Initialize(vtkMatrix4x4 *matrix)
         targetImageRange);
       }
 
-    if (this->InterpolatorType == vtkImageRegistration::Nearest &&
-        this->JointHistogramSize[0] <= 256 &&
-        this->JointHistogramSize[1] <= 256)
+    // the source is the first input of the metric, so it is binned along
+    // the first axis of the joint histogram
+    int sourceBins = this->EffectiveJointHistogramSize[0];
+    int targetBins = this->EffectiveJointHistogramSize[1];
+
+    if ((this->InterpolatorType == vtkImageRegistration::Nearest ||
+         this->InterpolatorType == vtkImageRegistration::Linear) &&
+        sourceBins <= 256 && targetBins <= 256)
       {
       // If nearest-neighbor interpolation is used, then the image instensity
       // can be quantized during initialization, instead of being done at each
-      // iteration of the registration.
+      // iteration of the registration.  For linear interpolation, the target
+      // is quantized to bin coordinates with 8 fractional bits, so that the
+      // interpolation is done on 16-bit values and the metric can do the
+      // binning with integer arithmetic.  For symmetric registration, the
+      // source is also interpolated, so it is quantized in the same way.
+      double sourceFactor = 1.0;
+      int sourceType = VTK_UNSIGNED_CHAR;
+      if (this->InterpolatorType == vtkImageRegistration::Linear &&
+          this->Symmetric && !this->SliceToVolume)
+        {
+        sourceFactor = 256.0;
+        sourceType = VTK_UNSIGNED_SHORT;
+        }
 
-      double sourceScale = ((this->JointHistogramSize[1] - 1)/
+      double sourceScale = ((sourceBins - 1)*sourceFactor/
         (sourceImageRange[1] - sourceImageRange[0]));
       // The "0.5/sourceScale" causes the vtkImageShiftScale filter to
       // round the value, instead of truncating it.
       double sourceShift = (-sourceImageRange[0] + 0.5/sourceScale);
 
-      vtkImageShiftScale *sourceQuantizer = this->SourceImageTypecast;
-      sourceQuantizer->SET_INPUT_DATA(sourceImage);
-      sourceQuantizer->SetOutputScalarTypeToUnsignedChar();
-      sourceQuantizer->ClampOverflowOn();
-      sourceQuantizer->SetShift(sourceShift);
-      sourceQuantizer->SetScale(sourceScale);
-      sourceQuantizer->Update();
-      sourceImage = sourceQuantizer->GetOutput();
+      sourceImage = vtkPrepareImage(
+        this->RegistrationInfo, sourceImage, vtkPreparedShiftScale,
+        sourceType, sourceShift, sourceScale, 1);
 
-      double targetScale = ((this->JointHistogramSize[0] - 1)/
+      double targetFactor = 1.0;
+      if (this->InterpolatorType == vtkImageRegistration::Linear)
+        {
+        targetFactor = 256.0;
+        }
+
+      double targetScale = ((targetBins - 1)*targetFactor/
         (targetImageRange[1] - targetImageRange[0]));
       double targetShift = (-targetImageRange[0] + 0.5/targetScale);
 
-      vtkImageShiftScale *targetQuantizer = this->TargetImageTypecast;
-      targetQuantizer->SET_INPUT_DATA(targetImage);
-      targetQuantizer->SetOutputScalarTypeToUnsignedChar();
-      targetQuantizer->ClampOverflowOn();
-      targetQuantizer->SetShift(targetShift);
-      targetQuantizer->SetScale(targetScale);
-      targetQuantizer->Update();
-      targetImage = targetQuantizer->GetOutput();
+      int targetType = VTK_UNSIGNED_CHAR;
+      if (this->InterpolatorType == vtkImageRegistration::Linear)
+        {
+        targetType = VTK_UNSIGNED_SHORT;
+        }
+
+      targetImage = vtkPrepareImage(
+        this->RegistrationInfo, targetImage, vtkPreparedShiftScale,
+        targetType, targetShift, targetScale, 1);
 
       // the rescaled image range is now the histogram range
       targetImageRange[0] = 0;
-      targetImageRange[1] = this->JointHistogramSize[0] - 1;
+      targetImageRange[1] = (targetBins - 1)*targetFactor;
       sourceImageRange[0] = 0;
-      sourceImageRange[1] = this->JointHistogramSize[1] - 1;
+      sourceImageRange[1] = (sourceBins - 1)*sourceFactor;
       }
     }
 
@@ -724,33 +2639,57 @@ void vtkImageRegistration::Initialize(vtkMatrix4x4 *matrix)
   if (this->InterpolatorType == vtkImageRegistration::BSpline)
     {
     int scalarType = VTK_FLOAT;
-    if (targetImage->GetScalarType() == VTK_DOUBLE ||
-        sourceImage->GetScalarType() == VTK_DOUBLE)
+    if (!this->SinglePrecision &&
+        (targetImage->GetScalarType() == VTK_DOUBLE ||
+         sourceImage->GetScalarType() == VTK_DOUBLE))
       {
       scalarType = VTK_DOUBLE;
       }
 
     if (sourceImage->GetScalarType() != scalarType)
       {
-      vtkImageShiftScale *sourceCast = this->SourceImageTypecast;
-      sourceCast->SET_INPUT_DATA(sourceImage);
-      sourceCast->SetOutputScalarType(scalarType);
-      sourceCast->ClampOverflowOff();
-      sourceCast->SetShift(0.0);
-      sourceCast->SetScale(1.0);
-      sourceCast->Update();
-      sourceImage = sourceCast->GetOutput();
+      sourceImage = vtkPrepareImage(
+        this->RegistrationInfo, sourceImage, vtkPreparedShiftScale,
+        scalarType, 0.0, 1.0, 0);
+      }
+
+    targetImage = vtkPrepareImage(
+      this->RegistrationInfo, targetImage, vtkPreparedBSpline,
+      scalarType, 0.0, 1.0, 0);
+    }
+
+  // in single-precision mode, double images are converted to float, and
+  // for the arithmetic metrics the resampled target will be float
+  bool floatMetric = false;
+  if (this->SinglePrecision)
+    {
+#if VTK_MAJOR_VERSION >= 6
+    floatMetric =
+      (this->MetricType == vtkImageRegistration::SquaredDifference ||
+       this->MetricType == vtkImageRegistration::CrossCorrelation ||
+       this->MetricType == vtkImageRegistration::NormalizedCrossCorrelation ||
+       this->MetricType == vtkImageRegistration::NeighborhoodCorrelation);
+#endif
+
+    if (sourceImage->GetScalarType() == VTK_DOUBLE ||
+        (floatMetric && sourceImage->GetScalarType() != VTK_FLOAT))
+      {
+      sourceImage = vtkPrepareImage(
+        this->RegistrationInfo, sourceImage, vtkPreparedShiftScale,
+        VTK_FLOAT, 0.0, 1.0, 0);
       }
 
-    vtkImageBSplineCoefficients *bspline = this->ImageBSpline;
-    bspline->SET_INPUT_DATA(targetImage);
-    bspline->SetOutputScalarType(scalarType);
-    bspline->Update();
-    targetImage = bspline->GetOutput();
+    if (targetImage->GetScalarType() == VTK_DOUBLE)
+      {
+      targetImage = vtkPrepareImage(
+        this->RegistrationInfo, targetImage, vtkPreparedShiftScale,
+        VTK_FLOAT, 0.0, 1.0, 0);
+      }
     }
 
   // coerce types if NeighborhoodCorrelation
-  if (sourceImage->GetScalarType() != targetImage->GetScalarType() &&
+  if (!floatMetric &&
+      sourceImage->GetScalarType() != targetImage->GetScalarType() &&
       (this->MetricType == vtkImageRegistration::SquaredDifference ||
        this->MetricType == vtkImageRegistration::NeighborhoodCorrelation))
     {
@@ -776,35 +2715,56 @@ void vtkImageRegistration::Initialize(vtkMatrix4x4 *matrix)
 
     if (sourceType != coercedType)
       {
-      vtkImageShiftScale *sourceCast = this->SourceImageTypecast;
-      sourceCast->SET_INPUT_DATA(sourceImage);
-      sourceCast->SetOutputScalarType(coercedType);
-      sourceCast->ClampOverflowOff();
-      sourceCast->SetShift(0.0);
-      sourceCast->SetScale(1.0);
-      sourceCast->Update();
-      sourceImage = sourceCast->GetOutput();
+      sourceImage = vtkPrepareImage(
+        this->RegistrationInfo, sourceImage, vtkPreparedShiftScale,
+        coercedType, 0.0, 1.0, 0);
       }
 
     if (targetType != coercedType)
       {
-      vtkImageShiftScale *targetCast = this->TargetImageTypecast;
-      targetCast->SET_INPUT_DATA(targetImage);
-      targetCast->SetOutputScalarType(coercedType);
-      targetCast->ClampOverflowOff();
-      targetCast->SetShift(0.0);
-      targetCast->SetScale(1.0);
-      targetCast->Update();
-      targetImage = targetCast->GetOutput();
+      targetImage = vtkPrepareImage(
+        this->RegistrationInfo, targetImage, vtkPreparedShiftScale,
+        coercedType, 0.0, 1.0, 0);
       }
     }
 
+  // use the fast path for rigid transforms if initial matrix is affine
+  vtkMatrix4x4 *resliceMatrix = NULL;
+  if (this->TransformType <= vtkImageRegistration::Rigid &&
+      initialMatrix->Element[3][0] == 0.0 &&
+      initialMatrix->Element[3][1] == 0.0 &&
+      initialMatrix->Element[3][2] == 0.0 &&
+      initialMatrix->Element[3][3] == 1.0)
+    {
+    resliceMatrix = this->ResliceMatrix;
+    }
+
   vtkImageReslice *reslice = this->ImageReslice;
   reslice->SetInformationInput(sourceImage);
   reslice->SET_INPUT_DATA(targetImage);
   reslice->SET_STENCIL_DATA(this->GetSourceImageStencil());
-  reslice->SetResliceTransform(this->Transform);
+  if (resliceMatrix)
+    {
+    // the matrix goes into the ResliceAxes, so the output geometry
+    // must be set explicitly instead of being derived from the axes
+    reslice->SetResliceTransform(NULL);
+    reslice->SetResliceAxes(resliceMatrix);
+    reslice->SetOutputSpacing(sourceImage->GetSpacing());
+    reslice->SetOutputOrigin(sourceImage->GetOrigin());
+    reslice->SetOutputExtent(sourceImage->GetExtent());
+    }
+  else
+    {
+    reslice->SetResliceAxes(NULL);
+    reslice->SetOutputSpacingToDefault();
+    reslice->SetOutputOriginToDefault();
+    reslice->SetOutputExtentToDefault();
+    reslice->SetResliceTransform(this->Transform);
+    }
   reslice->GenerateStencilOutputOn();
+#if VTK_MAJOR_VERSION >= 6
+  reslice->SetOutputScalarType(floatMetric ? VTK_FLOAT : -1);
+#endif
   reslice->SetInterpolator(0);
   switch (this->InterpolatorType)
     {
@@ -848,7 +2808,58 @@ void vtkImageRegistration::Initialize(vtkMatrix4x4 *matrix)
       interp->Delete();
       }
       break;
+    case vtkImageRegistration::MajorityLabel:
+      {
+      vtkLabelInterpolator *interp = vtkLabelInterpolator::New();
+      interp->SetKernelTypeToMajority();
+      reslice->SetInterpolator(interp);
+      interp->Delete();
+      }
+      break;
+    }
+
+  // check for a single-slice source and a multi-slice target
+  int sourceExtent[6];
+  int targetExtent[6];
+  sourceImage->GetExtent(sourceExtent);
+  targetImage->GetExtent(targetExtent);
+  this->SliceToVolume = (transformDim > 2 &&
+                         sourceExtent[4] == sourceExtent[5] &&
+                         targetExtent[4] < targetExtent[5]);
+
+  // symmetric registration is not done for slice-to-volume
+  bool symmetric = (this->Symmetric && !this->SliceToVolume);
+
+  // for slice-to-volume, average the target over the slice thickness
+#if VTK_MAJOR_VERSION > 6 || (VTK_MAJOR_VERSION == 6 && VTK_MINOR_VERSION > 1)
+  int slabSlices = 1;
+  double slabFraction = 1.0;
+  if (this->SliceToVolume && this->SourceSliceThickness > 0)
+    {
+    // use a sample spacing no larger than the target voxel size
+    double targetSpacing[3];
+    targetImage->GetSpacing(targetSpacing);
+    double minTargetSpacing = fabs(targetSpacing[0]);
+    for (int jj = 1; jj < 3; jj++)
+      {
+      double sp = fabs(targetSpacing[jj]);
+      minTargetSpacing = (sp < minTargetSpacing ? sp : minTargetSpacing);
+      }
+    double thickness = this->SourceSliceThickness;
+    slabSlices = vtkMath::Ceil(thickness/minTargetSpacing);
+    slabSlices = (slabSlices > 1 ? slabSlices : 1);
+    // the slab samples are spaced by a fraction of the output z spacing
+    slabFraction = thickness/(slabSlices*fabs(sourceImage->GetSpacing()[2]));
+    }
+  reslice->SetSlabNumberOfSlices(slabSlices);
+  reslice->SetSlabModeToMean();
+  reslice->SetSlabSliceSpacingFraction(slabFraction);
+#else
+  if (this->SliceToVolume && this->SourceSliceThickness > 0)
+    {
+    vtkWarningMacro("Initialize: SourceSliceThickness requires VTK 6.2");
     }
+#endif
 
   if (this->Metric)
     {
@@ -901,7 +2912,7 @@ void vtkImageRegistration::Initialize(vtkMatrix4x4 *matrix)
       vtkImageMutualInformation *metric = vtkImageMutualInformation::New();
       this->Metric = metric;
 
-      metric->SetNumberOfBins(this->JointHistogramSize);
+      metric->SetNumberOfBins(this->EffectiveJointHistogramSize);
 
       if (this->MetricType ==
           vtkImageRegistration::NormalizedMutualInformation)
@@ -941,7 +2952,112 @@ void vtkImageRegistration::Initialize(vtkMatrix4x4 *matrix)
       break;
     }
 
-  this->Metric->SET_INPUT_DATA(sourceImage);
+  // set the number of threads for the filters that run per evaluation
+  int numberOfThreads = this->NumberOfThreads;
+  if (numberOfThreads <= 0)
+    {
+    numberOfThreads = vtkMultiThreader::GetGlobalDefaultNumberOfThreads();
+    }
+  reslice->SetNumberOfThreads(numberOfThreads);
+  this->Metric->SetNumberOfThreads(numberOfThreads);
+
+  // for NUMA, the reslice filter and the metric must use the same slabs,
+  // and the source must be copied with the same slabs
+  static_cast<vtkImageRegistrationReslice *>(reslice)->ThreadAffinity =
+    this->ThreadAffinity;
+  this->Metric->SetThreadAffinity(this->ThreadAffinity);
+#ifdef USE_SMP_THREADED_IMAGE_ALGORITHM
+  if (this->ThreadAffinity)
+    {
+    reslice->EnableSMPOff();
+    }
+#endif
+#if VTK_MAJOR_VERSION > 7 || (VTK_MAJOR_VERSION == 7 && VTK_MINOR_VERSION >= 1)
+  reslice->SetSplitModeToSlab();
+  this->Metric->SetSplitModeToSlab();
+#endif
+  if (this->ThreadAffinity && !symmetric)
+    {
+    vtkImageRegistrationPlaceImage(
+      sourceImage, this->SourceImageCopy, reslice, numberOfThreads);
+    sourceImage = this->SourceImageCopy;
+    }
+  else
+    {
+    this->SourceImageCopy->Initialize();
+    }
+
+  // for symmetric registration, both images are resampled into the
+  // halfway space, which has the same sampling grid as the source
+  vtkImageReslice *sourceReslice = this->SourceReslice;
+  if (symmetric)
+    {
+    // the b-spline interpolator needs the source coefficients
+    vtkImageData *sourceInput = sourceImage;
+    if (this->InterpolatorType == vtkImageRegistration::BSpline)
+      {
+      sourceInput = vtkPrepareImage(
+        this->RegistrationInfo, sourceImage, vtkPreparedBSpline,
+        targetImage->GetScalarType(), 0.0, 1.0, 0);
+      }
+
+    sourceReslice->SetInformationInput(sourceImage);
+    sourceReslice->SET_INPUT_DATA(sourceInput);
+    // the source stencil is resampled into the halfway space along with
+    // the source, see vtkSetHalfMatrices()
+    vtkImageStencilData *sourceStencil = this->GetSourceImageStencil();
+    sourceReslice->SET_STENCIL_DATA(
+      sourceStencil ? this->HalfwayStencil : NULL);
+    sourceReslice->SetResliceTransform(NULL);
+    sourceReslice->SetResliceAxes(this->InverseHalfMatrix);
+    sourceReslice->SetOutputSpacing(sourceImage->GetSpacing());
+    sourceReslice->SetOutputOrigin(sourceImage->GetOrigin());
+    sourceReslice->SetOutputExtent(sourceImage->GetExtent());
+    sourceReslice->GenerateStencilOutputOn();
+#if VTK_MAJOR_VERSION >= 6
+    sourceReslice->SetOutputScalarType(floatMetric ? VTK_FLOAT : -1);
+#endif
+    sourceReslice->SetNumberOfThreads(numberOfThreads);
+    static_cast<vtkImageRegistrationReslice *>(sourceReslice)
+      ->ThreadAffinity = this->ThreadAffinity;
+#ifdef USE_SMP_THREADED_IMAGE_ALGORITHM
+    if (this->ThreadAffinity)
+      {
+      sourceReslice->EnableSMPOff();
+      }
+#endif
+#if VTK_MAJOR_VERSION > 7 || (VTK_MAJOR_VERSION == 7 && VTK_MINOR_VERSION >= 1)
+    sourceReslice->SetSplitModeToSlab();
+#endif
+
+    // use the same kind of interpolator as for the target
+    sourceReslice->SetInterpolator(0);
+    sourceReslice->SetInterpolationMode(reslice->GetInterpolationMode());
+    if (this->InterpolatorType > vtkImageRegistration::Cubic)
+      {
+      vtkAbstractImageInterpolator *interp =
+        reslice->GetInterpolator()->NewInstance();
+      interp->DeepCopy(reslice->GetInterpolator());
+      sourceReslice->SetInterpolator(interp);
+      interp->Delete();
+      }
+
+    // the target is resampled with the other half of the transform,
+    // and only where the resampled source is valid
+    reslice->SetResliceTransform(NULL);
+    reslice->SetResliceAxes(this->HalfMatrix);
+    reslice->SetOutputSpacing(sourceImage->GetSpacing());
+    reslice->SetOutputOrigin(sourceImage->GetOrigin());
+    reslice->SetOutputExtent(sourceImage->GetExtent());
+    reslice->SetInputConnection(1, sourceReslice->GetStencilOutputPort());
+
+    this->Metric->SetInputConnection(0, sourceReslice->GetOutputPort());
+    }
+  else
+    {
+    sourceReslice->RemoveAllInputs();
+    this->Metric->SET_INPUT_DATA(sourceImage);
+    }
   this->Metric->SetInputConnection(1, reslice->GetOutputPort());
   this->Metric->SetInputConnection(2, reslice->GetStencilOutputPort());
   this->Metric->SetInputRange(0, sourceImageRange);
@@ -955,6 +3071,46 @@ void vtkImageRegistration::Initialize(vtkMatrix4x4 *matrix)
   this->RegistrationInfo->Optimizer = this->Optimizer;
   this->RegistrationInfo->Metric = this->Metric;
   this->RegistrationInfo->InitialMatrix = this->InitialTransformMatrix;
+  this->RegistrationInfo->ResliceMatrix = resliceMatrix;
+
+  // each evaluation will only resample the overlap of the images, unless
+  // the slabs must stay fixed for the sake of the thread affinity
+  this->RegistrationInfo->Reslice = NULL;
+  this->RegistrationInfo->HalfMatrix = NULL;
+  this->RegistrationInfo->InverseHalfMatrix = NULL;
+  this->RegistrationInfo->SourceStencil = NULL;
+  this->RegistrationInfo->HalfwayStencil = NULL;
+  if (symmetric)
+    {
+    vtkImageRegistrationInfo *info = this->RegistrationInfo;
+    info->HalfMatrix = this->HalfMatrix;
+    info->InverseHalfMatrix = this->InverseHalfMatrix;
+    if (this->GetSourceImageStencil())
+      {
+      info->SourceStencil = this->GetSourceImageStencil();
+      info->HalfwayStencil = this->HalfwayStencil;
+      sourceImage->GetExtent(info->SourceExtent);
+      sourceImage->GetOrigin(info->SourceOrigin);
+      sourceImage->GetSpacing(info->SourceSpacing);
+      }
+    }
+  else if (!this->ThreadAffinity)
+    {
+    vtkImageRegistrationInfo *info = this->RegistrationInfo;
+    info->Reslice = reslice;
+    sourceImage->GetExtent(info->SourceExtent);
+    sourceImage->GetOrigin(info->SourceOrigin);
+    sourceImage->GetSpacing(info->SourceSpacing);
+    targetImage->GetBounds(info->TargetBounds);
+    double *targetSpacing = targetImage->GetSpacing();
+    for (int i = 0; i < 3; i++)
+      {
+      // pad by half a voxel, the reslice filter allows this much
+      double d = 0.5*fabs(targetSpacing[i]);
+      info->TargetBounds[2*i] -= d;
+      info->TargetBounds[2*i + 1] += d;
+      }
+    }
 
   if (this->CollectValues)
     {
@@ -1032,70 +3188,364 @@ void vtkImageRegistration::Initialize(vtkMatrix4x4 *matrix)
     optimizer->SetParameterScale(pcount++, tscale);
     }
 
-  // rotation parameters
-  if (this->TransformType > vtkImageRegistration::Translation)
+  // rotation parameters
+  if (this->TransformType > vtkImageRegistration::Translation)
+    {
+    if (transformDim > 2)
+      {
+      optimizer->SetParameterValue(pcount, 0);
+      optimizer->SetParameterScale(pcount++, rscale);
+      optimizer->SetParameterValue(pcount, 0);
+      optimizer->SetParameterScale(pcount++, rscale);
+      }
+    optimizer->SetParameterValue(pcount, 0);
+    optimizer->SetParameterScale(pcount++, rscale);
+    }
+
+  if (this->TransformType > vtkImageRegistration::Rigid)
+    {
+    // single scale parameter
+    optimizer->SetParameterValue(pcount, 0);
+    optimizer->SetParameterScale(pcount++, sscale);
+    }
+
+  if (this->TransformType > vtkImageRegistration::Similarity)
+    {
+    // extra scale parameters, weighed at 25%
+    optimizer->SetParameterValue(pcount, 0);
+    optimizer->SetParameterScale(pcount++, sscale*0.25);
+    if (transformDim > 2)
+      {
+      optimizer->SetParameterValue(pcount, 0);
+      optimizer->SetParameterScale(pcount++, sscale*0.25);
+      }
+    }
+
+  if (this->TransformType == vtkImageRegistration::Affine)
+    {
+    // extra rotation parameters, scaled at 25%
+    if (transformDim > 2)
+      {
+      optimizer->SetParameterValue(pcount, 0);
+      optimizer->SetParameterScale(pcount++, rscale*0.25);
+      optimizer->SetParameterValue(pcount, 0);
+      optimizer->SetParameterScale(pcount++, rscale*0.25);
+      }
+    optimizer->SetParameterValue(pcount, 0);
+    optimizer->SetParameterScale(pcount++, rscale*0.25);
+    }
+
+  // build the initial transform from the parameters
+  vtkSetTransformParameters(this->RegistrationInfo);
+  if (resliceMatrix)
+    {
+    vtkComputeRigidMatrix(this->RegistrationInfo, *resliceMatrix->Element);
+    resliceMatrix->Modified();
+    }
+
+  this->MetricValues->Initialize();
+  this->CostValues->Initialize();
+  this->ParameterValues->Initialize();
+  this->ParameterValues->SetNumberOfComponents(
+    optimizer->GetNumberOfParameters());
+
+  // reset the convergence monitor
+  int np = optimizer->GetNumberOfParameters();
+  this->RegistrationInfo->CostHistory.clear();
+  this->RegistrationInfo->StepHistory.clear();
+  this->RegistrationInfo->EvaluationHistory.clear();
+  this->RegistrationInfo->LastParameters.resize(np);
+  for (int ip = 0; ip < np; ip++)
+    {
+    this->RegistrationInfo->LastParameters[ip] =
+      optimizer->GetParameterValue(ip);
+    }
+  this->StoppedByConvergenceMonitor = false;
+
+  this->Modified();
+}
+
+//--------------------------------------------------------------------------
+void vtkImageRegistration::InitializeDeformable(
+  vtkMatrix4x4 *matrix, vtkImageData *sourceImage, vtkImageData *targetImage)
+{
+  vtkImageRegistrationInfo *info = this->RegistrationInfo;
+
+  int transformDim = this->TransformDimensionality;
+  if (transformDim < 2) { transformDim = 2; }
+  if (transformDim > 3) { transformDim = 3; }
+
+  // the linear part of the transform is fixed
+  vtkMatrix4x4 *initialMatrix = this->InitialTransformMatrix;
+  initialMatrix->Identity();
+  if (matrix)
+    {
+    initialMatrix->DeepCopy(matrix);
+    }
+  this->Transform->Identity();
+  this->Transform->Concatenate(initialMatrix);
+
+  // the optimizer and the metric are not used
+  if (this->Metric)
+    {
+    this->Metric->RemoveAllInputs();
+    this->Metric->Delete();
+    this->Metric = 0;
+    }
+  if (this->Optimizer)
+    {
+    this->Optimizer->Delete();
+    this->Optimizer = 0;
+    }
+
+  // choose the metric
+  switch (this->MetricType)
+    {
+    case vtkImageRegistration::SquaredDifference:
+      info->DeformableMetric = vtkDeformableSquaredDifference;
+      break;
+    case vtkImageRegistration::MutualInformation:
+    case vtkImageRegistration::NormalizedMutualInformation:
+      info->DeformableMetric = vtkDeformableMutualInformation;
+      break;
+    case vtkImageRegistration::CrossCorrelation:
+    case vtkImageRegistration::NormalizedCrossCorrelation:
+      info->DeformableMetric = vtkDeformableCorrelation;
+      break;
+    default:
+      vtkWarningMacro("Initialize: Deformable registration does not "
+                      "support this metric, using NormalizedCrossCorrelation");
+      info->DeformableMetric = vtkDeformableCorrelation;
+      break;
+    }
+
+  // compute the ranges for the joint histogram
+  double sourceImageRange[2];
+  double targetImageRange[2];
+  sourceImageRange[0] = this->SourceImageRange[0];
+  sourceImageRange[1] = this->SourceImageRange[1];
+  targetImageRange[0] = this->TargetImageRange[0];
+  targetImageRange[1] = this->TargetImageRange[1];
+  if (info->DeformableMetric == vtkDeformableMutualInformation)
+    {
+    if (sourceImageRange[0] >= sourceImageRange[1])
+      {
+      this->ComputeImageRange(sourceImage, this->GetSourceImageStencil(),
+        sourceImageRange);
+      }
+    if (targetImageRange[0] >= targetImageRange[1])
+      {
+      this->ComputeImageRange(targetImage, NULL, targetImageRange);
+      }
+    }
+  info->DeformableRange[0][0] = sourceImageRange[0];
+  info->DeformableRange[0][1] = sourceImageRange[1];
+  info->DeformableRange[1][0] = targetImageRange[0];
+  info->DeformableRange[1][1] = targetImageRange[1];
+  info->DeformableBins[0] = this->EffectiveJointHistogramSize[0];
+  info->DeformableBins[1] = this->EffectiveJointHistogramSize[1];
+
+  // the images are converted to float, the target is always interpolated
+  // with trilinear interpolation so that its gradient is continuous
+  // within each voxel
+  if (sourceImage->GetScalarType() != VTK_FLOAT)
+    {
+    sourceImage = vtkPrepareImage(
+      this->RegistrationInfo, sourceImage, vtkPreparedShiftScale,
+      VTK_FLOAT, 0.0, 1.0, 0);
+    }
+  if (targetImage->GetScalarType() != VTK_FLOAT)
+    {
+    targetImage = vtkPrepareImage(
+      this->RegistrationInfo, targetImage, vtkPreparedShiftScale,
+      VTK_FLOAT, 0.0, 1.0, 0);
+    }
+
+  // the grid spacing
+  double spacing = this->DeformableGridSpacing;
+  if (spacing <= 0)
+    {
+    double sourceSpacing[3];
+    sourceImage->GetSpacing(sourceSpacing);
+    spacing = 0.0;
+    for (int i = 0; i < transformDim; i++)
+      {
+      double s = fabs(sourceSpacing[i]);
+      spacing = (s > spacing ? s : spacing);
+      }
+    spacing *= 8.0;
+    }
+
+  // keep the current deformation if it covers the source image, and
+  // refine it if its spacing is larger by a power of two
+  vtkBSplineGridTransform *deformation = this->Deformation;
+  double bounds[6];
+  sourceImage->GetBounds(bounds);
+  bool keep = (deformation->GetNumberOfControlPoints() > 0 &&
+               (deformation->GetGridDimensions()[2] > 1) ==
+               (transformDim > 2));
+  if (keep)
+    {
+    double gridSpacing = deformation->GetGridSpacing()[0];
+    int refinements = 0;
+    while (gridSpacing > 1.001*spacing && refinements < 8)
+      {
+      gridSpacing *= 0.5;
+      refinements++;
+      }
+    keep = (fabs(gridSpacing - spacing) <= 0.001*spacing);
+    for (int j = 0; keep && j < refinements; j++)
+      {
+      deformation->Refine();
+      }
+    for (int i = 0; keep && i < transformDim; i++)
+      {
+      // the full support of four control points is needed
+      double origin = deformation->GetGridOrigin()[i];
+      int n = deformation->GetGridDimensions()[i];
+      keep = (bounds[2*i] >= origin + 0.999*spacing &&
+              bounds[2*i + 1] <= origin + (n - 2.001)*spacing);
+      }
+    }
+  if (!keep)
+    {
+    deformation->SetGridGeometryFromBounds(bounds, spacing, transformDim);
+    }
+
+  int numberOfThreads = this->NumberOfThreads;
+  if (numberOfThreads <= 0)
+    {
+    numberOfThreads = vtkMultiThreader::GetGlobalDefaultNumberOfThreads();
+    }
+  deformation->SetNumberOfThreads(numberOfThreads);
+
+  info->Transform = this->Transform;
+  info->Optimizer = NULL;
+  info->Metric = NULL;
+  info->InitialMatrix = initialMatrix;
+  info->ResliceMatrix = NULL;
+  info->Reslice = NULL;
+  info->HalfMatrix = NULL;
+  info->InverseHalfMatrix = NULL;
+  info->SourceStencil = NULL;
+  info->HalfwayStencil = NULL;
+  info->Deformation = deformation;
+  info->DeformableSource = sourceImage;
+  info->DeformableTarget = targetImage;
+  info->DeformableStencil = this->GetSourceImageStencil();
+  info->NumberOfThreads = numberOfThreads;
+  info->TransformDimensionality = transformDim;
+  info->TransformType = this->TransformType;
+  info->OptimizerType = this->OptimizerType;
+  info->MetricType = this->MetricType;
+  info->NumberOfEvaluations = 0;
+  info->InitialCost = 0.0;
+
+  // the derivative is computed by the first iteration
+  info->Gradient.clear();
+  info->DeformableTable.clear();
+  info->DeformableCost = VTK_DOUBLE_MAX;
+  info->DeformableStep = 0.25*spacing;
+  info->DeformableMaximumStep = 0.4*spacing;
+  info->DeformableIterations = 0;
+
+  this->MetricValues->Initialize();
+  this->CostValues->Initialize();
+  this->ParameterValues->Initialize();
+  if (this->CollectValues)
+    {
+    info->MetricValues = this->MetricValues;
+    info->CostValues = this->CostValues;
+    }
+  else
+    {
+    info->MetricValues = NULL;
+    info->CostValues = NULL;
+    }
+  info->ParameterValues = NULL;
+
+  info->CostHistory.clear();
+  info->StepHistory.clear();
+  info->EvaluationHistory.clear();
+  info->LastParameters.clear();
+  this->StoppedByConvergenceMonitor = false;
+  this->SliceToVolume = false;
+
+  this->Modified();
+}
+
+//--------------------------------------------------------------------------
+bool vtkImageRegistration::MonitorConvergence()
+{
+  vtkImageRegistrationInfo *info = this->RegistrationInfo;
+  vtkFunctionMinimizer *optimizer = this->Optimizer;
+
+  // compute the largest parameter step, relative to the parameter scale
+  double step = 0.0;
+  int np = optimizer->GetNumberOfParameters();
+  for (int ip = 0; ip < np; ip++)
     {
-    if (transformDim > 2)
+    double p = optimizer->GetParameterValue(ip);
+    double s = fabs(p - info->LastParameters[ip]);
+    double scale = optimizer->GetParameterScale(ip);
+    if (scale > 0)
       {
-      optimizer->SetParameterValue(pcount, 0);
-      optimizer->SetParameterScale(pcount++, rscale);
-      optimizer->SetParameterValue(pcount, 0);
-      optimizer->SetParameterScale(pcount++, rscale);
+      s /= scale;
       }
-    optimizer->SetParameterValue(pcount, 0);
-    optimizer->SetParameterScale(pcount++, rscale);
+    step = (step > s ? step : s);
+    info->LastParameters[ip] = p;
     }
 
-  if (this->TransformType > vtkImageRegistration::Rigid)
+  // the first evaluation was done at the starting point
+  if (info->CostHistory.empty())
     {
-    // single scale parameter
-    optimizer->SetParameterValue(pcount, 0);
-    optimizer->SetParameterScale(pcount++, sscale);
+    info->CostHistory.push_back(info->InitialCost);
+    info->StepHistory.push_back(0.0);
+    info->EvaluationHistory.push_back(1);
     }
 
-  if (this->TransformType > vtkImageRegistration::Similarity)
-    {
-    // extra scale parameters, weighed at 25%
-    optimizer->SetParameterValue(pcount, 0);
-    optimizer->SetParameterScale(pcount++, sscale*0.25);
-    if (transformDim > 2)
-      {
-      optimizer->SetParameterValue(pcount, 0);
-      optimizer->SetParameterScale(pcount++, sscale*0.25);
-      }
-    }
+  info->CostHistory.push_back(optimizer->GetFunctionValue());
+  info->StepHistory.push_back(step);
+  info->EvaluationHistory.push_back(info->NumberOfEvaluations);
 
-  if (this->TransformType == vtkImageRegistration::Affine)
+  if (this->ConvergenceMonitor &&
+      vtkCheckConvergence(info, this->ConvergenceWindow,
+                          this->ConvergenceThreshold, this->CostTolerance))
     {
-    // extra rotation parameters, scaled at 25%
-    if (transformDim > 2)
-      {
-      optimizer->SetParameterValue(pcount, 0);
-      optimizer->SetParameterScale(pcount++, rscale*0.25);
-      optimizer->SetParameterValue(pcount, 0);
-      optimizer->SetParameterScale(pcount++, rscale*0.25);
-      }
-    optimizer->SetParameterValue(pcount, 0);
-    optimizer->SetParameterScale(pcount++, rscale*0.25);
+    this->StoppedByConvergenceMonitor = true;
     }
 
-  // build the initial transform from the parameters
-  vtkSetTransformParameters(this->RegistrationInfo);
+  return this->StoppedByConvergenceMonitor;
+}
 
-  this->MetricValues->Initialize();
-  this->CostValues->Initialize();
-  this->ParameterValues->Initialize();
-  this->ParameterValues->SetNumberOfComponents(
-    optimizer->GetNumberOfParameters());
+//--------------------------------------------------------------------------
+namespace {
 
-  this->Modified();
+// Invoke an IterationEvent with the current state as the call data
+void vtkInvokeIterationEvent(
+  vtkImageRegistration *self, vtkTransform *transform, int iteration,
+  int evaluations, double cost, int numParameters, const double *parameters)
+{
+  vtkImageRegistration::IterationEventData data;
+  data.Iteration = iteration;
+  data.NumberOfEvaluations = evaluations;
+  data.Cost = cost;
+  data.NumberOfParameters = numParameters;
+  data.Parameters = parameters;
+  vtkMatrix4x4 *matrix = transform->GetMatrix();
+  for (int j = 0; j < 16; j++)
+    {
+    data.Matrix[j] = matrix->Element[j/4][j%4];
+    }
+
+  self->InvokeEvent(vtkCommand::IterationEvent, &data);
 }
 
+} // end anonymous namespace
+
 //--------------------------------------------------------------------------
 int vtkImageRegistration::ExecuteRegistration()
 {
-  // reset Abort flag
-  this->AbortExecute = 0;
   this->Progress = 0.0;
 
   this->InvokeEvent(vtkCommand::StartEvent,NULL);
@@ -1103,9 +3553,54 @@ int vtkImageRegistration::ExecuteRegistration()
   int converged = 0;
 
   vtkFunctionMinimizer *optimizer = this->Optimizer;
+  vtkImageRegistrationInfo *info = this->RegistrationInfo;
 
-  if (optimizer)
+  if (info->DeformableSource)
+    {
+    int n = this->MaximumNumberOfIterations;
+    if (n <= 0)
+      {
+      n = VTK_INT_MAX;
+      }
+    for (int i = 0; i < n && !converged; i++)
+      {
+      this->UpdateProgress(i*1.0/n);
+      if (this->AbortExecute)
+        {
+        break;
+        }
+      converged = !vtkDeformableIterate(
+        info, this, this->CostTolerance, this->TransformTolerance);
+      if (this->AbortExecute)
+        {
+        converged = 0;
+        break;
+        }
+
+      this->MetricValue = info->DeformableCost;
+
+      vtkBSplineGridTransform *deformation = this->Deformation;
+      vtkInvokeIterationEvent(
+        this, this->Transform, i, info->NumberOfEvaluations,
+        info->DeformableCost,
+        static_cast<int>(3*deformation->GetNumberOfControlPoints()),
+        deformation->GetCoefficients()->GetPointer(0));
+
+      if (info->NumberOfEvaluations >= this->MaximumNumberOfEvaluations)
+        {
+        converged = 0;
+        break;
+        }
+      }
+
+    if (converged && !this->AbortExecute)
+      {
+      this->UpdateProgress(1.0);
+      }
+    }
+  else if (optimizer)
     {
+    std::vector<double> parameters;
     int n = this->MaximumNumberOfIterations;
     if (n <= 0)
       {
@@ -1119,9 +3614,38 @@ int vtkImageRegistration::ExecuteRegistration()
         break;
         }
       converged = !optimizer->Iterate();
+
+      if (optimizer->GetAbortFlag())
+        {
+        // go back to the parameters from the last complete iteration
+        int np = static_cast<int>(info->LastParameters.size());
+        for (int ip = 0; ip < np; ip++)
+          {
+          optimizer->SetParameterValue(ip, info->LastParameters[ip]);
+          }
+        vtkSetTransformParameters(info);
+        converged = 0;
+        break;
+        }
+
       vtkSetTransformParameters(this->RegistrationInfo);
       this->MetricValue = optimizer->GetFunctionValue();
 
+      if (!converged && this->MonitorConvergence())
+        {
+        converged = 1;
+        }
+
+      int np = optimizer->GetNumberOfParameters();
+      parameters.resize(np);
+      for (int ip = 0; ip < np; ip++)
+        {
+        parameters[ip] = optimizer->GetParameterValue(ip);
+        }
+      vtkInvokeIterationEvent(
+        this, this->Transform, i, info->NumberOfEvaluations,
+        optimizer->GetFunctionValue(), np, (np > 0 ? &parameters[0] : NULL));
+
       if (this->RegistrationInfo->NumberOfEvaluations >=
           this->MaximumNumberOfEvaluations)
         {
@@ -1142,10 +3666,53 @@ int vtkImageRegistration::ExecuteRegistration()
   return converged;
 }
 
+//--------------------------------------------------------------------------
+void vtkImageRegistration::ResetAbort()
+{
+  // reset Abort flags
+  this->AbortExecute = 0;
+  if (this->Optimizer)
+    {
+    this->Optimizer->SetAbortFlag(0);
+    }
+}
+
+//--------------------------------------------------------------------------
+void vtkImageRegistration::AbortRegistration()
+{
+  // the optimizer checks its flag before every evaluation, and the
+  // metric and reslice filters check their flags while they execute
+  this->AbortExecute = 1;
+  if (this->Optimizer)
+    {
+    this->Optimizer->SetAbortFlag(1);
+    }
+  if (this->Metric)
+    {
+    this->Metric->SetAbortExecute(1);
+    }
+  this->ImageReslice->SetAbortExecute(1);
+  this->SourceReslice->SetAbortExecute(1);
+}
+
 //--------------------------------------------------------------------------
 int vtkImageRegistration::Iterate()
 {
   vtkFunctionMinimizer *optimizer = this->Optimizer;
+  vtkImageRegistrationInfo *info = this->RegistrationInfo;
+
+  if (info->DeformableSource)
+    {
+    int result = vtkDeformableIterate(
+      info, this, this->CostTolerance, this->TransformTolerance);
+    if (info->DeformableIterations >= this->MaximumNumberOfIterations ||
+        info->NumberOfEvaluations >= this->MaximumNumberOfEvaluations)
+      {
+      result = 0;
+      }
+    this->MetricValue = info->DeformableCost;
+    return result;
+    }
 
   if (optimizer)
     {
@@ -1158,19 +3725,388 @@ int vtkImageRegistration::Iterate()
       }
     vtkSetTransformParameters(this->RegistrationInfo);
     this->MetricValue = optimizer->GetFunctionValue();
+    if (result && this->MonitorConvergence())
+      {
+      result = 0;
+      }
     return result;
     }
 
   return 0;
 }
 
+//--------------------------------------------------------------------------
+namespace {
+
+// Read a keyword followed by "n" values, and return false if the keyword
+// does not match or if the values cannot be read.
+template<class T>
+bool vtkReadStateValues(istream& is, const char *keyword, T *values, int n)
+{
+  if (!vtkFunctionMinimizer::ReadStateKeyword(is, keyword))
+    {
+    return false;
+    }
+  for (int i = 0; i < n; i++)
+    {
+    is >> values[i];
+    }
+  return !is.fail();
+}
+
+} // end anonymous namespace
+
+//--------------------------------------------------------------------------
+void vtkImageRegistration::SaveState(ostream& os)
+{
+  vtkImageRegistrationInfo *info = this->RegistrationInfo;
+  vtkFunctionMinimizer *optimizer = this->Optimizer;
+
+  if (optimizer == NULL && info->DeformableSource == NULL)
+    {
+    vtkErrorMacro("SaveState: Registration has not been initialized.");
+    return;
+    }
+
+  std::streamsize precision = os.precision(17);
+
+  os << "vtkImageRegistration 1\n";
+  os << "TransformType " << this->TransformType << "\n";
+  os << "TransformDimensionality " << this->TransformDimensionality << "\n";
+  os << "OptimizerType " << this->OptimizerType << "\n";
+  os << "Center " << info->Center[0] << " " << info->Center[1] << " "
+     << info->Center[2] << "\n";
+  os << "InitialMatrix";
+  for (int i = 0; i < 16; i++)
+    {
+    os << " " << this->InitialTransformMatrix->Element[i/4][i%4];
+    }
+  os << "\n";
+  os << "NumberOfEvaluations " << info->NumberOfEvaluations << "\n";
+  os << "InitialCost " << info->InitialCost << "\n";
+  os << "MetricValue " << this->MetricValue << "\n";
+  os << "CostValue " << this->CostValue << "\n";
+  os << "StoppedByConvergenceMonitor "
+     << this->StoppedByConvergenceMonitor << "\n";
+
+  if (info->DeformableSource)
+    {
+    // the deformation, and the state of the gradient descent
+    vtkBSplineGridTransform *deformation = this->Deformation;
+    int *dims = deformation->GetGridDimensions();
+    double *origin = deformation->GetGridOrigin();
+    double *spacing = deformation->GetGridSpacing();
+    os << "GridDimensions " << dims[0] << " " << dims[1] << " "
+       << dims[2] << "\n";
+    os << "GridOrigin " << origin[0] << " " << origin[1] << " "
+       << origin[2] << "\n";
+    os << "GridSpacing " << spacing[0] << " " << spacing[1] << " "
+       << spacing[2] << "\n";
+    os << "DeformableCost " << info->DeformableCost << "\n";
+    os << "DeformableStep " << info->DeformableStep << "\n";
+    os << "DeformableIterations " << info->DeformableIterations << "\n";
+    vtkIdType nc = 3*deformation->GetNumberOfControlPoints();
+    const double *coeffs = deformation->GetCoefficients()->GetPointer(0);
+    os << "Coefficients " << nc << "\n";
+    for (vtkIdType j = 0; j < nc; j += 3)
+      {
+      os << coeffs[j] << " " << coeffs[j + 1] << " " << coeffs[j + 2] << "\n";
+      }
+    size_t ng = info->Gradient.size();
+    os << "Gradient " << ng << "\n";
+    for (size_t j = 0; j < ng; j += 3)
+      {
+      os << info->Gradient[j] << " " << info->Gradient[j + 1] << " "
+         << info->Gradient[j + 2] << "\n";
+      }
+    os.precision(precision);
+    return;
+    }
+
+  // the trajectory used by the convergence monitor
+  size_t m = info->CostHistory.size();
+  os << "History " << m << "\n";
+  for (size_t j = 0; j < m; j++)
+    {
+    os << info->CostHistory[j] << " " << info->StepHistory[j] << " "
+       << info->EvaluationHistory[j] << "\n";
+    }
+  size_t np = info->LastParameters.size();
+  os << "LastParameters " << np;
+  for (size_t j = 0; j < np; j++)
+    {
+    os << " " << info->LastParameters[j];
+    }
+  os << "\n";
+
+  os.precision(precision);
+
+  optimizer->SaveState(os);
+}
+
+//--------------------------------------------------------------------------
+int vtkImageRegistration::RestoreState(istream& is)
+{
+  vtkImageRegistrationInfo *info = this->RegistrationInfo;
+  vtkFunctionMinimizer *optimizer = this->Optimizer;
+
+  if (optimizer == NULL && info->DeformableSource == NULL)
+    {
+    vtkErrorMacro("RestoreState: Registration has not been initialized.");
+    return 0;
+    }
+
+  int version = 0;
+  int transformType = -1;
+  int transformDim = -1;
+  int optimizerType = -1;
+  if (!vtkReadStateValues(is, "vtkImageRegistration", &version, 1) ||
+      version != 1 ||
+      !vtkReadStateValues(is, "TransformType", &transformType, 1) ||
+      !vtkReadStateValues(is, "TransformDimensionality", &transformDim, 1) ||
+      !vtkReadStateValues(is, "OptimizerType", &optimizerType, 1))
+    {
+    vtkErrorMacro("RestoreState: Unable to read state.");
+    return 0;
+    }
+  if (transformType != this->TransformType ||
+      transformDim != this->TransformDimensionality ||
+      optimizerType != this->OptimizerType)
+    {
+    vtkErrorMacro("RestoreState: The saved state is for a different "
+                  "transform or optimizer type.");
+    return 0;
+    }
+
+  double center[3];
+  double matrix[16];
+  int evaluations = 0;
+  double initialCost = 0.0;
+  double metricValue = 0.0;
+  double costValue = 0.0;
+  bool stopped = false;
+  size_t m = 0;
+  size_t np = 0;
+
+  if (!vtkReadStateValues(is, "Center", center, 3) ||
+      !vtkReadStateValues(is, "InitialMatrix", matrix, 16) ||
+      !vtkReadStateValues(is, "NumberOfEvaluations", &evaluations, 1) ||
+      !vtkReadStateValues(is, "InitialCost", &initialCost, 1) ||
+      !vtkReadStateValues(is, "MetricValue", &metricValue, 1) ||
+      !vtkReadStateValues(is, "CostValue", &costValue, 1) ||
+      !vtkReadStateValues(is, "StoppedByConvergenceMonitor", &stopped, 1))
+    {
+    vtkErrorMacro("RestoreState: Unable to read state.");
+    return 0;
+    }
+
+  if (info->DeformableSource)
+    {
+    int dims[3];
+    double origin[3];
+    double spacing[3];
+    double deformableCost = 0.0;
+    double deformableStep = 0.0;
+    int deformableIterations = 0;
+    vtkIdType nc = 0;
+    size_t ng = 0;
+    if (!vtkReadStateValues(is, "GridDimensions", dims, 3) ||
+        !vtkReadStateValues(is, "GridOrigin", origin, 3) ||
+        !vtkReadStateValues(is, "GridSpacing", spacing, 3) ||
+        !vtkReadStateValues(is, "DeformableCost", &deformableCost, 1) ||
+        !vtkReadStateValues(is, "DeformableStep", &deformableStep, 1) ||
+        !vtkReadStateValues(
+          is, "DeformableIterations", &deformableIterations, 1) ||
+        !vtkReadStateValues(is, "Coefficients", &nc, 1) ||
+        nc != 3*static_cast<vtkIdType>(dims[0])*dims[1]*dims[2])
+      {
+      vtkErrorMacro("RestoreState: Unable to read state.");
+      return 0;
+      }
+    std::vector<double> coeffs(nc);
+    for (vtkIdType j = 0; j < nc && !is.fail(); j++)
+      {
+      is >> coeffs[j];
+      }
+    if (is.fail() ||
+        !vtkReadStateValues(is, "Gradient", &ng, 1) ||
+        (ng != 0 && ng != static_cast<size_t>(nc)))
+      {
+      vtkErrorMacro("RestoreState: Unable to read state.");
+      return 0;
+      }
+    std::vector<double> gradient(ng);
+    for (size_t j = 0; j < ng && !is.fail(); j++)
+      {
+      is >> gradient[j];
+      }
+    if (is.fail())
+      {
+      vtkErrorMacro("RestoreState: Unable to read state.");
+      return 0;
+      }
+
+    vtkBSplineGridTransform *deformation = this->Deformation;
+    deformation->SetGridGeometry(dims, origin, spacing);
+    double *cptr = deformation->GetCoefficients()->GetPointer(0);
+    for (vtkIdType j = 0; j < nc; j++)
+      {
+      cptr[j] = coeffs[j];
+      }
+    deformation->Modified();
+
+    info->Center[0] = center[0];
+    info->Center[1] = center[1];
+    info->Center[2] = center[2];
+    this->InitialTransformMatrix->DeepCopy(matrix);
+    this->Transform->Identity();
+    this->Transform->Concatenate(this->InitialTransformMatrix);
+    info->NumberOfEvaluations = evaluations;
+    info->InitialCost = initialCost;
+    info->DeformableCost = deformableCost;
+    info->DeformableStep = deformableStep;
+    info->DeformableIterations = deformableIterations;
+    info->Gradient.swap(gradient);
+    this->MetricValue = metricValue;
+    this->CostValue = costValue;
+    this->StoppedByConvergenceMonitor = stopped;
+
+    return 1;
+    }
+
+  if (!vtkReadStateValues(is, "History", &m, 1))
+    {
+    vtkErrorMacro("RestoreState: Unable to read state.");
+    return 0;
+    }
+
+  std::vector<double> costHistory(m);
+  std::vector<double> stepHistory(m);
+  std::vector<int> evaluationHistory(m);
+  for (size_t j = 0; j < m && !is.fail(); j++)
+    {
+    is >> costHistory[j] >> stepHistory[j] >> evaluationHistory[j];
+    }
+
+  if (is.fail() || !vtkReadStateValues(is, "LastParameters", &np, 1))
+    {
+    vtkErrorMacro("RestoreState: Unable to read state.");
+    return 0;
+    }
+  std::vector<double> lastParameters(np);
+  for (size_t j = 0; j < np && !is.fail(); j++)
+    {
+    is >> lastParameters[j];
+    }
+
+  if (is.fail() ||
+      np != static_cast<size_t>(optimizer->GetNumberOfParameters()) ||
+      !optimizer->RestoreState(is))
+    {
+    vtkErrorMacro("RestoreState: Unable to read state.");
+    return 0;
+    }
+
+  info->Center[0] = center[0];
+  info->Center[1] = center[1];
+  info->Center[2] = center[2];
+  this->InitialTransformMatrix->DeepCopy(matrix);
+  info->NumberOfEvaluations = evaluations;
+  info->InitialCost = initialCost;
+  info->CostHistory.swap(costHistory);
+  info->StepHistory.swap(stepHistory);
+  info->EvaluationHistory.swap(evaluationHistory);
+  info->LastParameters.swap(lastParameters);
+  this->MetricValue = metricValue;
+  this->CostValue = costValue;
+  this->StoppedByConvergenceMonitor = stopped;
+
+  // rebuild the transform from the restored parameters
+  vtkSetTransformParameters(info);
+  if (info->ResliceMatrix)
+    {
+    vtkComputeRigidMatrix(info, *info->ResliceMatrix->Element);
+    info->ResliceMatrix->Modified();
+    }
+
+  return 1;
+}
+
 //--------------------------------------------------------------------------
 int vtkImageRegistration::UpdateRegistration()
 {
   this->Update();
+  this->ResetAbort();
   return this->ExecuteRegistration();
 }
 
+//--------------------------------------------------------------------------
+int vtkImageRegistration::StartRegistration()
+{
+  vtkImageRegistrationInfo *info = this->RegistrationInfo;
+
+  if (this->IsRegistrationRunning())
+    {
+    vtkErrorMacro("StartRegistration: registration is already running");
+    return 0;
+    }
+
+  // join the previous thread, if it has not been joined yet
+  if (info->ThreadId >= 0)
+    {
+    this->WaitForRegistration();
+    }
+
+  this->Update();
+  this->ResetAbort();
+
+  if (info->Threader == NULL)
+    {
+    info->Threader = vtkMultiThreader::New();
+    }
+
+  info->ThreadRunning = 1;
+  info->ThreadResult = 0;
+  info->ThreadId = info->Threader->SpawnThread(
+    &vtkImageRegistrationInfo::ThreadExecute, this);
+
+  if (info->ThreadId < 0)
+    {
+    info->ThreadRunning = 0;
+    vtkErrorMacro("StartRegistration: unable to create thread");
+    return 0;
+    }
+
+  return 1;
+}
+
+//--------------------------------------------------------------------------
+int vtkImageRegistration::WaitForRegistration()
+{
+  vtkImageRegistrationInfo *info = this->RegistrationInfo;
+
+  if (info->ThreadId >= 0)
+    {
+    // this joins the thread
+    info->Threader->TerminateThread(info->ThreadId);
+    info->ThreadId = -1;
+    }
+
+  return info->ThreadResult;
+}
+
+//--------------------------------------------------------------------------
+int vtkImageRegistration::IsRegistrationRunning()
+{
+  vtkImageRegistrationInfo *info = this->RegistrationInfo;
+
+  info->ThreadLock->Lock();
+  int running = info->ThreadRunning;
+  info->ThreadLock->Unlock();
+
+  return running;
+}
+
 //----------------------------------------------------------------------------
 int vtkImageRegistration::FillInputPortInformation(int port,
                                                    vtkInformation* info)
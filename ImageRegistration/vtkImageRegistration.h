@@ -12,10 +12,13 @@
      PURPOSE.  See the above copyright notice for more information.
 
 =========================================================================*/
-// .NAME vtkImageRegistration - Perform linear image registration.
+// .NAME vtkImageRegistration - Perform linear or deformable registration.
 // .SECTION Description
 // This class will find the transformation that registers the source
-// image to the target image.
+// image to the target image.  A deformable registration can also be
+// done, in which case a B-spline deformation is found that refines a
+// linear registration.  The deformable stage always samples the target
+// image with trilinear interpolation, regardless of InterpolatorType.
 
 #ifndef vtkImageRegistration_h
 #define vtkImageRegistration_h
@@ -26,11 +29,12 @@ class vtkImageData;
 class vtkImageStencilData;
 class vtkLinearTransform;
 class vtkTransform;
+class vtkAbstractTransform;
+class vtkGeneralTransform;
+class vtkBSplineGridTransform;
 class vtkMatrix4x4;
 class vtkDoubleArray;
 class vtkImageReslice;
-class vtkImageShiftScale;
-class vtkImageBSplineCoefficients;
 class vtkAbstractImageInterpolator;
 class vtkFunctionMinimizer;
 class vtkImageSimilarityMetric;
@@ -103,7 +107,8 @@ public:
     BSpline,
     Sinc,
     ASinc,
-    Label
+    Label,
+    MajorityLabel
   };
 
   // Transform types
@@ -114,7 +119,8 @@ public:
     Similarity,
     ScaleSourceAxes,
     ScaleTargetAxes,
-    Affine
+    Affine,
+    Deformable
   };
 
   // Initializer types
@@ -151,7 +157,13 @@ public:
   vtkGetMacro(OptimizerType, int);
 
   // Description:
-  // Set the image interpolator.  The default is Linear.
+  // Set the image interpolator.  The default is Linear.  For label images,
+  // use Nearest, Label (Gaussian-weighted voting), or MajorityLabel (the
+  // most common label among the eight nearest voxels, which is nearly as
+  // fast as Nearest).
+  // The interpolator is not used for Deformable registration, which needs
+  // the gradient of the target and therefore always uses trilinear
+  // interpolation.
   vtkSetMacro(InterpolatorType, int);
   void SetInterpolatorTypeToNearest() {
     this->SetInterpolatorType(Nearest); }
@@ -167,13 +179,18 @@ public:
     this->SetInterpolatorType(ASinc); }
   void SetInterpolatorTypeToLabel() {
     this->SetInterpolatorType(Label); }
+  void SetInterpolatorTypeToMajorityLabel() {
+    this->SetInterpolatorType(MajorityLabel); }
   vtkGetMacro(InterpolatorType, int);
 
   // Description:
   // Set the transform type.  The default is Rigid.  The Similarity
   // transform type adds a universal scale factor, ScaleSourceAxes
   // allows scaling along all three source image axes, ScaleTargetAxes
-  // allows scaling along all three target image axes.
+  // allows scaling along all three target image axes.  The Deformable
+  // transform type keeps the linear transform fixed at the matrix that
+  // is given to Initialize(), and optimizes a B-spline deformation that
+  // is applied to the source coordinates before the linear transform.
   vtkSetMacro(TransformType, int);
   void SetTransformTypeToRigid() {
     this->SetTransformType(Rigid); }
@@ -185,6 +202,8 @@ public:
     this->SetTransformType(ScaleTargetAxes); }
   void SetTransformTypeToAffine() {
     this->SetTransformType(Affine); }
+  void SetTransformTypeToDeformable() {
+    this->SetTransformType(Deformable); }
   vtkGetMacro(TransformType, int);
 
   // Description:
@@ -198,6 +217,77 @@ public:
     this->SetTransformDimensionality(3); }
   vtkGetMacro(TransformDimensionality, int);
 
+  // Description:
+  // Set the number of threads to use for the metric and for resampling
+  // the target image.  The default value of zero will use the default
+  // number of threads for VTK.
+  vtkSetMacro(NumberOfThreads, int);
+  vtkGetMacro(NumberOfThreads, int);
+
+  // Description:
+  // Do the registration in single precision.  The default is Off.
+  // When this is on, double images are converted to float and the B-spline
+  // coefficients are always float.  For SquaredDifference and the
+  // correlation metrics, the source and the resampled target are also
+  // float, so that the per-voxel arithmetic is done in float (and can use
+  // SIMD instructions) while only the sums are done in double.  This halves
+  // the memory that is needed for a prefiltered target.
+  vtkSetMacro(SinglePrecision, bool);
+  vtkGetMacro(SinglePrecision, bool);
+  vtkBooleanMacro(SinglePrecision, bool);
+
+  // Description:
+  // Place the data for large volumes for NUMA systems.  The default is Off.
+  // When this is on, the source image is copied slab by slab, each slab
+  // of the resampled target is computed, and each slab is compared by the
+  // metric, all by the same CPU, so that each slab stays in the memory that
+  // is local to that CPU.  The threads are only bound to CPUs on Linux.
+  vtkSetMacro(ThreadAffinity, bool);
+  vtkGetMacro(ThreadAffinity, bool);
+  vtkBooleanMacro(ThreadAffinity, bool);
+
+  // Description:
+  // Do a symmetric (inverse-consistent) registration.  The default is Off.
+  // When this is on, the transform is split into two halves, and at each
+  // step the target is resampled with one half and the source with the
+  // inverse of the other half, into a halfway space that has the same
+  // sampling grid as the source.  Both images are interpolated, so the
+  // result is the same (but inverted) if the images are swapped.  The
+  // source stencil, if any, is resampled into the halfway space along
+  // with the source.  This is not done for slice-to-volume registration.
+  vtkSetMacro(Symmetric, bool);
+  vtkGetMacro(Symmetric, bool);
+  vtkBooleanMacro(Symmetric, bool);
+
+  // Description:
+  // Set the thickness of the source slice for slice-to-volume registration.
+  // If the source image is a single slice and the target is a volume, and
+  // the transform is 3D, then the slice is registered to the volume with
+  // the full 3D transform and only the pixels of the slice are resampled
+  // at each evaluation.  If the thickness is set, the target is averaged
+  // over this thickness around the slice in order to match the slice
+  // profile of the source.  The default is zero, which samples the target
+  // only at the plane of the slice.
+  vtkSetMacro(SourceSliceThickness, double);
+  vtkGetMacro(SourceSliceThickness, double);
+
+  // Description:
+  // Check whether the last call to Initialize() set up a slice-to-volume
+  // registration, i.e. a single-slice source and a multi-slice target.
+  vtkGetMacro(SliceToVolume, bool);
+
+  // Description:
+  // Set the spacing of the control point grid for Deformable registration,
+  // in the same units as the image spacing.  The default value of zero
+  // will use a spacing of eight times the largest source voxel spacing.
+  // When Initialize() is called, the current deformation is kept if its
+  // grid spacing is equal to this spacing or is larger by a power of two,
+  // in which case the grid is refined.  This allows a deformable
+  // registration to be done from coarse to fine by halving the grid
+  // spacing at each level.  Otherwise, the deformation is reset.
+  vtkSetMacro(DeformableGridSpacing, double);
+  vtkGetMacro(DeformableGridSpacing, double);
+
   // Description:
   // Set the initializer type.  The default is None.  The Centered
   // initializer sets an initial translation that will center the
@@ -215,16 +305,52 @@ public:
   vtkSetVector2Macro(JointHistogramSize, int);
   vtkGetVector2Macro(JointHistogramSize, int);
 
+  // Description:
+  // Choose the joint histogram size automatically.  The default is Off.
+  // When this is on, the JointHistogramSize is ignored, and the number of
+  // bins along each axis is chosen when the registration is initialized,
+  // from the interquartile range of each image and the number of source
+  // voxels in the stencil, by the Freedman-Diaconis rule for a 2D
+  // histogram.  If the interquartile range is zero, then Sturges' rule
+  // is used instead.  The result is clamped to the range [16, 256].
+  vtkSetMacro(AutomaticHistogramSize, bool);
+  vtkGetMacro(AutomaticHistogramSize, bool);
+  vtkBooleanMacro(AutomaticHistogramSize, bool);
+
+  // Description:
+  // Get the joint histogram size that is being used.  This is only valid
+  // after the registration has been initialized.
+  vtkGetVector2Macro(EffectiveJointHistogramSize, int);
+
   // Description:
   // Set the ranges of the two axes of the joint histogram.
-  // By default, the joint histogram covers the full range of data values
-  // present in the image (this default is used whenever the first value
-  // in the range is greater than the second value in the range).
+  // By default, the joint histogram covers the range of data values
+  // between the ImageRangePercentiles (this default is used whenever the
+  // first value in the range is greater than the second value in the range).
   vtkSetVector2Macro(SourceImageRange, double);
   vtkSetVector2Macro(TargetImageRange, double);
   vtkGetVector2Macro(SourceImageRange, double);
   vtkGetVector2Macro(TargetImageRange, double);
 
+  // Description:
+  // Set the percentiles for computing the default image ranges.  The
+  // default is 0 and 100, which gives the full range of the data.  Values
+  // such as 0.1 and 99.9 will exclude outliers (the values outside of the
+  // range are clamped to the range).  The range for each image is only
+  // computed again if the image has been modified.
+  vtkSetVector2Macro(ImageRangePercentiles, double);
+  vtkGetVector2Macro(ImageRangePercentiles, double);
+
+  // Description:
+  // Compute the range of an image between the given percentiles, with a
+  // single (multithreaded) histogram pass.  The stencil is optional.  The
+  // range can be expanded by the given fractions of its width, but it
+  // will not be expanded beyond the minimum and maximum values.
+  static void ComputePercentileRange(
+    vtkImageData *data, vtkImageStencilData *stencil,
+    const double percentiles[2], const double expansion[2],
+    double range[2]);
+
   // Description:
   // Initialize the transform.  This will also initialize the
   // NumberOfEvaluations to zero.  If a TransformInitializer is
@@ -262,14 +388,62 @@ public:
   vtkSetMacro(MaximumNumberOfEvaluations, int);
   vtkGetMacro(MaximumNumberOfEvaluations, int);
 
+  // Description:
+  // Turn on the convergence monitor.  Default: Off.  The monitor fits
+  // a line to the cost versus the number of evaluations over the last
+  // few iterations, and stops the registration once the improvement
+  // that could be expected from continuing is below the noise floor
+  // of the cost, and once the parameter steps have become smaller than
+  // the initial parameter scales.  This trims the long, flat tails that
+  // are common at the coarse levels of a multi-resolution registration.
+  // The monitor is not used for Deformable registration, which stops
+  // once its step size falls below the TransformTolerance.
+  vtkSetMacro(ConvergenceMonitor, bool);
+  vtkGetMacro(ConvergenceMonitor, bool);
+  vtkBooleanMacro(ConvergenceMonitor, bool);
+
+  // Description:
+  // Set the number of iterations that the convergence monitor will look
+  // back over to measure the rate of improvement.  Default: 3.
+  vtkSetClampMacro(ConvergenceWindow, int, 2, 100);
+  vtkGetMacro(ConvergenceWindow, int);
+
+  // Description:
+  // Set the threshold for the convergence monitor, as a multiple of the
+  // noise floor.  The noise floor is the larger of the residual of the
+  // line fit (i.e. the jitter in the cost trajectory) and the CostTolerance
+  // times the current cost.  Default: 1.0.
+  vtkSetMacro(ConvergenceThreshold, double);
+  vtkGetMacro(ConvergenceThreshold, double);
+
+  // Description:
+  // Check whether the last call to Iterate() or UpdateRegistration()
+  // was stopped by the convergence monitor.
+  vtkGetMacro(StoppedByConvergenceMonitor, bool);
+
   // Description:
   // Get the number of times that the metric has been evaluated.
   int GetNumberOfEvaluations();
 
   // Description:
   // Get the last transform that was produced by the optimizer.
+  // For a Deformable registration, this is the linear part of the
+  // transformation.
   vtkLinearTransform *GetTransform();
 
+  // Description:
+  // Get the deformation that was produced by a Deformable registration.
+  // The deformation is applied to the source coordinates before the
+  // linear transform.  It will be an identity transform if the last
+  // registration was not Deformable.
+  vtkBSplineGridTransform *GetDeformation() { return this->Deformation; }
+
+  // Description:
+  // Get the full source-to-target transformation, i.e. the deformation
+  // followed by the linear transform.  This can be used with the
+  // vtkImageReslice filter to resample the target image.
+  vtkAbstractTransform *GetDeformableTransform();
+
   // Description:
   // Get the current value of the metric.
   vtkGetMacro(MetricValue, double);
@@ -312,21 +486,93 @@ public:
   // been reached.
   int Iterate();
 
+  // Description:
+  // Save the state of the registration to a stream, so that an interrupted
+  // registration can be resumed later.  The state includes the initial
+  // matrix, the evaluation counts, and the complete optimizer state.
+  void SaveState(ostream& os);
+
+  // Description:
+  // Restore a state that was saved with SaveState().  Before this is
+  // called, the registration must have been set up and initialized with
+  // the same settings that were used when the state was saved.  Returns
+  // zero if the state could not be read or does not match the settings.
+  int RestoreState(istream& is);
+
   // Description:
   // Start registration.  The registration will run to completion,
   // according to the optimization parameters that were set.  To
   // see intermediate results, set an observer for ProgressEvents.
   // There will be one ProgressEvent per iteration.  This will return
   // zero if the maximum number of iterations was reached before convergence.
+  // An IterationEvent is also invoked after every iteration, and its
+  // call data is an IterationEventData struct with the current state.
   int UpdateRegistration();
 
+  // Description:
+  // The call data for the IterationEvent.  It holds the iteration number,
+  // the number of evaluations, the cost, the parameters (or, for
+  // deformable registration, the deformation coefficients), and the
+  // linear transform matrix in row-major order.  Observers should copy
+  // whatever they need, since the data is only valid during the event,
+  // but they do not have to query the registration while it is running.
+  struct IterationEventData
+  {
+    int Iteration;
+    int NumberOfEvaluations;
+    double Cost;
+    int NumberOfParameters;
+    const double *Parameters;
+    double Matrix[16];
+  };
+
+  // Description:
+  // Start the registration on a worker thread and return immediately.
+  // The input pipeline is updated on the calling thread before the worker
+  // thread is started, and the pipeline must not be modified until the
+  // registration has finished.  All events, including the IterationEvent,
+  // are invoked from the worker thread.  Returns zero if a registration is
+  // already running.
+  int StartRegistration();
+
+  // Description:
+  // Wait for the registration started by StartRegistration() to finish,
+  // and return the value that UpdateRegistration() would have returned.
+  int WaitForRegistration();
+
+  // Description:
+  // Check whether the registration started by StartRegistration() is
+  // still running.
+  int IsRegistrationRunning();
+
+  // Description:
+  // Abort the registration.  This can be called from any thread, or from
+  // within an observer.  The metric evaluation that is in progress is
+  // interrupted, and the transform is reset to the result of the last
+  // iteration that was completed.
+  void AbortRegistration();
+
 protected:
   vtkImageRegistration();
   ~vtkImageRegistration();
 
   void ComputeImageRange(vtkImageData *data, vtkImageStencilData *stencil,
                          double range[2]);
+  void ComputeImageStatistics(vtkImageData *data,
+                              vtkImageStencilData *stencil,
+                              double range[2], double quartiles[2],
+                              double *count);
+  void ComputeJointHistogramSize(vtkImageData *source,
+                                 vtkImageData *target);
+  void InitializeDeformable(vtkMatrix4x4 *matrix, vtkImageData *source,
+                            vtkImageData *target);
   int ExecuteRegistration();
+  void ResetAbort();
+
+  // Description:
+  // Record the results of the last iteration for the convergence monitor,
+  // and return true if the monitor says that registration should stop.
+  bool MonitorConvergence();
 
   // Functions overridden from Superclass
   virtual int ProcessRequest(vtkInformation *,
@@ -350,17 +596,31 @@ protected:
   int                              TransformType;
   int                              InitializerType;
   int                              TransformDimensionality;
+  double                           SourceSliceThickness;
+  double                           DeformableGridSpacing;
+  int                              NumberOfThreads;
+  bool                             SinglePrecision;
+  bool                             ThreadAffinity;
+  bool                             Symmetric;
+  bool                             SliceToVolume;
 
   int                              MaximumNumberOfIterations;
   int                              MaximumNumberOfEvaluations;
   double                           CostTolerance;
   double                           TransformTolerance;
+  bool                             ConvergenceMonitor;
+  int                              ConvergenceWindow;
+  double                           ConvergenceThreshold;
+  bool                             StoppedByConvergenceMonitor;
   double                           MetricValue;
   double                           CostValue;
 
   int                              JointHistogramSize[2];
+  int                              EffectiveJointHistogramSize[2];
+  bool                             AutomaticHistogramSize;
   double                           SourceImageRange[2];
   double                           TargetImageRange[2];
+  double                           ImageRangePercentiles[2];
 
   vtkTimeStamp                     ExecuteTime;
 
@@ -368,12 +628,17 @@ protected:
   vtkImageSimilarityMetric        *Metric;
   vtkAbstractImageInterpolator    *Interpolator;
   vtkTransform                    *Transform;
+  vtkBSplineGridTransform         *Deformation;
+  vtkGeneralTransform             *DeformableTransform;
 
   vtkMatrix4x4                    *InitialTransformMatrix;
+  vtkMatrix4x4                    *ResliceMatrix;
   vtkImageReslice                 *ImageReslice;
-  vtkImageBSplineCoefficients     *ImageBSpline;
-  vtkImageShiftScale              *SourceImageTypecast;
-  vtkImageShiftScale              *TargetImageTypecast;
+  vtkImageReslice                 *SourceReslice;
+  vtkMatrix4x4                    *HalfMatrix;
+  vtkMatrix4x4                    *InverseHalfMatrix;
+  vtkImageStencilData             *HalfwayStencil;
+  vtkImageData                    *SourceImageCopy;
 
   vtkImageRegistrationInfo        *RegistrationInfo;
 
@@ -382,6 +647,8 @@ protected:
   vtkDoubleArray                  *CostValues;
   vtkDoubleArray                  *ParameterValues;
 
+  friend struct vtkImageRegistrationInfo;
+
 private:
   // Copy constructor and assigment operator are purposely not implemented
   vtkImageRegistration(const vtkImageRegistration&);
@@ -37,6 +37,8 @@ vtkImageSimilarityMetric::vtkImageSimilarityMetric()
   this->Value = 0.0;
   this->Cost = 0.0;
 
+  this->ThreadAffinity = false;
+
   this->SetNumberOfInputPorts(3);
   this->SetNumberOfOutputPorts(0);
 }
@@ -57,6 +59,8 @@ void vtkImageSimilarityMetric::PrintSelf(ostream& os, vtkIndent indent)
      << this->InputRange[1][0] << ", " << this->InputRange[1][1] << ")\n";
   os << indent << "Value: " << this->Value << "\n";
   os << indent << "Cost: " << this->Cost << "\n";
+  os << indent << "ThreadAffinity: "
+     << (this->ThreadAffinity ? "On\n" : "Off\n");
 }
 
 //----------------------------------------------------------------------------
@@ -143,12 +147,29 @@ int vtkImageSimilarityMetric::RequestUpdateExtent(
   inInfo0->Set(vtkStreamingDemandDrivenPipeline::UPDATE_EXTENT(), inExt0, 6);
   inInfo1->Set(vtkStreamingDemandDrivenPipeline::UPDATE_EXTENT(), inExt1, 6);
 
-  // need to set the stencil update extent to the input extent
+  // need to set the stencil update extent to the extent that will be
+  // compared, i.e. the intersection of the input extents
   if (this->GetNumberOfInputConnections(2) > 0)
     {
+    int stencilExt[6];
+    for (int i = 0; i < 6; i += 2)
+      {
+      int j = i + 1;
+      stencilExt[i] = (inExt0[i] > inExt1[i] ? inExt0[i] : inExt1[i]);
+      stencilExt[j] = (inExt0[j] < inExt1[j] ? inExt0[j] : inExt1[j]);
+      if (stencilExt[i] > stencilExt[j])
+        {
+        // no overlap, use the first input's extent
+        for (int k = 0; k < 6; k++)
+          {
+          stencilExt[k] = inExt0[k];
+          }
+        break;
+        }
+      }
     vtkInformation *stencilInfo = inputVector[2]->GetInformationObject(0);
     stencilInfo->Set(vtkStreamingDemandDrivenPipeline::UPDATE_EXTENT(),
-                     inExt0, 6);
+                     stencilExt, 6);
     }
 
   return 1;
@@ -183,11 +204,16 @@ vtkImageSimilarityMetricThreadStruct::ThreadExecute(void *arg)
   int total = ts->Algorithm->SplitExtent(
     splitExt, ts->Extent, ti->ThreadID, ti->NumberOfThreads);
 
-  if (ti->ThreadID < total &&
+  // skip the piece if the execution has been aborted
+  if (ti->ThreadID < total && !ts->Algorithm->GetAbortExecute() &&
       splitExt[1] >= splitExt[0] &&
       splitExt[3] >= splitExt[2] &&
       splitExt[5] >= splitExt[4])
     {
+    // bind the thread to a CPU if requested
+    vtkImageSimilarityMetricThreadAffinity affinity(
+      ts->Algorithm->ThreadAffinity ? ti->ThreadID : -1);
+
     ts->Algorithm->PieceRequestData(
       ts->Request, ts->InputsInfo, ts->OutputsInfo,
       splitExt, ti->ThreadID);
@@ -222,7 +248,10 @@ void vtkImageSimilarityMetricFunctor::operator()(
 {
   vtkImageSimilarityMetricThreadStruct *ts = this->PipelineInfo;
 
-  for (vtkIdType piece = begin; piece < end; piece++)
+  // stop early if the execution has been aborted
+  for (vtkIdType piece = begin;
+       piece < end && !ts->Algorithm->GetAbortExecute();
+       piece++)
     {
     int splitExt[6] = { 0, -1, 0, -1, 0, -1 };
 
@@ -320,7 +349,7 @@ int vtkImageSimilarityMetric::RequestData(
     }
 
 #ifdef USE_SMP_THREADED_IMAGE_ALGORITHM
-  if (this->EnableSMP)
+  if (this->EnableSMP && !this->ThreadAffinity)
     {
     // code for vtkSMPTools
 
@@ -82,6 +82,21 @@ public:
   double GetCost() { return this->Cost; }
   //@}
 
+  //@{
+  //! Always process the same slab of the input with the same CPU.
+  /*!
+   *  When this is on, the input is split into the same slabs every time
+   *  the metric executes, the slab for each thread is always processed by
+   *  the same CPU, and vtkMultiThreader is used even if SMP is enabled.
+   *  On a NUMA system, if the input data for each slab was first touched
+   *  by the same CPU, then all memory accesses will be local.  The binding
+   *  of threads to CPUs is only done on Linux.  The default is Off.
+   */
+  vtkSetMacro(ThreadAffinity, bool);
+  vtkGetMacro(ThreadAffinity, bool);
+  vtkBooleanMacro(ThreadAffinity, bool);
+  //@}
+
 protected:
   vtkImageSimilarityMetric();
   ~vtkImageSimilarityMetric();
@@ -142,6 +157,8 @@ private:
   double Value;
   double Cost;
 
+  bool ThreadAffinity;
+
   friend class vtkImageSimilarityMetricFunctor;
   friend struct vtkImageSimilarityMetricThreadStruct;
 };
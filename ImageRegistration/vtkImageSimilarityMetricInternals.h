@@ -27,6 +27,66 @@
 #include <vtkSMPTools.h>
 #endif
 
+#if defined(__linux__)
+#include <sched.h>
+#endif
+
+//----------------------------------------------------------------------------
+// While this object exists, the calling thread is bound to a single CPU,
+// chosen from the CPUs that the thread is currently allowed to use.  A given
+// threadId is always bound to the same CPU, so if each thread always works
+// on the same slab of an image, the memory for that slab will be placed on
+// the NUMA node of the CPU that processes it (by the first-touch policy).
+// A negative threadId does nothing.  The destructor restores the previous
+// affinity.  Binding is only done on Linux.
+class vtkImageSimilarityMetricThreadAffinity
+{
+public:
+  vtkImageSimilarityMetricThreadAffinity(int threadId) : Bound(false)
+    {
+#if defined(__linux__) && defined(CPU_SETSIZE)
+    if (threadId >= 0 &&
+        sched_getaffinity(0, sizeof(this->Saved), &this->Saved) == 0)
+      {
+      int n = CPU_COUNT(&this->Saved);
+      int k = (n > 0 ? threadId % n : -1);
+      for (int cpu = 0; k >= 0 && cpu < CPU_SETSIZE; cpu++)
+        {
+        if (CPU_ISSET(cpu, &this->Saved) && k-- == 0)
+          {
+          cpu_set_t mask;
+          CPU_ZERO(&mask);
+          CPU_SET(cpu, &mask);
+          this->Bound = (sched_setaffinity(0, sizeof(mask), &mask) == 0);
+          }
+        }
+      }
+#else
+    (void)threadId;
+#endif
+    }
+
+  ~vtkImageSimilarityMetricThreadAffinity()
+    {
+#if defined(__linux__) && defined(CPU_SETSIZE)
+    if (this->Bound)
+      {
+      sched_setaffinity(0, sizeof(this->Saved), &this->Saved);
+      }
+#endif
+    }
+
+private:
+  vtkImageSimilarityMetricThreadAffinity(
+    const vtkImageSimilarityMetricThreadAffinity&);
+  void operator=(const vtkImageSimilarityMetricThreadAffinity&);
+
+  bool Bound;
+#if defined(__linux__) && defined(CPU_SETSIZE)
+  cpu_set_t Saved;
+#endif
+};
+
 #ifdef USE_SMP_THREADED_IMAGE_ALGORITHM
 //----------------------------------------------------------------------------
 // Given a per-thread data structure T, this template provides an iterator
@@ -101,7 +161,7 @@ public:
 
   void Initialize(vtkImageSimilarityMetric *a)
     {
-    if (!a->GetEnableSMP())
+    if (!a->GetEnableSMP() || a->GetThreadAffinity())
       {
       size_t n = a->GetNumberOfThreads();
       this->MT = new T[n];
@@ -205,4 +265,108 @@ private:
 
 #endif
 
+//----------------------------------------------------------------------------
+// Span kernels for single-precision data.  The voxels are summed in blocks,
+// and within each block the arithmetic is done in float with eight
+// independent partial sums, which allows the compiler to use SIMD
+// instructions.  Only the block sums are accumulated in double, so the
+// rounding error does not grow with the size of the image.
+
+#define VTK_SIMILARITY_METRIC_FLOAT_BLOCK 256
+
+//----------------------------------------------------------------------------
+// Sum of squared differences for two contiguous float spans.
+inline double vtkImageSimilarityMetricSumSquares(
+  const float *x, const float *y, vtkIdType n)
+{
+  double sum = 0.0;
+
+  while (n > 0)
+    {
+    int m = (n < VTK_SIMILARITY_METRIC_FLOAT_BLOCK ?
+             static_cast<int>(n) : VTK_SIMILARITY_METRIC_FLOAT_BLOCK);
+    n -= m;
+
+    float s[8] = { 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f };
+    int i = 0;
+    for (; i + 8 <= m; i += 8)
+      {
+      for (int l = 0; l < 8; l++)
+        {
+        float d = y[i + l] - x[i + l];
+        s[l] += d*d;
+        }
+      }
+    for (; i < m; i++)
+      {
+      float d = y[i] - x[i];
+      s[0] += d*d;
+      }
+
+    sum += (static_cast<double>(s[0] + s[1]) + (s[2] + s[3]) +
+            (s[4] + s[5]) + (s[6] + s[7]));
+    x += m;
+    y += m;
+    }
+
+  return sum;
+}
+
+//----------------------------------------------------------------------------
+// The sums x, y, x*x, y*y, x*y for two contiguous float spans, added to
+// the supplied sums.
+inline void vtkImageSimilarityMetricCrossSums(
+  const float *x, const float *y, vtkIdType n, double sums[5])
+{
+  while (n > 0)
+    {
+    int m = (n < VTK_SIMILARITY_METRIC_FLOAT_BLOCK ?
+             static_cast<int>(n) : VTK_SIMILARITY_METRIC_FLOAT_BLOCK);
+    n -= m;
+
+    float s[5][8];
+    for (int k = 0; k < 5; k++)
+      {
+      for (int l = 0; l < 8; l++)
+        {
+        s[k][l] = 0.0f;
+        }
+      }
+
+    int i = 0;
+    for (; i + 8 <= m; i += 8)
+      {
+      for (int l = 0; l < 8; l++)
+        {
+        float a = x[i + l];
+        float b = y[i + l];
+        s[0][l] += a;
+        s[1][l] += b;
+        s[2][l] += a*a;
+        s[3][l] += b*b;
+        s[4][l] += a*b;
+        }
+      }
+    for (; i < m; i++)
+      {
+      float a = x[i];
+      float b = y[i];
+      s[0][0] += a;
+      s[1][0] += b;
+      s[2][0] += a*a;
+      s[3][0] += b*b;
+      s[4][0] += a*b;
+      }
+
+    for (int k = 0; k < 5; k++)
+      {
+      const float *t = s[k];
+      sums[k] += (static_cast<double>(t[0] + t[1]) + (t[2] + t[3]) +
+                  (t[4] + t[5]) + (t[6] + t[7]));
+      }
+    x += m;
+    y += m;
+    }
+}
+
 #endif /* vtkImageSimilarityMetricInternals_h */
@@ -71,6 +71,32 @@ void vtkImageSquaredDifference::PrintSelf(ostream& os, vtkIndent indent)
 // begin anonymous namespace
 namespace {
 
+//----------------------------------------------------------------------------
+// Sum the squared differences over a span.
+template<class T1, class T2>
+double vtkImageSquaredDifferenceSpan(
+  const T1 *inPtr, const T2 *inPtr1, vtkIdType n)
+{
+  double s = 0;
+
+  for (vtkIdType i = 0; i < n; i++)
+    {
+    double x = inPtr[i];
+    double y = inPtr1[i];
+    double d = y - x;
+    s += d*d;
+    }
+
+  return s;
+}
+
+// For float data, do the per-voxel arithmetic in single precision.
+inline double vtkImageSquaredDifferenceSpan(
+  const float *inPtr, const float *inPtr1, vtkIdType n)
+{
+  return vtkImageSimilarityMetricSumSquares(inPtr, inPtr1, n);
+}
+
 //----------------------------------------------------------------------------
 template<class T1, class T2>
 void vtkImageSquaredDifferenceExecute(
@@ -88,8 +114,8 @@ void vtkImageSquaredDifferenceExecute(
   double sqsum = 0;
   vtkIdType count = 0;
 
-  // iterate over all spans in the stencil
-  while (!inIter.IsAtEnd())
+  // iterate over all spans in the stencil, unless aborted
+  while (!inIter.IsAtEnd() && !self->GetAbortExecute())
     {
     if (inIter.IsInStencil())
       {
@@ -97,19 +123,9 @@ void vtkImageSquaredDifferenceExecute(
       T1 *inPtrEnd = inIter.EndSpan();
       inPtr1 = inIter1.BeginSpan();
 
-      double s = 0;
-
-      // iterate over all voxels in the span
-      while (inPtr != inPtrEnd)
-        {
-        double x = *inPtr++;
-        double y = *inPtr1++;
-        double d = y - x;
-        s += d*d;
-        }
-
-      count += static_cast<vtkIdType>(inPtrEnd - inPtr);
-      sqsum += s;
+      vtkIdType n = static_cast<vtkIdType>(inPtrEnd - inPtr);
+      sqsum += vtkImageSquaredDifferenceSpan(inPtr, inPtr1, n);
+      count += n;
       }
     inIter.NextSpan();
     inIter1.NextSpan();
@@ -0,0 +1,312 @@
+/*=========================================================================
+
+  Module: vtkInterpolationWeightsCache.h
+
+  Copyright (c) 2016 David Gobbi
+  All rights reserved.
+  See Copyright.txt or http://dgobbi.github.io/bsd3.txt for details.
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notice for more information.
+
+=========================================================================*/
+// This is an internal header for use in image interpolators.  It provides
+// a cache for the tables that are built by PrecomputeWeightsForExtent(),
+// so that when many images are resampled onto the same grid, the tables
+// are only computed once.  The cache is shared by all interpolators, and
+// the key contains the class name, the matrix, the extents, the layout
+// of the input, and whatever kernel parameters the interpolator supplies.
+
+#ifndef vtkInterpolationWeightsCache_h
+#define vtkInterpolationWeightsCache_h
+
+#include "vtkImageInterpolatorInternals.h"
+#include "vtkMutexLock.h"
+
+#include <map>
+#include <string>
+#include <vector>
+
+// the number of unused tables that are kept in the cache
+#define VTK_INTERPOLATION_WEIGHTS_CACHE_SIZE 32
+
+//----------------------------------------------------------------------------
+class vtkInterpolationWeightsCache
+{
+public:
+  // Create a key for the given interpolator class.  The kernel parameters
+  // must be added with AddParameter() before Find() is called.
+  vtkInterpolationWeightsCache(const char *className)
+    : ClassName(className) {}
+
+  // Add a parameter that affects the weights, e.g. the kernel radius.
+  void AddParameter(double value)
+    {
+    this->Parameters.push_back(value);
+    }
+
+  void AddParameters(const double *values, int n)
+    {
+    this->Parameters.insert(this->Parameters.end(), values, values + n);
+    }
+
+  // Look for weights that were computed with the same parameters.  If they
+  // are found, then their tables are placed in "weights" and the clipped
+  // extent is returned in "clipExt".  The tables belong to the cache, and
+  // must be released with Release() rather than deleted.
+  template<class F>
+  bool Find(const F newmat[16], const int outExt[6], const F bounds[6],
+            vtkInterpolationWeights *weights, int clipExt[6]);
+
+  // Add newly computed weights to the cache.  If another thread added the
+  // same weights in the meantime, then these weights are not added, and
+  // they remain the responsibility of the caller.
+  void Insert(const vtkInterpolationWeights *weights, const int clipExt[6]);
+
+  // If the tables are held by the cache, then release them, delete the
+  // weights, and return true.  Otherwise, return false so that the caller
+  // will free the weights the usual way.
+  static bool Release(vtkInterpolationWeights *&weights);
+
+private:
+  struct Key
+  {
+    std::string ClassName;
+    std::vector<double> Values;
+
+    bool operator<(const Key& other) const
+    {
+      if (this->ClassName != other.ClassName)
+        {
+        return (this->ClassName < other.ClassName);
+        }
+      return (this->Values < other.Values);
+    }
+  };
+
+  struct Entry
+  {
+    int WeightType;
+    int KernelSize[3];
+    int WeightExtent[6];
+    int ClipExtent[6];
+    vtkIdType *Positions[3];
+    void *Weights[3];
+    int Users;
+    unsigned long LastUse;
+  };
+
+  typedef std::map<Key, Entry> EntryMap;
+
+  // The table owns the tables for all of the entries
+  struct Table
+  {
+    EntryMap Entries;
+    unsigned long UseCount;
+    vtkSimpleMutexLock Lock;
+
+    Table() : UseCount(0) {}
+
+    ~Table()
+      {
+      for (EntryMap::iterator iter = this->Entries.begin();
+           iter != this->Entries.end(); ++iter)
+        {
+        FreeEntry(&iter->second);
+        }
+      }
+  };
+
+  static Table *GetTable()
+    {
+    static Table table;
+    return &table;
+    }
+
+  static void FreeEntry(Entry *entry);
+  static void Prune(Table *table);
+
+  std::string ClassName;
+  std::vector<double> Parameters;
+  Key CacheKey;
+};
+
+//----------------------------------------------------------------------------
+template<class F>
+bool vtkInterpolationWeightsCache::Find(
+  const F newmat[16], const int outExt[6], const F bounds[6],
+  vtkInterpolationWeights *weights, int clipExt[6])
+{
+  // everything that is used by PrecomputeWeightsForExtent() goes in the key
+  Key& key = this->CacheKey;
+  key.ClassName = this->ClassName;
+  key.Values.clear();
+  key.Values.reserve(48 + this->Parameters.size());
+  key.Values.push_back(vtkTypeTraits<F>::VTKTypeID());
+  key.Values.insert(key.Values.end(), newmat, newmat + 16);
+  key.Values.insert(key.Values.end(), outExt, outExt + 6);
+  key.Values.insert(key.Values.end(), bounds, bounds + 6);
+  key.Values.insert(key.Values.end(), weights->Extent, weights->Extent + 6);
+  for (int i = 0; i < 3; i++)
+    {
+    key.Values.push_back(static_cast<double>(weights->Increments[i]));
+    }
+  key.Values.push_back(weights->BorderMode);
+  key.Values.push_back(weights->InterpolationMode);
+  key.Values.insert(key.Values.end(),
+                    this->Parameters.begin(), this->Parameters.end());
+
+  Table *table = GetTable();
+  table->Lock.Lock();
+
+  bool found = false;
+  EntryMap::iterator iter = table->Entries.find(key);
+  if (iter != table->Entries.end())
+    {
+    Entry *entry = &iter->second;
+    entry->Users++;
+    entry->LastUse = ++table->UseCount;
+    weights->WeightType = entry->WeightType;
+    for (int j = 0; j < 3; j++)
+      {
+      weights->KernelSize[j] = entry->KernelSize[j];
+      weights->Positions[j] = entry->Positions[j];
+      weights->Weights[j] = entry->Weights[j];
+      }
+    for (int j = 0; j < 6; j++)
+      {
+      weights->WeightExtent[j] = entry->WeightExtent[j];
+      clipExt[j] = entry->ClipExtent[j];
+      }
+    found = true;
+    }
+
+  table->Lock.Unlock();
+
+  return found;
+}
+
+//----------------------------------------------------------------------------
+inline void vtkInterpolationWeightsCache::Insert(
+  const vtkInterpolationWeights *weights, const int clipExt[6])
+{
+  Entry entry;
+  entry.WeightType = weights->WeightType;
+  for (int j = 0; j < 3; j++)
+    {
+    entry.KernelSize[j] = weights->KernelSize[j];
+    entry.Positions[j] = weights->Positions[j];
+    entry.Weights[j] = weights->Weights[j];
+    }
+  for (int j = 0; j < 6; j++)
+    {
+    entry.WeightExtent[j] = weights->WeightExtent[j];
+    entry.ClipExtent[j] = clipExt[j];
+    }
+  entry.Users = 1;
+
+  Table *table = GetTable();
+  table->Lock.Lock();
+
+  entry.LastUse = ++table->UseCount;
+  if (table->Entries.insert(std::make_pair(this->CacheKey, entry)).second)
+    {
+    Prune(table);
+    }
+
+  table->Lock.Unlock();
+}
+
+//----------------------------------------------------------------------------
+inline bool vtkInterpolationWeightsCache::Release(
+  vtkInterpolationWeights *&weights)
+{
+  Table *table = GetTable();
+  table->Lock.Lock();
+
+  // the tables for the x axis uniquely identify the entry
+  EntryMap::iterator iter = table->Entries.begin();
+  while (iter != table->Entries.end() &&
+         iter->second.Positions[0] != weights->Positions[0])
+    {
+    ++iter;
+    }
+
+  bool cached = (iter != table->Entries.end());
+  if (cached)
+    {
+    iter->second.Users--;
+    Prune(table);
+    }
+
+  table->Lock.Unlock();
+
+  if (cached)
+    {
+    delete weights;
+    weights = NULL;
+    }
+
+  return cached;
+}
+
+//----------------------------------------------------------------------------
+// Remove the least recently used entries that have no users, until there
+// are no more than VTK_INTERPOLATION_WEIGHTS_CACHE_SIZE unused entries.
+inline void vtkInterpolationWeightsCache::Prune(Table *table)
+{
+  for (;;)
+    {
+    int unused = 0;
+    EntryMap::iterator oldest = table->Entries.end();
+    for (EntryMap::iterator iter = table->Entries.begin();
+         iter != table->Entries.end(); ++iter)
+      {
+      if (iter->second.Users == 0)
+        {
+        unused++;
+        if (oldest == table->Entries.end() ||
+            iter->second.LastUse < oldest->second.LastUse)
+          {
+          oldest = iter;
+          }
+        }
+      }
+    if (unused <= VTK_INTERPOLATION_WEIGHTS_CACHE_SIZE)
+      {
+      break;
+      }
+    FreeEntry(&oldest->second);
+    table->Entries.erase(oldest);
+    }
+}
+
+//----------------------------------------------------------------------------
+// Free the tables in the same way as vtkAbstractImageInterpolator does.
+inline void vtkInterpolationWeightsCache::FreeEntry(Entry *entry)
+{
+  for (int k = 0; k < 3; k++)
+    {
+    int step = entry->KernelSize[k];
+    entry->Positions[k] += step*entry->WeightExtent[2*k];
+    delete [] entry->Positions[k];
+    if (entry->Weights[k])
+      {
+      if (entry->WeightType == VTK_FLOAT)
+        {
+        float *constants = static_cast<float *>(entry->Weights[k]);
+        constants += step*entry->WeightExtent[2*k];
+        delete [] constants;
+        }
+      else
+        {
+        double *constants = static_cast<double *>(entry->Weights[k]);
+        constants += step*entry->WeightExtent[2*k];
+        delete [] constants;
+        }
+      }
+    }
+}
+
+#endif /* vtkInterpolationWeightsCache_h */
@@ -36,10 +36,14 @@
 
 #include "vtkLabelInterpolator.h"
 #include "vtkImageInterpolatorInternals.h"
+#include "vtkInterpolationWeightsCache.h"
 #include "vtkImageData.h"
 #include "vtkDataArray.h"
 #include "vtkObjectFactory.h"
 
+#include <vector>
+#include <string.h>
+
 #include "vtkTemplateAliasMacro.h"
 // turn off 64-bit ints when templating over all types, because
 // they cannot be faithfully represented by doubles
@@ -64,11 +68,20 @@
 // in order to provide sufficient precision for 16-bit images
 #define VTK_LABEL_KERNEL_TABLE_DIVISIONS 256
 
+// initial number of slots in the label hash table (must be a power of two),
+// the table grows as needed if the kernel covers many labels
+#define VTK_LABEL_HASH_INITIAL_SIZE 64
+
+// maximum number of taps for the majority kernel
+#define VTK_LABEL_MAJORITY_TAPS_MAX 27
+
 vtkStandardNewMacro(vtkLabelInterpolator);
 
 //----------------------------------------------------------------------------
 vtkLabelInterpolator::vtkLabelInterpolator()
 {
+  this->KernelType = VTK_LABEL_GAUSSIAN_KERNEL;
+  this->MajorityKernelSize = 2;
   this->RadiusFactors[0] = 3;
   this->RadiusFactors[1] = 3;
   this->RadiusFactors[2] = 3;
@@ -101,6 +114,10 @@ void vtkLabelInterpolator::PrintSelf(ostream& os, vtkIndent indent)
 {
   this->Superclass::PrintSelf(os,indent);
 
+  os << indent << "KernelType: "
+     << this->GetKernelTypeAsString() << "\n";
+  os << indent << "MajorityKernelSize: "
+     << this->MajorityKernelSize << "\n";
   os << indent << "RadiusFactors: " << this->RadiusFactors[0] << " "
      << this->RadiusFactors[1] << " " << this->RadiusFactors[2] << "\n";
   os << indent << "BlurFactors: " << this->BlurFactors[0] << " "
@@ -113,6 +130,24 @@ void vtkLabelInterpolator::PrintSelf(ostream& os, vtkIndent indent)
 void vtkLabelInterpolator::ComputeSupportSize(
   const double matrix[16], int size[3])
 {
+  // the majority kernel has a fixed size, it is never blurred
+  if (this->KernelType == VTK_LABEL_MAJORITY_KERNEL)
+    {
+    for (int i = 0; i < 3; i++)
+      {
+      size[i] = 2*static_cast<int>(
+        this->GetKernelRadius(i) + 1.0 - VTK_INTERPOLATE_FLOOR_TOL);
+      }
+    if (matrix)
+      {
+      this->KernelSize[0] = size[0];
+      this->KernelSize[1] = size[1];
+      this->KernelSize[2] = size[2];
+      this->InternalUpdate();
+      }
+    return;
+    }
+
   // compute the default support size for when matrix is null
   if (this->Antialiasing)
     {
@@ -126,12 +161,12 @@ void vtkLabelInterpolator::ComputeSupportSize(
       {
       // use blur factors to compute support size
       size[i] = 2*static_cast<int>(
-        this->RadiusFactors[i] + 1.0 - VTK_INTERPOLATE_FLOOR_TOL);
+        this->GetKernelRadius(i) + 1.0 - VTK_INTERPOLATE_FLOOR_TOL);
       double rowscale = this->BlurFactors[i];
       if (rowscale > (1.0 + VTK_INTERPOLATE_FLOOR_TOL))
         {
         size[i] = 2*static_cast<int>(
-          rowscale*this->RadiusFactors[i] + 1.0 - VTK_INTERPOLATE_FLOOR_TOL);
+          rowscale*this->GetKernelRadius(i) + 1.0 - VTK_INTERPOLATE_FLOOR_TOL);
         }
       }
     }
@@ -148,7 +183,7 @@ void vtkLabelInterpolator::ComputeSupportSize(
       {
       this->BlurFactors[i] = 1.0;
       this->KernelSize[i] = 2*static_cast<int>(
-        this->RadiusFactors[i] + 1.0 - VTK_INTERPOLATE_FLOOR_TOL);
+        this->GetKernelRadius(i) + 1.0 - VTK_INTERPOLATE_FLOOR_TOL);
       }
     }
   else
@@ -199,7 +234,7 @@ void vtkLabelInterpolator::ComputeSupportSize(
       // need extra suport for antialiasing
       this->BlurFactors[i] = rowscale;
       int s = 2*static_cast<int>(
-        rowscale*this->RadiusFactors[i] + 1.0 - VTK_INTERPOLATE_FLOOR_TOL);
+        rowscale*this->GetKernelRadius(i) + 1.0 - VTK_INTERPOLATE_FLOOR_TOL);
       size[i] = s;
       this->KernelSize[i] = s;
       }
@@ -230,6 +265,74 @@ void vtkLabelInterpolator::SetRadiusFactors(
     }
 }
 
+//----------------------------------------------------------------------------
+void vtkLabelInterpolator::SetKernelType(int ktype)
+{
+  static int mintype = VTK_LABEL_GAUSSIAN_KERNEL;
+  static int maxtype = VTK_LABEL_MAJORITY_KERNEL;
+  ktype = ((ktype > mintype) ? ktype : mintype);
+  ktype = ((ktype < maxtype) ? ktype : maxtype);
+  if (this->KernelType != ktype)
+    {
+    this->KernelType = ktype;
+    // reset the kernel size in case ComputeSupportSize() is not called
+    for (int i = 0; i < 3; i++)
+      {
+      this->KernelSize[i] = 2*static_cast<int>(
+        this->GetKernelRadius(i) + 1.0 - VTK_INTERPOLATE_FLOOR_TOL);
+      }
+    this->Modified();
+    }
+}
+
+//----------------------------------------------------------------------------
+void vtkLabelInterpolator::SetMajorityKernelSize(int size)
+{
+  size = ((size > 2) ? 3 : 2);
+  if (this->MajorityKernelSize != size)
+    {
+    this->MajorityKernelSize = size;
+    // reset the kernel size in case ComputeSupportSize() is not called
+    for (int i = 0; i < 3; i++)
+      {
+      this->KernelSize[i] = 2*static_cast<int>(
+        this->GetKernelRadius(i) + 1.0 - VTK_INTERPOLATE_FLOOR_TOL);
+      }
+    this->Modified();
+    }
+}
+
+//----------------------------------------------------------------------------
+const char *vtkLabelInterpolator::GetKernelTypeAsString()
+{
+  const char *result = "";
+
+  switch (this->KernelType)
+    {
+    case VTK_LABEL_GAUSSIAN_KERNEL:
+      result = "Gaussian";
+      break;
+    case VTK_LABEL_MAJORITY_KERNEL:
+      result = "Majority";
+      break;
+    }
+
+  return result;
+}
+
+//----------------------------------------------------------------------------
+double vtkLabelInterpolator::GetKernelRadius(int axis)
+{
+  // the majority kernel covers the 2x2x2 or 3x3x3 neighborhood, but a
+  // 3x3x3 neighborhood needs a window of four voxels since it is centered
+  // on the nearest voxel rather than on the sample point
+  if (this->KernelType == VTK_LABEL_MAJORITY_KERNEL)
+    {
+    return 0.5*this->MajorityKernelSize;
+    }
+  return this->RadiusFactors[axis];
+}
+
 //----------------------------------------------------------------------------
 void vtkLabelInterpolator::SetBlurFactors(double x, double y, double z)
 {
@@ -262,6 +365,8 @@ void vtkLabelInterpolator::InternalDeepCopy(
   vtkLabelInterpolator *obj = vtkLabelInterpolator::SafeDownCast(a);
   if (obj)
     {
+    this->SetKernelType(obj->KernelType);
+    this->SetMajorityKernelSize(obj->MajorityKernelSize);
     this->SetRadiusFactors(obj->RadiusFactors);
     this->SetAntialiasing(obj->Antialiasing);
     if (this->Antialiasing)
@@ -275,9 +380,11 @@ void vtkLabelInterpolator::InternalDeepCopy(
       }
     }
 
-  this->KernelSize[0] = 6;
-  this->KernelSize[1] = 6;
-  this->KernelSize[2] = 6;
+  for (int i = 0; i < 3; i++)
+    {
+    this->KernelSize[i] = 2*static_cast<int>(
+      this->GetKernelRadius(i) + 1.0 - VTK_INTERPOLATE_FLOOR_TOL);
+    }
 
   if (this->KernelLookupTable[0])
     {
@@ -288,8 +395,9 @@ void vtkLabelInterpolator::InternalDeepCopy(
 //----------------------------------------------------------------------------
 void vtkLabelInterpolator::InternalUpdate()
 {
+  bool majority = (this->KernelType == VTK_LABEL_MAJORITY_KERNEL);
   bool blurchange = false;
-  int mode = 0;
+  int mode = this->KernelType;
   int hsize[3];
   for (int i = 0; i < 3; i++)
     {
@@ -303,15 +411,18 @@ void vtkLabelInterpolator::InternalUpdate()
                    VTK_INTERPOLATE_FLOOR_TOL);
     }
 
-  if (this->BlurFactors[0] > 1.0 + VTK_INTERPOLATE_FLOOR_TOL)
+  if (!majority &&
+      this->BlurFactors[0] > 1.0 + VTK_INTERPOLATE_FLOOR_TOL)
     {
     mode |= VTK_INTERPOLATION_WINDOW_XBLUR_MASK;
     }
-  if (this->BlurFactors[1] > 1.0 + VTK_INTERPOLATE_FLOOR_TOL)
+  if (!majority &&
+      this->BlurFactors[1] > 1.0 + VTK_INTERPOLATE_FLOOR_TOL)
     {
     mode |= VTK_INTERPOLATION_WINDOW_YBLUR_MASK;
     }
-  if (this->BlurFactors[2] > 1.0 + VTK_INTERPOLATE_FLOOR_TOL)
+  if (!majority &&
+      this->BlurFactors[2] > 1.0 + VTK_INTERPOLATE_FLOOR_TOL)
     {
     mode |= VTK_INTERPOLATION_WINDOW_ZBLUR_MASK;
     }
@@ -320,9 +431,17 @@ void vtkLabelInterpolator::InternalUpdate()
   mode |= (hsize[1] << VTK_INTERPOLATION_WINDOW_YSIZE_SHIFT);
   mode |= (hsize[2] << VTK_INTERPOLATION_WINDOW_ZSIZE_SHIFT);
 
-  if (this->InterpolationInfo->InterpolationMode != mode ||
-      blurchange ||
-      this->KernelLookupTable[0] == NULL)
+  // the majority vote does not need the kernel lookup tables
+  if (majority)
+    {
+    if (this->KernelLookupTable[0])
+      {
+      this->FreeKernelLookupTable();
+      }
+    }
+  else if (this->InterpolationInfo->InterpolationMode != mode ||
+           blurchange ||
+           this->KernelLookupTable[0] == NULL)
     {
     this->BuildKernelLookupTable();
     }
@@ -394,12 +513,370 @@ void vtkGaussInterpWeights(T *kernel, F *fX, F fx, int m)
   while (--n);
 }
 
+//----------------------------------------------------------------------------
+// Hash functions for label values.  Floating-point labels are hashed by
+// their bits, after adding zero to make -0.0 and +0.0 equivalent.
+inline unsigned int vtkLabelHashMix(vtkTypeUInt64 x)
+{
+  vtkTypeUInt32 h = static_cast<vtkTypeUInt32>(x ^ (x >> 32));
+  h *= 2654435761u;
+  return (h ^ (h >> 16));
+}
+
+template<class T>
+inline unsigned int vtkLabelHash(T label)
+{
+  return vtkLabelHashMix(static_cast<vtkTypeUInt64>(label));
+}
+
+inline unsigned int vtkLabelHash(float label)
+{
+  label += 0.0f;
+  vtkTypeUInt32 x;
+  memcpy(&x, &label, sizeof(x));
+  return vtkLabelHashMix(x);
+}
+
+inline unsigned int vtkLabelHash(double label)
+{
+  label += 0.0;
+  vtkTypeUInt64 x;
+  memcpy(&x, &label, sizeof(x));
+  return vtkLabelHashMix(x);
+}
+
+//----------------------------------------------------------------------------
+// Accumulate the kernel weights for each label with an open-addressed
+// hash table, so that the cost per kernel tap does not depend on the
+// number of distinct labels within the kernel.  The table is kept at
+// most half full, and it lives on the stack unless the kernel covers
+// more than VTK_LABEL_HASH_INITIAL_SIZE/2 labels.  The insertion order
+// is recorded so that ties are broken exactly as they would be by a
+// linear search, and so that the table can be cleared cheaply.
+template<class F, class T>
+class vtkLabelAccumulator
+{
+public:
+  vtkLabelAccumulator();
+  ~vtkLabelAccumulator();
+
+  // Add a weight for a label.
+  void Add(T label, F weight);
+
+  // Get the label with the largest total weight, and clear the table.
+  T GetMaximumAndReset();
+
+private:
+  vtkLabelAccumulator(const vtkLabelAccumulator&);  // Not implemented.
+  void operator=(const vtkLabelAccumulator&);  // Not implemented.
+
+  void Grow();
+
+  int Size;
+  int Count;
+  int LastSlot;
+  T *Labels;
+  F *Weights;
+  unsigned char *Occupied;
+  int *Order;
+
+  T LabelStorage[VTK_LABEL_HASH_INITIAL_SIZE];
+  F WeightStorage[VTK_LABEL_HASH_INITIAL_SIZE];
+  unsigned char OccupiedStorage[VTK_LABEL_HASH_INITIAL_SIZE];
+  int OrderStorage[VTK_LABEL_HASH_INITIAL_SIZE/2];
+
+  // the heap arrays are only allocated if the table has to grow
+  T *LabelHeap;
+  F *WeightHeap;
+  unsigned char *OccupiedHeap;
+  int *OrderHeap;
+};
+
+//----------------------------------------------------------------------------
+template<class F, class T>
+vtkLabelAccumulator<F, T>::vtkLabelAccumulator()
+{
+  this->Size = VTK_LABEL_HASH_INITIAL_SIZE;
+  this->Count = 0;
+  this->LastSlot = -1;
+  this->Labels = this->LabelStorage;
+  this->Weights = this->WeightStorage;
+  this->Occupied = this->OccupiedStorage;
+  this->Order = this->OrderStorage;
+  this->LabelHeap = 0;
+  this->WeightHeap = 0;
+  this->OccupiedHeap = 0;
+  this->OrderHeap = 0;
+  memset(this->OccupiedStorage, 0, VTK_LABEL_HASH_INITIAL_SIZE);
+}
+
+//----------------------------------------------------------------------------
+template<class F, class T>
+vtkLabelAccumulator<F, T>::~vtkLabelAccumulator()
+{
+  delete [] this->LabelHeap;
+  delete [] this->WeightHeap;
+  delete [] this->OccupiedHeap;
+  delete [] this->OrderHeap;
+}
+
+//----------------------------------------------------------------------------
+template<class F, class T>
+inline void vtkLabelAccumulator<F, T>::Add(T label, F weight)
+{
+  // neighboring taps usually have the same label, so check the last one
+  int i = this->LastSlot;
+  if (i >= 0 && this->Labels[i] == label)
+    {
+    this->Weights[i] += weight;
+    return;
+    }
+
+  // linear probing
+  unsigned int mask = this->Size - 1;
+  i = vtkLabelHash(label) & mask;
+  while (this->Occupied[i])
+    {
+    if (this->Labels[i] == label)
+      {
+      this->Weights[i] += weight;
+      this->LastSlot = i;
+      return;
+      }
+    i = (i + 1) & mask;
+    }
+
+  if (2*(this->Count + 1) > this->Size)
+    {
+    this->Grow();
+    this->Add(label, weight);
+    return;
+    }
+
+  this->Occupied[i] = 1;
+  this->Labels[i] = label;
+  this->Weights[i] = weight;
+  this->Order[this->Count++] = i;
+  this->LastSlot = i;
+}
+
+//----------------------------------------------------------------------------
+template<class F, class T>
+void vtkLabelAccumulator<F, T>::Grow()
+{
+  // save the entries in insertion order
+  int n = this->Count;
+  std::vector<T> labels(n);
+  std::vector<F> weights(n);
+  for (int li = 0; li < n; li++)
+    {
+    int i = this->Order[li];
+    labels[li] = this->Labels[i];
+    weights[li] = this->Weights[i];
+    }
+
+  int size = 2*this->Size;
+  delete [] this->LabelHeap;
+  delete [] this->WeightHeap;
+  delete [] this->OccupiedHeap;
+  delete [] this->OrderHeap;
+  this->LabelHeap = new T[size];
+  this->WeightHeap = new F[size];
+  this->OccupiedHeap = new unsigned char[size];
+  this->OrderHeap = new int[size/2];
+  memset(this->OccupiedHeap, 0, size);
+  this->Size = size;
+  this->Labels = this->LabelHeap;
+  this->Weights = this->WeightHeap;
+  this->Occupied = this->OccupiedHeap;
+  this->Order = this->OrderHeap;
+
+  // re-insert the entries in their original order
+  unsigned int mask = size - 1;
+  for (int li = 0; li < n; li++)
+    {
+    unsigned int i = vtkLabelHash(labels[li]) & mask;
+    while (this->Occupied[i])
+      {
+      i = (i + 1) & mask;
+      }
+    this->Occupied[i] = 1;
+    this->Labels[i] = labels[li];
+    this->Weights[i] = weights[li];
+    this->Order[li] = i;
+    }
+  this->LastSlot = -1;
+}
+
+//----------------------------------------------------------------------------
+template<class F, class T>
+T vtkLabelAccumulator<F, T>::GetMaximumAndReset()
+{
+  F maxweight = 0;
+  T label = 0;
+  for (int li = 0; li < this->Count; li++)
+    {
+    int i = this->Order[li];
+    F weight = this->Weights[i];
+    if (weight >= maxweight)
+      {
+      maxweight = weight;
+      label = this->Labels[i];
+      }
+    this->Occupied[i] = 0;
+    }
+  this->Count = 0;
+  this->LastSlot = -1;
+  return label;
+}
+
+//----------------------------------------------------------------------------
+// Check whether all the taps of the kernel have the same label, in which
+// case the weights do not have to be computed at all.
+template<class T>
+bool vtkLabelKernelIsUniform(
+  const T *inPtr, const vtkIdType *factX, const vtkIdType *factY,
+  const vtkIdType *factZ, int xm, int j1, int j2, int k1, int k2,
+  T *label)
+{
+  T label0 = inPtr[factZ[k1] + factY[j1] + factX[0]];
+  for (int k = k1; k <= k2; k++)
+    {
+    for (int j = j1; j <= j2; j++)
+      {
+      const T *tmpPtr = inPtr + factZ[k] + factY[j];
+      for (int l = 0; l < xm; l++)
+        {
+        if (tmpPtr[factX[l]] != label0)
+          {
+          return false;
+          }
+        }
+      }
+    }
+  *label = label0;
+  return true;
+}
+
+//----------------------------------------------------------------------------
+// Take an unweighted vote among at most 27 taps.  For so few taps, it is
+// faster to compare against every label seen so far than to hash.  The
+// comparison against the first tap is done for all taps without branching,
+// since usually all of the taps have the same label.  Ties are broken in
+// favor of the label of the nearest tap, and otherwise in favor of the
+// label that was seen first.
+template<class T>
+inline T vtkLabelMajorityVote(const T *labels, int n, int nearest)
+{
+  T label0 = labels[0];
+  int same = 1;
+  for (int i = 1; i < n; i++)
+    {
+    same &= (labels[i] == label0);
+    }
+  if (same)
+    {
+    return label0;
+    }
+
+  T candidates[VTK_LABEL_MAJORITY_TAPS_MAX];
+  int counts[VTK_LABEL_MAJORITY_TAPS_MAX];
+  int m = 0;
+  for (int i = 0; i < n; i++)
+    {
+    T label = labels[i];
+    int c = 0;
+    while (c < m && candidates[c] != label)
+      {
+      c++;
+      }
+    if (c == m)
+      {
+      candidates[m] = label;
+      counts[m++] = 1;
+      }
+    else
+      {
+      counts[c]++;
+      }
+    }
+
+  T result = labels[nearest];
+  int maxcount = 0;
+  for (int c = 0; c < m; c++)
+    {
+    if (candidates[c] == result)
+      {
+      maxcount = counts[c];
+      }
+    }
+  for (int c = 0; c < m; c++)
+    {
+    if (counts[c] > maxcount)
+      {
+      maxcount = counts[c];
+      result = candidates[c];
+      }
+    }
+  return result;
+}
+
+//----------------------------------------------------------------------------
+// Get the input indices of the taps for the majority vote along one axis,
+// for a neighborhood of "n" voxels (either 2 or 3), and return the tap
+// that is nearest to the sample point.  The 2-voxel neighborhood
+// surrounds the point, while the 3-voxel neighborhood is centered on the
+// nearest voxel.
+template<class F>
+int vtkLabelMajorityTaps(
+  F point, int n, int borderMode, int minExt, int maxExt, int inId[3])
+{
+  F f;
+  int idx = vtkInterpolationMath::Floor(point, f);
+  int nearest = (f >= 0.5);
+  if (n == 3)
+    {
+    idx += nearest - 1;
+    nearest = 1;
+    }
+
+  for (int l = 0; l < n; l++)
+    {
+    switch (borderMode)
+      {
+      case VTK_IMAGE_BORDER_REPEAT:
+        inId[l] = vtkInterpolationMath::Wrap(idx + l, minExt, maxExt);
+        break;
+      case VTK_IMAGE_BORDER_MIRROR:
+        inId[l] = vtkInterpolationMath::Mirror(idx + l, minExt, maxExt);
+        break;
+      default:
+        inId[l] = vtkInterpolationMath::Clamp(idx + l, minExt, maxExt);
+        break;
+      }
+    }
+
+  return nearest;
+}
+
+//----------------------------------------------------------------------------
+// Get the neighborhood size for the majority vote from the window size.
+inline int vtkLabelMajoritySize(int mode)
+{
+  int hsize = ((mode & VTK_INTERPOLATION_WINDOW_XSIZE_MASK)
+               >> VTK_INTERPOLATION_WINDOW_XSIZE_SHIFT);
+  return (hsize > 1 ? 3 : 2);
+}
+
 //----------------------------------------------------------------------------
 template<class F, class T>
 struct vtkImageLabelInterpolate
 {
   static void General(
     vtkInterpolationInfo *info, const F point[3], F *outPtr);
+
+  static void Majority(
+    vtkInterpolationInfo *info, const F point[3], F *outPtr);
 };
 
 //----------------------------------------------------------------------------
@@ -504,19 +981,6 @@ void vtkImageLabelInterpolate<F, T>::General(
       break;
     }
 
-  // compute the kernel weights
-  F fX[VTK_LABEL_KERNEL_SIZE_MAX];
-  F fY[VTK_LABEL_KERNEL_SIZE_MAX];
-  F fZ[VTK_LABEL_KERNEL_SIZE_MAX];
-
-  vtkGaussInterpWeights(kernel[0], fX, fx, xm);
-  vtkGaussInterpWeights(kernel[1], fY, fy, ym);
-  vtkGaussInterpWeights(kernel[2], fZ, fz, zm);
-
-  // the labels
-  F labelWeights[VTK_LABEL_KERNEL_LABELS_MAX];
-  T labels[VTK_LABEL_KERNEL_LABELS_MAX];
-
   // check if only one slice in a particular direction
   int multipleY = (minY != maxY);
   int multipleZ = (minZ != maxZ);
@@ -527,9 +991,35 @@ void vtkImageLabelInterpolate<F, T>::General(
   int j1 = ym2*(1 - multipleY);
   int j2 = (ym2 + 1)*(multipleY + 1) - 1;
 
+  // the weights are only needed if the kernel has more than one label
+  bool weightsComputed = false;
+  F fX[VTK_LABEL_KERNEL_SIZE_MAX];
+  F fY[VTK_LABEL_KERNEL_SIZE_MAX];
+  F fZ[VTK_LABEL_KERNEL_SIZE_MAX];
+
   do // loop over components
     {
-    int labelCount = 0;
+    T uniformLabel;
+    if (vtkLabelKernelIsUniform(inPtr, factX, factY, factZ,
+                                xm, j1, j2, k1, k2, &uniformLabel))
+      {
+      *outPtr++ = uniformLabel;
+      inPtr++;
+      continue;
+      }
+
+    // compute the kernel weights
+    if (!weightsComputed)
+      {
+      vtkGaussInterpWeights(kernel[0], fX, fx, xm);
+      vtkGaussInterpWeights(kernel[1], fY, fy, ym);
+      vtkGaussInterpWeights(kernel[2], fZ, fz, zm);
+      weightsComputed = true;
+      }
+
+    // the labels, the table is only needed if the kernel is not uniform
+    vtkLabelAccumulator<F, T> accumulator;
+
     int k = k1;
     do // loop over z
       {
@@ -549,22 +1039,7 @@ void vtkImageLabelInterpolate<F, T>::General(
         do
           {
           F val = fzy*(*tmpfX++);
-          T label = tmpPtr[*tmpfactX++];
-          int li = 0;
-          for (; li < labelCount; li++)
-            {
-            if (label == labels[li])
-              {
-              labelWeights[li] += val;
-              break;
-              }
-            }
-          if (li == labelCount && li < VTK_LABEL_KERNEL_LABELS_MAX)
-            {
-            labels[li] = label;
-            labelWeights[li] = val;
-            labelCount++;
-            }
+          accumulator.Add(tmpPtr[*tmpfactX++], val);
           }
         while (--l);
         }
@@ -572,18 +1047,56 @@ void vtkImageLabelInterpolate<F, T>::General(
       }
     while (++k <= k2);
 
-    F maxweight = 0;
-    T label = 0;
-    for (int li = 0; li < labelCount; li++)
+    *outPtr++ = accumulator.GetMaximumAndReset();
+    inPtr++;
+    }
+  while (--numscalars);
+}
+
+//----------------------------------------------------------------------------
+// The majority vote within a 2x2x2 or 3x3x3 neighborhood.
+template <class F, class T>
+void vtkImageLabelInterpolate<F, T>::Majority(
+  vtkInterpolationInfo *info, const F point[3], F *outPtr)
+{
+  const T *inPtr = static_cast<const T *>(info->Pointer);
+  int *inExt = info->Extent;
+  vtkIdType *inInc = info->Increments;
+  int numscalars = info->NumberOfComponents;
+  int border = info->BorderMode;
+  int n = vtkLabelMajoritySize(info->InterpolationMode);
+
+  int inIdX[3], inIdY[3], inIdZ[3];
+  int nx = vtkLabelMajorityTaps(
+    point[0], n, border, inExt[0], inExt[1], inIdX);
+  int ny = vtkLabelMajorityTaps(
+    point[1], n, border, inExt[2], inExt[3], inIdY);
+  int nz = vtkLabelMajorityTaps(
+    point[2], n, border, inExt[4], inExt[5], inIdZ);
+
+  vtkIdType offsets[VTK_LABEL_MAJORITY_TAPS_MAX];
+  int taps = 0;
+  for (int k = 0; k < n; k++)
+    {
+    for (int j = 0; j < n; j++)
       {
-      F weight = labelWeights[li];
-      if (weight >= maxweight)
+      vtkIdType factzy = inIdZ[k]*inInc[2] + inIdY[j]*inInc[1];
+      for (int i = 0; i < n; i++)
         {
-        maxweight = weight;
-        label = labels[li];
+        offsets[taps++] = factzy + inIdX[i]*inInc[0];
         }
       }
-    *outPtr++ = label;
+    }
+  int nearest = (nz*n + ny)*n + nx;
+
+  do // loop over components
+    {
+    T labels[VTK_LABEL_MAJORITY_TAPS_MAX];
+    for (int l = 0; l < taps; l++)
+      {
+      labels[l] = inPtr[offsets[l]];
+      }
+    *outPtr++ = vtkLabelMajorityVote(labels, taps, nearest);
     inPtr++;
     }
   while (--numscalars);
@@ -594,16 +1107,31 @@ void vtkImageLabelInterpolate<F, T>::General(
 template<class F>
 void vtkLabelInterpolatorGetInterpolationFunc(
   void (**interpolate)(vtkInterpolationInfo *, const F [3], F *),
-  int dataType)
+  int dataType, int kernelType)
 {
-  switch (dataType)
+  if (kernelType == VTK_LABEL_MAJORITY_KERNEL)
     {
-    vtkTemplateAliasMacro(
-      *interpolate =
-        &(vtkImageLabelInterpolate<F, VTK_TT>::General)
-      );
-    default:
-      *interpolate = 0;
+    switch (dataType)
+      {
+      vtkTemplateAliasMacro(
+        *interpolate =
+          &(vtkImageLabelInterpolate<F, VTK_TT>::Majority)
+        );
+      default:
+        *interpolate = 0;
+      }
+    }
+  else
+    {
+    switch (dataType)
+      {
+      vtkTemplateAliasMacro(
+        *interpolate =
+          &(vtkImageLabelInterpolate<F, VTK_TT>::General)
+        );
+      default:
+        *interpolate = 0;
+      }
     }
 }
 
@@ -616,6 +1144,10 @@ struct vtkImageLabelRowInterpolate
   static void General(
     vtkInterpolationWeights *weights, int idX, int idY, int idZ,
     F *outPtr, int n);
+
+  static void Majority(
+    vtkInterpolationWeights *weights, int idX, int idY, int idZ,
+    F *outPtr, int n);
 };
 
 
@@ -626,9 +1158,8 @@ void vtkImageLabelRowInterpolate<F, T>::General(
   vtkInterpolationWeights *weights, int idX, int idY, int idZ,
   F *outPtr, int n)
 {
-  // the labels
-  F labelWeights[VTK_LABEL_KERNEL_LABELS_MAX];
-  T labels[VTK_LABEL_KERNEL_LABELS_MAX];
+  // the labels, one table is used for the whole row
+  vtkLabelAccumulator<F, T> accumulator;
 
   int stepX = weights->KernelSize[0];
   int stepY = weights->KernelSize[1];
@@ -651,7 +1182,16 @@ void vtkImageLabelRowInterpolate<F, T>::General(
     int c = numscalars;
     do // loop over components
       {
-      int labelCount = 0;
+      T uniformLabel;
+      if (vtkLabelKernelIsUniform(inPtr0, factX, factY, factZ,
+                                  stepX, 0, stepY - 1, 0, stepZ - 1,
+                                  &uniformLabel))
+        {
+        *outPtr++ = uniformLabel;
+        inPtr0++;
+        continue;
+        }
+
       int k = 0;
       do // loop over z
         {
@@ -671,22 +1211,7 @@ void vtkImageLabelRowInterpolate<F, T>::General(
           do
             {
             F val = fzy*(*tmpfX++);
-            T label = tmpPtr[*tmpfactX++];
-            int li = 0;
-            for (; li < labelCount; li++)
-              {
-              if (label == labels[li])
-                {
-                labelWeights[li] += val;
-                break;
-                }
-              }
-            if (li == labelCount && li < VTK_LABEL_KERNEL_LABELS_MAX)
-              {
-              labels[li] = label;
-              labelWeights[li] = val;
-              labelCount++;
-              }
+            accumulator.Add(tmpPtr[*tmpfactX++], val);
             }
           while (--l);
           }
@@ -694,18 +1219,87 @@ void vtkImageLabelRowInterpolate<F, T>::General(
         }
       while (++k < stepZ);
 
-      F maxweight = 0;
-      T label = 0;
-      for (int li = 0; li < labelCount; li++)
+      *outPtr++ = accumulator.GetMaximumAndReset();
+      inPtr0++;
+      }
+    while (--c);
+
+    factX += stepX;
+    fX += stepX;
+    }
+}
+
+//--------------------------------------------------------------------------
+// majority vote, the precomputed weights are one for the nearest tap
+// along each axis and zero for the other taps
+template<class F, class T>
+void vtkImageLabelRowInterpolate<F, T>::Majority(
+  vtkInterpolationWeights *weights, int idX, int idY, int idZ,
+  F *outPtr, int n)
+{
+  int stepX = weights->KernelSize[0];
+  int stepY = weights->KernelSize[1];
+  int stepZ = weights->KernelSize[2];
+  idX *= stepX;
+  idY *= stepY;
+  idZ *= stepZ;
+  const F *fX = static_cast<F *>(weights->Weights[0]) + idX;
+  const F *fY = static_cast<F *>(weights->Weights[1]) + idY;
+  const F *fZ = static_cast<F *>(weights->Weights[2]) + idZ;
+  const vtkIdType *factX = weights->Positions[0] + idX;
+  const vtkIdType *factY = weights->Positions[1] + idY;
+  const vtkIdType *factZ = weights->Positions[2] + idZ;
+  const T *inPtr = static_cast<const T *>(weights->Pointer);
+
+  // the y and z parts of the offsets are the same for the whole row
+  int stepYZ = stepY*stepZ;
+  int taps = stepX*stepYZ;
+  vtkIdType factYZ[9];
+  int nearestYZ = 0;
+  for (int k = 0; k < stepZ; k++)
+    {
+    for (int j = 0; j < stepY; j++)
+      {
+      factYZ[k*stepY + j] = factZ[k] + factY[j];
+      if (fZ[k] != 0 && fY[j] != 0)
         {
-        F weight = labelWeights[li];
-        if (weight >= maxweight)
-          {
-          maxweight = weight;
-          label = labels[li];
-          }
+        nearestYZ = k*stepY + j;
         }
-      *outPtr++ = label;
+      }
+    }
+
+  int numscalars = weights->NumberOfComponents;
+  for (int i = n; i > 0; --i)
+    {
+    vtkIdType offsets[VTK_LABEL_MAJORITY_TAPS_MAX];
+    int t = 0;
+    for (int jk = 0; jk < stepYZ; jk++)
+      {
+      for (int l = 0; l < stepX; l++)
+        {
+        offsets[t++] = factYZ[jk] + factX[l];
+        }
+      }
+    int nearestX = 0;
+    for (int l = 0; l < stepX; l++)
+      {
+      if (fX[l] != 0)
+        {
+        nearestX = l;
+        }
+      }
+    int nearest = nearestYZ*stepX + nearestX;
+
+    const T *inPtr0 = inPtr;
+    int c = numscalars;
+    do // loop over components
+      {
+      T labels[VTK_LABEL_MAJORITY_TAPS_MAX];
+      for (int l = 0; l < taps; l++)
+        {
+        labels[l] = inPtr0[offsets[l]];
+        }
+      *outPtr++ = vtkLabelMajorityVote(labels, taps, nearest);
       inPtr0++;
       }
     while (--c);
@@ -722,15 +1316,29 @@ template<class F>
 void vtkLabelInterpolatorGetRowInterpolationFunc(
   void (**summation)(vtkInterpolationWeights *weights, int idX, int idY,
                      int idZ, F *outPtr, int n),
-  int scalarType)
+  int scalarType, int kernelType)
 {
-  switch (scalarType)
+  if (kernelType == VTK_LABEL_MAJORITY_KERNEL)
     {
-    vtkTemplateAliasMacro(
-      *summation = &(vtkImageLabelRowInterpolate<F,VTK_TT>::General)
-      );
-    default:
-      *summation = 0;
+    switch (scalarType)
+      {
+      vtkTemplateAliasMacro(
+        *summation = &(vtkImageLabelRowInterpolate<F,VTK_TT>::Majority)
+        );
+      default:
+        *summation = 0;
+      }
+    }
+  else
+    {
+    switch (scalarType)
+      {
+      vtkTemplateAliasMacro(
+        *summation = &(vtkImageLabelRowInterpolate<F,VTK_TT>::General)
+        );
+      default:
+        *summation = 0;
+      }
     }
 }
 
@@ -754,6 +1362,8 @@ void vtkLabelInterpolatorPrecomputeWeights(
   blur[0] = ((mode & VTK_INTERPOLATION_WINDOW_XBLUR_MASK) != 0);
   blur[1] = ((mode & VTK_INTERPOLATION_WINDOW_YBLUR_MASK) != 0);
   blur[2] = ((mode & VTK_INTERPOLATION_WINDOW_ZBLUR_MASK) != 0);
+  bool majority = ((mode & VTK_INTERPOLATION_WINDOW_MASK) ==
+                   VTK_LABEL_MAJORITY_KERNEL);
 
   // set up input positions table for interpolation
   bool validClip = true;
@@ -784,6 +1394,13 @@ void vtkLabelInterpolatorPrecomputeWeights(
     int inCount = maxExt - minExt + 1;
     step = ((step < inCount) ? step : inCount);
 
+    // the majority vote needs every tap, unless all taps are the same
+    if (majority)
+      {
+      m = vtkLabelMajoritySize(mode);
+      step = ((inCount > 1) ? m : 1);
+      }
+
     // allocate space for the weights
     vtkIdType size = step*(outExt[2*j+1] - outExt[2*j] + 1);
     vtkIdType *positions = new vtkIdType[size];
@@ -802,6 +1419,38 @@ void vtkLabelInterpolatorPrecomputeWeights(
       {
       F point = matrow[3] + i*matrow[j];
 
+      if (point >= minBounds && point <= maxBounds)
+        {
+        if (region == 0)
+          { // entering the input extent
+          region = 1;
+          clipExt[2*j] = i;
+          }
+        }
+      else
+        {
+        if (region == 1)
+          { // leaving the input extent
+          region = 2;
+          clipExt[2*j+1] = i - 1;
+          }
+        }
+
+      if (majority)
+        {
+        // the weight marks the tap that is nearest to the point
+        int inId[3];
+        int nearest = vtkLabelMajorityTaps(
+          point, m, weights->BorderMode, minExt, maxExt, inId);
+        vtkIdType inInc = weights->Increments[k];
+        for (int ll = 0; ll < step; ll++)
+          {
+          positions[step*i + ll] = inId[ll]*inInc;
+          constants[step*i + ll] = static_cast<F>(ll == nearest || step == 1);
+          }
+        continue;
+        }
+
       F f = 0;
       int idx = vtkInterpolationMath::Floor(point, f);
       int lmax = 1;
@@ -885,23 +1534,6 @@ void vtkLabelInterpolatorPrecomputeWeights(
           while (++ll < step);
           }
         }
-
-      if (point >= minBounds && point <= maxBounds)
-        {
-        if (region == 0)
-          { // entering the input extent
-          region = 1;
-          clipExt[2*j] = i;
-          }
-        }
-      else
-        {
-        if (region == 1)
-          { // leaving the input extent
-          region = 2;
-          clipExt[2*j+1] = i - 1;
-          }
-        }
       }
 
     if (region == 0 || clipExt[2*j] > clipExt[2*j+1])
@@ -930,7 +1562,7 @@ void vtkLabelInterpolator::GetInterpolationFunc(
   void (**func)(vtkInterpolationInfo *, const double [3], double *))
 {
   vtkLabelInterpolatorGetInterpolationFunc(
-    func, this->InterpolationInfo->ScalarType);
+    func, this->InterpolationInfo->ScalarType, this->KernelType);
 }
 
 //----------------------------------------------------------------------------
@@ -938,7 +1570,7 @@ void vtkLabelInterpolator::GetInterpolationFunc(
   void (**func)(vtkInterpolationInfo *, const float [3], float *))
 {
   vtkLabelInterpolatorGetInterpolationFunc(
-    func, this->InterpolationInfo->ScalarType);
+    func, this->InterpolationInfo->ScalarType, this->KernelType);
 }
 
 //----------------------------------------------------------------------------
@@ -946,7 +1578,7 @@ void vtkLabelInterpolator::GetRowInterpolationFunc(
   void (**func)(vtkInterpolationWeights *, int, int, int, double *, int))
 {
   vtkLabelInterpolatorGetRowInterpolationFunc(
-    func, this->InterpolationInfo->ScalarType);
+    func, this->InterpolationInfo->ScalarType, this->KernelType);
 }
 
 //----------------------------------------------------------------------------
@@ -954,7 +1586,7 @@ void vtkLabelInterpolator::GetRowInterpolationFunc(
   void (**func)(vtkInterpolationWeights *, int, int, int, float *, int))
 {
   vtkLabelInterpolatorGetRowInterpolationFunc(
-    func, this->InterpolationInfo->ScalarType);
+    func, this->InterpolationInfo->ScalarType, this->KernelType);
 }
 
 //----------------------------------------------------------------------------
@@ -964,8 +1596,18 @@ void vtkLabelInterpolator::PrecomputeWeightsForExtent(
 {
   weights = new vtkInterpolationWeights(*this->InterpolationInfo);
 
-  vtkLabelInterpolatorPrecomputeWeights(
-    matrix, extent, newExtent, this->StructuredBoundsDouble, weights);
+  // the parameters that were used to build the kernel lookup tables
+  vtkInterpolationWeightsCache cache(this->GetClassName());
+  cache.AddParameters(this->RadiusFactors, 3);
+  cache.AddParameters(this->LastBlurFactors, 3);
+
+  if (!cache.Find(matrix, extent, this->StructuredBoundsDouble,
+                  weights, newExtent))
+    {
+    vtkLabelInterpolatorPrecomputeWeights(
+      matrix, extent, newExtent, this->StructuredBoundsDouble, weights);
+    cache.Insert(weights, newExtent);
+    }
 }
 
 //----------------------------------------------------------------------------
@@ -975,15 +1617,28 @@ void vtkLabelInterpolator::PrecomputeWeightsForExtent(
 {
   weights = new vtkInterpolationWeights(*this->InterpolationInfo);
 
-  vtkLabelInterpolatorPrecomputeWeights(
-    matrix, extent, newExtent, this->StructuredBoundsFloat, weights);
+  // the parameters that were used to build the kernel lookup tables
+  vtkInterpolationWeightsCache cache(this->GetClassName());
+  cache.AddParameters(this->RadiusFactors, 3);
+  cache.AddParameters(this->LastBlurFactors, 3);
+
+  if (!cache.Find(matrix, extent, this->StructuredBoundsFloat,
+                  weights, newExtent))
+    {
+    vtkLabelInterpolatorPrecomputeWeights(
+      matrix, extent, newExtent, this->StructuredBoundsFloat, weights);
+    cache.Insert(weights, newExtent);
+    }
 }
 
 //----------------------------------------------------------------------------
 void vtkLabelInterpolator::FreePrecomputedWeights(
   vtkInterpolationWeights *&weights)
 {
-  this->Superclass::FreePrecomputedWeights(weights);
+  if (!vtkInterpolationWeightsCache::Release(weights))
+    {
+    this->Superclass::FreePrecomputedWeights(weights);
+    }
 }
 
 //----------------------------------------------------------------------------
@@ -1084,4 +1739,8 @@ void vtkLabelInterpolator::FreeKernelLookupTable()
         }
       }
     }
+
+  this->KernelLookupTable[0] = NULL;
+  this->KernelLookupTable[1] = NULL;
+  this->KernelLookupTable[2] = NULL;
 }
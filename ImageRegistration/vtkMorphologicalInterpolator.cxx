@@ -15,10 +15,13 @@
 
 #include "vtkMorphologicalInterpolator.h"
 #include "vtkImageInterpolatorInternals.h"
+#include "vtkInterpolationWeightsCache.h"
 #include "vtkImageData.h"
 #include "vtkDataArray.h"
 #include "vtkObjectFactory.h"
 
+#include <vector>
+
 #include "vtkTemplateAliasMacro.h"
 // turn off 64-bit ints when templating over all types, because
 // they cannot be faithfully represented by doubles
@@ -33,14 +36,27 @@ vtkStandardNewMacro(vtkMorphologicalInterpolator);
 vtkMorphologicalInterpolator::vtkMorphologicalInterpolator()
 {
   this->Operation = VTK_IMIOPERATION_DILATE;
+  this->Shape = VTK_IMISHAPE_ELLIPSOID;
+  this->PrefilterInput = 0;
+  this->PrefilterInputUsed = 0;
   this->Radius[0] = 0.5;
   this->Radius[1] = 0.5;
   this->Radius[2] = 0.5;
+  this->PrefilteredScalars = NULL;
+  this->PrefilteredSource = NULL;
+  for (int i = 0; i < 6; i++)
+    {
+    this->PrefilteredExtent[i] = 0;
+    }
 }
 
 //----------------------------------------------------------------------------
 vtkMorphologicalInterpolator::~vtkMorphologicalInterpolator()
 {
+  if (this->PrefilteredScalars)
+    {
+    this->PrefilteredScalars->Delete();
+    }
 }
 
 //----------------------------------------------------------------------------
@@ -52,12 +68,30 @@ void vtkMorphologicalInterpolator::PrintSelf(ostream& os, vtkIndent indent)
      << this->GetOperationAsString() << "\n";
   os << indent << "Radius: " << this->Radius[0] << " "
      << this->Radius[1] << " " << this->Radius[2] << "\n";
+  os << indent << "Shape: "
+     << this->GetShapeAsString() << "\n";
+  os << indent << "PrefilterInput: "
+     << (this->PrefilterInput ? "On\n" : "Off\n");
+  os << indent << "PrefilterInputUsed: "
+     << (this->PrefilterInputUsed ? "On\n" : "Off\n");
 }
 
 //----------------------------------------------------------------------------
 void vtkMorphologicalInterpolator::ComputeSupportSize(
   const double vtkNotUsed(matrix)[16], int size[3])
 {
+  if (this->PrefilterInput)
+    {
+    // the radius is not clamped, and an ellipsoid is not truncated
+    double offset = (this->Shape == VTK_IMISHAPE_BOX ? 0.0 : 0.5);
+    for (int i = 0; i < 3; i++)
+      {
+      double r = (this->Radius[i] >= 0 ? this->Radius[i] : 0);
+      size[i] = 1 + 2*static_cast<int>(r + offset);
+      }
+    return;
+    }
+
   this->InternalUpdate();
 
   size[0] = 1 + 2*static_cast<int>(this->InternalRadius[0]);
@@ -103,6 +137,38 @@ const char *vtkMorphologicalInterpolator::GetOperationAsString()
   return result;
 }
 
+//----------------------------------------------------------------------------
+void vtkMorphologicalInterpolator::SetShape(int shape)
+{
+  static int minshape = VTK_IMISHAPE_ELLIPSOID;
+  static int maxshape = VTK_IMISHAPE_BOX;
+  shape = ((shape > minshape) ? shape : minshape);
+  shape = ((shape < maxshape) ? shape : maxshape);
+  if (this->Shape != shape)
+    {
+    this->Shape = shape;
+    this->Modified();
+    }
+}
+
+//----------------------------------------------------------------------------
+const char *vtkMorphologicalInterpolator::GetShapeAsString()
+{
+  const char *result = "";
+
+  switch (this->Shape)
+    {
+    case VTK_IMISHAPE_ELLIPSOID:
+      result = "Ellipsoid";
+      break;
+    case VTK_IMISHAPE_BOX:
+      result = "Box";
+      break;
+    }
+
+  return result;
+}
+
 //----------------------------------------------------------------------------
 void vtkMorphologicalInterpolator::SetRadius(
   double x, double y, double z)
@@ -136,6 +202,11 @@ void vtkMorphologicalInterpolator::ComputeInternalRadius(
     // compute the inverse of the radius
     r = (r >= rmin ? r : rmin); 
     this->InternalRadius[i+3] = 1.0/r;
+    // a box includes every voxel, so use zero for the inverse radius
+    if (this->Shape == VTK_IMISHAPE_BOX)
+      {
+      this->InternalRadius[i+3] = 0.0;
+      }
     }
 }
 
@@ -148,6 +219,8 @@ void vtkMorphologicalInterpolator::InternalDeepCopy(
   if (obj)
     {
     this->SetOperation(obj->Operation);
+    this->SetShape(obj->Shape);
+    this->SetPrefilterInput(obj->PrefilterInput);
     this->SetRadius(obj->Radius);
     for (int i = 0; i < 6; i++) // InternalRadius has six elements
       {
@@ -162,6 +235,26 @@ void vtkMorphologicalInterpolator::InternalUpdate()
   this->ComputeInternalRadius(this->Radius);
   this->InterpolationInfo->InterpolationMode = this->Operation;
   this->InterpolationInfo->ExtraInfo = this->InternalRadius;
+  this->PrefilterInputUsed = 0;
+
+  if (this->PrefilterInput)
+    {
+    if (this->ComputePrefilteredScalars())
+      {
+      // sample the prefiltered scalars with a kernel of a single voxel
+      static double zeroRadius[6] = { 0.0, 0.0, 0.0, 0.0, 0.0, 0.0 };
+      this->InterpolationInfo->Pointer =
+        this->PrefilteredScalars->GetVoidPointer(this->ComponentOffset);
+      this->InterpolationInfo->ExtraInfo = zeroRadius;
+      this->PrefilterInputUsed = 1;
+      }
+    else
+      {
+      vtkWarningMacro("InternalUpdate: cannot prefilter this input with a "
+                      << this->GetShapeAsString() << ", using the "
+                      "per-sample operation instead.");
+      }
+    }
 }
 
 //----------------------------------------------------------------------------
@@ -660,6 +753,353 @@ void vtkMorphologicalInterpolatorPrecomputeWeights(
     }
 }
 
+//----------------------------------------------------------------------------
+// Prefiltering, i.e. applying the operation to the whole input
+//----------------------------------------------------------------------------
+
+//----------------------------------------------------------------------------
+// Apply a running max (dilate) or min (erode) over windows of 2*r+1
+// voxels along a line of n voxels, with the van Herk/Gil-Werman method.
+// The input line must be padded with r voxels at each end.  The cost
+// is three comparisons per voxel regardless of the radius.
+template<class T>
+void vtkMorphBoxFilterLine(
+  const T *line, T *g, T *h, T *out, int n, int r, bool dilate)
+{
+  int m = n + 2*r;
+  int w = 2*r + 1;
+
+  // the running max/min from the start of each block of w voxels
+  for (int i = 0; i < m; i++)
+    {
+    T v = line[i];
+    if (i % w != 0)
+      {
+      T u = g[i-1];
+      v = (dilate ? (u > v ? u : v) : (u < v ? u : v));
+      }
+    g[i] = v;
+    }
+
+  // the running max/min from the end of each block of w voxels
+  for (int i = m - 1; i >= 0; i--)
+    {
+    T v = line[i];
+    if (i != m - 1 && (i + 1) % w != 0)
+      {
+      T u = h[i+1];
+      v = (dilate ? (u > v ? u : v) : (u < v ? u : v));
+      }
+    h[i] = v;
+    }
+
+  // every window spans at most two blocks
+  for (int i = 0; i < n; i++)
+    {
+    T u = h[i];
+    T v = g[i + w - 1];
+    out[i] = (dilate ? (u > v ? u : v) : (u < v ? u : v));
+    }
+}
+
+//----------------------------------------------------------------------------
+// Compute d[p] = min(f[q] + g(p - q)) over q, where g(0) = 0 and
+// g(t) = a*(|t| - 0.5)^2 for t != 0, which is the squared distance from
+// a voxel center to the nearest point of another voxel.  This is done
+// with the lower envelope of the parabolas a*(x - q)^2 + f[q] (Felzenszwalb
+// and Huttenlocher), evaluated halfway between the voxels: for q < p the
+// envelope at p - 0.5 gives the correct distance, for q > p the envelope
+// at p + 0.5 does, and for other q these give distances that are larger.
+// The arrays v and z must have room for n and n + 1 values.
+void vtkMorphDistanceTransformLine(
+  const double *f, double *d, int n, double a, int *v, double *z)
+{
+  int k = 0;
+  v[0] = 0;
+  z[0] = -VTK_DOUBLE_MAX;
+  z[1] = VTK_DOUBLE_MAX;
+  for (int q = 1; q < n; q++)
+    {
+    // the intersection of the parabolas for q and v[k]
+    double s = 0.5*((f[q] - f[v[k]])/(a*(q - v[k])) + (q + v[k]));
+    while (s <= z[k])
+      {
+      k--;
+      s = 0.5*((f[q] - f[v[k]])/(a*(q - v[k])) + (q + v[k]));
+      }
+    k++;
+    v[k] = q;
+    z[k] = s;
+    z[k+1] = VTK_DOUBLE_MAX;
+    }
+
+  // evaluate the envelope at x = p - 0.5 and x = p + 0.5
+  k = 0;
+  double x = -0.5;
+  double e0 = 0.0;
+  for (int p = -1; p < n; p++)
+    {
+    while (z[k+1] < x)
+      {
+      k++;
+      }
+    double t = x - v[k];
+    double e1 = a*t*t + f[v[k]];
+    if (p >= 0)
+      {
+      double e = f[p];
+      e = (e0 < e ? e0 : e);
+      e = (e1 < e ? e1 : e);
+      d[p] = e;
+      }
+    e0 = e1;
+    x += 1.0;
+    }
+}
+
+//----------------------------------------------------------------------------
+// Apply a box operation to one component, in-place.
+template<class T>
+void vtkMorphPrefilterBox(
+  T *ptr, const int extent[6], const vtkIdType inc[3], int borderMode,
+  bool dilate, const double radius[3])
+{
+  std::vector<T> line, g, h, out;
+
+  for (int axis = 0; axis < 3; axis++)
+    {
+    int n = extent[2*axis+1] - extent[2*axis] + 1;
+    int r = static_cast<int>(radius[axis]);
+    if (n <= 1 || r <= 0)
+      {
+      continue;
+      }
+
+    // the other two axes
+    int axis1 = (axis + 1) % 3;
+    int axis2 = (axis + 2) % 3;
+    int n1 = extent[2*axis1+1] - extent[2*axis1] + 1;
+    int n2 = extent[2*axis2+1] - extent[2*axis2] + 1;
+    vtkIdType step = inc[axis];
+
+    // the line positions for the border region
+    int m = n + 2*r;
+    std::vector<vtkIdType> positions(m);
+    for (int i = 0; i < m; i++)
+      {
+      int j = i - r;
+      switch (borderMode)
+        {
+        case VTK_IMAGE_BORDER_REPEAT:
+          j = vtkInterpolationMath::Wrap(j, 0, n - 1);
+          break;
+        case VTK_IMAGE_BORDER_MIRROR:
+          j = vtkInterpolationMath::Mirror(j, 0, n - 1);
+          break;
+        default:
+          j = vtkInterpolationMath::Clamp(j, 0, n - 1);
+          break;
+        }
+      positions[i] = j*step;
+      }
+
+    line.resize(m);
+    g.resize(m);
+    h.resize(m);
+    out.resize(n);
+
+    for (int i2 = 0; i2 < n2; i2++)
+      {
+      for (int i1 = 0; i1 < n1; i1++)
+        {
+        T *linePtr = ptr + i1*inc[axis1] + i2*inc[axis2];
+        for (int i = 0; i < m; i++)
+          {
+          line[i] = linePtr[positions[i]];
+          }
+        vtkMorphBoxFilterLine(&line[0], &g[0], &h[0], &out[0], n, r, dilate);
+        for (int i = 0; i < n; i++)
+          {
+          linePtr[i*step] = out[i];
+          }
+        }
+      }
+    }
+}
+
+//----------------------------------------------------------------------------
+// Apply an ellipsoid operation to one component of a binary image,
+// in-place.  Returns false if the component is not binary.
+template<class T>
+bool vtkMorphPrefilterEllipsoid(
+  T *ptr, const int extent[6], const vtkIdType inc[3],
+  bool dilate, const double invRadius[3])
+{
+  int dims[3];
+  dims[0] = extent[1] - extent[0] + 1;
+  dims[1] = extent[3] - extent[2] + 1;
+  dims[2] = extent[5] - extent[4] + 1;
+
+  // find the (up to) two values that are present
+  T values[2];
+  values[0] = ptr[0];
+  values[1] = ptr[0];
+  bool haveTwo = false;
+  for (int k = 0; k < dims[2]; k++)
+    {
+    for (int j = 0; j < dims[1]; j++)
+      {
+      const T *linePtr = ptr + j*inc[1] + k*inc[2];
+      for (int i = 0; i < dims[0]; i++)
+        {
+        T v = linePtr[i*inc[0]];
+        if (v != values[0] && v != values[1])
+          {
+          if (haveTwo)
+            {
+            return false;
+            }
+          values[1] = v;
+          haveTwo = true;
+          }
+        }
+      }
+    }
+
+  if (!haveTwo)
+    {
+    return true;
+    }
+
+  // the "foreground" is the value that will grow
+  T lo = (values[0] < values[1] ? values[0] : values[1]);
+  T hi = (values[0] < values[1] ? values[1] : values[0]);
+  T fg = (dilate ? hi : lo);
+  T bg = (dilate ? lo : hi);
+
+  // any distance at or beyond the threshold can be clamped to "far"
+  const double threshold = 1.0 + VTK_INTERPOLATE_FLOOR_TOL;
+  const double farValue = 2.0;
+
+  // squared distances (in units of the radius) to the foreground
+  vtkIdType n = static_cast<vtkIdType>(dims[0])*dims[1]*dims[2];
+  std::vector<float> dist(n);
+  vtkIdType idx = 0;
+  for (int k = 0; k < dims[2]; k++)
+    {
+    for (int j = 0; j < dims[1]; j++)
+      {
+      const T *linePtr = ptr + j*inc[1] + k*inc[2];
+      for (int i = 0; i < dims[0]; i++)
+        {
+        dist[idx++] = (linePtr[i*inc[0]] == fg ? 0.0f : farValue);
+        }
+      }
+    }
+
+  // do the separable distance transform
+  vtkIdType distInc[3];
+  distInc[0] = 1;
+  distInc[1] = dims[0];
+  distInc[2] = static_cast<vtkIdType>(dims[0])*dims[1];
+  int maxDim = dims[0];
+  maxDim = (dims[1] > maxDim ? dims[1] : maxDim);
+  maxDim = (dims[2] > maxDim ? dims[2] : maxDim);
+  std::vector<double> f(maxDim), d(maxDim), z(maxDim + 1);
+  std::vector<int> v(maxDim);
+
+  for (int axis = 0; axis < 3; axis++)
+    {
+    int m = dims[axis];
+    if (m <= 1)
+      {
+      continue;
+      }
+    int axis1 = (axis + 1) % 3;
+    int axis2 = (axis + 2) % 3;
+    double a = invRadius[axis]*invRadius[axis];
+    vtkIdType step = distInc[axis];
+
+    for (int i2 = 0; i2 < dims[axis2]; i2++)
+      {
+      for (int i1 = 0; i1 < dims[axis1]; i1++)
+        {
+        float *linePtr = &dist[i1*distInc[axis1] + i2*distInc[axis2]];
+        for (int i = 0; i < m; i++)
+          {
+          f[i] = linePtr[i*step];
+          }
+        vtkMorphDistanceTransformLine(&f[0], &d[0], m, a, &v[0], &z[0]);
+        for (int i = 0; i < m; i++)
+          {
+          double e = d[i];
+          linePtr[i*step] = static_cast<float>(e < farValue ? e : farValue);
+          }
+        }
+      }
+    }
+
+  // threshold the distance
+  idx = 0;
+  for (int k = 0; k < dims[2]; k++)
+    {
+    for (int j = 0; j < dims[1]; j++)
+      {
+      T *linePtr = ptr + j*inc[1] + k*inc[2];
+      for (int i = 0; i < dims[0]; i++)
+        {
+        linePtr[i*inc[0]] = (dist[idx++] < threshold ? fg : bg);
+        }
+      }
+    }
+
+  return true;
+}
+
+//----------------------------------------------------------------------------
+// Apply the operation to the input, placing the result in "outPtr".
+template<class T>
+bool vtkMorphPrefilter(
+  const T *inPtr, T *outPtr, vtkIdType numValues,
+  const vtkInterpolationInfo *info, int shape, const double radius[3])
+{
+  bool dilate = (info->InterpolationMode == VTK_IMIOPERATION_DILATE);
+
+  // compute the inverse radius for the ellipsoid
+  double invRadius[3];
+  for (int i = 0; i < 3; i++)
+    {
+    const double rmin = 1e-17;
+    double r = (radius[i] >= rmin ? radius[i] : rmin);
+    invRadius[i] = 1.0/r;
+    }
+
+  // copy all of the input
+  for (vtkIdType i = 0; i < numValues; i++)
+    {
+    outPtr[i] = inPtr[i];
+    }
+
+  for (int c = 0; c < info->NumberOfComponents; c++)
+    {
+    if (shape == VTK_IMISHAPE_BOX)
+      {
+      vtkMorphPrefilterBox(
+        outPtr + c, info->Extent, info->Increments, info->BorderMode,
+        dilate, radius);
+      }
+    else if (info->BorderMode != VTK_IMAGE_BORDER_CLAMP ||
+             !vtkMorphPrefilterEllipsoid(
+               outPtr + c, info->Extent, info->Increments,
+               dilate, invRadius))
+      {
+      return false;
+      }
+    }
+
+  return true;
+}
+
 //----------------------------------------------------------------------------
 } // ends anonymous namespace
 
@@ -702,8 +1142,18 @@ void vtkMorphologicalInterpolator::PrecomputeWeightsForExtent(
 {
   weights = new vtkInterpolationWeights(*this->InterpolationInfo);
 
-  vtkMorphologicalInterpolatorPrecomputeWeights(
-    matrix, extent, newExtent, this->StructuredBoundsDouble, weights);
+  // the radius (and inverse radius) that the weights will use
+  vtkInterpolationWeightsCache cache(this->GetClassName());
+  cache.AddParameters(
+    static_cast<double *>(this->InterpolationInfo->ExtraInfo), 6);
+
+  if (!cache.Find(matrix, extent, this->StructuredBoundsDouble,
+                  weights, newExtent))
+    {
+    vtkMorphologicalInterpolatorPrecomputeWeights(
+      matrix, extent, newExtent, this->StructuredBoundsDouble, weights);
+    cache.Insert(weights, newExtent);
+    }
 }
 
 //----------------------------------------------------------------------------
@@ -713,13 +1163,97 @@ void vtkMorphologicalInterpolator::PrecomputeWeightsForExtent(
 {
   weights = new vtkInterpolationWeights(*this->InterpolationInfo);
 
-  vtkMorphologicalInterpolatorPrecomputeWeights(
-    matrix, extent, newExtent, this->StructuredBoundsFloat, weights);
+  // the radius (and inverse radius) that the weights will use
+  vtkInterpolationWeightsCache cache(this->GetClassName());
+  cache.AddParameters(
+    static_cast<double *>(this->InterpolationInfo->ExtraInfo), 6);
+
+  if (!cache.Find(matrix, extent, this->StructuredBoundsFloat,
+                  weights, newExtent))
+    {
+    vtkMorphologicalInterpolatorPrecomputeWeights(
+      matrix, extent, newExtent, this->StructuredBoundsFloat, weights);
+    cache.Insert(weights, newExtent);
+    }
 }
 
 //----------------------------------------------------------------------------
 void vtkMorphologicalInterpolator::FreePrecomputedWeights(
   vtkInterpolationWeights *&weights)
 {
-  this->Superclass::FreePrecomputedWeights(weights);
+  if (!vtkInterpolationWeightsCache::Release(weights))
+    {
+    this->Superclass::FreePrecomputedWeights(weights);
+    }
+}
+
+//----------------------------------------------------------------------------
+bool vtkMorphologicalInterpolator::ComputePrefilteredScalars()
+{
+  vtkDataArray *scalars = this->Scalars;
+  vtkInterpolationInfo *info = this->InterpolationInfo;
+  if (!scalars)
+    {
+    return false;
+    }
+
+  // check whether the prefiltered scalars are up to date
+  bool extentChanged = false;
+  for (int i = 0; i < 6; i++)
+    {
+    extentChanged |= (this->PrefilteredExtent[i] != info->Extent[i]);
+    }
+  if (this->PrefilteredScalars && this->PrefilteredSource == scalars &&
+      !extentChanged &&
+      this->PrefilterTime.GetMTime() > this->GetMTime() &&
+      this->PrefilterTime.GetMTime() > scalars->GetMTime())
+    {
+    return true;
+    }
+
+  if (!this->PrefilteredScalars ||
+      this->PrefilteredScalars->GetDataType() != scalars->GetDataType())
+    {
+    if (this->PrefilteredScalars)
+      {
+      this->PrefilteredScalars->Delete();
+      }
+    this->PrefilteredScalars = scalars->NewInstance();
+    }
+  this->PrefilteredScalars->SetNumberOfComponents(
+    scalars->GetNumberOfComponents());
+  this->PrefilteredScalars->SetNumberOfTuples(scalars->GetNumberOfTuples());
+
+  // the component offset is applied to both the input and the output
+  vtkIdType numValues = scalars->GetNumberOfTuples()*
+    scalars->GetNumberOfComponents() - this->ComponentOffset;
+  const void *inPtr = scalars->GetVoidPointer(this->ComponentOffset);
+  void *outPtr =
+    this->PrefilteredScalars->GetVoidPointer(this->ComponentOffset);
+
+  bool success = false;
+  switch (info->ScalarType)
+    {
+    vtkTemplateAliasMacro(
+      success = vtkMorphPrefilter(
+        static_cast<const VTK_TT *>(inPtr), static_cast<VTK_TT *>(outPtr),
+        numValues, info, this->Shape, this->Radius));
+    }
+
+  if (!success)
+    {
+    this->PrefilteredScalars->Delete();
+    this->PrefilteredScalars = NULL;
+    this->PrefilteredSource = NULL;
+    return false;
+    }
+
+  this->PrefilteredSource = scalars;
+  for (int i = 0; i < 6; i++)
+    {
+    this->PrefilteredExtent[i] = info->Extent[i];
+    }
+  this->PrefilterTime.Modified();
+
+  return true;
 }
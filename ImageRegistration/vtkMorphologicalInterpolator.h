@@ -16,6 +16,8 @@
 // .SECTION Description
 // vtkMorphologicalInterpolator is an interpolator that applies a
 // morphological filter (e.g. erosion or dilation) to the image.
+// For large radii, PrefilterInput should be used, since the cost of
+// the per-sample operation grows with the cube of the radius.
 // .SECTION Thanks
 // Thanks to David Gobbi, Department of Radiology, University of Calgary
 // for providing this class.
@@ -32,7 +34,11 @@
 #define VTK_IMIOPERATION_ERODE  1
 #define VTK_IMI_KERNEL_SIZE_MAX 32
 
+#define VTK_IMISHAPE_ELLIPSOID 0
+#define VTK_IMISHAPE_BOX       1
+
 class vtkImageData;
+class vtkDataArray;
 struct vtkInterpolationInfo;
 
 class VTK_EXPORT vtkMorphologicalInterpolator :
@@ -68,6 +74,43 @@ public:
     f[2] = this->Radius[2]; }
   double *GetRadius() { return this->Radius; }
 
+  // Description:
+  // Set the shape of the structuring element (default: Ellipsoid).
+  // The Box includes every voxel that is within the radius along each
+  // of the three axes.
+  virtual void SetShape(int shape);
+  void SetShapeToEllipsoid() {
+    this->SetShape(VTK_IMISHAPE_ELLIPSOID); }
+  void SetShapeToBox() {
+    this->SetShape(VTK_IMISHAPE_BOX); }
+  int GetShape() { return this->Shape; }
+  virtual const char *GetShapeAsString();
+
+  // Description:
+  // Apply the operation to the whole input when the interpolator is
+  // updated, and then sample the result by nearest-neighbor interpolation
+  // (default: Off).  This is done with methods whose cost does not depend
+  // on the radius, and the radius is not limited by the maximum kernel
+  // size.  A Box is done with running min/max filters along the rows of
+  // each axis, and an Ellipsoid is done with a distance transform.  The
+  // distance transform can only be used if each component of the input
+  // has no more than two distinct values, i.e. for masks and binary
+  // images, and if the border mode is Clamp; otherwise a warning is
+  // printed and the operation is done for each sample as usual, see
+  // GetPrefilterInputUsed().  Note that the structuring element
+  // is centered on the nearest voxel, rather than on the sample point,
+  // and that an Ellipsoid is not truncated to the integer part of the
+  // radius, so results can differ slightly from the per-sample method.
+  vtkSetMacro(PrefilterInput, int);
+  vtkBooleanMacro(PrefilterInput, int);
+  vtkGetMacro(PrefilterInput, int);
+
+  // Description:
+  // Check whether the input was prefiltered when the interpolator was last
+  // updated.  This will be false if PrefilterInput is off, or if the input
+  // could not be prefiltered and the per-sample operation is used instead.
+  vtkGetMacro(PrefilterInputUsed, int);
+
   // Description:
   // Get the support size for use in computing update extents.  If the data
   // will be sampled on a regular grid, then pass a matrix describing the
@@ -87,7 +130,10 @@ public:
   // extent and the structured coordinates of the input.  This
   // matrix must perform only permutations, scales, and translation,
   // i.e. each of the three columns must have only one non-zero value.
-  // A new extent is provided for out-of-bounds checks.
+  // A new extent is provided for out-of-bounds checks.  The weights
+  // are cached, so if the same matrix and extent are used again with
+  // the same kernel and input geometry (even by a different interpolator)
+  // then the weights will not have to be recomputed.
   // THIS METHOD IS THREAD SAFE.
   virtual void PrecomputeWeightsForExtent(
     const double matrix[16], const int extent[6], int newExtent[6],
@@ -116,6 +162,11 @@ protected:
   // Compute the InternalRadius from the user supplied Radius.
   virtual void ComputeInternalRadius(const double radius[3]);
 
+  // Description:
+  // Apply the operation to the whole input, for PrefilterInput.  This
+  // will return false if it is not possible for this input.
+  virtual bool ComputePrefilteredScalars();
+
   // Description:
   // Get the interpolation functions.
   virtual void GetInterpolationFunc(
@@ -135,9 +186,17 @@ protected:
       vtkInterpolationWeights *, int, int, int, float *, int));
 
   int Operation;
+  int Shape;
+  int PrefilterInput;
+  int PrefilterInputUsed;
   double Radius[3];
   double InternalRadius[6];
 
+  vtkDataArray *PrefilteredScalars;
+  vtkDataArray *PrefilteredSource;
+  int PrefilteredExtent[6];
+  vtkTimeStamp PrefilterTime;
+
 private:
   vtkMorphologicalInterpolator(const vtkMorphologicalInterpolator&);  // Not implemented.
   void operator=(const vtkMorphologicalInterpolator&);  // Not implemented.
@@ -87,6 +87,100 @@ void vtkNelderMeadMinimizer::Start()
   this->InitializeAmoeba();
 }
 
+//----------------------------------------------------------------------------
+void vtkNelderMeadMinimizer::SaveState(ostream& os)
+{
+  this->Superclass::SaveState(os);
+
+  // the simplex only exists after the minimization has started
+  int n = this->NumberOfParameters;
+  int m = (this->Iterations > 0 && this->AmoebaVertices ? n + 1 : 0);
+  std::streamsize precision = os.precision(17);
+
+  os << "AmoebaSize " << this->AmoebaSize << "\n";
+  os << "AmoebaHighValue " << this->AmoebaHighValue << "\n";
+  os << "AmoebaNStepsNoImprovement "
+     << this->AmoebaNStepsNoImprovement << "\n";
+  os << "AmoebaVertices " << m << "\n";
+  for (int k = 0; k < m; k++)
+    {
+    // each vertex is followed by the function value at the vertex
+    const double *v = this->AmoebaVertices[k];
+    for (int i = 0; i < n; i++)
+      {
+      os << v[i] << " ";
+      }
+    os << this->AmoebaValues[k] << "\n";
+    }
+  if (m > 0)
+    {
+    os << "AmoebaSum";
+    for (int i = 0; i < n; i++)
+      {
+      os << " " << this->AmoebaSum[i];
+      }
+    os << "\n";
+    }
+
+  os.precision(precision);
+}
+
+//----------------------------------------------------------------------------
+int vtkNelderMeadMinimizer::RestoreState(istream& is)
+{
+  if (!this->Superclass::RestoreState(is))
+    {
+    return 0;
+    }
+
+  int n = this->NumberOfParameters;
+  int m = 0;
+  if (!vtkFunctionMinimizer::ReadStateKeyword(is, "AmoebaSize") ||
+      !(is >> this->AmoebaSize) ||
+      !vtkFunctionMinimizer::ReadStateKeyword(is, "AmoebaHighValue") ||
+      !(is >> this->AmoebaHighValue) ||
+      !vtkFunctionMinimizer::ReadStateKeyword(
+        is, "AmoebaNStepsNoImprovement") ||
+      !(is >> this->AmoebaNStepsNoImprovement) ||
+      !vtkFunctionMinimizer::ReadStateKeyword(is, "AmoebaVertices") ||
+      !(is >> m) || (m != 0 && m != n + 1) ||
+      (m == 0 && this->Iterations > 0))
+    {
+    vtkErrorMacro("RestoreState: Unable to read the simplex.");
+    this->Iterations = 0;
+    return 0;
+    }
+
+  if (m > 0)
+    {
+    this->AllocateAmoeba();
+    for (int k = 0; k < m; k++)
+      {
+      double *v = this->AmoebaVertices[k];
+      for (int i = 0; i < n; i++)
+        {
+        is >> v[i];
+        }
+      is >> this->AmoebaValues[k];
+      }
+    // the sum is kept incrementally, so it is read rather than recomputed
+    bool success = (!is.fail() &&
+      vtkFunctionMinimizer::ReadStateKeyword(is, "AmoebaSum"));
+    for (int i = 0; i < n && success; i++)
+      {
+      success = !(is >> this->AmoebaSum[i]).fail();
+      }
+    if (!success)
+      {
+      vtkErrorMacro("RestoreState: Unable to read the simplex.");
+      this->Iterations = 0;
+      return 0;
+      }
+    }
+
+  return 1;
+}
+
 //----------------------------------------------------------------------------
 int vtkNelderMeadMinimizer::Step()
 {
@@ -186,14 +280,13 @@ static  int  vtkAmoebaNumericallyClose(double  n1,
 @MODIFIED   :         2002    David Gobbi
 ---------------------------------------------------------------------------- */
 
-void  vtkNelderMeadMinimizer::InitializeAmoeba()
+void  vtkNelderMeadMinimizer::AllocateAmoeba()
 {
-  int    i, j;
+  int    i;
 
   this->TerminateAmoeba();
 
   int n_parameters = this->NumberOfParameters;
-  this->AmoebaNStepsNoImprovement = 0;
   this->AmoebaVertices = new double *[n_parameters+1];
   this->AmoebaVertices[0] = new double[n_parameters*(n_parameters+1)];
 
@@ -205,6 +298,16 @@ void  vtkNelderMeadMinimizer::InitializeAmoeba()
   this->AmoebaValues = new double[n_parameters+1];
 
   this->AmoebaSum = new double[n_parameters];
+}
+
+void  vtkNelderMeadMinimizer::InitializeAmoeba()
+{
+  int    i, j;
+
+  this->AllocateAmoeba();
+
+  int n_parameters = this->NumberOfParameters;
+  this->AmoebaNStepsNoImprovement = 0;
 
   for (j = 0; j < n_parameters; j++)
     {
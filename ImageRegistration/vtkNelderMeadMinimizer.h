@@ -48,6 +48,11 @@ public:
   vtkSetClampMacro(ExpansionRatio,double,1.0,2.0);
   vtkGetMacro(ExpansionRatio,double);
 
+  // Description:
+  // Save and restore the state, including the simplex.
+  void SaveState(ostream& os);
+  int RestoreState(istream& is);
+
 protected:
   vtkNelderMeadMinimizer();
   ~vtkNelderMeadMinimizer();
@@ -55,6 +60,7 @@ protected:
   void Start();
   int Step();
 
+  void AllocateAmoeba();
   void InitializeAmoeba();
   void GetAmoebaParameterValues();
   void TerminateAmoeba();
@@ -333,10 +333,9 @@ double vtkPowellMinimizer::PowellBracket(
 }
 
 //----------------------------------------------------------------------------
-void vtkPowellMinimizer::Start()
+void vtkPowellMinimizer::PowellAllocate()
 {
   int n = this->NumberOfParameters;
-  double *pw = this->ParameterScales;
   delete [] this->PowellVectors;
   delete [] this->PowellWorkspace;
 
@@ -346,17 +345,96 @@ void vtkPowellMinimizer::Start()
   double *work = new double[n*(n+2)];
   for (int k = 0; k < n; k++)
     {
-    double *v = work + n*(k + 2);
-    vecs[k] = v;
-    for (int i = 0; i < n; i++) { v[i] = 0.0; }
-    v[k] = pw[k];
+    vecs[k] = work + n*(k + 2);
     }
 
   this->PowellWorkspace = work;
   this->PowellVectors = vecs;
+}
+
+//----------------------------------------------------------------------------
+void vtkPowellMinimizer::Start()
+{
+  int n = this->NumberOfParameters;
+  double *pw = this->ParameterScales;
+
+  this->PowellAllocate();
+
+  // the initial directions are the scaled parameter axes
+  double **vecs = this->PowellVectors;
+  for (int k = 0; k < n; k++)
+    {
+    double *v = vecs[k];
+    for (int i = 0; i < n; i++) { v[i] = 0.0; }
+    v[k] = pw[k];
+    }
+
   this->EvaluateFunction();
 }
 
+//----------------------------------------------------------------------------
+void vtkPowellMinimizer::SaveState(ostream& os)
+{
+  this->Superclass::SaveState(os);
+
+  // the directions only exist after the minimization has started
+  int n = this->NumberOfParameters;
+  int m = (this->Iterations > 0 && this->PowellVectors ? n : 0);
+  std::streamsize precision = os.precision(17);
+
+  os << "PowellVectors " << m << "\n";
+  for (int k = 0; k < m; k++)
+    {
+    const double *v = this->PowellVectors[k];
+    for (int i = 0; i < n; i++)
+      {
+      os << (i == 0 ? "" : " ") << v[i];
+      }
+    os << "\n";
+    }
+
+  os.precision(precision);
+}
+
+//----------------------------------------------------------------------------
+int vtkPowellMinimizer::RestoreState(istream& is)
+{
+  if (!this->Superclass::RestoreState(is))
+    {
+    return 0;
+    }
+
+  int n = this->NumberOfParameters;
+  int m = 0;
+  if (!vtkFunctionMinimizer::ReadStateKeyword(is, "PowellVectors") ||
+      !(is >> m) || (m != 0 && m != n) || (m == 0 && this->Iterations > 0))
+    {
+    vtkErrorMacro("RestoreState: Unable to read the direction set.");
+    this->Iterations = 0;
+    return 0;
+    }
+
+  if (m > 0)
+    {
+    this->PowellAllocate();
+    for (int k = 0; k < m; k++)
+      {
+      double *v = this->PowellVectors[k];
+      for (int i = 0; i < n; i++)
+        {
+        if (!(is >> v[i]))
+          {
+          vtkErrorMacro("RestoreState: Unable to read the direction set.");
+          this->Iterations = 0;
+          return 0;
+          }
+        }
+      }
+    }
+
+  return 1;
+}
+
 //----------------------------------------------------------------------------
 int vtkPowellMinimizer::Step()
 {
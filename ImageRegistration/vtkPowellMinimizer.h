@@ -30,6 +30,11 @@ public:
   vtkTypeMacro(vtkPowellMinimizer,vtkFunctionMinimizer);
   void PrintSelf(ostream& os, vtkIndent indent);
 
+  // Description:
+  // Save and restore the state, including the direction set.
+  void SaveState(ostream& os);
+  int RestoreState(istream& is);
+
 protected:
   vtkPowellMinimizer();
   ~vtkPowellMinimizer();
@@ -47,6 +52,10 @@ protected:
     const double *p0, double y0, const double *v, double *p, int n,
     double bracket[3], bool *failed);
 
+  // Description:
+  // Allocate the workspace and the direction set.
+  void PowellAllocate();
+
   // Description:
   // Initialize the workspace required for the method.
   void Start();
@@ -19,6 +19,8 @@
 #include "vtkImageData.h"
 #include "vtkDataSet.h"
 #include "vtkPointData.h"
+#include "vtkDataArray.h"
+#include "vtkCollection.h"
 #include "vtkImageStencilData.h"
 #include "vtkImageStencilIterator.h"
 #include "vtkImageIterator.h"
@@ -27,6 +29,7 @@
 #include "vtkIdTypeArray.h"
 #include "vtkIntArray.h"
 #include "vtkImageStencilData.h"
+#include "vtkMultiThreader.h"
 #include "vtkStreamingDemandDrivenPipeline.h"
 #include "vtkInformation.h"
 #include "vtkInformationVector.h"
@@ -39,6 +42,140 @@
 #include <stack>
 #include <algorithm>
 
+//----------------------------------------------------------------------------
+namespace {
+
+// A run of voxels along the x axis, connectivity is computed for the runs
+// rather than for the individual voxels.
+struct vtkICFRun
+{
+  int x0;
+  int x1;
+};
+
+} // end anonymous namespace
+
+//----------------------------------------------------------------------------
+// The information that is kept between the slabs when streaming.  Each
+// slab has its own "provisional" regions, which are joined into the final
+// regions through a table of equivalences.
+class vtkImageConnectivityFilterStreamState
+{
+public:
+  enum PassEnum {
+    Idle = 0,
+    Analysis = 1,
+    Output = 2
+  };
+
+  vtkImageConnectivityFilterStreamState()
+    : Pass(Idle), Started(false), Overlap(false), Division(0),
+      NumberOfDivisions(1), FirstDivision(0), LastDivision(-1),
+      AnalysisValid(false) {
+    for (int i = 0; i < 6; i++) { this->Extent[i] = 0; } }
+
+  // Get the extent of one of the slabs.
+  void GetSlabExtent(int division, int slabExt[6])
+  {
+    int nz = this->Extent[5] - this->Extent[4] + 1;
+    for (int i = 0; i < 6; i++)
+      {
+      slabExt[i] = this->Extent[i];
+      }
+    slabExt[4] = this->Extent[4] + (nz*division)/this->NumberOfDivisions;
+    slabExt[5] = this->Extent[4] + (nz*(division + 1))/this->NumberOfDivisions
+      - 1;
+  }
+
+  // Find the slabs that are needed for the output extent, return false
+  // if no slabs are needed.
+  bool SetOutputDivisions(const int outExt[6])
+  {
+    for (int i = 0; i < 6; i += 2)
+      {
+      if (outExt[i] > this->Extent[i+1] || outExt[i+1] < this->Extent[i])
+        {
+        return false;
+        }
+      }
+    this->FirstDivision = this->NumberOfDivisions;
+    this->LastDivision = -1;
+    for (int d = 0; d < this->NumberOfDivisions; d++)
+      {
+      int slabExt[6];
+      this->GetSlabExtent(d, slabExt);
+      if (slabExt[5] >= outExt[4] && slabExt[4] <= outExt[5])
+        {
+        if (d < this->FirstDivision)
+          {
+          this->FirstDivision = d;
+          }
+        this->LastDivision = d;
+        }
+      }
+    return (this->FirstDivision <= this->LastDivision);
+  }
+
+  // Clear the tables before the first slab.
+  void InitializeAnalysis(vtkIdType numberOfSeeds)
+  {
+    this->Parent.clear();
+    this->Sizes.clear();
+    this->Extents.clear();
+    this->SlabBase.clear();
+    this->SeedRegions.assign(numberOfSeeds, -1);
+    this->PlaneRowStart.clear();
+    this->PlaneRuns.clear();
+    this->PlaneIds.clear();
+    this->LabelMap.clear();
+  }
+
+  // Free the tables that are not needed after the last slab.
+  void FinishAnalysis()
+  {
+    std::vector<vtkIdType>().swap(this->Parent);
+    std::vector<vtkIdType>().swap(this->Sizes);
+    std::vector<int>().swap(this->Extents);
+    std::vector<vtkIdType>().swap(this->SeedRegions);
+    std::vector<vtkIdType>().swap(this->PlaneRowStart);
+    std::vector<vtkICFRun>().swap(this->PlaneRuns);
+    std::vector<vtkIdType>().swap(this->PlaneIds);
+    this->AnalysisValid = true;
+  }
+
+  int Pass;
+  bool Started;
+  bool Overlap;
+  int Division;
+  int NumberOfDivisions;
+  int FirstDivision;
+  int LastDivision;
+  int Extent[6];
+  // This is cleared by RequestInformation(), which the pipeline calls
+  // whenever the filter or anything upstream has been modified.
+  bool AnalysisValid;
+
+  // The table of equivalences, and the size and extent (relative to
+  // Extent) of each provisional region.
+  std::vector<vtkIdType> Parent;
+  std::vector<vtkIdType> Sizes;
+  std::vector<int> Extents;
+
+  // The first provisional region in each slab.
+  std::vector<vtkIdType> SlabBase;
+
+  // The provisional region that contains each seed, or -1.
+  std::vector<vtkIdType> SeedRegions;
+
+  // The runs in the last plane of the previous slab.
+  std::vector<vtkIdType> PlaneRowStart;
+  std::vector<vtkICFRun> PlaneRuns;
+  std::vector<vtkIdType> PlaneIds;
+
+  // The final label for each provisional region.
+  std::vector<vtkIdType> LabelMap;
+};
+
 vtkStandardNewMacro(vtkImageConnectivityFilter);
 
 //----------------------------------------------------------------------------
@@ -65,12 +202,19 @@ vtkImageConnectivityFilter::vtkImageConnectivityFilter()
   this->LabelScalarType = VTK_UNSIGNED_CHAR;
 
   this->GenerateRegionExtents = 0;
+  this->GenerateRegionStencils = 0;
+
+  this->NumberOfThreads = 0;
+
+  this->NumberOfStreamDivisions = 1;
+  this->StreamState = new vtkImageConnectivityFilterStreamState;
 
   this->ExtractedRegionLabels = vtkIdTypeArray::New();
   this->ExtractedRegionSizes = vtkIdTypeArray::New();
   this->ExtractedRegionSeedIds = vtkIdTypeArray::New();
   this->ExtractedRegionExtents = vtkIntArray::New();
   this->ExtractedRegionExtents->SetNumberOfComponents(6);
+  this->ExtractedRegionStencils = vtkCollection::New();
 
   this->SetNumberOfInputPorts(3);
 }
@@ -94,6 +238,11 @@ vtkImageConnectivityFilter::~vtkImageConnectivityFilter()
     {
     this->ExtractedRegionExtents->Delete();
     }
+  if (this->ExtractedRegionStencils)
+    {
+    this->ExtractedRegionStencils->Delete();
+    }
+  delete this->StreamState;
 }
 
 //----------------------------------------------------------------------------
@@ -229,6 +378,19 @@ vtkIdType vtkImageConnectivityFilter::GetNumberOfExtractedRegions()
   return this->ExtractedRegionLabels->GetNumberOfTuples();
 }
 
+//----------------------------------------------------------------------------
+vtkImageStencilData *vtkImageConnectivityFilter::GetExtractedRegionStencil(
+  vtkIdType i)
+{
+  if (i < 0 || i >= this->ExtractedRegionStencils->GetNumberOfItems())
+    {
+    return 0;
+    }
+
+  return static_cast<vtkImageStencilData *>(
+    this->ExtractedRegionStencils->GetItemAsObject(static_cast<int>(i)));
+}
+
 //----------------------------------------------------------------------------
 namespace {
 
@@ -249,6 +411,60 @@ protected:
   // A functor to assist in comparing region sizes.
   struct CompareSize;
 
+  // A run of unmarked voxels along the x axis.
+  typedef vtkICFRun Run;
+
+  // Everything that is needed by the threads that label the runs.
+  struct RunThreadStruct;
+
+  // The passes that are done by the threads.
+  enum RunPassEnum {
+    CountRunsPass = 0,
+    ConnectRunsPass = 1
+  };
+
+  // Find the runs of unmarked voxels in one row of the bitmask, and store
+  // them in "runs" unless it is NULL.  The number of runs is returned.
+  static vtkIdType FindRuns(
+    const unsigned char *maskPtr, vtkIdType bitOffset, int n,
+    vtkICF::Run *runs);
+
+  // Find the runs for one row of a stencil, like FindRuns().  The indices
+  // yIdx, zIdx, and the returned runs are relative to the extent.
+  static vtkIdType FindStencilRuns(
+    vtkImageStencilData *stencil, const int extent[6], int yIdx, int zIdx,
+    vtkICF::Run *runs);
+
+  // Find the root of a tree of runs, for union-find.
+  static vtkIdType FindRoot(vtkIdType *parent, vtkIdType i);
+
+  // Join the trees for any runs in row r1 that touch runs in row r2.
+  static void ConnectRows(
+    vtkIdType *parent, const vtkICF::Run *runs, const vtkIdType *rowStart,
+    vtkIdType r1, vtkIdType r2);
+
+  // Join the trees for runs in two lists that touch, where the trees are
+  // given by "ids" rather than by the index of each run.
+  static void ConnectRuns(
+    vtkIdType *parent, const vtkICF::Run *runs1, const vtkIdType *ids1,
+    vtkIdType n1, const vtkICF::Run *runs2, const vtkIdType *ids2,
+    vtkIdType n2);
+
+  // Count or connect the runs over a slab of rows.
+  static VTK_THREAD_RETURN_TYPE RunThreadExecute(void *arg);
+
+  // Write the labels for the runs over a slab of rows.
+  template<class OT>
+  static VTK_THREAD_RETURN_TYPE WriteRunsThreadExecute(void *arg);
+
+  // Find and connect all the runs, and number the regions in raster order.
+  // On return, the "parent" of each run is the index of its region.
+  static void LabelRuns(
+    vtkICF::RunThreadStruct *ts, vtkMultiThreader *threader,
+    std::vector<vtkIdType>& rowStart, std::vector<vtkICF::Run>& runs,
+    std::vector<vtkIdType>& parent, bool generateExtents,
+    std::vector<vtkICF::Region>& regions);
+
   // Remove all but the largest region from the output image.
   template<class OT>
   static void PruneAllButLargest(
@@ -328,6 +544,33 @@ protected:
     vtkICF::RegionVector& regionInfo);
 
 public:
+  // Execute method for when region stencils are generated.
+  static void StencilExecute(
+    vtkImageConnectivityFilter *self, vtkDataSet *seedData,
+    vtkImageStencilData *stencil, int extent[6],
+    const double origin[3], const double spacing[3]);
+
+  // Find the regions in one slab when streaming, and join them with the
+  // regions in the previous slab.
+  static void AnalyzeSlab(
+    vtkImageConnectivityFilter *self,
+    vtkImageConnectivityFilterStreamState *state, unsigned char *maskPtr,
+    int slabExt[6], vtkDataSet *seedData,
+    const double origin[3], const double spacing[3]);
+
+  // Join the regions after the last slab, and create the region arrays.
+  static void FinishAnalysis(
+    vtkImageConnectivityFilter *self,
+    vtkImageConnectivityFilterStreamState *state, vtkDataSet *seedData,
+    int minLabel, int maxLabel);
+
+  // Write the labels for one slab when streaming.
+  template<class OT>
+  static void WriteSlab(
+    vtkImageConnectivityFilter *self,
+    vtkImageConnectivityFilterStreamState *state, vtkImageData *outData,
+    OT *outPtr, unsigned char *maskPtr, int slabExt[6]);
+
   // Create a bit mask from the input
   template<class IT>
   static void ExecuteInput(
@@ -341,6 +584,10 @@ public:
     vtkImageData *outData, vtkDataSet *seedData, vtkImageStencilData *stencil,
     OT *outPtr, unsigned char *maskPtr, int extent[6]);
 
+  // Get the number of threads to use for the given number of rows.
+  static int GetNumberOfThreads(
+    vtkImageConnectivityFilter *self, vtkIdType numRows);
+
   // Utility method to find the intersection of two extents.
   // Returns false if the extents do not intersect.
   static bool IntersectExtents(
@@ -446,6 +693,32 @@ public:
 
 };
 
+//----------------------------------------------------------------------------
+int vtkICF::GetNumberOfThreads(
+  vtkImageConnectivityFilter *self, vtkIdType numRows)
+{
+  int numThreads = self->GetNumberOfThreads();
+  if (numThreads <= 0)
+    {
+    numThreads = vtkMultiThreader::GetGlobalDefaultNumberOfThreads();
+    }
+  // vtkMultiThreader will not run more than VTK_MAX_THREADS
+  if (numThreads > VTK_MAX_THREADS)
+    {
+    numThreads = VTK_MAX_THREADS;
+    }
+  if (numThreads > numRows)
+    {
+    numThreads = static_cast<int>(numRows);
+    }
+  if (numThreads < 1)
+    {
+    numThreads = 1;
+    }
+
+  return numThreads;
+}
+
 //----------------------------------------------------------------------------
 bool vtkICF::IntersectExtents(
   const int extent1[6], const int extent2[6], int output[6])
@@ -1239,201 +1512,1288 @@ void vtkICF::SeededExecute(
 }
 
 //----------------------------------------------------------------------------
-template <class OT>
-void vtkICF::SeedlessExecute(
-  vtkImageConnectivityFilter *self,
-  vtkImageData *outData, vtkImageStencilData *stencil,
-  OT *outPtr, unsigned char *maskPtr, int extent[6],
-  vtkICF::RegionVector& regionInfo)
+// the rows are divided into slabs, one slab per thread, and the runs are
+// found either from the bitmask or (if MaskPtr is NULL) from the stencil
+struct vtkICF::RunThreadStruct
 {
-  // Get execution parameters
-  int extractionMode = self->GetExtractionMode();
-  vtkIdType sizeRange[2];
-  self->GetSizeRange(sizeRange);
-
-  vtkIdType outInc[3];
-  outData->GetIncrements(outInc);
-
-  int outExt[6];
-  outData->GetExtent(outExt);
-
-  // Indexing will go from 0 to maxIdX, and the lower limit if "extent" will
-  // be subracted from outExt.  If outExt was the same as extent, then NULL
-  // is returned, else outExt is returned.
-  int maxIdx[3];
-  int *outLimits = vtkICF::ZeroBaseExtent(extent, outExt, maxIdx);
+  int Pass;
+  int NumberOfThreads;
+  const unsigned char *MaskPtr;
+  vtkImageStencilData *Stencil;
+  int *Extent;
+  int MaxIdx[3];
+  vtkIdType *RowStart;
+  vtkICF::Run *Runs;
+  vtkIdType *Parent;
+  void *OutPtr;
+  vtkIdType *OutInc;
+  int *OutLimits;
+  const void *RegionLabels;
+};
 
-  // for measuring extent of fill
-  int seedExtent[6];
-  // only set to non-null if extent generation was requested
-  int *fillExtent = (self->GetGenerateRegionExtents() ? seedExtent : NULL);
+//----------------------------------------------------------------------------
+vtkIdType vtkICF::FindRuns(
+  const unsigned char *maskPtr, vtkIdType bitOffset, int n,
+  vtkICF::Run *runs)
+{
+  const unsigned char *maskPtr1 = maskPtr + (bitOffset >> 3);
+  unsigned char bit = 1 << static_cast<unsigned char>(bitOffset & 0x7);
+  vtkIdType count = 0;
+  int x = 0;
 
-  // keep track of position in bitmask
-  unsigned char *maskPtr1 = maskPtr;
-  unsigned char bit = 1;
+  while (x < n)
+    {
+    // skip the marked voxels, a whole byte at a time if possible
+    while (x < n && (*maskPtr1 & bit) != 0)
+      {
+      if (bit == 1 && *maskPtr1 == 0xff && n - x >= 8)
+        {
+        maskPtr1++;
+        x += 8;
+        continue;
+        }
+      x++;
+      bit <<= 1;
+      if (bit == 0)
+        {
+        maskPtr1++;
+        bit = 1;
+        }
+      }
 
-  std::stack<vtkICF::Seed> seedStack;
+    if (x == n)
+      {
+      break;
+      }
 
-  for (int zIdx = 0; zIdx <= maxIdx[2]; zIdx++)
-    {
-    for (int yIdx = 0; yIdx <= maxIdx[1]; yIdx++)
+    // find the end of the run of unmarked voxels
+    int x0 = x;
+    while (x < n && (*maskPtr1 & bit) == 0)
       {
-      for (int xIdx = 0; xIdx <= maxIdx[0]; xIdx++)
+      if (bit == 1 && *maskPtr1 == 0 && n - x >= 8)
         {
-        // check the bitmask to see if voxel is already colored
-        unsigned char bitSet = *maskPtr1 & bit;
-        bit <<= 1;
-        if (bit == 0)
-          {
-          maskPtr1++;
-          bit = 1;
-          }
+        maskPtr1++;
+        x += 8;
+        continue;
+        }
+      x++;
+      bit <<= 1;
+      if (bit == 0)
+        {
+        maskPtr1++;
+        bit = 1;
+        }
+      }
 
-        // if already colored, skip
-        if (bitSet != 0)
-          {
-          continue;
-          }
+    if (runs)
+      {
+      runs[count].x0 = x0;
+      runs[count].x1 = x - 1;
+      }
+    count++;
+    }
 
-        // initialize the region extent from the seed position
-        seedExtent[0] = seedExtent[1] = xIdx;
-        seedExtent[2] = seedExtent[3] = yIdx;
-        seedExtent[4] = seedExtent[5] = zIdx;
+  return count;
+}
 
-        OT label = static_cast<OT>(regionInfo.size());
-        seedStack.push(vtkICF::Seed(xIdx, yIdx, zIdx, label));
+//----------------------------------------------------------------------------
+vtkIdType vtkICF::FindStencilRuns(
+  vtkImageStencilData *stencil, const int extent[6], int yIdx, int zIdx,
+  vtkICF::Run *runs)
+{
+  vtkIdType count = 0;
+  int lastX = 0;
+  int iter = 0;
+  int r1, r2;
 
-        // find all voxels that are connected to the seed
-        vtkIdType voxelCount = vtkICF::Fill(
-          outPtr, outInc, outLimits, maskPtr, maxIdx,
-          fillExtent, seedStack);
+  while (stencil->GetNextExtent(r1, r2, extent[0], extent[1],
+                                yIdx + extent[2], zIdx + extent[4], iter))
+    {
+    r1 -= extent[0];
+    r2 -= extent[0];
+    if (r1 > r2)
+      {
+      continue;
+      }
 
-        if (voxelCount != 0)
+    // stencil extents that touch are merged into a single run
+    if (count > 0 && r1 <= lastX + 1)
+      {
+      if (r2 > lastX)
+        {
+        lastX = r2;
+        if (runs)
           {
-          if (voxelCount == 1 &&
-              static_cast<OT>(regionInfo.size()) == vtkTypeTraits<OT>::Max())
-            {
-            // smallest region is definitely the one we just added
-            vtkIdType outOffset = (xIdx*outInc[0] +
-                                   yIdx*outInc[1] +
-                                   zIdx*outInc[2]);
-            outPtr[outOffset] = 0;
-            }
-          else
-            {
-            vtkICF::AddRegion(
-              outData, outPtr, stencil, extent, sizeRange, regionInfo,
-              voxelCount, -1, seedExtent, extractionMode);
-            }
+          runs[count - 1].x1 = r2;
           }
         }
       }
+    else
+      {
+      lastX = r2;
+      if (runs)
+        {
+        runs[count].x0 = r1;
+        runs[count].x1 = r2;
+        }
+      count++;
+      }
     }
+
+  return count;
 }
 
 //----------------------------------------------------------------------------
-// This templated function executes the filter for any type of data.
-template <class OT>
-void vtkICF::ExecuteOutput(
-  vtkImageConnectivityFilter *self,
-  vtkImageData *outData, vtkDataSet *seedData, vtkImageStencilData *stencil,
-  OT *outPtr, unsigned char *maskPtr, int extent[6])
+// the parent always has a lower index than the child, so the root of
+// each tree is the first run of the region in raster order
+vtkIdType vtkICF::FindRoot(vtkIdType *parent, vtkIdType i)
 {
-  // push the "background" onto the region vector
-  vtkICF::RegionVector regionInfo;
-  regionInfo.push_back(vtkICF::Region(0, 0, extent));
-
-  // execution depends on how regions are seeded
-  vtkDataArray *seedScalars = 0;
-  if (seedData)
-    {
-    seedScalars = seedData->GetPointData()->GetScalars();
-    vtkICF::SeededExecute(
-      self, outData, seedData, stencil, outPtr, maskPtr,
-      extent, regionInfo);
-    }
-
-  // if no seeds, or if AllRegions selected, search for all regions
-  int extractionMode = self->GetExtractionMode();
-  if (!seedData ||
-      extractionMode == vtkImageConnectivityFilter::AllRegions)
+  while (parent[i] != i)
     {
-    vtkICF::SeedlessExecute(
-      self, outData, stencil, outPtr, maskPtr, extent,
-      regionInfo);
+    parent[i] = parent[parent[i]];
+    i = parent[i];
     }
-
-  // do final relabelling and other bookkeeping
-  vtkICF::Finish(
-    self, outData, outPtr, stencil, extent, seedScalars, regionInfo);
+  return i;
 }
 
-} // end anonymous namespace
-
 //----------------------------------------------------------------------------
-int vtkImageConnectivityFilter::RequestInformation(
-  vtkInformation *vtkNotUsed(request),
-  vtkInformationVector **vtkNotUsed(inputVector),
-  vtkInformationVector *outputVector)
+void vtkICF::ConnectRows(
+  vtkIdType *parent, const vtkICF::Run *runs, const vtkIdType *rowStart,
+  vtkIdType r1, vtkIdType r2)
 {
-  vtkInformation* outInfo = outputVector->GetInformationObject(0);
-  vtkDataObject::SetPointDataActiveScalarInfo(
-    outInfo, this->LabelScalarType, 1);
+  vtkIdType i = rowStart[r1];
+  vtkIdType iEnd = rowStart[r1 + 1];
+  vtkIdType j = rowStart[r2];
+  vtkIdType jEnd = rowStart[r2 + 1];
 
-  return 1;
+  while (i < iEnd && j < jEnd)
+    {
+    // if the runs overlap, then join their trees
+    if (runs[i].x0 <= runs[j].x1 && runs[j].x0 <= runs[i].x1)
+      {
+      vtkIdType a = vtkICF::FindRoot(parent, i);
+      vtkIdType b = vtkICF::FindRoot(parent, j);
+      if (a < b)
+        {
+        parent[b] = a;
+        }
+      else if (b < a)
+        {
+        parent[a] = b;
+        }
+      }
+
+    // advance whichever run ends first
+    if (runs[i].x1 < runs[j].x1)
+      {
+      i++;
+      }
+    else
+      {
+      j++;
+      }
+    }
 }
 
 //----------------------------------------------------------------------------
-int vtkImageConnectivityFilter::RequestUpdateExtent(
-  vtkInformation *vtkNotUsed(request),
-  vtkInformationVector **inputVector,
-  vtkInformationVector *vtkNotUsed(outputVector))
+void vtkICF::ConnectRuns(
+  vtkIdType *parent, const vtkICF::Run *runs1, const vtkIdType *ids1,
+  vtkIdType n1, const vtkICF::Run *runs2, const vtkIdType *ids2,
+  vtkIdType n2)
 {
-  vtkInformation *inInfo = inputVector[0]->GetInformationObject(0);
-  vtkInformation *stencilInfo = inputVector[1]->GetInformationObject(0);
+  vtkIdType i = 0;
+  vtkIdType j = 0;
 
-  int extent[6];
-  inInfo->Get(vtkStreamingDemandDrivenPipeline::WHOLE_EXTENT(), extent);
-  inInfo->Set(vtkStreamingDemandDrivenPipeline::UPDATE_EXTENT(), extent, 6);
-  if (stencilInfo)
+  while (i < n1 && j < n2)
     {
-    stencilInfo->Set(vtkStreamingDemandDrivenPipeline::UPDATE_EXTENT(),
-                     extent, 6);
-    }
+    // if the runs overlap, then join their trees
+    if (runs1[i].x0 <= runs2[j].x1 && runs2[j].x0 <= runs1[i].x1)
+      {
+      vtkIdType a = vtkICF::FindRoot(parent, ids1[i]);
+      vtkIdType b = vtkICF::FindRoot(parent, ids2[j]);
+      if (a < b)
+        {
+        parent[b] = a;
+        }
+      else if (b < a)
+        {
+        parent[a] = b;
+        }
+      }
 
-  return 1;
+    // advance whichever run ends first
+    if (runs1[i].x1 < runs2[j].x1)
+      {
+      i++;
+      }
+    else
+      {
+      j++;
+      }
+    }
 }
 
 //----------------------------------------------------------------------------
-int vtkImageConnectivityFilter::RequestData(
-  vtkInformation *vtkNotUsed(request),
-  vtkInformationVector **inputVector,
-  vtkInformationVector *outputVector)
+VTK_THREAD_RETURN_TYPE vtkICF::RunThreadExecute(void *arg)
 {
-  vtkInformation *outInfo = outputVector->GetInformationObject(0);
-  vtkInformation *inInfo = inputVector[0]->GetInformationObject(0);
-  vtkInformation *stencilInfo = inputVector[1]->GetInformationObject(0);
-  vtkInformation *seedInfo = inputVector[2]->GetInformationObject(0);
-
-  vtkImageData* outData = static_cast<vtkImageData *>(
-    outInfo->Get(vtkDataObject::DATA_OBJECT()));
-  vtkImageData* inData = static_cast<vtkImageData *>(
-    inInfo->Get(vtkDataObject::DATA_OBJECT()));
-
-  vtkDataSet* seedData = 0;
-  if (seedInfo)
+  vtkMultiThreader::ThreadInfo *ti =
+    static_cast<vtkMultiThreader::ThreadInfo *>(arg);
+  vtkICF::RunThreadStruct *ts =
+    static_cast<vtkICF::RunThreadStruct *>(ti->UserData);
+
+  int nx = ts->MaxIdx[0] + 1;
+  int ny = ts->MaxIdx[1] + 1;
+  vtkIdType numRows = static_cast<vtkIdType>(ny)*(ts->MaxIdx[2] + 1);
+  vtkIdType *rowStart = ts->RowStart;
+  vtkICF::Run *runs = ts->Runs;
+  vtkIdType *parent = ts->Parent;
+
+  // each thread does a contiguous slab of rows
+  vtkIdType firstRow = (numRows*ti->ThreadID)/ts->NumberOfThreads;
+  vtkIdType lastRow = (numRows*(ti->ThreadID + 1))/ts->NumberOfThreads;
+
+  for (vtkIdType r = firstRow; r < lastRow; r++)
     {
-    seedData = static_cast<vtkDataSet *>(
-      seedInfo->Get(vtkDataObject::DATA_OBJECT()));
-    }
+    // the counts are converted to offsets after all threads are done
+    vtkICF::Run *rowRuns = NULL;
+    if (ts->Pass == vtkICF::ConnectRunsPass)
+      {
+      rowRuns = &runs[rowStart[r]];
+      }
 
-  vtkImageStencilData* stencil = 0;
-  if (stencilInfo)
+    vtkIdType count = 0;
+    if (ts->MaskPtr)
+      {
+      count = vtkICF::FindRuns(ts->MaskPtr, r*nx, nx, rowRuns);
+      }
+    else
+      {
+      count = vtkICF::FindStencilRuns(
+        ts->Stencil, ts->Extent, static_cast<int>(r % ny),
+        static_cast<int>(r / ny), rowRuns);
+      }
+
+    if (ts->Pass == vtkICF::CountRunsPass)
+      {
+      rowStart[r + 1] = count;
+      continue;
+      }
+
+    for (vtkIdType i = rowStart[r]; i < rowStart[r + 1]; i++)
+      {
+      parent[i] = i;
+      }
+
+    // join with the previous row and the previous slice, but only
+    // within the slab, the slabs are joined after the threads are done
+    if (r % ny != 0 && r - 1 >= firstRow)
+      {
+      vtkICF::ConnectRows(parent, runs, rowStart, r, r - 1);
+      }
+    if (r - ny >= firstRow)
+      {
+      vtkICF::ConnectRows(parent, runs, rowStart, r, r - ny);
+      }
+    }
+
+  return VTK_THREAD_RETURN_VALUE;
+}
+
+//----------------------------------------------------------------------------
+template<class OT>
+VTK_THREAD_RETURN_TYPE vtkICF::WriteRunsThreadExecute(void *arg)
+{
+  vtkMultiThreader::ThreadInfo *ti =
+    static_cast<vtkMultiThreader::ThreadInfo *>(arg);
+  vtkICF::RunThreadStruct *ts =
+    static_cast<vtkICF::RunThreadStruct *>(ti->UserData);
+
+  int nx = ts->MaxIdx[0] + 1;
+  int ny = ts->MaxIdx[1] + 1;
+  vtkIdType numRows = static_cast<vtkIdType>(ny)*(ts->MaxIdx[2] + 1);
+  vtkIdType *rowStart = ts->RowStart;
+  vtkICF::Run *runs = ts->Runs;
+  vtkIdType *parent = ts->Parent;
+
+  // each thread does a contiguous slab of rows
+  vtkIdType firstRow = (numRows*ti->ThreadID)/ts->NumberOfThreads;
+  vtkIdType lastRow = (numRows*(ti->ThreadID + 1))/ts->NumberOfThreads;
+
+  // the parent of each run has been replaced by its region index
+  OT *outPtr = static_cast<OT *>(ts->OutPtr);
+  const OT *labels = static_cast<const OT *>(ts->RegionLabels);
+  vtkIdType *outInc = ts->OutInc;
+  int *outLimits = ts->OutLimits;
+
+  for (vtkIdType r = firstRow; r < lastRow; r++)
+    {
+    int yIdx = static_cast<int>(r % ny);
+    int zIdx = static_cast<int>(r / ny);
+    int xMin = 0;
+    int xMax = nx - 1;
+    vtkIdType outOffset = yIdx*outInc[1] + zIdx*outInc[2];
+    if (outLimits)
+      {
+      if (yIdx < outLimits[2] || yIdx > outLimits[3] ||
+          zIdx < outLimits[4] || zIdx > outLimits[5])
+        {
+        continue;
+        }
+      xMin = outLimits[0];
+      xMax = outLimits[1];
+      outOffset = ((yIdx - outLimits[2])*outInc[1] +
+                   (zIdx - outLimits[4])*outInc[2] -
+                   xMin*outInc[0]);
+      }
+
+    for (vtkIdType i = rowStart[r]; i < rowStart[r + 1]; i++)
+      {
+      OT label = labels[parent[i]];
+      int x0 = (runs[i].x0 > xMin ? runs[i].x0 : xMin);
+      int x1 = (runs[i].x1 < xMax ? runs[i].x1 : xMax);
+      if (label != 0 && x0 <= x1)
+        {
+        OT *ptr = outPtr + outOffset + x0*outInc[0];
+        for (int x = x0; x <= x1; x++)
+          {
+          *ptr = label;
+          ptr += outInc[0];
+          }
+        }
+      }
+    }
+
+  return VTK_THREAD_RETURN_VALUE;
+}
+
+//----------------------------------------------------------------------------
+void vtkICF::LabelRuns(
+  vtkICF::RunThreadStruct *ts, vtkMultiThreader *threader,
+  std::vector<vtkIdType>& rowStart, std::vector<vtkICF::Run>& runs,
+  std::vector<vtkIdType>& parent, bool generateExtents,
+  std::vector<vtkICF::Region>& regions)
+{
+  int ny = ts->MaxIdx[1] + 1;
+  vtkIdType numRows = static_cast<vtkIdType>(ny)*(ts->MaxIdx[2] + 1);
+  int numThreads = ts->NumberOfThreads;
+
+  // the runs for row "r" are at rowStart[r] to rowStart[r+1]-1
+  rowStart.resize(numRows + 1);
+  rowStart[0] = 0;
+  ts->RowStart = &rowStart[0];
+
+  // the threader might run fewer threads than requested, and every
+  // thread must run or else some rows will be missed
+  threader->SetNumberOfThreads(numThreads);
+  numThreads = threader->GetNumberOfThreads();
+  ts->NumberOfThreads = numThreads;
+  threader->SetSingleMethod(vtkICF::RunThreadExecute, ts);
+
+  // count the runs in each row
+  ts->Pass = vtkICF::CountRunsPass;
+  threader->SingleMethodExecute();
+
+  for (vtkIdType r = 0; r < numRows; r++)
+    {
+    rowStart[r + 1] += rowStart[r];
+    }
+
+  vtkIdType numRuns = rowStart[numRows];
+  if (numRuns == 0)
+    {
+    return;
+    }
+
+  // find the runs and join them within each slab
+  runs.resize(numRuns);
+  parent.resize(numRuns);
+  ts->Runs = &runs[0];
+  ts->Parent = &parent[0];
+  ts->Pass = vtkICF::ConnectRunsPass;
+  threader->SingleMethodExecute();
+
+  // join each slab with the rows that precede it
+  for (int t = 1; t < numThreads; t++)
+    {
+    vtkIdType firstRow = (numRows*t)/numThreads;
+    vtkIdType lastRow = (numRows*(t + 1))/numThreads;
+    for (vtkIdType r = firstRow; r < lastRow && r < firstRow + ny; r++)
+      {
+      if (r == firstRow && r % ny != 0)
+        {
+        vtkICF::ConnectRows(&parent[0], &runs[0], &rowStart[0], r, r - 1);
+        }
+      if (r - ny >= 0)
+        {
+        vtkICF::ConnectRows(&parent[0], &runs[0], &rowStart[0], r, r - ny);
+        }
+      }
+    }
+
+  // number the regions in raster order, and replace the parent of each
+  // run with its region index (the parent of each run precedes the run,
+  // so it will already have been replaced)
+  for (vtkIdType r = 0; r < numRows; r++)
+    {
+    int yIdx = static_cast<int>(r % ny);
+    int zIdx = static_cast<int>(r / ny);
+    for (vtkIdType i = rowStart[r]; i < rowStart[r + 1]; i++)
+      {
+      const vtkICF::Run& run = runs[i];
+      vtkIdType p = parent[i];
+      if (p == i)
+        {
+        // initialize the region extent from the first voxel
+        int seedExtent[6];
+        seedExtent[0] = seedExtent[1] = run.x0;
+        seedExtent[2] = seedExtent[3] = yIdx;
+        seedExtent[4] = seedExtent[5] = zIdx;
+        p = static_cast<vtkIdType>(regions.size());
+        regions.push_back(vtkICF::Region(0, -1, seedExtent));
+        }
+      else
+        {
+        p = parent[p];
+        }
+      parent[i] = p;
+
+      vtkICF::Region& region = regions[p];
+      region.size += run.x1 - run.x0 + 1;
+      if (generateExtents)
+        {
+        int *e = region.extent;
+        e[0] = (run.x0 < e[0] ? run.x0 : e[0]);
+        e[1] = (run.x1 > e[1] ? run.x1 : e[1]);
+        e[2] = (yIdx < e[2] ? yIdx : e[2]);
+        e[3] = (yIdx > e[3] ? yIdx : e[3]);
+        e[5] = zIdx;
+        }
+      }
+    }
+}
+
+//----------------------------------------------------------------------------
+// Find all regions that are not already marked in the bitmask.  Instead of
+// a flood fill, this labels the runs in each row with union-find, with the
+// rows divided between threads.  The regions are numbered in the order
+// that a raster scan would find them, so the results match a flood fill.
+template <class OT>
+void vtkICF::SeedlessExecute(
+  vtkImageConnectivityFilter *self,
+  vtkImageData *outData, vtkImageStencilData *stencil,
+  OT *outPtr, unsigned char *maskPtr, int extent[6],
+  vtkICF::RegionVector& regionInfo)
+{
+  // Get execution parameters
+  int extractionMode = self->GetExtractionMode();
+  vtkIdType sizeRange[2];
+  self->GetSizeRange(sizeRange);
+  bool generateExtents = (self->GetGenerateRegionExtents() != 0);
+
+  vtkIdType outInc[3];
+  outData->GetIncrements(outInc);
+
+  int outExt[6];
+  outData->GetExtent(outExt);
+
+  // Indexing will go from 0 to maxIdX, and the lower limit if "extent" will
+  // be subracted from outExt.  If outExt was the same as extent, then NULL
+  // is returned, else outExt is returned.
+  int maxIdx[3];
+  int *outLimits = vtkICF::ZeroBaseExtent(extent, outExt, maxIdx);
+
+  vtkIdType numRows = static_cast<vtkIdType>(maxIdx[1] + 1)*(maxIdx[2] + 1);
+
+  vtkICF::RunThreadStruct ts;
+  ts.NumberOfThreads = vtkICF::GetNumberOfThreads(self, numRows);
+  ts.MaskPtr = maskPtr;
+  ts.Stencil = NULL;
+  ts.Extent = NULL;
+  ts.MaxIdx[0] = maxIdx[0];
+  ts.MaxIdx[1] = maxIdx[1];
+  ts.MaxIdx[2] = maxIdx[2];
+  ts.Runs = NULL;
+  ts.Parent = NULL;
+  ts.OutPtr = outPtr;
+  ts.OutInc = outInc;
+  ts.OutLimits = outLimits;
+  ts.RegionLabels = NULL;
+
+  std::vector<vtkIdType> rowStart;
+  std::vector<vtkICF::Run> runs;
+  std::vector<vtkIdType> parent;
+  std::vector<vtkICF::Region> regions;
+
+  vtkMultiThreader *threader = vtkMultiThreader::New();
+  vtkICF::LabelRuns(
+    &ts, threader, rowStart, runs, parent, generateExtents, regions);
+
+  vtkIdType numRegions = static_cast<vtkIdType>(regions.size());
+  if (numRegions == 0)
+    {
+    threader->Delete();
+    return;
+    }
+
+  // add the regions in the same order as a flood fill would, so that they
+  // are pruned in the same way if the labels run out, and use the id to
+  // keep track of where each region ends up
+  for (vtkIdType k = 0; k < numRegions; k++)
+    {
+    if (regions[k].size == 1 &&
+        static_cast<OT>(regionInfo.size()) == vtkTypeTraits<OT>::Max())
+      {
+      // smallest region is definitely the one we would add
+      continue;
+      }
+    vtkICF::AddRegion(
+      outData, outPtr, stencil, extent, sizeRange, regionInfo,
+      regions[k].size, -2 - k, regions[k].extent, extractionMode);
+    }
+
+  // the label for each region is its final position in regionInfo
+  std::vector<OT> regionLabels(numRegions, 0);
+  for (size_t j = 1; j < regionInfo.size(); j++)
+    {
+    vtkIdType k = -2 - regionInfo[j].id;
+    if (k >= 0)
+      {
+      regionLabels[k] = static_cast<OT>(j);
+      regionInfo[j].id = -1;
+      }
+    }
+
+  // write the labels to the output
+  ts.RegionLabels = &regionLabels[0];
+  threader->SetSingleMethod(vtkICF::WriteRunsThreadExecute<OT>, &ts);
+  threader->SingleMethodExecute();
+
+  threader->Delete();
+}
+
+//----------------------------------------------------------------------------
+// This templated function executes the filter for any type of data.
+template <class OT>
+void vtkICF::ExecuteOutput(
+  vtkImageConnectivityFilter *self,
+  vtkImageData *outData, vtkDataSet *seedData, vtkImageStencilData *stencil,
+  OT *outPtr, unsigned char *maskPtr, int extent[6])
+{
+  // push the "background" onto the region vector
+  vtkICF::RegionVector regionInfo;
+  regionInfo.push_back(vtkICF::Region(0, 0, extent));
+
+  // execution depends on how regions are seeded
+  vtkDataArray *seedScalars = 0;
+  if (seedData)
+    {
+    seedScalars = seedData->GetPointData()->GetScalars();
+    vtkICF::SeededExecute(
+      self, outData, seedData, stencil, outPtr, maskPtr,
+      extent, regionInfo);
+    }
+
+  // if no seeds, or if AllRegions selected, search for all regions
+  int extractionMode = self->GetExtractionMode();
+  if (!seedData ||
+      extractionMode == vtkImageConnectivityFilter::AllRegions)
+    {
+    vtkICF::SeedlessExecute(
+      self, outData, stencil, outPtr, maskPtr, extent,
+      regionInfo);
+    }
+
+  // do final relabelling and other bookkeeping
+  vtkICF::Finish(
+    self, outData, outPtr, stencil, extent, seedScalars, regionInfo);
+}
+
+//----------------------------------------------------------------------------
+// This function finds the regions from the runs of the stencil, without
+// the use of the image, and generates a stencil for each region.
+void vtkICF::StencilExecute(
+  vtkImageConnectivityFilter *self, vtkDataSet *seedData,
+  vtkImageStencilData *stencil, int extent[6],
+  const double origin[3], const double spacing[3])
+{
+  // Get execution parameters
+  int extractionMode = self->GetExtractionMode();
+  vtkIdType sizeRange[2];
+  self->GetSizeRange(sizeRange);
+
+  int maxIdx[3];
+  maxIdx[0] = extent[1] - extent[0];
+  maxIdx[1] = extent[3] - extent[2];
+  maxIdx[2] = extent[5] - extent[4];
+
+  int ny = maxIdx[1] + 1;
+  vtkIdType numRows = static_cast<vtkIdType>(ny)*(maxIdx[2] + 1);
+
+  vtkICF::RunThreadStruct ts;
+  ts.NumberOfThreads = vtkICF::GetNumberOfThreads(self, numRows);
+  ts.MaskPtr = NULL;
+  ts.Stencil = stencil;
+  ts.Extent = extent;
+  ts.MaxIdx[0] = maxIdx[0];
+  ts.MaxIdx[1] = maxIdx[1];
+  ts.MaxIdx[2] = maxIdx[2];
+  ts.Runs = NULL;
+  ts.Parent = NULL;
+  ts.OutPtr = NULL;
+  ts.OutInc = NULL;
+  ts.OutLimits = NULL;
+  ts.RegionLabels = NULL;
+
+  std::vector<vtkIdType> rowStart;
+  std::vector<vtkICF::Run> runs;
+  std::vector<vtkIdType> parent;
+  std::vector<vtkICF::Region> regions;
+
+  // the extents are always needed, for allocating the stencils
+  vtkMultiThreader *threader = vtkMultiThreader::New();
+  vtkICF::LabelRuns(
+    &ts, threader, rowStart, runs, parent, true, regions);
+  threader->Delete();
+
+  // push the "background" onto the region vector, and keep track of
+  // which of the regions is at each position in the region vector
+  vtkICF::RegionVector regionInfo;
+  regionInfo.push_back(vtkICF::Region(0, 0, extent));
+  std::vector<vtkIdType> regionIndex(1, -1);
+  std::vector<bool> used(regions.size(), false);
+
+  // the regions that contain seeds come first, in the order of the seeds
+  vtkDataArray *seedScalars = 0;
+  if (seedData)
+    {
+    seedScalars = seedData->GetPointData()->GetScalars();
+    vtkIdType nPoints = seedData->GetNumberOfPoints();
+    for (vtkIdType i = 0; i < nPoints; i++)
+      {
+      if (seedScalars && seedScalars->GetComponent(i, 0) == 0)
+        {
+        continue;
+        }
+
+      double point[3];
+      seedData->GetPoint(i, point);
+      int idx[3];
+      bool outOfBounds = false;
+
+      // convert point from data coords to image index
+      for (int j = 0; j < 3; j++)
+        {
+        idx[j] = vtkMath::Floor((point[j] - origin[j])/spacing[j] + 0.5);
+        idx[j] -= extent[2*j];
+        outOfBounds |= (idx[j] < 0 || idx[j] > maxIdx[j]);
+        }
+
+      if (outOfBounds)
+        {
+        continue;
+        }
+
+      // find the run that contains the seed, if any
+      vtkIdType r = static_cast<vtkIdType>(idx[2])*ny + idx[1];
+      for (vtkIdType j = rowStart[r]; j < rowStart[r + 1]; j++)
+        {
+        if (runs[j].x0 <= idx[0] && idx[0] <= runs[j].x1)
+          {
+          vtkIdType k = parent[j];
+          if (!used[k])
+            {
+            used[k] = true;
+            regionInfo.push_back(
+              vtkICF::Region(regions[k].size, i, regions[k].extent));
+            regionIndex.push_back(k);
+            }
+          break;
+          }
+        }
+      }
+    }
+
+  // if no seeds, or if AllRegions selected, add all the other regions
+  if (!seedData ||
+      extractionMode == vtkImageConnectivityFilter::AllRegions)
+    {
+    for (size_t k = 0; k < regions.size(); k++)
+      {
+      if (!used[k])
+        {
+        regionInfo.push_back(regions[k]);
+        regionIndex.push_back(static_cast<vtkIdType>(k));
+        }
+      }
+    }
+
+  // get only the regions in the requested range of sizes
+  size_t m = 1;
+  for (size_t j = 1; j < regionInfo.size(); j++)
+    {
+    vtkIdType s = regionInfo[j].size;
+    if (s >= sizeRange[0] && s <= sizeRange[1])
+      {
+      regionInfo[m] = regionInfo[j];
+      regionIndex[m] = regionIndex[j];
+      m++;
+      }
+    }
+  regionInfo.resize(m);
+  regionIndex.resize(m);
+
+  // keep only the largest, if requested
+  if (extractionMode == vtkImageConnectivityFilter::LargestRegion &&
+      regionInfo.size() > 1)
+    {
+    vtkICF::RegionVector::iterator largest = regionInfo.largest();
+    size_t j = std::distance(regionInfo.begin(), largest);
+    regionInfo[1] = regionInfo[j];
+    regionIndex[1] = regionIndex[j];
+    regionInfo.resize(2);
+    regionIndex.resize(2);
+    }
+
+  // create the region info arrays, the label range is the range of the
+  // label scalar type even though no label image is produced
+  int labelType = self->GetLabelScalarType();
+  vtkICF::GenerateRegionArrays(
+    self, regionInfo, seedScalars, extent,
+    static_cast<int>(vtkDataArray::GetDataTypeMin(labelType)),
+    static_cast<int>(vtkDataArray::GetDataTypeMax(labelType)));
+
+  // the stencils must go in the same order as the sorted arrays
+  vtkIdTypeArray *labelArray = self->GetExtractedRegionLabels();
+  vtkIdType n = labelArray->GetNumberOfTuples();
+  std::vector<vtkImageStencilData *> stencils(n);
+  std::vector<vtkImageStencilData *> regionStencils(regions.size());
+  for (vtkIdType i = 0; i < n; i++)
+    {
+    vtkIdType j = i;
+    if (self->GetLabelMode() == vtkImageConnectivityFilter::SizeRank)
+      {
+      j = labelArray->GetValue(i) - 1;
+      }
+
+    int regionExt[6];
+    const int *e = regionInfo[i+1].extent;
+    for (int k = 0; k < 3; k++)
+      {
+      regionExt[2*k] = e[2*k] + extent[2*k];
+      regionExt[2*k+1] = e[2*k+1] + extent[2*k];
+      }
+
+    vtkImageStencilData *regionStencil = vtkImageStencilData::New();
+    regionStencil->SetOrigin(stencil->GetOrigin());
+    regionStencil->SetSpacing(stencil->GetSpacing());
+    regionStencil->SetExtent(regionExt);
+    regionStencil->AllocateExtents();
+    stencils[j] = regionStencil;
+    regionStencils[regionIndex[i+1]] = regionStencil;
+    }
+
+  vtkICF::SortRegionArrays(self);
+
+  // add the runs to the stencils in raster order
+  for (vtkIdType r = 0; r < numRows; r++)
+    {
+    int yIdx = static_cast<int>(r % ny) + extent[2];
+    int zIdx = static_cast<int>(r / ny) + extent[4];
+    for (vtkIdType i = rowStart[r]; i < rowStart[r + 1]; i++)
+      {
+      vtkImageStencilData *regionStencil = regionStencils[parent[i]];
+      if (regionStencil)
+        {
+        regionStencil->InsertNextExtent(
+          runs[i].x0 + extent[0], runs[i].x1 + extent[0], yIdx, zIdx);
+        }
+      }
+    }
+
+  vtkCollection *collection = self->GetExtractedRegionStencils();
+  for (vtkIdType i = 0; i < n; i++)
+    {
+    collection->AddItem(stencils[i]);
+    stencils[i]->Delete();
+    }
+}
+
+//----------------------------------------------------------------------------
+void vtkICF::AnalyzeSlab(
+  vtkImageConnectivityFilter *self,
+  vtkImageConnectivityFilterStreamState *state, unsigned char *maskPtr,
+  int slabExt[6], vtkDataSet *seedData,
+  const double origin[3], const double spacing[3])
+{
+  int maxIdx[3];
+  maxIdx[0] = slabExt[1] - slabExt[0];
+  maxIdx[1] = slabExt[3] - slabExt[2];
+  maxIdx[2] = slabExt[5] - slabExt[4];
+
+  int ny = maxIdx[1] + 1;
+  vtkIdType numRows = static_cast<vtkIdType>(ny)*(maxIdx[2] + 1);
+
+  vtkICF::RunThreadStruct ts;
+  ts.NumberOfThreads = vtkICF::GetNumberOfThreads(self, numRows);
+  ts.MaskPtr = maskPtr;
+  ts.Stencil = NULL;
+  ts.Extent = NULL;
+  ts.MaxIdx[0] = maxIdx[0];
+  ts.MaxIdx[1] = maxIdx[1];
+  ts.MaxIdx[2] = maxIdx[2];
+  ts.Runs = NULL;
+  ts.Parent = NULL;
+  ts.OutPtr = NULL;
+  ts.OutInc = NULL;
+  ts.OutLimits = NULL;
+  ts.RegionLabels = NULL;
+
+  std::vector<vtkIdType> rowStart;
+  std::vector<vtkICF::Run> runs;
+  std::vector<vtkIdType> parent;
+  std::vector<vtkICF::Region> regions;
+
+  vtkMultiThreader *threader = vtkMultiThreader::New();
+  vtkICF::LabelRuns(
+    &ts, threader, rowStart, runs, parent, true, regions);
+  threader->Delete();
+
+  // the provisional regions for this slab follow those of the previous
+  // slabs, and the region extents must be made relative to Extent
+  vtkIdType base = static_cast<vtkIdType>(state->Sizes.size());
+  vtkIdType numRegions = static_cast<vtkIdType>(regions.size());
+  state->SlabBase.push_back(base);
+  int zOffset = slabExt[4] - state->Extent[4];
+  for (vtkIdType k = 0; k < numRegions; k++)
+    {
+    const int *e = regions[k].extent;
+    state->Parent.push_back(base + k);
+    state->Sizes.push_back(regions[k].size);
+    state->Extents.insert(state->Extents.end(), e, e + 4);
+    state->Extents.push_back(e[4] + zOffset);
+    state->Extents.push_back(e[5] + zOffset);
+    }
+
+  // convert the parent of each run into its provisional region
+  for (size_t i = 0; i < parent.size(); i++)
+    {
+    parent[i] += base;
+    }
+
+  // join with the last plane of the previous slab
+  if (!state->PlaneRuns.empty() && !runs.empty())
+    {
+    for (int yIdx = 0; yIdx < ny; yIdx++)
+      {
+      vtkIdType i = rowStart[yIdx];
+      vtkIdType j = state->PlaneRowStart[yIdx];
+      vtkICF::ConnectRuns(
+        &state->Parent[0],
+        &runs[0] + i, &parent[0] + i, rowStart[yIdx + 1] - i,
+        &state->PlaneRuns[0] + j, &state->PlaneIds[0] + j,
+        state->PlaneRowStart[yIdx + 1] - j);
+      }
+    }
+
+  // keep the last plane of this slab for the next slab
+  vtkIdType firstRow = numRows - ny;
+  vtkIdType firstRun = rowStart[firstRow];
+  vtkIdType lastRun = rowStart[numRows];
+  state->PlaneRowStart.resize(ny + 1);
+  for (int yIdx = 0; yIdx <= ny; yIdx++)
+    {
+    state->PlaneRowStart[yIdx] = rowStart[firstRow + yIdx] - firstRun;
+    }
+  state->PlaneRuns.assign(runs.begin() + firstRun, runs.begin() + lastRun);
+  state->PlaneIds.assign(parent.begin() + firstRun, parent.begin() + lastRun);
+
+  // find the provisional regions that contain the seeds
+  if (seedData)
+    {
+    vtkDataArray *scalars = seedData->GetPointData()->GetScalars();
+    vtkIdType nPoints = seedData->GetNumberOfPoints();
+    for (vtkIdType i = 0; i < nPoints; i++)
+      {
+      if (scalars && scalars->GetComponent(i, 0) == 0)
+        {
+        continue;
+        }
+
+      double point[3];
+      seedData->GetPoint(i, point);
+      int idx[3];
+      bool outOfBounds = false;
+
+      // convert point from data coords to slab index
+      for (int j = 0; j < 3; j++)
+        {
+        idx[j] = vtkMath::Floor((point[j] - origin[j])/spacing[j] + 0.5);
+        idx[j] -= slabExt[2*j];
+        outOfBounds |= (idx[j] < 0 || idx[j] > maxIdx[j]);
+        }
+
+      if (outOfBounds)
+        {
+        continue;
+        }
+
+      vtkIdType r = static_cast<vtkIdType>(idx[2])*ny + idx[1];
+      for (vtkIdType j = rowStart[r]; j < rowStart[r + 1]; j++)
+        {
+        if (runs[j].x0 <= idx[0] && idx[0] <= runs[j].x1)
+          {
+          state->SeedRegions[i] = parent[j];
+          break;
+          }
+        }
+      }
+    }
+}
+
+//----------------------------------------------------------------------------
+void vtkICF::FinishAnalysis(
+  vtkImageConnectivityFilter *self,
+  vtkImageConnectivityFilterStreamState *state, vtkDataSet *seedData,
+  int minLabel, int maxLabel)
+{
+  // Get execution parameters
+  int extractionMode = self->GetExtractionMode();
+  vtkIdType sizeRange[2];
+  self->GetSizeRange(sizeRange);
+
+  std::vector<vtkIdType>& parent = state->Parent;
+  std::vector<vtkIdType>& sizes = state->Sizes;
+  std::vector<int>& extents = state->Extents;
+  vtkIdType n = static_cast<vtkIdType>(parent.size());
+
+  // join each provisional region with the root of its tree, which is the
+  // first of the joined regions in raster order (the parent always
+  // precedes the child, so the parent already points to the root)
+  for (vtkIdType p = 0; p < n; p++)
+    {
+    vtkIdType q = parent[parent[p]];
+    parent[p] = q;
+    if (q != p)
+      {
+      const int *e = &extents[6*p];
+      int *rootExt = &extents[6*q];
+      sizes[q] += sizes[p];
+      for (int k = 0; k < 6; k += 2)
+        {
+        rootExt[k] = (e[k] < rootExt[k] ? e[k] : rootExt[k]);
+        rootExt[k+1] = (e[k+1] > rootExt[k+1] ? e[k+1] : rootExt[k+1]);
+        }
+      }
+    }
+
+  // push the "background" onto the region vector, and keep track of
+  // which root is at each position in the region vector
+  vtkICF::RegionVector regionInfo;
+  regionInfo.push_back(vtkICF::Region(0, 0, state->Extent));
+  std::vector<vtkIdType> regionIndex(1, -1);
+  std::vector<bool> used(n, false);
+
+  // the regions that contain seeds come first, in the order of the seeds
+  vtkDataArray *seedScalars = 0;
+  if (seedData)
+    {
+    seedScalars = seedData->GetPointData()->GetScalars();
+    vtkIdType nPoints = static_cast<vtkIdType>(state->SeedRegions.size());
+    for (vtkIdType i = 0; i < nPoints; i++)
+      {
+      vtkIdType p = state->SeedRegions[i];
+      if (p >= 0 && !used[parent[p]])
+        {
+        vtkIdType q = parent[p];
+        used[q] = true;
+        regionInfo.push_back(vtkICF::Region(sizes[q], i, &extents[6*q]));
+        regionIndex.push_back(q);
+        }
+      }
+    }
+
+  // if no seeds, or if AllRegions selected, add all the other regions
+  if (!seedData ||
+      extractionMode == vtkImageConnectivityFilter::AllRegions)
+    {
+    for (vtkIdType p = 0; p < n; p++)
+      {
+      if (parent[p] == p && !used[p])
+        {
+        regionInfo.push_back(vtkICF::Region(sizes[p], -1, &extents[6*p]));
+        regionIndex.push_back(p);
+        }
+      }
+    }
+
+  // get only the regions in the requested range of sizes
+  size_t m = 1;
+  for (size_t j = 1; j < regionInfo.size(); j++)
+    {
+    vtkIdType s = regionInfo[j].size;
+    if (s >= sizeRange[0] && s <= sizeRange[1])
+      {
+      regionInfo[m] = regionInfo[j];
+      regionIndex[m] = regionIndex[j];
+      m++;
+      }
+    }
+  regionInfo.resize(m);
+  regionIndex.resize(m);
+
+  if (extractionMode == vtkImageConnectivityFilter::LargestRegion)
+    {
+    // keep only the largest region
+    if (regionInfo.size() > 1)
+      {
+      vtkICF::RegionVector::iterator largest = regionInfo.largest();
+      size_t j = std::distance(regionInfo.begin(), largest);
+      regionInfo[1] = regionInfo[j];
+      regionIndex[1] = regionIndex[j];
+      regionInfo.resize(2);
+      regionIndex.resize(2);
+      }
+    }
+  else if (regionInfo.size() > static_cast<size_t>(maxLabel) + 1)
+    {
+    // if there are not enough labels, discard the smallest regions
+    vtkICF::CompareSize cmpfunc(regionInfo);
+    std::vector<vtkIdType> tmpi(regionInfo.size() - 1);
+    for (size_t j = 0; j < tmpi.size(); j++)
+      {
+      tmpi[j] = static_cast<vtkIdType>(j + 1);
+      }
+    std::stable_sort(tmpi.begin(), tmpi.end(), cmpfunc);
+    std::vector<bool> keep(regionInfo.size(), false);
+    for (int j = 0; j < maxLabel; j++)
+      {
+      keep[tmpi[j]] = true;
+      }
+    m = 1;
+    for (size_t j = 1; j < regionInfo.size(); j++)
+      {
+      if (keep[j])
+        {
+        regionInfo[m] = regionInfo[j];
+        regionIndex[m] = regionIndex[j];
+        m++;
+        }
+      }
+    regionInfo.resize(m);
+    regionIndex.resize(m);
+    }
+
+  // create the region info arrays
+  vtkICF::GenerateRegionArrays(
+    self, regionInfo, seedScalars, state->Extent, minLabel, maxLabel);
+
+  // the label array gives the label for each region in the output
+  vtkIdTypeArray *labelArray = self->GetExtractedRegionLabels();
+  state->LabelMap.assign(n, 0);
+  for (size_t j = 1; j < regionInfo.size(); j++)
+    {
+    state->LabelMap[regionIndex[j]] = labelArray->GetValue(j - 1);
+    }
+  for (vtkIdType p = 0; p < n; p++)
+    {
+    state->LabelMap[p] = state->LabelMap[parent[p]];
+    }
+
+  // sort the region info arrays (must be done after the labels are used)
+  if (regionInfo.size() > 1)
+    {
+    vtkICF::SortRegionArrays(self);
+    }
+
+  state->FinishAnalysis();
+}
+
+//----------------------------------------------------------------------------
+template<class OT>
+void vtkICF::WriteSlab(
+  vtkImageConnectivityFilter *self,
+  vtkImageConnectivityFilterStreamState *state, vtkImageData *outData,
+  OT *outPtr, unsigned char *maskPtr, int slabExt[6])
+{
+  vtkIdType outInc[3];
+  outData->GetIncrements(outInc);
+
+  int outExt[6];
+  outData->GetExtent(outExt);
+
+  // the limits are relative to the slab, and can go beyond the slab
+  int maxIdx[3];
+  int *outLimits = vtkICF::ZeroBaseExtent(slabExt, outExt, maxIdx);
+
+  vtkIdType numRows = static_cast<vtkIdType>(maxIdx[1] + 1)*(maxIdx[2] + 1);
+
+  vtkICF::RunThreadStruct ts;
+  ts.NumberOfThreads = vtkICF::GetNumberOfThreads(self, numRows);
+  ts.MaskPtr = maskPtr;
+  ts.Stencil = NULL;
+  ts.Extent = NULL;
+  ts.MaxIdx[0] = maxIdx[0];
+  ts.MaxIdx[1] = maxIdx[1];
+  ts.MaxIdx[2] = maxIdx[2];
+  ts.Runs = NULL;
+  ts.Parent = NULL;
+  ts.OutPtr = outPtr;
+  ts.OutInc = outInc;
+  ts.OutLimits = outLimits;
+  ts.RegionLabels = NULL;
+
+  std::vector<vtkIdType> rowStart;
+  std::vector<vtkICF::Run> runs;
+  std::vector<vtkIdType> parent;
+  std::vector<vtkICF::Region> regions;
+
+  // the regions are numbered the same way as they were for AnalyzeSlab()
+  vtkMultiThreader *threader = vtkMultiThreader::New();
+  vtkICF::LabelRuns(
+    &ts, threader, rowStart, runs, parent, false, regions);
+
+  size_t numRegions = regions.size();
+  if (numRegions > 0)
+    {
+    vtkIdType base = state->SlabBase[state->Division];
+    std::vector<OT> regionLabels(numRegions);
+    for (size_t k = 0; k < numRegions; k++)
+      {
+      regionLabels[k] = static_cast<OT>(state->LabelMap[base + k]);
+      }
+
+    ts.RegionLabels = &regionLabels[0];
+    threader->SetSingleMethod(vtkICF::WriteRunsThreadExecute<OT>, &ts);
+    threader->SingleMethodExecute();
+    }
+
+  threader->Delete();
+}
+
+} // end anonymous namespace
+
+//----------------------------------------------------------------------------
+int vtkImageConnectivityFilter::RequestInformation(
+  vtkInformation *vtkNotUsed(request),
+  vtkInformationVector **vtkNotUsed(inputVector),
+  vtkInformationVector *outputVector)
+{
+  vtkInformation* outInfo = outputVector->GetInformationObject(0);
+  vtkDataObject::SetPointDataActiveScalarInfo(
+    outInfo, this->LabelScalarType, 1);
+
+  // the pipeline only calls this if something was modified, so the
+  // regions that were found by streaming must be found again
+  this->StreamState->AnalysisValid = false;
+
+  return 1;
+}
+
+//----------------------------------------------------------------------------
+int vtkImageConnectivityFilter::RequestUpdateExtent(
+  vtkInformation *request,
+  vtkInformationVector **inputVector,
+  vtkInformationVector *outputVector)
+{
+  if (this->NumberOfStreamDivisions > 1 && !this->GenerateRegionStencils)
+    {
+    return this->RequestStreamingUpdateExtent(
+      request, inputVector, outputVector);
+    }
+
+  vtkInformation *inInfo = inputVector[0]->GetInformationObject(0);
+  vtkInformation *stencilInfo = inputVector[1]->GetInformationObject(0);
+
+  int extent[6];
+  inInfo->Get(vtkStreamingDemandDrivenPipeline::WHOLE_EXTENT(), extent);
+  if (stencilInfo)
+    {
+    stencilInfo->Set(vtkStreamingDemandDrivenPipeline::UPDATE_EXTENT(),
+                     extent, 6);
+    }
+
+  // the image scalars are not needed if only the stencil is used
+  if (this->GenerateRegionStencils)
+    {
+    extent[0] = extent[2] = extent[4] = 0;
+    extent[1] = extent[3] = extent[5] = -1;
+    }
+  inInfo->Set(vtkStreamingDemandDrivenPipeline::UPDATE_EXTENT(), extent, 6);
+
+  return 1;
+}
+
+//----------------------------------------------------------------------------
+int vtkImageConnectivityFilter::RequestData(
+  vtkInformation *request,
+  vtkInformationVector **inputVector,
+  vtkInformationVector *outputVector)
+{
+  if (this->NumberOfStreamDivisions > 1 && !this->GenerateRegionStencils)
+    {
+    return this->RequestStreamingData(request, inputVector, outputVector);
+    }
+
+  vtkInformation *outInfo = outputVector->GetInformationObject(0);
+  vtkInformation *inInfo = inputVector[0]->GetInformationObject(0);
+  vtkInformation *stencilInfo = inputVector[1]->GetInformationObject(0);
+  vtkInformation *seedInfo = inputVector[2]->GetInformationObject(0);
+
+  vtkImageData* outData = static_cast<vtkImageData *>(
+    outInfo->Get(vtkDataObject::DATA_OBJECT()));
+  vtkImageData* inData = static_cast<vtkImageData *>(
+    inInfo->Get(vtkDataObject::DATA_OBJECT()));
+
+  vtkDataSet* seedData = 0;
+  if (seedInfo)
+    {
+    seedData = static_cast<vtkDataSet *>(
+      seedInfo->Get(vtkDataObject::DATA_OBJECT()));
+    }
+
+  vtkImageStencilData* stencil = 0;
+  if (stencilInfo)
     {
     stencil = static_cast<vtkImageStencilData *>(
       stencilInfo->Get(vtkDataObject::DATA_OBJECT()));
     }
 
+  this->ExtractedRegionStencils->RemoveAllItems();
+
+  if (this->GenerateRegionStencils)
+    {
+    if (!stencil)
+      {
+      vtkErrorMacro("Execute: GenerateRegionStencils requires a stencil.");
+      return 0;
+      }
+
+    // the input image is empty, so use the pipeline information
+    int extent[6];
+    double origin[3];
+    double spacing[3];
+    inInfo->Get(vtkStreamingDemandDrivenPipeline::WHOLE_EXTENT(), extent);
+    inInfo->Get(vtkDataObject::ORIGIN(), origin);
+    inInfo->Get(vtkDataObject::SPACING(), spacing);
+
+    int stencilExtent[6];
+    stencil->GetExtent(stencilExtent);
+    if (!vtkICF::IntersectExtents(extent, stencilExtent, extent))
+      {
+      // if stencil doesn't overlap the input, there are no regions
+      this->ExtractedRegionSizes->Reset();
+      this->ExtractedRegionSeedIds->Reset();
+      this->ExtractedRegionLabels->Reset();
+      this->ExtractedRegionExtents->Reset();
+      return 1;
+      }
+
+    vtkICF::StencilExecute(
+      this, seedData, stencil, extent, origin, spacing);
+
+    return 1;
+    }
+
   int outExt[6];
   outInfo->Get(vtkStreamingDemandDrivenPipeline::UPDATE_EXTENT(), outExt);
 #if VTK_MAJOR_VERSION >= 6
@@ -1531,6 +2891,273 @@ int vtkImageConnectivityFilter::RequestData(
   return rval;
 }
 
+//----------------------------------------------------------------------------
+// When streaming, the input and the stencil are requested one slab at a
+// time.  The first pass through the slabs finds the regions, and the second
+// pass writes the labels for the slabs that overlap the output extent.
+int vtkImageConnectivityFilter::RequestStreamingUpdateExtent(
+  vtkInformation *vtkNotUsed(request),
+  vtkInformationVector **inputVector,
+  vtkInformationVector *outputVector)
+{
+  vtkInformation *outInfo = outputVector->GetInformationObject(0);
+  vtkInformation *inInfo = inputVector[0]->GetInformationObject(0);
+  vtkInformation *stencilInfo = inputVector[1]->GetInformationObject(0);
+  vtkImageConnectivityFilterStreamState *state = this->StreamState;
+
+  // before the first slab, decide which passes are needed
+  if (!state->Started)
+    {
+    int *extent = state->Extent;
+    inInfo->Get(vtkStreamingDemandDrivenPipeline::WHOLE_EXTENT(), extent);
+    state->Overlap = true;
+    if (stencilInfo)
+      {
+      int stencilExtent[6];
+      stencilInfo->Get(
+        vtkStreamingDemandDrivenPipeline::WHOLE_EXTENT(), stencilExtent);
+      state->Overlap =
+        vtkICF::IntersectExtents(extent, stencilExtent, extent);
+      }
+
+    state->Pass = vtkImageConnectivityFilterStreamState::Idle;
+    if (state->Overlap)
+      {
+      int nz = extent[5] - extent[4] + 1;
+      state->NumberOfDivisions = (this->NumberOfStreamDivisions < nz ?
+                                  this->NumberOfStreamDivisions : nz);
+
+      int outExt[6];
+      outInfo->Get(vtkStreamingDemandDrivenPipeline::UPDATE_EXTENT(), outExt);
+      if (!state->AnalysisValid)
+        {
+        state->Pass = vtkImageConnectivityFilterStreamState::Analysis;
+        state->Division = 0;
+        }
+      else if (state->SetOutputDivisions(outExt))
+        {
+        state->Pass = vtkImageConnectivityFilterStreamState::Output;
+        state->Division = state->FirstDivision;
+        }
+      }
+    }
+
+  // request the current slab, or nothing if no slabs are needed
+  int slabExt[6] = { 0, -1, 0, -1, 0, -1 };
+  if (state->Pass != vtkImageConnectivityFilterStreamState::Idle)
+    {
+    state->GetSlabExtent(state->Division, slabExt);
+    }
+  inInfo->Set(vtkStreamingDemandDrivenPipeline::UPDATE_EXTENT(), slabExt, 6);
+  if (stencilInfo)
+    {
+    stencilInfo->Set(vtkStreamingDemandDrivenPipeline::UPDATE_EXTENT(),
+                     slabExt, 6);
+    }
+
+  return 1;
+}
+
+//----------------------------------------------------------------------------
+int vtkImageConnectivityFilter::RequestStreamingData(
+  vtkInformation *request,
+  vtkInformationVector **inputVector,
+  vtkInformationVector *outputVector)
+{
+  vtkInformation *outInfo = outputVector->GetInformationObject(0);
+  vtkInformation *inInfo = inputVector[0]->GetInformationObject(0);
+  vtkInformation *stencilInfo = inputVector[1]->GetInformationObject(0);
+  vtkInformation *seedInfo = inputVector[2]->GetInformationObject(0);
+  vtkImageConnectivityFilterStreamState *state = this->StreamState;
+
+  vtkImageData* outData = static_cast<vtkImageData *>(
+    outInfo->Get(vtkDataObject::DATA_OBJECT()));
+  vtkImageData* inData = static_cast<vtkImageData *>(
+    inInfo->Get(vtkDataObject::DATA_OBJECT()));
+
+  vtkDataSet* seedData = 0;
+  if (seedInfo)
+    {
+    seedData = static_cast<vtkDataSet *>(
+      seedInfo->Get(vtkDataObject::DATA_OBJECT()));
+    }
+
+  vtkImageStencilData* stencil = 0;
+  if (stencilInfo)
+    {
+    stencil = static_cast<vtkImageStencilData *>(
+      stencilInfo->Get(vtkDataObject::DATA_OBJECT()));
+    }
+
+  // the output is allocated and cleared before the first slab
+  if (!state->Started)
+    {
+    int outExt[6];
+    outInfo->Get(vtkStreamingDemandDrivenPipeline::UPDATE_EXTENT(), outExt);
+#if VTK_MAJOR_VERSION >= 6
+    this->AllocateOutputData(outData, outInfo, outExt);
+#else
+    this->AllocateOutputData(outData, outExt);
+#endif
+
+    void *outPtr = outData->GetScalarPointerForExtent(outExt);
+    size_t size = (outExt[1] - outExt[0] + 1);
+    size *= (outExt[3] - outExt[2] + 1);
+    size *= (outExt[5] - outExt[4] + 1);
+    memset(outPtr, 0, size*outData->GetScalarSize());
+
+    int outScalarType = outData->GetScalarType();
+    if (outScalarType != VTK_UNSIGNED_CHAR &&
+        outScalarType != VTK_SHORT &&
+        outScalarType != VTK_UNSIGNED_SHORT &&
+        outScalarType != VTK_INT)
+      {
+      vtkErrorMacro("Execute: Output ScalarType is "
+                    << outData->GetScalarType()
+                    << ", but it must be one of VTK_UNSIGNED_CHAR, "
+                    "VTK_SHORT, VTK_UNSIGNED_SHORT, or VTK_INT");
+      state->Pass = vtkImageConnectivityFilterStreamState::Idle;
+      return 0;
+      }
+
+    if (state->Pass == vtkImageConnectivityFilterStreamState::Idle)
+      {
+      if (!state->Overlap)
+        {
+        // if stencil doesn't overlap the input, there are no regions
+        this->ExtractedRegionSizes->Reset();
+        this->ExtractedRegionSeedIds->Reset();
+        this->ExtractedRegionLabels->Reset();
+        this->ExtractedRegionExtents->Reset();
+        }
+      return 1;
+      }
+
+    // tell the pipeline to start looping
+    state->Started = true;
+    request->Set(vtkStreamingDemandDrivenPipeline::CONTINUE_EXECUTING(), 1);
+
+    if (state->Pass == vtkImageConnectivityFilterStreamState::Analysis)
+      {
+      state->InitializeAnalysis(seedData ? seedData->GetNumberOfPoints() : 0);
+      }
+    }
+
+  int slabExt[6];
+  state->GetSlabExtent(state->Division, slabExt);
+
+  // create the image bitmask for the slab (each bit is a voxel)
+  size_t size = (slabExt[1] - slabExt[0] + 1);
+  size *= (slabExt[3] - slabExt[2] + 1);
+  size *= (slabExt[5] - slabExt[4] + 1);
+  unsigned char *mask = new unsigned char [(size + 7) / 8];
+
+  void *inPtr = inData->GetScalarPointerForExtent(slabExt);
+
+  int rval = 1;
+
+  switch (inData->GetScalarType())
+    {
+    vtkTemplateAliasMacro(
+      vtkICF::ExecuteInput(this, inData, static_cast<VTK_TT *>(inPtr),
+        mask, stencil, slabExt));
+
+    default:
+      vtkErrorMacro(<< "Execute: Unknown input ScalarType");
+      rval = 0;
+    }
+
+  bool done = (rval == 0);
+
+  if (done)
+    {
+    // stop without writing anything
+    }
+  else if (state->Pass == vtkImageConnectivityFilterStreamState::Analysis)
+    {
+    vtkICF::AnalyzeSlab(
+      this, state, mask, slabExt, seedData,
+      inData->GetOrigin(), inData->GetSpacing());
+    }
+  else
+    {
+    int outExt[6];
+    outData->GetExtent(outExt);
+    void *outPtr = outData->GetScalarPointerForExtent(outExt);
+
+    switch (outData->GetScalarType())
+      {
+      case VTK_UNSIGNED_CHAR:
+        vtkICF::WriteSlab(this, state, outData,
+          static_cast<unsigned char *>(outPtr), mask, slabExt);
+        break;
+
+      case VTK_SHORT:
+        vtkICF::WriteSlab(this, state, outData,
+          static_cast<short *>(outPtr), mask, slabExt);
+        break;
+
+      case VTK_UNSIGNED_SHORT:
+        vtkICF::WriteSlab(this, state, outData,
+          static_cast<unsigned short *>(outPtr), mask, slabExt);
+        break;
+
+      case VTK_INT:
+        vtkICF::WriteSlab(this, state, outData,
+          static_cast<int *>(outPtr), mask, slabExt);
+        break;
+      }
+    }
+
+  delete [] mask;
+
+  // go to the next slab
+  state->Division++;
+  if (done)
+    {
+    // an error occurred
+    }
+  else if (state->Pass == vtkImageConnectivityFilterStreamState::Analysis)
+    {
+    if (state->Division == state->NumberOfDivisions)
+      {
+      // all regions have been found, so create the region arrays
+      int labelType = outData->GetScalarType();
+      vtkICF::FinishAnalysis(
+        this, state, seedData,
+        static_cast<int>(vtkDataArray::GetDataTypeMin(labelType)),
+        static_cast<int>(vtkDataArray::GetDataTypeMax(labelType)));
+
+      // the second pass writes the labels for the output extent
+      int outExt[6];
+      outData->GetExtent(outExt);
+      state->Pass = vtkImageConnectivityFilterStreamState::Output;
+      if (state->SetOutputDivisions(outExt))
+        {
+        state->Division = state->FirstDivision;
+        }
+      else
+        {
+        done = true;
+        }
+      }
+    }
+  else if (state->Division > state->LastDivision)
+    {
+    done = true;
+    }
+
+  if (done)
+    {
+    // tell the pipeline to stop looping
+    request->Remove(vtkStreamingDemandDrivenPipeline::CONTINUE_EXECUTING());
+    state->Started = false;
+    state->Pass = vtkImageConnectivityFilterStreamState::Idle;
+    }
+
+  return rval;
+}
+
 //----------------------------------------------------------------------------
 void vtkImageConnectivityFilter::PrintSelf(ostream& os, vtkIndent indent)
 {
@@ -1575,6 +3202,15 @@ void vtkImageConnectivityFilter::PrintSelf(ostream& os, vtkIndent indent)
   os << indent << "GenerateRegionExtents: "
      << (this->GenerateRegionExtents ? "On\n" : "Off\n");
 
+  os << indent << "GenerateRegionStencils: "
+     << (this->GenerateRegionStencils ? "On\n" : "Off\n");
+
+  os << indent << "NumberOfThreads: "
+     << this->NumberOfThreads << "\n";
+
+  os << indent << "NumberOfStreamDivisions: "
+     << this->NumberOfStreamDivisions << "\n";
+
   os << indent << "SeedConnection: "
      << this->GetSeedConnection() << "\n";
 
@@ -29,6 +29,8 @@
 
 #include "vtkImageAlgorithm.h"
 
+class vtkCollection;
+class vtkImageConnectivityFilterStreamState;
 class vtkIdTypeArray;
 class vtkIntArray;
 class vtkDataSet;
@@ -169,6 +171,27 @@ public:
   vtkBooleanMacro(GenerateRegionExtents, int);
   vtkGetMacro(GenerateRegionExtents, int);
 
+  // Description:
+  // Turn this on to generate a stencil for each region instead of a label
+  // image.  In this mode, a stencil input is required, and the regions are
+  // the connected parts of the stencil: the input image scalars are never
+  // requested from the pipeline, and the output image is left empty.  The
+  // runs of the stencil are connected directly, so the time and memory
+  // that are needed depend on the number of runs rather than the number
+  // of voxels.  The region extents are always generated in this mode.
+  vtkSetMacro(GenerateRegionStencils, int);
+  vtkBooleanMacro(GenerateRegionStencils, int);
+  vtkGetMacro(GenerateRegionStencils, int);
+
+  // Description:
+  // Get the stencil for each extracted region.
+  // This is only valid if GenerateRegionStencilsOn() was called before
+  // the filter was executed.  The stencils are in the same order as the
+  // other region arrays.
+  vtkImageStencilData *GetExtractedRegionStencil(vtkIdType i);
+  vtkCollection *GetExtractedRegionStencils() {
+    return this->ExtractedRegionStencils; }
+
   // Description:
   // Set the size range for the extracted regions.
   // Only regions that have sizes within the specified range will be present
@@ -190,6 +213,34 @@ public:
   vtkSetMacro(ActiveComponent, int);
   vtkGetMacro(ActiveComponent, int);
 
+  // Description:
+  // Set the number of threads to use when searching for regions that are
+  // not grown from seeds (i.e. for AllRegions, or for LargestRegion when no
+  // seeds are given).  These regions are found by dividing the image into
+  // slabs, labeling the runs of voxels within each slab, and then joining
+  // the slabs.  The default value of zero will use the default number of
+  // threads.  The results do not depend on the number of threads.
+  vtkSetMacro(NumberOfThreads, int);
+  vtkGetMacro(NumberOfThreads, int);
+
+  // Description:
+  // Set the number of slabs for streaming (default: 1, no streaming).
+  // If this is greater than one, then the input and the stencil are
+  // requested from the pipeline one slab at a time, and the only things
+  // that are kept between slabs are the runs along the last plane of the
+  // previous slab and a table that records which regions are connected
+  // across the slabs.  The slabs are read twice: once to find the regions
+  // and compute the region arrays, and then again to write the labels for
+  // the requested output extent.  The regions are not searched for again
+  // unless the filter or its inputs are modified, so when the output is
+  // requested in pieces (for example by vtkImageDataStreamer, or by a
+  // writer that streams), only the slabs that overlap each piece are read.
+  // When streaming, the region extents are always generated, and if there
+  // are more regions than labels, the smallest regions are discarded.
+  // This setting is ignored if GenerateRegionStencils is on.
+  vtkSetClampMacro(NumberOfStreamDivisions, int, 1, VTK_INT_MAX);
+  vtkGetMacro(NumberOfStreamDivisions, int);
+
 protected:
   vtkImageConnectivityFilter();
   ~vtkImageConnectivityFilter();
@@ -203,11 +254,17 @@ protected:
   int ActiveComponent;
   int LabelScalarType;
   int GenerateRegionExtents;
+  int GenerateRegionStencils;
+  int NumberOfThreads;
+  int NumberOfStreamDivisions;
+
+  vtkImageConnectivityFilterStreamState *StreamState;
 
   vtkIdTypeArray *ExtractedRegionLabels;
   vtkIdTypeArray *ExtractedRegionSizes;
   vtkIdTypeArray *ExtractedRegionSeedIds;
   vtkIntArray *ExtractedRegionExtents;
+  vtkCollection *ExtractedRegionStencils;
 
   void ComputeInputUpdateExtent(int inExt[6], int outExt[6]);
 
@@ -219,6 +276,13 @@ protected:
   virtual int RequestData(
     vtkInformation *, vtkInformationVector **, vtkInformationVector *);
 
+  // Description:
+  // The update extent and data requests for when the input is streamed.
+  int RequestStreamingUpdateExtent(
+    vtkInformation *, vtkInformationVector **, vtkInformationVector *);
+  int RequestStreamingData(
+    vtkInformation *, vtkInformationVector **, vtkInformationVector *);
+
 private:
   vtkImageConnectivityFilter(const vtkImageConnectivityFilter&);  // Not implemented.
   void operator=(const vtkImageConnectivityFilter&);  // Not implemented.
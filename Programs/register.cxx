@@ -17,13 +17,18 @@ Module:    register.cxx
 #include <vtkSmartPointer.h>
 
 #include <vtkImageReslice.h>
-#include <vtkImageResize.h>
 #include <vtkImageBSplineCoefficients.h>
 #include <vtkImageBSplineInterpolator.h>
 #include <vtkImageSincInterpolator.h>
 #include <vtkImageHistogramStatistics.h>
 #include <vtkImageThreshold.h>
 #include <vtkImageCast.h>
+#include <vtkImageClip.h>
+#include <vtkImageDataStreamer.h>
+#include <vtkExtentTranslator.h>
+#include <vtkAlgorithmOutput.h>
+#include <vtkInformation.h>
+#include <vtkStreamingDemandDrivenPipeline.h>
 #include <vtkROIStencilSource.h>
 #include <vtkImageData.h>
 #include <vtkPointData.h>
@@ -36,6 +41,8 @@ Module:    register.cxx
 #include <vtkMath.h>
 #include <vtkCommand.h>
 #include <vtkMultiThreader.h>
+#include <vtkTrivialProducer.h>
+#include <vtkByteSwap.h>
 
 #include <vtkMINCImageReader.h>
 #include <vtkMINCImageWriter.h>
@@ -66,6 +73,8 @@ Module:    register.cxx
 #include "vtkITKXFMReader.h"
 #include "vtkITKXFMWriter.h"
 #include "vtkImageRegistration.h"
+#include "vtkImageMotionCorrection.h"
+#include "vtkImageGaussianPyramid.h"
 #include "vtkLabelInterpolator.h"
 
 // optional readers
@@ -159,6 +168,10 @@ void SetInterpolator(vtkImageReslice *reslice, int interpolator)
     case vtkImageRegistration::Label:
       reslice->SetInterpolator(labelInterpolator);
       break;
+    case vtkImageRegistration::MajorityLabel:
+      labelInterpolator->SetKernelTypeToMajority();
+      reslice->SetInterpolator(labelInterpolator);
+      break;
     }
 }
 
@@ -329,7 +342,7 @@ vtkDICOMReader *ReadDICOMImage(
 
 void WriteDICOMImage(
   vtkImageReader2 *sourceReader, vtkImageReader2 *targetReader,
-  vtkImageData *data, vtkMatrix4x4 *matrix, const char *directoryName,
+  vtkAlgorithmOutput *input, vtkMatrix4x4 *matrix, const char *directoryName,
   int vtkNotUsed(coordSystem))
 {
   if (vtksys::SystemTools::FileExists(directoryName))
@@ -423,7 +436,7 @@ void WriteDICOMImage(
       }
     writer->SetMemoryRowOrder(reader->GetMemoryRowOrder());
     }
-  writer->SET_INPUT_DATA(data);
+  writer->SetInputConnection(input);
   writer->SetPatientMatrix(matrix);
   writer->Write();
 }
@@ -519,47 +532,35 @@ vtkDICOMImageReader *ReadDICOMImage(
 }
 #endif
 
-vtkMINCImageReader *ReadMINCImage(
-  vtkImageData *data, vtkMatrix4x4 *matrix, const char *fileName,
-  int coordSystem)
+// Flip the rows and columns of an image into a DICOM-style ordering.
+void FlipImageRows(vtkImageData *data)
 {
-  // read the image
-  vtkMINCImageReader *reader = vtkMINCImageReader::New();
-
-  reader->SetFileName(fileName);
-  reader->Update();
-  if (reader->GetErrorCode())
-    {
-    exit(1);
-    }
-
-  vtkSmartPointer<vtkImageData> image = reader->GetOutput();
-
-  if (coordSystem == DICOMCoords)
-    {
-    double spacing[3];
-    reader->GetOutput()->GetSpacing(spacing);
-    spacing[0] = fabs(spacing[0]);
-    spacing[1] = fabs(spacing[1]);
-    spacing[2] = fabs(spacing[2]);
-
-    // flip the image rows into a DICOM-style ordering
-    vtkSmartPointer<vtkImageReslice> flip =
-      vtkSmartPointer<vtkImageReslice>::New();
-
-    flip->SetInputConnection(reader->GetOutputPort());
-    flip->SetResliceAxesDirectionCosines(
-      -1,0,0, 0,-1,0, 0,0,1);
-    flip->SetOutputSpacing(spacing);
-    flip->Update();
+  double spacing[3];
+  data->GetSpacing(spacing);
+  spacing[0] = fabs(spacing[0]);
+  spacing[1] = fabs(spacing[1]);
+  spacing[2] = fabs(spacing[2]);
 
-    image = flip->GetOutput();
-    }
+  vtkSmartPointer<vtkImageData> image =
+    vtkSmartPointer<vtkImageData>::New();
+  image->ShallowCopy(data);
 
-  // get the data
-  data->CopyStructure(image);
-  data->GetPointData()->PassData(image->GetPointData());
+  vtkSmartPointer<vtkImageReslice> flip =
+    vtkSmartPointer<vtkImageReslice>::New();
+  flip->SET_INPUT_DATA(image);
+  flip->SetResliceAxesDirectionCosines(
+    -1,0,0, 0,-1,0, 0,0,1);
+  flip->SetOutputSpacing(spacing);
+  flip->Update();
+
+  data->CopyStructure(flip->GetOutput());
+  data->GetPointData()->PassData(flip->GetOutput()->GetPointData());
+}
 
+// Get the matrix for a MINC image, after its header has been read.
+void GetMINCMatrix(
+  vtkMINCImageReader *reader, vtkMatrix4x4 *matrix, int coordSystem)
+{
   if (coordSystem == DICOMCoords)
     {
     // generate the matrix, but modify to use DICOM coords
@@ -569,41 +570,22 @@ vtkMINCImageReader *ReadMINCImage(
     vtkMatrix4x4::Multiply4x4(*reader->GetDirectionCosines()->Element,
                               xyFlipMatrix, *matrix->Element);
     // do the left/right, up/down dicom-to-minc transformation
-    vtkMatrix4x4::Multiply4x4(xyFlipMatrix, *matrix->Element, *matrix->Element);
+    vtkMatrix4x4::Multiply4x4(xyFlipMatrix, *matrix->Element,
+                              *matrix->Element);
     matrix->Modified();
     }
   else
     {
     matrix->DeepCopy(reader->GetDirectionCosines());
     }
-
-  return reader;
-}
-
-void WriteMINCImage(
-  vtkImageReader2 *vtkNotUsed(sourceReader),
-  vtkImageReader2 *vtkNotUsed(targetReader),
-  vtkImageData *data, vtkMatrix4x4 *vtkNotUsed(matrix), const char *fileName,
-  int vtkNotUsed(coordSystem))
-{
-  fprintf(stderr, "Writing MINC images is not supported yet, "
-          "the output file will have incorrect information\n");
-  vtkSmartPointer<vtkMINCImageWriter> writer =
-    vtkSmartPointer<vtkMINCImageWriter>::New();
-  writer->SetFileName(fileName);
-  writer->SET_INPUT_DATA(data);
-  // the input matrix must be converted
-  //writer->SetDirectionCosines(matrix);
-  writer->Write();
 }
 
-#ifdef AIRS_USE_NIFTI
-vtkNIFTIReader *ReadNIFTIImage(
+vtkMINCImageReader *ReadMINCImage(
   vtkImageData *data, vtkMatrix4x4 *matrix, const char *fileName,
   int coordSystem)
 {
   // read the image
-  vtkNIFTIReader *reader = vtkNIFTIReader::New();
+  vtkMINCImageReader *reader = vtkMINCImageReader::New();
 
   reader->SetFileName(fileName);
   reader->Update();
@@ -612,33 +594,44 @@ vtkNIFTIReader *ReadNIFTIImage(
     exit(1);
     }
 
-  vtkSmartPointer<vtkImageData> image = reader->GetOutput();
+  // get the data
+  vtkImageData *image = reader->GetOutput();
+  data->CopyStructure(image);
+  data->GetPointData()->PassData(image->GetPointData());
 
   if (coordSystem == DICOMCoords)
     {
-    double spacing[3];
-    reader->GetOutput()->GetSpacing(spacing);
-    spacing[0] = fabs(spacing[0]);
-    spacing[1] = fabs(spacing[1]);
-    spacing[2] = fabs(spacing[2]);
-
     // flip the image rows into a DICOM-style ordering
-    vtkSmartPointer<vtkImageReslice> flip =
-      vtkSmartPointer<vtkImageReslice>::New();
+    FlipImageRows(data);
+    }
 
-    flip->SetInputConnection(reader->GetOutputPort());
-    flip->SetResliceAxesDirectionCosines(
-      -1,0,0, 0,-1,0, 0,0,1);
-    flip->SetOutputSpacing(spacing);
-    flip->Update();
+  GetMINCMatrix(reader, matrix, coordSystem);
 
-    image = flip->GetOutput();
-    }
+  return reader;
+}
 
-  // get the data
-  data->CopyStructure(image);
-  data->GetPointData()->PassData(image->GetPointData());
+void WriteMINCImage(
+  vtkImageReader2 *vtkNotUsed(sourceReader),
+  vtkImageReader2 *vtkNotUsed(targetReader),
+  vtkAlgorithmOutput *input, vtkMatrix4x4 *vtkNotUsed(matrix),
+  const char *fileName, int vtkNotUsed(coordSystem))
+{
+  fprintf(stderr, "Writing MINC images is not supported yet, "
+          "the output file will have incorrect information\n");
+  vtkSmartPointer<vtkMINCImageWriter> writer =
+    vtkSmartPointer<vtkMINCImageWriter>::New();
+  writer->SetFileName(fileName);
+  writer->SetInputConnection(input);
+  // the input matrix must be converted
+  //writer->SetDirectionCosines(matrix);
+  writer->Write();
+}
 
+#ifdef AIRS_USE_NIFTI
+// Get the matrix for a NIFTI image, after its header has been read.
+void GetNIFTIMatrix(
+  vtkNIFTIReader *reader, vtkMatrix4x4 *matrix, int coordSystem)
+{
   // get the SForm or QForm matrix if present
   static double nMatrix[16] =
     { 1, 0, 0, 0,  0, 1, 0, 0,  0, 0, 1, 0,  0, 0, 0, 1 };
@@ -659,20 +652,49 @@ vtkNIFTIReader *ReadNIFTIImage(
     // correct for the flip that was done earlier
     vtkMatrix4x4::Multiply4x4(nMatrix, xyFlipMatrix, *matrix->Element);
     // do the left/right, up/down dicom-to-minc transformation
-    vtkMatrix4x4::Multiply4x4(xyFlipMatrix, *matrix->Element, *matrix->Element);
+    vtkMatrix4x4::Multiply4x4(xyFlipMatrix, *matrix->Element,
+                              *matrix->Element);
     matrix->Modified();
     }
   else
     {
     matrix->DeepCopy(nMatrix);
     }
+}
+
+vtkNIFTIReader *ReadNIFTIImage(
+  vtkImageData *data, vtkMatrix4x4 *matrix, const char *fileName,
+  int coordSystem)
+{
+  // read the image
+  vtkNIFTIReader *reader = vtkNIFTIReader::New();
+
+  reader->SetFileName(fileName);
+  reader->Update();
+  if (reader->GetErrorCode())
+    {
+    exit(1);
+    }
+
+  // get the data
+  vtkImageData *image = reader->GetOutput();
+  data->CopyStructure(image);
+  data->GetPointData()->PassData(image->GetPointData());
+
+  if (coordSystem == DICOMCoords)
+    {
+    // flip the image rows into a DICOM-style ordering
+    FlipImageRows(data);
+    }
+
+  GetNIFTIMatrix(reader, matrix, coordSystem);
 
   return reader;
 }
 
 void WriteNIFTIImage(
   vtkImageReader2 *vtkNotUsed(sourceReader), vtkImageReader2 *targetReader,
-  vtkImageData *data, vtkMatrix4x4 *matrix, const char *fileName,
+  vtkAlgorithmOutput *input, vtkMatrix4x4 *matrix, const char *fileName,
   int vtkNotUsed(coordSystem))
 {
   vtkNIFTIReader *reader = vtkNIFTIReader::SafeDownCast(targetReader);
@@ -692,13 +714,202 @@ void WriteNIFTIImage(
       writer->SetQFac(-1.0);
       }
     }
-  writer->SET_INPUT_DATA(data);
+  writer->SetInputConnection(input);
   writer->SetQFormMatrix(matrix);
   writer->SetSFormMatrix(matrix);
   writer->SetFileName(fileName);
   writer->Write();
 }
 
+// The state that is shared by the two threads of WriteNIFTISlabs().
+struct NIFTISlabInfo
+{
+  vtkImageClip *Clips[2];
+  int NextClip;         // the clip that will generate the next slab
+  int NextExtent[6];    // the extent of the next slab
+  int LastClip;         // the clip that holds the slab to be appended
+  FILE *File;
+  bool WriteError;
+};
+
+// Generate the next slab in thread 0 (which is the main thread, so the
+// pipeline is never updated from any other thread), while thread 1
+// appends the previous slab to the file.
+VTK_THREAD_RETURN_TYPE NIFTISlabExecute(void *arg)
+{
+  vtkMultiThreader::ThreadInfo *ti =
+    static_cast<vtkMultiThreader::ThreadInfo *>(arg);
+  NIFTISlabInfo *info = static_cast<NIFTISlabInfo *>(ti->UserData);
+
+  if (ti->ThreadID == 0 && info->NextClip >= 0)
+    {
+    vtkImageClip *clip = info->Clips[info->NextClip];
+    clip->SetOutputWholeExtent(info->NextExtent);
+    clip->Update();
+    }
+  else if (ti->ThreadID == 1 && info->LastClip >= 0)
+    {
+    vtkImageData *data = info->Clips[info->LastClip]->GetOutput();
+    size_t n = static_cast<size_t>(data->GetNumberOfPoints())*
+      data->GetScalarSize();
+    if (fwrite(data->GetScalarPointer(), 1, n, info->File) != n)
+      {
+      info->WriteError = true;
+      }
+    }
+
+  return VTK_THREAD_RETURN_VALUE;
+}
+
+// Write a NIFTI image in z slabs, so that only two slabs of the output are
+// in memory at once.  The first slab is written with the NIFTI writer, the
+// number of slices in its header is changed to that of the whole image,
+// and then each following slab is appended to the file while the slab
+// after it is being resampled.  If the image cannot be written this way,
+// then a warning is printed and false is returned before the file is
+// written.
+bool WriteNIFTISlabs(
+  vtkImageReader2 *sourceReader, vtkImageReader2 *targetReader,
+  vtkAlgorithmOutput *input, vtkMatrix4x4 *matrix, const char *fileName,
+  int coordSystem, int numberOfSlabs)
+{
+  // the voxels can only be appended to an uncompressed single file
+  std::string ext = vtksys::SystemTools::LowerCase(
+    vtksys::SystemTools::GetFilenameLastExtension(fileName));
+  if (ext != ".nii")
+    {
+    fprintf(stderr, "Warning: \"--stream\" needs a \".nii\" file for "
+            "NIFTI output, the image will be resampled in one piece.\n");
+    return false;
+    }
+
+  // the writer reverses the slices if qfac is -1, and it writes the
+  // components (or the time points) after all the slices
+  vtkNIFTIReader *reader = vtkNIFTIReader::SafeDownCast(targetReader);
+  vtkAlgorithm *producer = input->GetProducer();
+  producer->UpdateInformation();
+  vtkInformation *outInfo = producer->GetOutputInformation(input->GetIndex());
+  vtkInformation *scalarInfo = vtkDataObject::GetActiveFieldInformation(
+    outInfo, vtkDataObject::FIELD_ASSOCIATION_POINTS,
+    vtkDataSetAttributes::SCALARS);
+  int numComponents = 1;
+  if (scalarInfo &&
+      scalarInfo->Has(vtkDataObject::FIELD_NUMBER_OF_COMPONENTS()))
+    {
+    numComponents =
+      scalarInfo->Get(vtkDataObject::FIELD_NUMBER_OF_COMPONENTS());
+    }
+  if (numComponents != 1 || (reader && reader->GetQFac() < 0))
+    {
+    fprintf(stderr, "Warning: \"--stream\" is not supported for NIFTI "
+            "images with more than one component or with a negative qfac, "
+            "the image will be resampled in one piece.\n");
+    return false;
+    }
+
+  // every slab must have at least two slices, or the writer will write a
+  // header for a 2D image
+  int extent[6];
+  outInfo->Get(vtkStreamingDemandDrivenPipeline::WHOLE_EXTENT(), extent);
+  int numSlices = extent[5] - extent[4] + 1;
+  int numSlabs = (numberOfSlabs < numSlices/2 ? numberOfSlabs : numSlices/2);
+  if (numSlabs < 2 || numSlices > 32767)
+    {
+    fprintf(stderr, "Warning: \"--stream\" cannot split an image with "
+            "%d slices, the image will be resampled in one piece.\n",
+            numSlices);
+    return false;
+    }
+
+  NIFTISlabInfo info;
+  vtkSmartPointer<vtkImageClip> clips[2];
+  for (int i = 0; i < 2; i++)
+    {
+    clips[i] = vtkSmartPointer<vtkImageClip>::New();
+    clips[i]->SetInputConnection(input);
+    clips[i]->ClipDataOn();
+    info.Clips[i] = clips[i];
+    }
+
+  // write the header and the first slab
+  int slabExtent[6] = { extent[0], extent[1], extent[2], extent[3],
+                        extent[4], extent[4] + numSlices/numSlabs - 1 };
+  clips[0]->SetOutputWholeExtent(slabExtent);
+  clips[0]->Update();
+  WriteNIFTIImage(sourceReader, targetReader, clips[0]->GetOutputPort(),
+                  matrix, fileName, coordSystem);
+
+  // set the number of slices in the header, which is native-endian
+  FILE *fp = fopen(fileName, "r+b");
+  int headerSize = 0;
+  if (fp == 0 || fread(&headerSize, 4, 1, fp) != 1)
+    {
+    fprintf(stderr, "Unable to open file %s\n", fileName);
+    exit(1);
+    }
+  bool success = false;
+  if (headerSize == 348)
+    {
+    short dims[8];
+    if (fseek(fp, 40, SEEK_SET) == 0 && fread(dims, 2, 8, fp) == 8)
+      {
+      dims[0] = (dims[0] > 3 ? dims[0] : 3);
+      dims[3] = static_cast<short>(numSlices);
+      success = (fseek(fp, 40, SEEK_SET) == 0 &&
+                 fwrite(dims, 2, 8, fp) == 8);
+      }
+    }
+  else if (headerSize == 540)
+    {
+    vtkTypeInt64 dims[8];
+    if (fseek(fp, 16, SEEK_SET) == 0 && fread(dims, 8, 8, fp) == 8)
+      {
+      dims[0] = (dims[0] > 3 ? dims[0] : 3);
+      dims[3] = numSlices;
+      success = (fseek(fp, 16, SEEK_SET) == 0 &&
+                 fwrite(dims, 8, 8, fp) == 8);
+      }
+    }
+  if (!success || fseek(fp, 0, SEEK_END) != 0)
+    {
+    fprintf(stderr, "Unable to update the header of file %s\n", fileName);
+    exit(1);
+    }
+
+  // generate each slab while the previous one is appended
+  vtkSmartPointer<vtkMultiThreader> threader =
+    vtkSmartPointer<vtkMultiThreader>::New();
+  threader->SetNumberOfThreads(2);
+  threader->SetSingleMethod(NIFTISlabExecute, &info);
+  info.File = fp;
+  info.WriteError = false;
+  for (int s = 1; s <= numSlabs; s++)
+    {
+    info.NextClip = -1;
+    if (s < numSlabs)
+      {
+      info.NextClip = s % 2;
+      slabExtent[4] = extent[4] + s*numSlices/numSlabs;
+      slabExtent[5] = extent[4] + (s + 1)*numSlices/numSlabs - 1;
+      for (int i = 0; i < 6; i++)
+        {
+        info.NextExtent[i] = slabExtent[i];
+        }
+      }
+    // the first slab was written along with the header
+    info.LastClip = (s > 1 ? (s - 1) % 2 : -1);
+    threader->SingleMethodExecute();
+    }
+
+  if (fclose(fp) != 0 || info.WriteError)
+    {
+    fprintf(stderr, "Unable to write file %s\n", fileName);
+    exit(1);
+    }
+
+  return true;
+}
+
 #endif /* AIRS_USE_NIFTI */
 
 vtkImageReader2 *ReadImage(
@@ -755,9 +966,10 @@ vtkImageReader2 *ReadImage(
   // ---------
   // use vtkImageReslice to eliminate any shear caused by CT tilted gantry
 
-  // use sinc interpolation here unless NN or LA requested
+  // use sinc interpolation here unless NN, LA, or ML requested
   if (interpolator != vtkImageRegistration::Nearest &&
-      interpolator != vtkImageRegistration::Label)
+      interpolator != vtkImageRegistration::Label &&
+      interpolator != vtkImageRegistration::MajorityLabel)
     {
     interpolator = vtkImageRegistration::Sinc;
     }
@@ -844,19 +1056,25 @@ int CoordSystem(const char *filename)
   return DICOMCoords;
 }
 
+// The image is pulled through the pipeline from the given port.  If the
+// number of slabs is at least two, then the image is generated and written
+// in z slabs: the MINC writer pulls the slabs through a streamer, and
+// NIFTI files are written slab by slab by WriteNIFTISlabs().
 void WriteImage(
   vtkImageReader2 *sourceReader, vtkImageReader2 *targetReader,
-  vtkImageData *image, vtkMatrix4x4 *matrix,
-  const char *filename, int coordSystem, int interpolator)
+  vtkAlgorithmOutput *input, vtkMatrix4x4 *matrix,
+  const char *filename, int coordSystem, int interpolator,
+  int numberOfSlabs)
 {
 #ifdef AIRS_USE_DICOM
   // check if tilted-gantry images must be produced
   vtkSmartPointer<vtkImageReslice> reslice =
     vtkSmartPointer<vtkImageReslice>::New();
 
-  // use sinc interpolation here unless NN or LA requested
+  // use sinc interpolation here unless NN, LA, or ML requested
   if (interpolator != vtkImageRegistration::Nearest &&
-      interpolator != vtkImageRegistration::Label)
+      interpolator != vtkImageRegistration::Label &&
+      interpolator != vtkImageRegistration::MajorityLabel)
     {
     interpolator = vtkImageRegistration::Sinc;
     }
@@ -894,11 +1112,16 @@ void WriteImage(
     // if shear is not insignificant, resample on an orthogonal grid
     if (fabs(xshear) > 1e-3 || fabs(yshear) > 1e-3)
       {
+      // get the geometry without generating the image
       double origin[3], spacing[3];
       int extent[6];
-      image->GetOrigin(origin);
-      image->GetSpacing(spacing);
-      image->GetExtent(extent);
+      vtkAlgorithm *producer = input->GetProducer();
+      producer->UpdateInformation();
+      vtkInformation *outInfo =
+        producer->GetOutputInformation(input->GetIndex());
+      outInfo->Get(vtkDataObject::ORIGIN(), origin);
+      outInfo->Get(vtkDataObject::SPACING(), spacing);
+      outInfo->Get(vtkStreamingDemandDrivenPipeline::WHOLE_EXTENT(), extent);
       // adjust the spacing if necessary
       spacing[2] *= zdn;
       origin[2] *= zdn;
@@ -907,48 +1130,629 @@ void WriteImage(
       origin[1] -= yshear*0.5*spacing[2]*(extent[5] - extent[4]);
 
       reslice->SetResliceAxes(rmat);
-      reslice->SET_INPUT_DATA(image);
+      reslice->SetInputConnection(input);
       reslice->SetOutputOrigin(origin);
       reslice->SetOutputSpacing(spacing);
       reslice->SetOutputExtent(extent);
       SetInterpolator(reslice, interpolator);
-      reslice->Update();
 
-      image = reslice->GetOutput();
-      matrix = reader->GetPatientMatrix();
+      input = reslice->GetOutputPort();
+      matrix = reader->GetPatientMatrix();
+      }
+    }
+#endif
+
+  int t = GuessFileType(filename);
+
+  if (t == MINCImage)
+    {
+    // the MINC writer requests the image one slice at a time
+    vtkSmartPointer<vtkImageDataStreamer> streamer =
+      vtkSmartPointer<vtkImageDataStreamer>::New();
+    if (numberOfSlabs > 1)
+      {
+      streamer->SetInputConnection(input);
+      streamer->SetNumberOfStreamDivisions(numberOfSlabs);
+      streamer->GetExtentTranslator()->SetSplitModeToZSlab();
+      input = streamer->GetOutputPort();
+      }
+    WriteMINCImage(
+      sourceReader, targetReader, input, matrix, filename, coordSystem);
+    }
+  else if (t == NIFTIImage)
+    {
+#ifdef AIRS_USE_NIFTI
+    if (numberOfSlabs < 2 ||
+        !WriteNIFTISlabs(sourceReader, targetReader, input, matrix,
+                         filename, coordSystem, numberOfSlabs))
+      {
+      WriteNIFTIImage(
+        sourceReader, targetReader, input, matrix, filename, coordSystem);
+      }
+#else
+    fprintf(stderr, "NIFTI files are not supported.\n");
+    exit(1);
+#endif
+    }
+  else
+    {
+#ifdef AIRS_USE_DICOM
+    if (numberOfSlabs > 1)
+      {
+      fprintf(stderr, "Warning: \"--stream\" is not supported for DICOM "
+              "output, the image will be resampled in one piece.\n");
+      }
+    WriteDICOMImage(
+      sourceReader, targetReader, input, matrix, filename, coordSystem);
+#else
+    fprintf(stderr, "Writing DICOM files is not supported.\n");
+    exit(1);
+#endif
+    }
+}
+
+#ifdef AIRS_USE_NIFTI
+// Read the frames of a series a few at a time, so that the whole series
+// never has to be held in memory.  The time steps of a MINC file are read
+// one at a time, and the frames of an uncompressed single-file NIFTI image
+// are read directly from the file.  Any other series is read in one piece,
+// and its frames are copied from memory.
+class SeriesReader
+{
+public:
+  SeriesReader(const char *fileName, int coordSystem);
+  ~SeriesReader();
+
+  // Description:
+  // Get the number of frames, the time between the frames (zero if not
+  // known), and the matrix for the frames.
+  int GetNumberOfFrames() { return this->NumberOfFrames; }
+  double GetTimeSpacing() { return this->TimeSpacing; }
+  vtkMatrix4x4 *GetMatrix() { return this->Matrix; }
+
+  // Description:
+  // Read "n" frames into the components of the image, starting at frame
+  // "first".  The frames must be read in order.  Returns false on error.
+  bool ReadFrames(int first, int n, vtkImageData *image);
+
+private:
+  void SetFrameInformation(vtkAlgorithm *reader);
+
+  std::string FileName;
+  int CoordSystem;
+  int NumberOfFrames;
+  double TimeSpacing;
+  vtkMatrix4x4 *Matrix;
+  vtkMINCImageReader *MINCReader; // for reading one time step at a time
+  FILE *File;                     // for reading NIFTI frames directly
+  bool SwapBytes;
+  vtkDataArray *Buffer;           // holds one frame that was read directly
+  vtkImageData *Series;           // holds a series that was read in one piece
+  int Extent[6];
+  double Spacing[3];
+  double Origin[3];
+  int ScalarType;
+};
+
+SeriesReader::SeriesReader(const char *fileName, int coordSystem)
+  : FileName(fileName), CoordSystem(coordSystem), NumberOfFrames(1),
+    TimeSpacing(0.0), MINCReader(0), File(0), SwapBytes(false),
+    Buffer(0), Series(0), ScalarType(VTK_FLOAT)
+{
+  this->Matrix = vtkMatrix4x4::New();
+
+  int t = GuessFileType(fileName);
+  std::string ext = vtksys::SystemTools::LowerCase(
+    vtksys::SystemTools::GetFilenameLastExtension(fileName));
+
+  if (t == MINCImage)
+    {
+    this->MINCReader = vtkMINCImageReader::New();
+    this->MINCReader->SetFileName(fileName);
+    this->MINCReader->UpdateInformation();
+    if (this->MINCReader->GetErrorCode())
+      {
+      exit(1);
+      }
+    int n = this->MINCReader->GetNumberOfTimeSteps();
+    this->NumberOfFrames = (n > 1 ? n : 1);
+    this->SetFrameInformation(this->MINCReader);
+    GetMINCMatrix(this->MINCReader, this->Matrix, coordSystem);
+    return;
+    }
+
+  if (t == NIFTIImage && ext == ".nii")
+    {
+    vtkSmartPointer<vtkNIFTIReader> reader =
+      vtkSmartPointer<vtkNIFTIReader>::New();
+    reader->SetFileName(fileName);
+    reader->UpdateInformation();
+    if (reader->GetErrorCode())
+      {
+      exit(1);
+      }
+
+    // get the dimensions and the offset to the voxels from the header
+    FILE *fp = fopen(fileName, "rb");
+    int headerSize = 0;
+    if (fp == 0 || fread(&headerSize, 4, 1, fp) != 1)
+      {
+      fprintf(stderr, "Unable to open file %s\n", fileName);
+      exit(1);
+      }
+    if (headerSize != 348 && headerSize != 540)
+      {
+      vtkByteSwap::SwapVoidRange(&headerSize, 1, 4);
+      this->SwapBytes = true;
+      }
+    vtkTypeInt64 dims[8] = { 0, 0, 0, 0, 0, 0, 0, 0 };
+    vtkTypeInt64 offset = 0;
+    bool success = false;
+    if (headerSize == 348)
+      {
+      short sdims[8];
+      float voxOffset;
+      success = (fseek(fp, 40, SEEK_SET) == 0 &&
+                 fread(sdims, 2, 8, fp) == 8 &&
+                 fseek(fp, 108, SEEK_SET) == 0 &&
+                 fread(&voxOffset, 4, 1, fp) == 1);
+      if (this->SwapBytes)
+        {
+        vtkByteSwap::SwapVoidRange(sdims, 8, 2);
+        vtkByteSwap::SwapVoidRange(&voxOffset, 1, 4);
+        }
+      for (int i = 0; i < 8; i++)
+        {
+        dims[i] = sdims[i];
+        }
+      offset = static_cast<vtkTypeInt64>(voxOffset);
+      }
+    else if (headerSize == 540)
+      {
+      success = (fseek(fp, 16, SEEK_SET) == 0 &&
+                 fread(dims, 8, 8, fp) == 8 &&
+                 fseek(fp, 168, SEEK_SET) == 0 &&
+                 fread(&offset, 8, 1, fp) == 1);
+      if (this->SwapBytes)
+        {
+        vtkByteSwap::SwapVoidRange(dims, 8, 8);
+        vtkByteSwap::SwapVoidRange(&offset, 1, 8);
+        }
+      }
+    if (!success)
+      {
+      fprintf(stderr, "Unable to read the header of file %s\n", fileName);
+      exit(1);
+      }
+
+    // the frames can be read directly if each frame is a single component
+    // (i.e. no vector dimension and no RGB), and if the reader does not
+    // have to reverse the slices because of a negative qfac
+    this->NumberOfFrames = static_cast<int>(dims[0] > 3 ? dims[4] : 1);
+    this->SetFrameInformation(reader);
+    vtkInformation *scalarInfo = vtkDataObject::GetActiveFieldInformation(
+      reader->GetOutputInformation(0),
+      vtkDataObject::FIELD_ASSOCIATION_POINTS,
+      vtkDataSetAttributes::SCALARS);
+    int numComponents = 1;
+    if (scalarInfo &&
+        scalarInfo->Has(vtkDataObject::FIELD_NUMBER_OF_COMPONENTS()))
+      {
+      numComponents =
+        scalarInfo->Get(vtkDataObject::FIELD_NUMBER_OF_COMPONENTS());
+      }
+    if (numComponents == this->NumberOfFrames &&
+        reader->GetQFac() >= 0 &&
+        offset > 0 && fseek(fp, static_cast<long>(offset), SEEK_SET) == 0)
+      {
+      this->File = fp;
+      this->TimeSpacing = reader->GetTimeSpacing();
+      GetNIFTIMatrix(reader, this->Matrix, coordSystem);
+      return;
+      }
+    fclose(fp);
+    }
+
+  // read the whole series
+  fprintf(stderr, "Warning: the series %s will be read in one piece.\n",
+          fileName);
+  this->Series = vtkImageData::New();
+  vtkImageReader2 *reader = 0;
+  if (t == NIFTIImage)
+    {
+    vtkNIFTIReader *niftiReader =
+      ReadNIFTIImage(this->Series, this->Matrix, fileName, coordSystem);
+    this->TimeSpacing = niftiReader->GetTimeSpacing();
+    reader = niftiReader;
+    }
+  else
+    {
+    reader = ReadDICOMImage(this->Series, this->Matrix, fileName,
+                            coordSystem);
+    }
+  reader->Delete();
+  this->NumberOfFrames = this->Series->GetNumberOfScalarComponents();
+  this->Series->GetExtent(this->Extent);
+  this->Series->GetSpacing(this->Spacing);
+  this->Series->GetOrigin(this->Origin);
+  this->ScalarType = this->Series->GetScalarType();
+}
+
+SeriesReader::~SeriesReader()
+{
+  this->Matrix->Delete();
+  if (this->MINCReader)
+    {
+    this->MINCReader->Delete();
+    }
+  if (this->File)
+    {
+    fclose(this->File);
+    }
+  if (this->Buffer)
+    {
+    this->Buffer->Delete();
+    }
+  if (this->Series)
+    {
+    this->Series->Delete();
+    }
+}
+
+// Get the geometry of one frame, after the header has been read.
+void SeriesReader::SetFrameInformation(vtkAlgorithm *reader)
+{
+  vtkInformation *outInfo = reader->GetOutputInformation(0);
+  outInfo->Get(vtkStreamingDemandDrivenPipeline::WHOLE_EXTENT(),
+               this->Extent);
+  outInfo->Get(vtkDataObject::SPACING(), this->Spacing);
+  outInfo->Get(vtkDataObject::ORIGIN(), this->Origin);
+  vtkInformation *scalarInfo = vtkDataObject::GetActiveFieldInformation(
+    outInfo, vtkDataObject::FIELD_ASSOCIATION_POINTS,
+    vtkDataSetAttributes::SCALARS);
+  if (scalarInfo && scalarInfo->Has(vtkDataObject::FIELD_ARRAY_TYPE()))
+    {
+    this->ScalarType = scalarInfo->Get(vtkDataObject::FIELD_ARRAY_TYPE());
+    }
+}
+
+bool SeriesReader::ReadFrames(int first, int n, vtkImageData *image)
+{
+  image->SetExtent(this->Extent);
+  image->SetSpacing(this->Spacing);
+  image->SetOrigin(this->Origin);
+#if VTK_MAJOR_VERSION >= 6
+  image->AllocateScalars(this->ScalarType, n);
+#else
+  image->SetScalarType(this->ScalarType);
+  image->SetNumberOfScalarComponents(n);
+  image->AllocateScalars();
+#endif
+  vtkDataArray *scalars = image->GetPointData()->GetScalars();
+  vtkIdType numVoxels = image->GetNumberOfPoints();
+
+  for (int c = 0; c < n; c++)
+    {
+    int frame = first + c;
+    if (this->MINCReader)
+      {
+      this->MINCReader->SetTimeStep(frame);
+      this->MINCReader->Update();
+      if (this->MINCReader->GetErrorCode())
+        {
+        return false;
+        }
+      scalars->CopyComponent(
+        c, this->MINCReader->GetOutput()->GetPointData()->GetScalars(), 0);
+      }
+    else if (this->File)
+      {
+      if (this->Buffer == 0)
+        {
+        this->Buffer = vtkDataArray::CreateDataArray(this->ScalarType);
+        this->Buffer->SetNumberOfTuples(numVoxels);
+        }
+      size_t size = this->Buffer->GetDataTypeSize();
+      void *ptr = this->Buffer->GetVoidPointer(0);
+      if (fread(ptr, size, numVoxels, this->File) !=
+          static_cast<size_t>(numVoxels))
+        {
+        return false;
+        }
+      if (this->SwapBytes)
+        {
+        vtkByteSwap::SwapVoidRange(ptr, numVoxels, static_cast<int>(size));
+        }
+      scalars->CopyComponent(c, this->Buffer, 0);
+      }
+    else
+      {
+      scalars->CopyComponent(
+        c, this->Series->GetPointData()->GetScalars(), frame);
+      }
+    }
+
+  // a series read in one piece was already flipped by its reader
+  if (this->Series == 0 && this->CoordSystem == DICOMCoords)
+    {
+    FlipImageRows(image);
+    }
+
+  return true;
+}
+
+// Write a corrected series to a single-file NIFTI image as it is produced.
+// The header is generated by the NIFTI writer from the first frame, and it
+// is then written with the number of frames and with a comment extension
+// that has a line reserved for the matrix of each frame.  The frames are
+// appended to the file as they are corrected, and the matrices are filled
+// in at the same time.
+class SeriesWriter
+{
+public:
+  SeriesWriter(const char *fileName, int numFrames, double timeSpacing,
+               vtkMatrix4x4 *matrix, int coordSystem);
+  ~SeriesWriter();
+
+  // Description:
+  // Append the components of the image to the file as frames, along with
+  // the matrices for the frames (16 values per frame, row-major).  The
+  // frames must be written in order.  Returns false on error.
+  bool WriteFrames(int first, vtkImageData *image, const double *matrices);
+
+private:
+  bool WriteHeader(vtkImageData *image);
+
+  // The length of the line for each frame matrix in the extension.
+  enum { LineLength = 300 };
+
+  std::string FileName;
+  int NumberOfFrames;
+  double TimeSpacing;
+  vtkMatrix4x4 *Matrix;
+  int CoordSystem;
+  FILE *File;
+  long ExtensionOffset;  // offset to the first frame matrix
+  int NumberOfFramesWritten;
+  vtkDataArray *Buffer;  // holds one frame to be written
+};
+
+SeriesWriter::SeriesWriter(
+  const char *fileName, int numFrames, double timeSpacing,
+  vtkMatrix4x4 *matrix, int coordSystem)
+  : FileName(fileName), NumberOfFrames(numFrames), TimeSpacing(timeSpacing),
+    Matrix(matrix), CoordSystem(coordSystem), File(0), ExtensionOffset(0),
+    NumberOfFramesWritten(0), Buffer(0)
+{
+  this->Matrix->Register(0);
+}
+
+SeriesWriter::~SeriesWriter()
+{
+  this->Matrix->UnRegister(0);
+  if (this->File)
+    {
+    fclose(this->File);
+    }
+  if (this->Buffer)
+    {
+    this->Buffer->Delete();
+    }
+}
+
+bool SeriesWriter::WriteHeader(vtkImageData *image)
+{
+  const char *fileName = this->FileName.c_str();
+
+  // write the first frame with the NIFTI writer to generate a header
+  this->Buffer = vtkDataArray::CreateDataArray(image->GetScalarType());
+  this->Buffer->SetNumberOfTuples(image->GetNumberOfPoints());
+  this->Buffer->CopyComponent(0, image->GetPointData()->GetScalars(), 0);
+  vtkSmartPointer<vtkImageData> frame =
+    vtkSmartPointer<vtkImageData>::New();
+  frame->CopyStructure(image);
+  frame->GetPointData()->SetScalars(this->Buffer);
+#if VTK_MAJOR_VERSION >= 6
+  vtkSmartPointer<vtkTrivialProducer> producer =
+    vtkSmartPointer<vtkTrivialProducer>::New();
+  producer->SetOutput(frame);
+  vtkAlgorithmOutput *port = producer->GetOutputPort();
+#else
+  vtkAlgorithmOutput *port = frame->GetProducerPort();
+#endif
+  WriteNIFTIImage(NULL, NULL, port, this->Matrix, fileName,
+                  this->CoordSystem);
+
+  // read the header back, it is native-endian
+  FILE *fp = fopen(fileName, "rb");
+  int headerSize = 0;
+  if (fp == 0 || fread(&headerSize, 4, 1, fp) != 1 ||
+      (headerSize != 348 && headerSize != 540))
+    {
+    if (fp)
+      {
+      fclose(fp);
+      }
+    return false;
+    }
+  std::vector<char> header(headerSize);
+  bool success = (fseek(fp, 0, SEEK_SET) == 0 &&
+                  fread(&header[0], 1, headerSize, fp) ==
+                  static_cast<size_t>(headerSize));
+  fclose(fp);
+  if (!success)
+    {
+    return false;
+    }
+
+  // the extension holds a title line and one line per frame, and its
+  // size (which includes the 8 bytes for esize and ecode) must be a
+  // multiple of 16
+  std::string title = "frame matrices (row-major), "
+    "from output world coords to input world coords\n";
+  int esize = static_cast<int>(
+    8 + title.length() + this->NumberOfFrames*LineLength);
+  esize = (esize + 15)/16*16;
+  std::vector<char> extension(esize, '\0');
+  int ecode = 6; // NIFTI_ECODE_COMMENT
+  memcpy(&extension[0], &esize, 4);
+  memcpy(&extension[4], &ecode, 4);
+  memcpy(&extension[8], title.c_str(), title.length());
+  for (int i = 0; i < this->NumberOfFrames; i++)
+    {
+    char *line = &extension[8 + title.length() + i*LineLength];
+    memset(line, ' ', LineLength - 1);
+    line[LineLength - 1] = '\n';
+    }
+
+  // set the number of frames, the time spacing, and the voxel offset
+  vtkTypeInt64 voxOffset = headerSize + 4 + esize;
+  if (headerSize == 348)
+    {
+    short dims[8];
+    float pixdim[8];
+    memcpy(dims, &header[40], 16);
+    memcpy(pixdim, &header[76], 32);
+    dims[0] = 4;
+    dims[4] = static_cast<short>(this->NumberOfFrames);
+    pixdim[4] = (this->TimeSpacing > 0 ?
+                 static_cast<float>(this->TimeSpacing) : pixdim[4]);
+    float offset = static_cast<float>(voxOffset);
+    memcpy(&header[40], dims, 16);
+    memcpy(&header[76], pixdim, 32);
+    memcpy(&header[108], &offset, 4);
+    }
+  else
+    {
+    vtkTypeInt64 dims[8];
+    double pixdim[8];
+    memcpy(dims, &header[16], 64);
+    memcpy(pixdim, &header[104], 64);
+    dims[0] = 4;
+    dims[4] = this->NumberOfFrames;
+    pixdim[4] = (this->TimeSpacing > 0 ? this->TimeSpacing : pixdim[4]);
+    memcpy(&header[16], dims, 64);
+    memcpy(&header[104], pixdim, 64);
+    memcpy(&header[168], &voxOffset, 8);
+    }
+
+  // rewrite the file with the new header and the extension
+  static const char extender[4] = { 1, 0, 0, 0 };
+  this->File = fopen(fileName, "wb");
+  this->ExtensionOffset = static_cast<long>(
+    headerSize + 4 + 8 + title.length());
+  return (this->File != 0 &&
+          fwrite(&header[0], 1, headerSize, this->File) ==
+            static_cast<size_t>(headerSize) &&
+          fwrite(extender, 1, 4, this->File) == 4 &&
+          fwrite(&extension[0], 1, esize, this->File) ==
+            static_cast<size_t>(esize));
+}
+
+bool SeriesWriter::WriteFrames(
+  int first, vtkImageData *image, const double *matrices)
+{
+  if (first != this->NumberOfFramesWritten ||
+      (this->File == 0 && !this->WriteHeader(image)))
+    {
+    return false;
+    }
+
+  // fill in the matrices
+  int n = image->GetNumberOfScalarComponents();
+  for (int c = 0; c < n; c++)
+    {
+    char line[LineLength + 32];
+    int l = sprintf(line, "%6d", first + c);
+    for (int j = 0; j < 16; j++)
+      {
+      l += sprintf(&line[l], " %.9g", matrices[16*c + j]);
+      }
+    if (l >= LineLength ||
+        fseek(this->File, this->ExtensionOffset + (first + c)*LineLength,
+              SEEK_SET) != 0 ||
+        fwrite(line, 1, l, this->File) != static_cast<size_t>(l))
+      {
+      return false;
       }
     }
-#endif
 
-  int t = GuessFileType(filename);
+  // append the frames
+  if (fseek(this->File, 0, SEEK_END) != 0)
+    {
+    return false;
+    }
+  vtkIdType numVoxels = image->GetNumberOfPoints();
+  size_t size = this->Buffer->GetDataTypeSize();
+  for (int c = 0; c < n; c++)
+    {
+    this->Buffer->CopyComponent(0, image->GetPointData()->GetScalars(), c);
+    if (fwrite(this->Buffer->GetVoidPointer(0), size, numVoxels,
+               this->File) != static_cast<size_t>(numVoxels))
+      {
+      return false;
+      }
+    }
 
-  if (t == MINCImage)
+  this->NumberOfFramesWritten += n;
+  if (this->NumberOfFramesWritten == this->NumberOfFrames)
     {
-    WriteMINCImage(
-      sourceReader, targetReader, image, matrix, filename, coordSystem);
+    bool success = (fclose(this->File) == 0);
+    this->File = 0;
+    return success;
     }
-  else if (t == NIFTIImage)
+
+  return true;
+}
+#endif /* AIRS_USE_NIFTI */
+
+
+// Write the registration state to a checkpoint file, preceded by the
+// pyramid level and whether that level is complete.  The file is written
+// under a temporary name and then renamed, so that an interruption cannot
+// leave a truncated checkpoint.
+void WriteCheckpoint(
+  vtkImageRegistration *reg, int level, bool complete, const char *fname)
+{
+  std::string tmpname = fname;
+  tmpname += ".tmp";
+
+  ofstream outfile(tmpname.c_str(), ios::out | ios::trunc);
+  if (outfile.fail())
     {
-#ifdef AIRS_USE_NIFTI
-    WriteNIFTIImage(
-      sourceReader, targetReader, image, matrix, filename, coordSystem);
-#else
-    fprintf(stderr, "NIFTI files are not supported.\n");
-    exit(1);
-#endif
+    fprintf(stderr, "Unable to open checkpoint file %s\n", tmpname.c_str());
+    return;
     }
-  else
+
+  outfile << "level " << level << "\n";
+  outfile << "complete " << complete << "\n";
+  reg->SaveState(outfile);
+  outfile.close();
+
+  if (outfile.fail() ||
+      !vtksys::SystemTools::RenameFile(tmpname.c_str(), fname))
     {
-#ifdef AIRS_USE_DICOM
-    WriteDICOMImage(
-      sourceReader, targetReader, image, matrix, filename, coordSystem);
-#else
-    fprintf(stderr, "Writing DICOM files is not supported.\n");
-    exit(1);
-#endif
+    fprintf(stderr, "Unable to write checkpoint file %s\n", fname);
     }
 }
 
+// Read the pyramid level from a checkpoint file, and whether that level
+// was complete, and return the stream positioned at the registration
+// state.  Returns -1 on failure.
+int ReadCheckpointLevel(ifstream& infile, const char *fname, bool *complete)
+{
+  infile.open(fname);
+  std::string word;
+  std::string word2;
+  int level = -1;
+  if (infile.fail() || !(infile >> word >> level) || word != "level" ||
+      !(infile >> word2 >> *complete) || word2 != "complete")
+    {
+    fprintf(stderr, "Unable to read checkpoint file %s\n", fname);
+    level = -1;
+    }
+  return level;
+}
 
 // Write a csv file that can be used to plot the convergence of the
 // registration.  The first column is the function evaluation count,
@@ -1279,20 +2083,19 @@ void ComputeRange(vtkImageData *image, double range[2], double fill[2])
   cylinder->SetBounds(bounds);
   cylinder->Update();
 
-  // get the range within the cylinder
+  // get the range within the cylinder (1st to 99th percentile, expanded
+  // by 10 percent), with the same histogram pass as vtkImageRegistration
+  static const double percentiles[2] = { 1.0, 99.0 };
+  static const double expansion[2] = { 0.1, 0.1 };
+  vtkImageRegistration::ComputePercentileRange(
+    image, cylinder->GetOutput(), percentiles, expansion, range);
+
+  // run again, with no cylinder stencil
   vtkSmartPointer<vtkImageHistogramStatistics> rangeFinder =
     vtkSmartPointer<vtkImageHistogramStatistics>::New();
 
   rangeFinder->SET_INPUT_DATA(image);
-  rangeFinder->SET_STENCIL_DATA(cylinder->GetOutput());
-  rangeFinder->Update();
-
-  rangeFinder->GetAutoRange(range);
-
-  // run again, with no cylinder stencil
-  rangeFinder->SET_STENCIL_DATA(0);
   rangeFinder->SetMaximumNumberOfBins(65536);
-  rangeFinder->Modified();
   rangeFinder->Update();
 
   // get the histogram and find the bin with highest frequency that
@@ -1393,6 +2196,7 @@ struct register_options
   int parallel;        // -P --parallel
   int coords;          // -C --coords
   int maxeval[4];      // -N --maxeval
+  int adaptive;        // --adaptive
   int display;         // -d --display
   int translucent;     // -t --translucent
   int silent;          // -s --silent
@@ -1400,10 +2204,13 @@ struct register_options
   int mip;             // --mip
 #endif
   int source_to_target; // --source-to-target
+  int stream;          // --stream
+  int series;          // --series
   const char *outxfm;  // -o (output transform)
   const char *output;  // -o (output image)
   const char *screenshot; // -j (output screenshot)
   const char *report;  // -r (report csv file)
+  const char *checkpoint; // --checkpoint (resumable state file)
   const char *source;
   const char *target;
   std::vector<TransformArg> transforms;
@@ -1422,6 +2229,7 @@ void register_initialize_options(register_options *options)
   options->maxeval[1] = 5000;
   options->maxeval[2] = 5000;
   options->maxeval[3] = 5000;
+  options->adaptive = 0;
   options->display = 0;
   options->translucent = 0;
   options->silent = 0;
@@ -1429,8 +2237,11 @@ void register_initialize_options(register_options *options)
   options->mip = 0;
 #endif
   options->source_to_target = 0;
+  options->stream = 0;
+  options->series = 0;
   options->screenshot = NULL;
   options->report = NULL;
+  options->checkpoint = NULL;
   options->output = NULL;
   options->outxfm = NULL;
   options->source = NULL;
@@ -1579,10 +2390,15 @@ void register_show_help(FILE *fp, const char *command)
     "                 WS        WindowedSinc\n"
     "                 AS        Antialiasing\n"
     "                 LA        Label\n"
+    "                 ML        MajorityLabel\n"
     "\n"
     "    Linear interpolation is usually the best choice, it provides\n"
-    "    a good balance between efficiency and quality.  Either Label or\n"
-    "    NearestNeighbor is required if one of the images is a label image.\n"
+    "    a good balance between efficiency and quality.  Either Label,\n"
+    "    MajorityLabel, or NearestNeighbor is required if one of the images\n"
+    "    is a label image.  MajorityLabel gives each voxel the label that\n"
+    "    is most common among the eight nearest voxels (ties go to the\n"
+    "    nearest voxel), and is nearly as fast as NearestNeighbor but\n"
+    "    without the staircase artifacts.\n"
     "    The Windowed Sinc interpolator uses a five-lobe Blackman-windowed\n"
     "    sinc kernel and offers the highest overall quality, while the\n"
     "    the Antialiasing interpolator uses a five-lobe Blackman-windowed\n"
@@ -1626,6 +2442,13 @@ void register_show_help(FILE *fp, const char *command)
     "\n"
     "    Set the maximum number of metric evaluations per stage.  Set this\n"
     "    to zero if you want to use the initial transform as-is.\n"
+    "\n"
+    " --adaptive        (default: off)\n"
+    "\n"
+    "    Move on to the next stage as soon as the improvement per metric\n"
+    "    evaluation drops below the noise floor of the metric, instead of\n"
+    "    waiting for the tolerance to be met.  The -N values still provide\n"
+    "    the maximum number of evaluations for each stage.\n"
 #ifdef VTK_HAS_SLAB_SPACING
     "\n"
     " --mip             (default: off)\n"
@@ -1660,6 +2483,15 @@ void register_show_help(FILE *fp, const char *command)
     "    Write a report in csv format that shows the convergence.  This is\n"
     "    for testing the metrics.\n"
     "\n"
+    " --checkpoint <file>\n"
+    "\n"
+    "    Save the state of the registration to the given file after every\n"
+    "    iteration, and at the end of each stage.  If the file already\n"
+    "    exists when the program starts, the registration will resume from\n"
+    "    the saved state, so that a job that was interrupted does not have\n"
+    "    to start over.  The file is removed when the registration is\n"
+    "    complete.\n"
+    "\n"
     " -o <file>\n"
     "\n"
     "    Provide a file for the resulting transform or image to be written\n"
@@ -1670,6 +2502,33 @@ void register_show_help(FILE *fp, const char *command)
     "    coordinate system.  For an image output, the target image is\n"
     "    resampled to match the geometry of the source image.\n"
     "\n"
+    " --stream <n>      (default: 0)\n"
+    "\n"
+    "    Resample the output image in n slabs (n must be at least 2), and\n"
+    "    write each slab as soon as it is generated, so that the whole\n"
+    "    output image is never held in memory.  This is supported for MINC\n"
+    "    output and for single-file \".nii\" output.  For NIFTI, each slab\n"
+    "    is written while the next slab is resampled, but images with more\n"
+    "    than one component or a negative qfac are not streamed.  For other\n"
+    "    output files, a warning is printed and the image is resampled in\n"
+    "    one piece.\n"
+    "\n"
+    " --series          (default: off)\n"
+    "\n"
+    "    Treat the target as a series (e.g. a 4D fMRI image) and register\n"
+    "    every frame to the source image.  Each frame starts from the\n"
+    "    result for the previous frame, the frames are split into blocks\n"
+    "    that are registered in parallel, and the series is read,\n"
+    "    registered, and written in chunks so that it never has to fit in\n"
+    "    memory.  The output image must be a \".nii\" file, and it holds\n"
+    "    the corrected series along with a comment extension that lists\n"
+    "    the matrix for every frame.  An output transform must be a \".csv\"\n"
+    "    or \".txt\" file, and it will have one row per frame.  The series\n"
+    "    is read directly from MINC files and from uncompressed \".nii\"\n"
+    "    files, other files are read in one piece.  The \"-N\" values give\n"
+    "    the number of pyramid levels and the maximum number of evaluations\n"
+    "    per frame.\n"
+    "\n"
     " -i --invert <transform>\n"
     "\n"
     "    Use the inverse of the given transform as the initial transform.\n"
@@ -1706,6 +2565,7 @@ int register_read_options(
     "WindowedSinc", "WS",
     "Antialiasing", "AS",
     "Label", "LA",
+    "MajorityLabel", "ML",
     0 };
   static const char *optimizer_args[] = {
     "PW", "Powell",
@@ -1878,6 +2738,11 @@ int register_read_options(
           {
           options->interpolator = vtkImageRegistration::Label;
           }
+        else if (strcmp(arg, "MajorityLabel") == 0 ||
+                 strcmp(arg, "ML") == 0)
+          {
+          options->interpolator = vtkImageRegistration::MajorityLabel;
+          }
         }
       else if (strcmp(arg, "-O") == 0 ||
                strcmp(arg, "--optimizer") == 0)
@@ -1940,6 +2805,10 @@ int register_read_options(
           if (*arg == 'x') { arg++; }
           }
         }
+      else if (strcmp(arg, "--adaptive") == 0)
+        {
+        options->adaptive = 1;
+        }
       else if (strcmp(arg, "-d") == 0 ||
                strcmp(arg, "--display") == 0)
         {
@@ -1960,6 +2829,21 @@ int register_read_options(
         {
         options->source_to_target = 1;
         }
+      else if (strcmp(arg, "--stream") == 0)
+        {
+        arg = check_next_arg(argc, argv, &argi, 0);
+        options->stream = static_cast<int>(strtoul(arg, NULL, 0));
+        if (options->stream == 1)
+          {
+          fprintf(stderr,
+                  "The \"--stream\" option needs at least 2 slabs\n");
+          exit(1);
+          }
+        }
+      else if (strcmp(arg, "--series") == 0)
+        {
+        options->series = 1;
+        }
       else if (strcmp(arg, "-s") == 0 ||
                strcmp(arg, "--silent") == 0)
         {
@@ -1994,6 +2878,11 @@ int register_read_options(
         arg = check_next_arg(argc, argv, &argi, 0);
         options->report = arg;
         }
+      else if (strcmp(arg, "--checkpoint") == 0)
+        {
+        arg = check_next_arg(argc, argv, &argi, 0);
+        options->checkpoint = arg;
+        }
       else if (strcmp(arg, "-o") == 0)
         {
         arg = check_next_arg(argc, argv, &argi, 0);
@@ -2029,6 +2918,321 @@ int register_read_options(
   return 1;
 }
 
+#ifdef AIRS_USE_NIFTI
+// The state that is shared by the two threads of register_series().
+struct SeriesThreadInfo
+{
+  vtkImageMotionCorrection *Filter; // the filter to update, or NULL
+  SeriesReader *Reader;
+  vtkImageData *NextChunk;          // the chunk to read, or NULL
+  int NextFrame;                    // the first frame of the next chunk
+  int NextCount;                    // the number of frames to read
+  SeriesWriter *Writer;
+  vtkImageData *LastOutput;         // the corrected chunk to write, or NULL
+  int LastFrame;                    // the first frame of the last chunk
+  const double *LastMatrices;       // the matrices for the last chunk
+  bool ReadError;
+  bool WriteError;
+};
+
+// Correct the current chunk in thread 0 (which is the main thread, so the
+// filter is never updated from any other thread), while thread 1 writes
+// the previous chunk and then reads the next chunk.
+VTK_THREAD_RETURN_TYPE SeriesExecute(void *arg)
+{
+  vtkMultiThreader::ThreadInfo *ti =
+    static_cast<vtkMultiThreader::ThreadInfo *>(arg);
+  SeriesThreadInfo *info = static_cast<SeriesThreadInfo *>(ti->UserData);
+
+  if (ti->ThreadID == 0 && info->Filter)
+    {
+    info->Filter->Update();
+    }
+  else if (ti->ThreadID == 1)
+    {
+    if (info->LastOutput && info->Writer &&
+        !info->Writer->WriteFrames(
+          info->LastFrame, info->LastOutput, info->LastMatrices))
+      {
+      info->WriteError = true;
+      }
+    if (info->NextChunk &&
+        !info->Reader->ReadFrames(
+          info->NextFrame, info->NextCount, info->NextChunk))
+      {
+      info->ReadError = true;
+      }
+    }
+
+  return VTK_THREAD_RETURN_VALUE;
+}
+#endif /* AIRS_USE_NIFTI */
+
+// Register every frame of a series (the target) to the source image, and
+// write the corrected series and the matrices for all of the frames.  The
+// series is read, corrected, and written in chunks, so that only a few
+// chunks are ever in memory, and the next chunk is read while the current
+// chunk is corrected.
+int register_series(register_options *options, vtkMatrix4x4 *initialMatrix)
+{
+#ifdef AIRS_USE_NIFTI
+  const char *imagefile = options->output;
+  const char *xfmfile = options->outxfm;
+
+  if (options->source_to_target || options->checkpoint || options->report)
+    {
+    fprintf(stderr, "The \"--series\" option cannot be used with "
+            "\"--source-to-target\", \"--checkpoint\", or \"-r\".\n");
+    return 1;
+    }
+  if (imagefile &&
+      vtksys::SystemTools::LowerCase(
+        vtksys::SystemTools::GetFilenameLastExtension(imagefile)) != ".nii")
+    {
+    fprintf(stderr, "The \"--series\" option needs a \".nii\" file "
+            "for the output image.\n");
+    return 1;
+    }
+  int xfmtype = (xfmfile ? GuessFileType(xfmfile) : CSVTransform);
+  if (xfmtype != CSVTransform && xfmtype != TXTTransform)
+    {
+    fprintf(stderr, "The \"--series\" option needs a \".csv\" or "
+            "\".txt\" file for the output transforms.\n");
+    return 1;
+    }
+  if (options->display || options->screenshot)
+    {
+    fprintf(stderr, "Warning: the series will not be displayed.\n");
+    }
+
+  if (!options->silent)
+    {
+    cout << "Reading source image: " << options->source << endl;
+    }
+
+  double sourceRange[2] = { 0.0, 1.0 };
+  vtkSmartPointer<vtkImageData> sourceImage =
+    vtkSmartPointer<vtkImageData>::New();
+  vtkSmartPointer<vtkMatrix4x4> sourceMatrix =
+    vtkSmartPointer<vtkMatrix4x4>::New();
+  vtkSmartPointer<vtkImageReader2> sourceReader =
+    ReadImage(sourceImage, sourceMatrix, sourceRange,
+              options->source, options->coords, options->interpolator);
+  sourceReader->Delete();
+
+  if (!options->silent)
+    {
+    cout << "Reading target series: " << options->target << endl;
+    }
+
+  SeriesReader series(options->target, options->coords);
+  int numFrames = series.GetNumberOfFrames();
+  if (imagefile && numFrames > 32767)
+    {
+    fprintf(stderr, "The series has too many frames (%d) to write.\n",
+            numFrames);
+    return 1;
+    }
+
+  // the matrix from the source data to the first frame, after applying
+  // the initial transform to the target
+  vtkSmartPointer<vtkMatrix4x4> matrix =
+    vtkSmartPointer<vtkMatrix4x4>::New();
+  matrix->DeepCopy(initialMatrix);
+  matrix->Invert();
+  vtkMatrix4x4::Multiply4x4(matrix, series.GetMatrix(), matrix);
+  matrix->Invert();
+  vtkMatrix4x4::Multiply4x4(matrix, sourceMatrix, matrix);
+
+  // the source to target world transform is targetMatrix*M*inv(sourceMatrix)
+  vtkSmartPointer<vtkMatrix4x4> invSourceMatrix =
+    vtkSmartPointer<vtkMatrix4x4>::New();
+  invSourceMatrix->DeepCopy(sourceMatrix);
+  invSourceMatrix->Invert();
+
+  // set up the motion correction with the registration parameters, where
+  // the levels are the stages that have a nonzero number of evaluations
+  int numLevels = 0;
+  while (numLevels < 4 && options->maxeval[numLevels] > 0)
+    {
+    numLevels++;
+    }
+  if (numLevels == 0)
+    {
+    fprintf(stderr, "The \"--series\" option needs a nonzero \"-N\".\n");
+    return 1;
+    }
+
+  int interpolatorType = options->interpolator;
+  vtkSmartPointer<vtkImageMotionCorrection> correction =
+    vtkSmartPointer<vtkImageMotionCorrection>::New();
+  correction->SetReferenceImage(sourceImage);
+  correction->SetTransformDimensionality(options->dimensionality);
+  correction->SetTransformType(options->transform);
+  correction->SetMetricType(options->metric);
+  correction->SetInterpolatorType(interpolatorType);
+  correction->SetOptimizerType(options->optimizer);
+  correction->SetImageRangePercentiles(1.0, 99.0);
+  correction->SetNumberOfLevels(numLevels);
+  correction->SetMaximumNumberOfEvaluations(options->maxeval[0]);
+  if (interpolatorType == vtkImageRegistration::Nearest ||
+      interpolatorType == vtkImageRegistration::Label ||
+      interpolatorType == vtkImageRegistration::MajorityLabel)
+    {
+    correction->SetInterpolationModeToNearestNeighbor();
+    }
+  else if (interpolatorType == vtkImageRegistration::Linear)
+    {
+    correction->SetInterpolationModeToLinear();
+    }
+  else
+    {
+    correction->SetInterpolationModeToCubic();
+    }
+
+  // each chunk has enough frames to give every thread a block of frames
+  int numThreads = vtkMultiThreader::GetGlobalDefaultNumberOfThreads();
+  int chunkSize = 8*numThreads;
+  chunkSize = (chunkSize < numFrames ? chunkSize : numFrames);
+
+  SeriesWriter *writer = 0;
+  if (imagefile)
+    {
+    writer = new SeriesWriter(imagefile, numFrames, series.GetTimeSpacing(),
+                              sourceMatrix, options->coords);
+    }
+  std::ofstream xfmstream;
+  const char *delim = ((xfmtype == CSVTransform) ? "," : "\t");
+  if (xfmfile)
+    {
+    xfmstream.open(xfmfile, ios::out);
+    }
+
+  vtkSmartPointer<vtkImageData> chunks[2];
+  chunks[0] = vtkSmartPointer<vtkImageData>::New();
+  chunks[1] = vtkSmartPointer<vtkImageData>::New();
+  vtkSmartPointer<vtkImageData> lastOutput =
+    vtkSmartPointer<vtkImageData>::New();
+  std::vector<double> lastMatrices(16*chunkSize);
+
+  if (!series.ReadFrames(0, chunkSize, chunks[0]))
+    {
+    fprintf(stderr, "Unable to read file %s\n", options->target);
+    exit(1);
+    }
+
+  SeriesThreadInfo info;
+  info.Reader = &series;
+  info.Writer = writer;
+  info.LastMatrices = &lastMatrices[0];
+  info.ReadError = false;
+  info.WriteError = false;
+
+  vtkSmartPointer<vtkMultiThreader> threader =
+    vtkSmartPointer<vtkMultiThreader>::New();
+  threader->SetNumberOfThreads(2);
+  threader->SetSingleMethod(SeriesExecute, &info);
+
+  vtkSmartPointer<vtkTimerLog> timer =
+    vtkSmartPointer<vtkTimerLog>::New();
+  double startTime = timer->GetUniversalTime();
+
+  vtkSmartPointer<vtkMatrix4x4> wmatrix =
+    vtkSmartPointer<vtkMatrix4x4>::New();
+  int firstFrame = 0;
+  int lastCount = 0;
+  for (int c = 0; firstFrame < numFrames || lastCount > 0; c++)
+    {
+    int count = numFrames - firstFrame;
+    count = (count < chunkSize ? count : chunkSize);
+    int nextFrame = firstFrame + count;
+    int nextCount = numFrames - nextFrame;
+    nextCount = (nextCount < chunkSize ? nextCount : chunkSize);
+
+    info.Filter = 0;
+    if (count > 0)
+      {
+      correction->SetSeries(chunks[c % 2]);
+      correction->SetInitialMatrix(matrix);
+      info.Filter = correction;
+      }
+    info.NextChunk = (nextCount > 0 ? chunks[(c + 1) % 2].GetPointer() : 0);
+    info.NextFrame = nextFrame;
+    info.NextCount = nextCount;
+    info.LastOutput = (lastCount > 0 ? lastOutput.GetPointer() : 0);
+    info.LastFrame = firstFrame - lastCount;
+    threader->SingleMethodExecute();
+
+    if (info.ReadError)
+      {
+      fprintf(stderr, "Unable to read file %s\n", options->target);
+      exit(1);
+      }
+    if (info.WriteError)
+      {
+      fprintf(stderr, "Unable to write file %s\n", imagefile);
+      exit(1);
+      }
+    if (count == 0)
+      {
+      break;
+      }
+
+    // keep the corrected chunk until it has been written, and start
+    // the next chunk from the last frame of this chunk
+    lastOutput->DeepCopy(correction->GetOutput());
+    correction->GetFrameMatrix(count - 1, matrix);
+    for (int f = 0; f < count; f++)
+      {
+      correction->GetFrameMatrix(f, wmatrix);
+      vtkMatrix4x4::Multiply4x4(series.GetMatrix(), wmatrix, wmatrix);
+      vtkMatrix4x4::Multiply4x4(wmatrix, invSourceMatrix, wmatrix);
+      for (int j = 0; j < 16; j++)
+        {
+        lastMatrices[16*f + j] = wmatrix->Element[j/4][j%4];
+        }
+      if (xfmfile)
+        {
+        // one row per frame, with the matrix in row-major order
+        for (int j = 0; j < 16; j++)
+          {
+          xfmstream << std::setprecision(10) << lastMatrices[16*f + j]
+                    << (j < 15 ? delim : "\n");
+          }
+        }
+      }
+
+    if (!options->silent)
+      {
+      cout << "Registered frames " << firstFrame << " to "
+           << (nextFrame - 1) << " of " << numFrames << " in "
+           << (timer->GetUniversalTime() - startTime) << "s" << endl;
+      }
+
+    lastCount = count;
+    firstFrame = nextFrame;
+    }
+
+  delete writer;
+  if (xfmfile)
+    {
+    if (!xfmstream.good())
+      {
+      fprintf(stderr, "Unable to write output transform.\n");
+      exit(1);
+      }
+    xfmstream.close();
+    }
+
+  return 0;
+#else
+  (void)options;
+  (void)initialMatrix;
+  fprintf(stderr, "The \"--series\" option needs NIFTI support.\n");
+  return 1;
+#endif
+}
+
 int main(int argc, char *argv[])
 {
   register_options options;
@@ -2130,6 +3334,12 @@ int main(int argc, char *argv[])
       }
     }
 
+  // a series is read and registered frame by frame
+  if (options.series)
+    {
+    return register_series(&options, initialMatrix);
+    }
+
   if (!options.silent)
     {
     cout << "Reading source image: " << sourcefile << endl;
@@ -2272,7 +3482,8 @@ int main(int argc, char *argv[])
   renderWindow->SetSize(512,512);
 
   if (interpolatorType == vtkImageRegistration::Nearest ||
-      interpolatorType == vtkImageRegistration::Label)
+      interpolatorType == vtkImageRegistration::Label ||
+      interpolatorType == vtkImageRegistration::MajorityLabel)
     {
     targetProperty->SetInterpolationTypeToNearest();
     sourceProperty->SetInterpolationTypeToNearest();
@@ -2340,33 +3551,18 @@ int main(int argc, char *argv[])
     minSpacing = sourceSpacing[2];
     }
 
-  // blur source image with Blackman-windowed sinc
-  vtkSmartPointer<vtkImageSincInterpolator> sourceBlurKernel =
-    vtkSmartPointer<vtkImageSincInterpolator>::New();
-  sourceBlurKernel->SetWindowFunctionToBlackman();
-  sourceBlurKernel->AntialiasingOn();
-
-  // reduce the source resolution
-  vtkSmartPointer<vtkImageResize> sourceBlur =
-    vtkSmartPointer<vtkImageResize>::New();
+  // blur source image with a recursive Gaussian and reduce its resolution,
+  // the cost of this does not depend on the amount of blurring
+  vtkSmartPointer<vtkImageGaussianPyramid> sourceBlur =
+    vtkSmartPointer<vtkImageGaussianPyramid>::New();
   sourceBlur->SET_INPUT_DATA(sourceImage);
-  sourceBlur->SetResizeMethodToOutputSpacing();
-  sourceBlur->SetInterpolator(sourceBlurKernel);
   sourceBlur->SetInterpolate(
     interpolatorType != vtkImageRegistration::Nearest);
 
-  // blur target with Blackman-windowed sinc
-  vtkSmartPointer<vtkImageSincInterpolator> targetBlurKernel =
-    vtkSmartPointer<vtkImageSincInterpolator>::New();
-  targetBlurKernel->SetWindowFunctionToBlackman();
-  targetBlurKernel->AntialiasingOn();
-
-  // keep target at full resolution
-  vtkSmartPointer<vtkImageResize> targetBlur =
-    vtkSmartPointer<vtkImageResize>::New();
+  // blur target with a recursive Gaussian, but keep full resolution
+  vtkSmartPointer<vtkImageGaussianPyramid> targetBlur =
+    vtkSmartPointer<vtkImageGaussianPyramid>::New();
   targetBlur->SET_INPUT_DATA(targetImage);
-  targetBlur->SetResizeMethodToOutputSpacing();
-  targetBlur->SetInterpolator(targetBlurKernel);
   targetBlur->SetInterpolate(
     interpolatorType != vtkImageRegistration::Nearest);
 
@@ -2390,6 +3586,7 @@ int main(int argc, char *argv[])
   registration->SetJointHistogramSize(numberOfBins,numberOfBins);
   registration->SetCostTolerance(1e-4);
   registration->SetTransformTolerance(transformTolerance);
+  registration->SetConvergenceMonitor(options.adaptive != 0);
   if (xfminputs->size() > 0)
     {
     registration->SetInitializerTypeToNone();
@@ -2423,8 +3620,35 @@ int main(int argc, char *argv[])
   // will be set to "true" when registration is initialized
   bool initialized = false;
 
+  // if a checkpoint exists, the registration will resume from it
+  ifstream checkpointFile;
+  int resumeLevel = -1;
+  bool resumeComplete = false;
+  if (options.checkpoint &&
+      vtksys::SystemTools::FileExists(options.checkpoint))
+    {
+    resumeLevel = ReadCheckpointLevel(
+      checkpointFile, options.checkpoint, &resumeComplete);
+    if (resumeLevel < 0)
+      {
+      exit(1);
+      }
+    if (!options.silent)
+      {
+      cout << "Resuming from checkpoint " << options.checkpoint << endl;
+      }
+    }
+
   while (level < 4 && options.maxeval[level] > 0)
     {
+    if (level < resumeLevel)
+      {
+      // this stage was completed before the checkpoint was saved
+      level++;
+      blurFactor /= 2.0;
+      continue;
+      }
+
     registration->SetMaximumNumberOfEvaluations(options.maxeval[level]);
     registration->SetMaximumNumberOfIterations(options.maxeval[level]);
     registration->SetInterpolatorType(interpolatorType);
@@ -2433,8 +3657,7 @@ int main(int argc, char *argv[])
     if (blurFactor < 1.1)
       {
       // full resolution: no blurring or resampling
-      sourceBlur->SetInterpolator(0);
-      sourceBlur->InterpolateOff();
+      sourceBlur->SetBlurFactors(1.0, 1.0, 1.0);
       sourceBlur->SetOutputSpacing(sourceSpacing);
 #if VTK_MAJOR_VERSION >= 6
       sourceBlur->UpdateWholeExtent();
@@ -2443,8 +3666,7 @@ int main(int argc, char *argv[])
       sourceBlur->Update();
 #endif
 
-      targetBlur->SetInterpolator(0);
-      sourceBlur->InterpolateOff();
+      targetBlur->SetBlurFactors(1.0, 1.0, 1.0);
       targetBlur->SetOutputSpacing(targetSpacing);
 #if VTK_MAJOR_VERSION >= 6
       targetBlur->UpdateWholeExtent();
@@ -2466,7 +3688,7 @@ int main(int argc, char *argv[])
           }
         }
 
-      sourceBlurKernel->SetBlurFactors(
+      sourceBlur->SetBlurFactors(
         spacing[0]/sourceSpacing[0],
         spacing[1]/sourceSpacing[1],
         spacing[2]/sourceSpacing[2]);
@@ -2479,7 +3701,7 @@ int main(int argc, char *argv[])
       sourceBlur->Update();
 #endif
 
-      targetBlurKernel->SetBlurFactors(
+      targetBlur->SetBlurFactors(
         blurFactor*minSpacing/targetSpacing[0],
         blurFactor*minSpacing/targetSpacing[1],
         blurFactor*minSpacing/targetSpacing[2]);
@@ -2501,13 +3723,33 @@ int main(int argc, char *argv[])
 
     registration->Initialize(matrix);
 
+    if (level == resumeLevel)
+      {
+      if (!registration->RestoreState(checkpointFile))
+        {
+        fprintf(stderr, "Unable to resume from checkpoint file %s\n",
+                options.checkpoint);
+        exit(1);
+        }
+      checkpointFile.close();
+      }
+
     initialized = true;
 
-    while (registration->Iterate())
+    // if the checkpoint was saved after this stage finished, the restored
+    // state is the final state for the stage, so do not iterate again
+    bool complete = (level == resumeLevel && resumeComplete);
+
+    while (!complete && registration->Iterate())
       {
       // registration->UpdateRegistration();
       // will iterate until convergence or failure
 
+      if (options.checkpoint)
+        {
+        WriteCheckpoint(registration, level, false, options.checkpoint);
+        }
+
       if (showTargetMoving)
         {
         targetMatrix->DeepCopy(registration->GetTransform()->GetMatrix());
@@ -2530,6 +3772,13 @@ int main(int argc, char *argv[])
         }
       }
 
+    // checkpoint the final state, so that a resume will not redo the
+    // last iteration of this stage
+    if (options.checkpoint && !complete)
+      {
+      WriteCheckpoint(registration, level, true, options.checkpoint);
+      }
+
     double newTime = timer->GetUniversalTime();
     double blurSpacing[3];
     sourceBlur->GetOutputSpacing(blurSpacing);
@@ -2546,7 +3795,12 @@ int main(int argc, char *argv[])
       {
       cout << minBlurSpacing << " mm took "
            << (newTime - lastTime) << "s and "
-           << registration->GetNumberOfEvaluations() << " evaluations" << endl;
+           << registration->GetNumberOfEvaluations() << " evaluations";
+      if (registration->GetStoppedByConvergenceMonitor())
+        {
+        cout << " (stopped early)";
+        }
+      cout << endl;
       lastTime = newTime;
       }
 
@@ -2560,6 +3814,12 @@ int main(int argc, char *argv[])
     cout << "registration took " << (lastTime - startTime) << "s" << endl;
     }
 
+  // the checkpoint is no longer needed
+  if (options.checkpoint)
+    {
+    vtksys::SystemTools::RemoveFile(options.checkpoint);
+    }
+
   // -------------------------------------------------------
   // write the output matrix
   if (xfmfile)
@@ -2666,33 +3926,38 @@ int main(int argc, char *argv[])
       }
 #endif
 
-    reslice->Update();
-    resliceImage = reslice->GetOutput();
+    vtkAlgorithmOutput *outputPort = reslice->GetOutputPort();
 
 #ifndef VTK_RESLICE_HAS_OUTPUT_SCALAR_TYPE
     vtkSmartPointer<vtkImageCast> imageCast =
       vtkSmartPointer<vtkImageCast>::New();
     if (outputScalarType != resliceImage->GetScalarType())
       {
-      imageCast->SET_INPUT_DATA(resliceImage);
+      imageCast->SetInputConnection(outputPort);
       imageCast->SetOutputScalarType(outputScalarType);
       imageCast->ClampOverflowOn();
-      imageCast->Update();
-      resliceImage = imageCast->GetOutput();
+      outputPort = imageCast->GetOutputPort();
       }
 #endif
 
+    // either resample the whole image now, or let WriteImage() generate
+    // and write the image in slabs
+    if (options.stream < 2)
+      {
+      outputPort->GetProducer()->Update();
+      }
+
     if (options.source_to_target)
       {
       WriteImage(targetReader, sourceReader,
-        resliceImage, originalTargetMatrix, imagefile,
-        options.coords, options.interpolator);
+        outputPort, originalTargetMatrix, imagefile,
+        options.coords, options.interpolator, options.stream);
       }
     else
       {
       WriteImage(sourceReader, targetReader,
-        resliceImage, originalSourceMatrix, imagefile,
-        options.coords, options.interpolator);
+        outputPort, originalSourceMatrix, imagefile,
+        options.coords, options.interpolator, options.stream);
       }
     }
 
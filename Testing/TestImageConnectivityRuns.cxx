@@ -0,0 +1,227 @@
+/*=========================================================================
+
+  Module: TestImageConnectivityRuns.cxx
+
+  Copyright (c) 2016 David Gobbi
+  All rights reserved.
+  See Copyright.txt or http://dgobbi.github.io/bsd3.txt for details.
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notice for more information.
+
+=========================================================================*/
+// Test that the regions that vtkImageConnectivityFilter finds without
+// seeds (by joining runs of voxels) are the same as the regions that it
+// finds by flood-filling from seeds, for a random mask.  The flood fill
+// is done by placing a seed at every voxel, in raster order, so that the
+// regions are found in the same order in both cases.  The regions that
+// are found when streaming are checked in the same way, before and after
+// the mask is modified.
+
+#include <vtkSmartPointer.h>
+#include <vtkImageData.h>
+#include <vtkIdTypeArray.h>
+#include <vtkIntArray.h>
+#include <vtkMinimalStandardRandomSequence.h>
+#include <vtkMultiThreader.h>
+#include <vtkPoints.h>
+#include <vtkPolyData.h>
+#include <vtkVersion.h>
+
+#include "AIRSConfig.h"
+#include "vtkImageConnectivityFilter.h"
+
+namespace {
+
+// Compare the label images and the region arrays of two filters.
+bool CompareRegions(
+  vtkImageConnectivityFilter *filter1, vtkImageConnectivityFilter *filter2)
+{
+  vtkIdType n = filter1->GetNumberOfExtractedRegions();
+  if (n != filter2->GetNumberOfExtractedRegions())
+    {
+    cerr << "number of regions: " << n << " != "
+         << filter2->GetNumberOfExtractedRegions() << "\n";
+    return false;
+    }
+
+  for (vtkIdType r = 0; r < n; r++)
+    {
+    if (filter1->GetExtractedRegionSizes()->GetValue(r) !=
+        filter2->GetExtractedRegionSizes()->GetValue(r) ||
+        filter1->GetExtractedRegionLabels()->GetValue(r) !=
+        filter2->GetExtractedRegionLabels()->GetValue(r))
+      {
+      cerr << "size or label of region " << r << " differs\n";
+      return false;
+      }
+    for (int i = 0; i < 6; i++)
+      {
+      if (filter1->GetExtractedRegionExtents()->GetValue(6*r + i) !=
+          filter2->GetExtractedRegionExtents()->GetValue(6*r + i))
+        {
+        cerr << "extent of region " << r << " differs\n";
+        return false;
+        }
+      }
+    }
+
+  vtkImageData *image1 = filter1->GetOutput();
+  vtkImageData *image2 = filter2->GetOutput();
+  int *ptr1 = static_cast<int *>(image1->GetScalarPointer());
+  int *ptr2 = static_cast<int *>(image2->GetScalarPointer());
+  vtkIdType m = image1->GetNumberOfPoints();
+  for (vtkIdType j = 0; j < m; j++)
+    {
+    if (ptr1[j] != ptr2[j])
+      {
+      cerr << "labels differ at voxel " << j << "\n";
+      return false;
+      }
+    }
+
+  return true;
+}
+
+} // end anonymous namespace
+
+int main(int, char *[])
+{
+  // a random mask, where about half of the voxels are set
+  int dims[3] = { 41, 37, 23 };
+  vtkSmartPointer<vtkImageData> image =
+    vtkSmartPointer<vtkImageData>::New();
+  image->SetExtent(0, dims[0] - 1, 0, dims[1] - 1, 0, dims[2] - 1);
+  image->SetSpacing(1.0, 1.0, 1.0);
+  image->SetOrigin(0.0, 0.0, 0.0);
+#if VTK_MAJOR_VERSION >= 6
+  image->AllocateScalars(VTK_UNSIGNED_CHAR, 1);
+#else
+  image->SetScalarTypeToUnsignedChar();
+  image->SetNumberOfScalarComponents(1);
+  image->AllocateScalars();
+#endif
+
+  vtkSmartPointer<vtkMinimalStandardRandomSequence> random =
+    vtkSmartPointer<vtkMinimalStandardRandomSequence>::New();
+  random->SetSeed(1);
+
+  // place a seed at every voxel in the mask
+  vtkSmartPointer<vtkPoints> seedPoints =
+    vtkSmartPointer<vtkPoints>::New();
+  unsigned char *ptr = static_cast<unsigned char *>(image->GetScalarPointer());
+  for (int k = 0; k < dims[2]; k++)
+    {
+    for (int j = 0; j < dims[1]; j++)
+      {
+      for (int i = 0; i < dims[0]; i++)
+        {
+        random->Next();
+        *ptr = (random->GetValue() < 0.5);
+        if (*ptr)
+          {
+          seedPoints->InsertNextPoint(i, j, k);
+          }
+        ptr++;
+        }
+      }
+    }
+
+  vtkSmartPointer<vtkPolyData> seedData =
+    vtkSmartPointer<vtkPolyData>::New();
+  seedData->SetPoints(seedPoints);
+
+  // find the regions by flood filling from the seeds
+  vtkSmartPointer<vtkImageConnectivityFilter> floodFill =
+    vtkSmartPointer<vtkImageConnectivityFilter>::New();
+#if VTK_MAJOR_VERSION >= 6
+  floodFill->SetInputData(image);
+#else
+  floodFill->SetInput(image);
+#endif
+  floodFill->SetSeedData(seedData);
+  floodFill->SetExtractionModeToSeededRegions();
+  floodFill->SetLabelScalarTypeToInt();
+  floodFill->GenerateRegionExtentsOn();
+  floodFill->Update();
+
+  cout << "regions: " << floodFill->GetNumberOfExtractedRegions() << "\n";
+
+  // find the regions by joining runs, with different numbers of threads,
+  // including more threads than vtkMultiThreader allows
+  int threadCounts[5] = { 1, 2, 3, 7, VTK_MAX_THREADS + 5 };
+  int errors = 0;
+  for (int t = 0; t < 5; t++)
+    {
+    vtkSmartPointer<vtkImageConnectivityFilter> runs =
+      vtkSmartPointer<vtkImageConnectivityFilter>::New();
+#if VTK_MAJOR_VERSION >= 6
+    runs->SetInputData(image);
+#else
+    runs->SetInput(image);
+#endif
+    runs->SetExtractionModeToAllRegions();
+    runs->SetLabelScalarTypeToInt();
+    runs->GenerateRegionExtentsOn();
+    runs->SetNumberOfThreads(threadCounts[t]);
+    runs->Update();
+
+    if (!CompareRegions(floodFill, runs))
+      {
+      cerr << "failed with " << threadCounts[t] << " threads\n";
+      errors++;
+      }
+    }
+
+  // find the regions by streaming the image in slabs
+  vtkSmartPointer<vtkImageConnectivityFilter> streamer =
+    vtkSmartPointer<vtkImageConnectivityFilter>::New();
+#if VTK_MAJOR_VERSION >= 6
+  streamer->SetInputData(image);
+#else
+  streamer->SetInput(image);
+#endif
+  streamer->SetExtractionModeToAllRegions();
+  streamer->SetLabelScalarTypeToInt();
+  streamer->SetNumberOfStreamDivisions(5);
+  streamer->Update();
+
+  if (!CompareRegions(floodFill, streamer))
+    {
+    cerr << "failed when streaming\n";
+    errors++;
+    }
+
+  // invert the mask, the streamer must not reuse the old regions
+  seedPoints->Initialize();
+  ptr = static_cast<unsigned char *>(image->GetScalarPointer());
+  for (int k = 0; k < dims[2]; k++)
+    {
+    for (int j = 0; j < dims[1]; j++)
+      {
+      for (int i = 0; i < dims[0]; i++)
+        {
+        *ptr = !*ptr;
+        if (*ptr)
+          {
+          seedPoints->InsertNextPoint(i, j, k);
+          }
+        ptr++;
+        }
+      }
+    }
+  image->Modified();
+  seedData->Modified();
+
+  floodFill->Update();
+  streamer->Update();
+
+  if (!CompareRegions(floodFill, streamer))
+    {
+    cerr << "failed when streaming a modified image\n";
+    errors++;
+    }
+
+  return (errors == 0 ? EXIT_SUCCESS : EXIT_FAILURE);
+}
@@ -0,0 +1,242 @@
+/*=========================================================================
+
+  Module: TestImageConnectivityStencils.cxx
+
+  Copyright (c) 2016 David Gobbi
+  All rights reserved.
+  See Copyright.txt or http://dgobbi.github.io/bsd3.txt for details.
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notice for more information.
+
+=========================================================================*/
+// Test the stencil mode of vtkImageConnectivityFilter, where the regions
+// are found from the runs of a stencil and a stencil is produced for each
+// region.  A sparse random stencil is used, and each region stencil is
+// compared voxel by voxel with the label image that the filter produces
+// for the same stencil when it is not in stencil mode.  The size and the
+// extent of each region are also compared.
+
+#include <vtkSmartPointer.h>
+#include <vtkImageData.h>
+#include <vtkImageStencilData.h>
+#include <vtkIdTypeArray.h>
+#include <vtkIntArray.h>
+#include <vtkMinimalStandardRandomSequence.h>
+#include <vtkVersion.h>
+
+#include "AIRSConfig.h"
+#include "vtkImageConnectivityFilter.h"
+
+#include <vector>
+
+int main(int, char *[])
+{
+  int dims[3] = { 43, 31, 19 };
+  int extent[6] = { 0, dims[0] - 1, 0, dims[1] - 1, 0, dims[2] - 1 };
+
+  // an image that is inside the scalar range everywhere, so that the
+  // regions are defined by the stencil alone
+  vtkSmartPointer<vtkImageData> image =
+    vtkSmartPointer<vtkImageData>::New();
+  image->SetExtent(extent);
+  image->SetSpacing(1.0, 1.0, 1.0);
+  image->SetOrigin(0.0, 0.0, 0.0);
+#if VTK_MAJOR_VERSION >= 6
+  image->AllocateScalars(VTK_UNSIGNED_CHAR, 1);
+#else
+  image->SetScalarTypeToUnsignedChar();
+  image->SetNumberOfScalarComponents(1);
+  image->AllocateScalars();
+#endif
+  unsigned char *ptr = static_cast<unsigned char *>(image->GetScalarPointer());
+  vtkIdType numVoxels = image->GetNumberOfPoints();
+  for (vtkIdType m = 0; m < numVoxels; m++)
+    {
+    ptr[m] = 1;
+    }
+
+  // a sparse stencil made of short random runs
+  vtkSmartPointer<vtkImageStencilData> stencil =
+    vtkSmartPointer<vtkImageStencilData>::New();
+  stencil->SetExtent(extent);
+  stencil->SetSpacing(1.0, 1.0, 1.0);
+  stencil->SetOrigin(0.0, 0.0, 0.0);
+  stencil->AllocateExtents();
+
+  vtkSmartPointer<vtkMinimalStandardRandomSequence> random =
+    vtkSmartPointer<vtkMinimalStandardRandomSequence>::New();
+  random->SetSeed(1);
+
+  for (int k = 0; k < dims[2]; k++)
+    {
+    for (int j = 0; j < dims[1]; j++)
+      {
+      int i = 0;
+      for (;;)
+        {
+        random->Next();
+        i += static_cast<int>(8*random->GetValue());
+        random->Next();
+        int r2 = i + static_cast<int>(4*random->GetValue());
+        if (i >= dims[0])
+          {
+          break;
+          }
+        r2 = (r2 < dims[0] ? r2 : dims[0] - 1);
+        stencil->InsertNextExtent(i, r2, j, k);
+        i = r2 + 2;
+        }
+      }
+    }
+
+  // the label image for the stencil
+  vtkSmartPointer<vtkImageConnectivityFilter> labeler =
+    vtkSmartPointer<vtkImageConnectivityFilter>::New();
+#if VTK_MAJOR_VERSION >= 6
+  labeler->SetInputData(image);
+#else
+  labeler->SetInput(image);
+#endif
+  labeler->SetStencilData(stencil);
+  labeler->SetExtractionModeToAllRegions();
+  labeler->SetLabelScalarTypeToInt();
+  labeler->GenerateRegionExtentsOn();
+  labeler->Update();
+
+  // the region stencils
+  vtkSmartPointer<vtkImageConnectivityFilter> stenciler =
+    vtkSmartPointer<vtkImageConnectivityFilter>::New();
+#if VTK_MAJOR_VERSION >= 6
+  stenciler->SetInputData(image);
+#else
+  stenciler->SetInput(image);
+#endif
+  stenciler->SetStencilData(stencil);
+  stenciler->SetExtractionModeToAllRegions();
+  stenciler->SetLabelScalarTypeToInt();
+  stenciler->GenerateRegionStencilsOn();
+  stenciler->Update();
+
+  vtkIdType n = labeler->GetNumberOfExtractedRegions();
+  cout << "regions: " << n << "\n";
+  if (n < 2 || n != stenciler->GetNumberOfExtractedRegions())
+    {
+    cerr << "number of regions: " << n << " != "
+         << stenciler->GetNumberOfExtractedRegions() << "\n";
+    return EXIT_FAILURE;
+    }
+
+  // the index of the region for each label of the label image
+  vtkIdTypeArray *labels = labeler->GetExtractedRegionLabels();
+  std::vector<vtkIdType> regionForLabel(n + 1, -1);
+  for (vtkIdType r = 0; r < n; r++)
+    {
+    vtkIdType label = labels->GetValue(r);
+    if (label < 1 || label > n)
+      {
+      cerr << "unexpected label " << label << "\n";
+      return EXIT_FAILURE;
+      }
+    regionForLabel[label] = r;
+    }
+
+  vtkImageData *labelImage = labeler->GetOutput();
+  int *labelPtr = static_cast<int *>(labelImage->GetScalarPointer());
+  std::vector<bool> matched(n, false);
+
+  int errors = 0;
+  for (vtkIdType s = 0; s < n && errors == 0; s++)
+    {
+    vtkImageStencilData *regionStencil =
+      stenciler->GetExtractedRegionStencil(s);
+    int regionExt[6];
+    regionStencil->GetExtent(regionExt);
+
+    // the extent that is reported must match the stencil extent
+    for (int j = 0; j < 6; j++)
+      {
+      if (stenciler->GetExtractedRegionExtents()->GetValue(6*s + j) !=
+          regionExt[j])
+        {
+        cerr << "extent of region stencil " << s << " is wrong\n";
+        errors++;
+        break;
+        }
+      }
+
+    // get the label of the first voxel in the stencil
+    int label = -1;
+    int iter = 0;
+    int r1, r2;
+    for (int k = regionExt[4]; k <= regionExt[5] && label < 0; k++)
+      {
+      for (int j = regionExt[2]; j <= regionExt[3] && label < 0; j++)
+        {
+        iter = 0;
+        if (regionStencil->GetNextExtent(
+              r1, r2, regionExt[0], regionExt[1], j, k, iter) && r1 <= r2)
+          {
+          label = labelPtr[(k*dims[1] + j)*dims[0] + r1];
+          }
+        }
+      }
+
+    // check every voxel of the stencil against the label image
+    vtkIdType count = 0;
+    for (int k = regionExt[4]; k <= regionExt[5] && errors == 0; k++)
+      {
+      for (int j = regionExt[2]; j <= regionExt[3] && errors == 0; j++)
+        {
+        for (int i = regionExt[0]; i <= regionExt[1]; i++)
+          {
+          int value = labelPtr[(k*dims[1] + j)*dims[0] + i];
+          bool inside = (regionStencil->IsInside(i, j, k) != 0);
+          if (inside != (value == label && label > 0))
+            {
+            cerr << "region stencil " << s << " differs from the labels"
+                 << " at " << i << ", " << j << ", " << k << "\n";
+            errors++;
+            break;
+            }
+          count += inside;
+          }
+        }
+      }
+    if (errors)
+      {
+      break;
+      }
+
+    // compare the size and extent with the matching labeled region
+    vtkIdType r = (label > 0 && label <= n ? regionForLabel[label] : -1);
+    if (r < 0 || matched[r])
+      {
+      cerr << "region stencil " << s << " does not match a region\n";
+      errors++;
+      break;
+      }
+    matched[r] = true;
+
+    if (count != stenciler->GetExtractedRegionSizes()->GetValue(s) ||
+        count != labeler->GetExtractedRegionSizes()->GetValue(r))
+      {
+      cerr << "size of region stencil " << s << " is wrong\n";
+      errors++;
+      }
+    for (int j = 0; j < 6; j++)
+      {
+      if (labeler->GetExtractedRegionExtents()->GetValue(6*r + j) !=
+          regionExt[j])
+        {
+        cerr << "extent of region stencil " << s << " differs from"
+             << " the extent of the labeled region\n";
+        errors++;
+        break;
+        }
+      }
+    }
+
+  return (errors == 0 ? EXIT_SUCCESS : EXIT_FAILURE);
+}
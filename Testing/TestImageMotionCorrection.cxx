@@ -0,0 +1,213 @@
+/*=========================================================================
+
+  Module: TestImageMotionCorrection.cxx
+
+  Copyright (c) 2016 David Gobbi
+  All rights reserved.
+  See Copyright.txt or http://dgobbi.github.io/bsd3.txt for details.
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notice for more information.
+
+=========================================================================*/
+// Test vtkImageMotionCorrection with a synthetic series, in which every
+// frame is the reference image shifted by a known translation.  The frame
+// matrices must match the translations, and the corrected frames must
+// match the reference.  This is done with one thread, where all frames
+// are registered in sequence, and with several threads, where the frames
+// are split into blocks.
+
+#include <vtkSmartPointer.h>
+#include <vtkImageData.h>
+#include <vtkPointData.h>
+#include <vtkFieldData.h>
+#include <vtkDataArray.h>
+#include <vtkMatrix4x4.h>
+#include <vtkVersion.h>
+
+#include "AIRSConfig.h"
+#include "vtkImageMotionCorrection.h"
+#include "vtkImageRegistration.h"
+
+#include <math.h>
+
+namespace {
+
+// A few gaussian blobs of different sizes, so that the image has enough
+// structure for the registration.
+double BlobValue(double x, double y, double z)
+{
+  static const double blobs[3][5] = {
+    { 14.0, 16.0, 15.0, 5.0, 1.0 },
+    { 22.0, 13.0, 18.0, 3.0, 0.7 },
+    { 17.0, 21.0, 11.0, 4.0, 0.5 } };
+
+  double v = 0.0;
+  for (int i = 0; i < 3; i++)
+    {
+    double dx = x - blobs[i][0];
+    double dy = y - blobs[i][1];
+    double dz = z - blobs[i][2];
+    double s = blobs[i][3];
+    v += blobs[i][4]*exp(-0.5*(dx*dx + dy*dy + dz*dz)/(s*s));
+    }
+  return v;
+}
+
+// Fill one component of an image with the blobs shifted by "shift".
+void FillImage(vtkImageData *image, int component, const double shift[3])
+{
+  int extent[6];
+  image->GetExtent(extent);
+  int numComponents = image->GetNumberOfScalarComponents();
+  float *ptr = static_cast<float *>(image->GetScalarPointer());
+  ptr += component;
+  for (int k = extent[4]; k <= extent[5]; k++)
+    {
+    for (int j = extent[2]; j <= extent[3]; j++)
+      {
+      for (int i = extent[0]; i <= extent[1]; i++)
+        {
+        *ptr = static_cast<float>(
+          BlobValue(i - shift[0], j - shift[1], k - shift[2]));
+        ptr += numComponents;
+        }
+      }
+    }
+}
+
+// Create an image with float scalars.
+vtkSmartPointer<vtkImageData> MakeImage(const int extent[6], int n)
+{
+  vtkSmartPointer<vtkImageData> image =
+    vtkSmartPointer<vtkImageData>::New();
+  image->SetExtent(const_cast<int *>(extent));
+  image->SetSpacing(1.0, 1.0, 1.0);
+  image->SetOrigin(0.0, 0.0, 0.0);
+#if VTK_MAJOR_VERSION >= 6
+  image->AllocateScalars(VTK_FLOAT, n);
+#else
+  image->SetScalarTypeToFloat();
+  image->SetNumberOfScalarComponents(n);
+  image->AllocateScalars();
+#endif
+  return image;
+}
+
+} // end anonymous namespace
+
+int main(int, char *[])
+{
+  const int numFrames = 6;
+  static const double shifts[numFrames][3] = {
+    { 0.0, 0.0, 0.0 },
+    { 0.5, 0.0, 0.0 },
+    { 1.0, -0.5, 0.0 },
+    { 1.2, -0.8, 0.4 },
+    { 0.8, -0.4, 0.8 },
+    { 0.3, 0.2, 0.5 } };
+
+  int extent[6] = { 0, 31, 0, 31, 0, 29 };
+  static const double noShift[3] = { 0.0, 0.0, 0.0 };
+
+  vtkSmartPointer<vtkImageData> reference = MakeImage(extent, 1);
+  FillImage(reference, 0, noShift);
+
+  // each frame is the reference moved by the shift
+  vtkSmartPointer<vtkImageData> series = MakeImage(extent, numFrames);
+  for (int f = 0; f < numFrames; f++)
+    {
+    FillImage(series, f, shifts[f]);
+    }
+
+  int errors = 0;
+  int threadCounts[2] = { 1, 3 };
+  for (int t = 0; t < 2; t++)
+    {
+    int numThreads = threadCounts[t];
+
+    vtkSmartPointer<vtkImageMotionCorrection> correction =
+      vtkSmartPointer<vtkImageMotionCorrection>::New();
+    correction->SetReferenceImage(reference);
+    correction->SetSeries(series);
+    correction->SetMetricType(vtkImageRegistration::SquaredDifference);
+    correction->SetTransformTolerance(0.01);
+    correction->SetCostTolerance(1e-6);
+    correction->SetNumberOfThreads(numThreads);
+    correction->Update();
+
+    vtkImageData *output = correction->GetOutput();
+    if (output->GetNumberOfScalarComponents() != numFrames ||
+        output->GetFieldData()->GetArray("FrameMatrices") == 0)
+      {
+      cerr << "output is incomplete with " << numThreads << " threads\n";
+      errors++;
+      continue;
+      }
+
+    vtkSmartPointer<vtkMatrix4x4> matrix =
+      vtkSmartPointer<vtkMatrix4x4>::New();
+    for (int f = 0; f < numFrames; f++)
+      {
+      // the matrix maps the reference to the frame, so the translation
+      // is the shift, and the rotation should be negligible
+      correction->GetFrameMatrix(f, matrix);
+      double maxError = 0.0;
+      double maxRotation = 0.0;
+      for (int i = 0; i < 3; i++)
+        {
+        double e = fabs(matrix->GetElement(i, 3) - shifts[f][i]);
+        maxError = (e > maxError ? e : maxError);
+        for (int j = 0; j < 3; j++)
+          {
+          double r = fabs(matrix->GetElement(i, j) - (i == j));
+          maxRotation = (r > maxRotation ? r : maxRotation);
+          }
+        }
+      if (maxRotation > 0.01)
+        {
+        cerr << "frame " << f << " is rotated with " << numThreads
+             << " threads\n";
+        errors++;
+        }
+      if (maxError > 0.25)
+        {
+        cerr << "frame " << f << " translation is off by " << maxError
+             << " with " << numThreads << " threads\n";
+        errors++;
+        }
+
+      // the corrected frame must match the reference away from the
+      // boundaries, where the shifted frame has no data
+      vtkDataArray *outScalars = output->GetPointData()->GetScalars();
+      vtkDataArray *refScalars = reference->GetPointData()->GetScalars();
+      double sum = 0.0;
+      int count = 0;
+      for (int k = extent[4] + 3; k <= extent[5] - 3; k++)
+        {
+        for (int j = extent[2] + 3; j <= extent[3] - 3; j++)
+          {
+          for (int i = extent[0] + 3; i <= extent[1] - 3; i++)
+            {
+            int ijk[3] = { i, j, k };
+            vtkIdType id = reference->ComputePointId(ijk);
+            double d = (outScalars->GetComponent(id, f) -
+                        refScalars->GetComponent(id, 0));
+            sum += d*d;
+            count++;
+            }
+          }
+        }
+      double rms = sqrt(sum/count);
+      if (rms > 0.02)
+        {
+        cerr << "corrected frame " << f << " differs from the reference"
+             << " (rms " << rms << ") with " << numThreads << " threads\n";
+        errors++;
+        }
+      }
+    }
+
+  return (errors == 0 ? EXIT_SUCCESS : EXIT_FAILURE);
+}
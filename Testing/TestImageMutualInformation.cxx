@@ -0,0 +1,173 @@
+/*=========================================================================
+
+  Module: TestImageMutualInformation.cxx
+
+  Copyright (c) 2016 David Gobbi
+  All rights reserved.
+  See Copyright.txt or http://dgobbi.github.io/bsd3.txt for details.
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notice for more information.
+
+=========================================================================*/
+// Test the joint histogram of vtkImageMutualInformation for float images
+// when the histogram is not square, with the size that is chosen by the
+// AutomaticHistogramSize option of vtkImageRegistration.
+
+#include <vtkSmartPointer.h>
+#include <vtkImageData.h>
+#include <vtkMatrix4x4.h>
+#include <vtkVersion.h>
+
+#include "AIRSConfig.h"
+#include "vtkImageMutualInformation.h"
+#include "vtkImageRegistration.h"
+
+#include <math.h>
+#include <vector>
+
+namespace {
+
+// Create a float image with a value of f(x)^power at each voxel, where
+// f(x) goes from zero to one along the x axis with a bit of texture.
+vtkSmartPointer<vtkImageData> MakeImage(int n, double power)
+{
+  vtkSmartPointer<vtkImageData> image =
+    vtkSmartPointer<vtkImageData>::New();
+  image->SetExtent(0, n - 1, 0, n - 1, 0, n - 1);
+  image->SetSpacing(1.0, 1.0, 1.0);
+  image->SetOrigin(0.0, 0.0, 0.0);
+#if VTK_MAJOR_VERSION >= 6
+  image->AllocateScalars(VTK_FLOAT, 1);
+#else
+  image->SetScalarTypeToFloat();
+  image->SetNumberOfScalarComponents(1);
+  image->AllocateScalars();
+#endif
+
+  float *ptr = static_cast<float *>(image->GetScalarPointer());
+  for (int k = 0; k < n; k++)
+    {
+    for (int j = 0; j < n; j++)
+      {
+      for (int i = 0; i < n; i++)
+        {
+        double f = (i + 0.25*((j + k) % 4))/(n + 0.75);
+        *ptr++ = static_cast<float>(pow(f, power));
+        }
+      }
+    }
+
+  return image;
+}
+
+// Compute the joint histogram in the same way as the filter.
+void JointHistogram(
+  vtkImageData *image0, vtkImageData *image1, const int numBins[2],
+  const double range0[2], const double range1[2], std::vector<int> *hist)
+{
+  hist->assign(numBins[0]*numBins[1], 0);
+  const double *ranges[2] = { range0, range1 };
+  float *ptrs[2];
+  ptrs[0] = static_cast<float *>(image0->GetScalarPointer());
+  ptrs[1] = static_cast<float *>(image1->GetScalarPointer());
+  vtkIdType n = image0->GetNumberOfPoints();
+  for (vtkIdType m = 0; m < n; m++)
+    {
+    int b[2];
+    for (int i = 0; i < 2; i++)
+      {
+      double s = (ranges[i][1] - ranges[i][0])/(numBins[i] - 1);
+      double x = (ptrs[i][m] - ranges[i][0])/s;
+      x = (x > 0.0 ? x : 0.0);
+      x = (x < numBins[i] - 1 ? x : numBins[i] - 1);
+      b[i] = static_cast<int>(x + 0.5);
+      }
+    (*hist)[b[1]*numBins[0] + b[0]]++;
+    }
+}
+
+} // end anonymous namespace
+
+int main(int, char *[])
+{
+  // the target has a long tail, so it needs more bins than the source
+  vtkSmartPointer<vtkImageData> source = MakeImage(32, 1.0);
+  vtkSmartPointer<vtkImageData> target = MakeImage(32, 8.0);
+
+  vtkSmartPointer<vtkMatrix4x4> matrix =
+    vtkSmartPointer<vtkMatrix4x4>::New();
+
+  vtkSmartPointer<vtkImageRegistration> registration =
+    vtkSmartPointer<vtkImageRegistration>::New();
+  registration->SetSourceImage(source);
+  registration->SetTargetImage(target);
+  registration->SetMetricTypeToMutualInformation();
+  registration->SetInterpolatorTypeToCubic();
+  registration->SetTransformTypeToRigid();
+  registration->AutomaticHistogramSizeOn();
+  registration->SetMaximumNumberOfEvaluations(50);
+  registration->Initialize(matrix);
+
+  int numBins[2];
+  registration->GetEffectiveJointHistogramSize(numBins);
+  cout << "automatic histogram size: "
+       << numBins[0] << " x " << numBins[1] << "\n";
+  if (numBins[0] >= numBins[1])
+    {
+    cerr << "expected more target bins than source bins\n";
+    return EXIT_FAILURE;
+    }
+
+  // run the metric through the generic (cubic, float) code path
+  while (registration->Iterate()) {}
+  cout << "metric value: " << registration->GetMetricValue() << "\n";
+
+  // check the joint histogram against one that is computed here
+  double range0[2] = { 0.0, 1.0 };
+  double range1[2] = { 0.0, 1.0 };
+  vtkSmartPointer<vtkImageMutualInformation> metric =
+    vtkSmartPointer<vtkImageMutualInformation>::New();
+#if VTK_MAJOR_VERSION >= 6
+  metric->SetInputData(0, source);
+  metric->SetInputData(1, target);
+#else
+  metric->SetInput(0, source);
+  metric->SetInput(1, target);
+#endif
+  metric->SetInputRange(0, range0);
+  metric->SetInputRange(1, range1);
+  metric->SetNumberOfBins(numBins);
+  metric->SetOutputScalarTypeToInt();
+  metric->Update();
+
+  std::vector<int> expected;
+  JointHistogram(source, target, numBins, range0, range1, &expected);
+
+  vtkImageData *output = metric->GetOutput();
+  int outExt[6];
+  output->GetExtent(outExt);
+  if (outExt[1] != numBins[0] - 1 || outExt[3] != numBins[1] - 1)
+    {
+    cerr << "joint histogram has the wrong extent\n";
+    return EXIT_FAILURE;
+    }
+
+  int *hist = static_cast<int *>(output->GetScalarPointer());
+  int errors = 0;
+  for (int j = 0; j < numBins[0]*numBins[1]; j++)
+    {
+    if (hist[j] != expected[j])
+      {
+      errors++;
+      }
+    }
+  if (errors)
+    {
+    cerr << errors << " joint histogram bins are incorrect\n";
+    return EXIT_FAILURE;
+    }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,199 @@
+/*=========================================================================
+
+  Module: TestLabelInterpolator.cxx
+
+  Copyright (c) 2016 David Gobbi
+  All rights reserved.
+  See Copyright.txt or http://dgobbi.github.io/bsd3.txt for details.
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notice for more information.
+
+=========================================================================*/
+// Test the Majority kernel of vtkLabelInterpolator against a majority
+// vote that is computed here, for both neighborhood sizes.  The point
+// interpolation is checked with InterpolateIJK(), and the row
+// interpolation (with precomputed weights) is checked with vtkImageReslice.
+
+#include <vtkSmartPointer.h>
+#include <vtkImageData.h>
+#include <vtkImageReslice.h>
+#include <vtkMinimalStandardRandomSequence.h>
+#include <vtkVersion.h>
+
+#include "AIRSConfig.h"
+#include "vtkLabelInterpolator.h"
+
+#include <math.h>
+#include <map>
+
+namespace {
+
+// Take the majority vote at a point in structured coordinates, where ties
+// go to the label of the nearest voxel and otherwise to the label that
+// was seen first.
+int MajorityLabel(vtkImageData *image, const double p[3], int n)
+{
+  int extent[6];
+  image->GetExtent(extent);
+
+  int ids[3][3];
+  int nearest[3];
+  for (int j = 0; j < 3; j++)
+    {
+    int i0 = static_cast<int>(floor(p[j]));
+    nearest[j] = (p[j] - i0 >= 0.5);
+    if (n == 3)
+      {
+      i0 += nearest[j] - 1;
+      nearest[j] = 1;
+      }
+    for (int l = 0; l < n; l++)
+      {
+      int i = i0 + l;
+      i = (i > extent[2*j] ? i : extent[2*j]);
+      i = (i < extent[2*j + 1] ? i : extent[2*j + 1]);
+      ids[j][l] = i;
+      }
+    }
+
+  int labels[27];
+  std::map<int, int> counts;
+  int t = 0;
+  for (int k = 0; k < n; k++)
+    {
+    for (int j = 0; j < n; j++)
+      {
+      for (int i = 0; i < n; i++)
+        {
+        int label = static_cast<int>(image->GetScalarComponentAsDouble(
+          ids[0][i], ids[1][j], ids[2][k], 0));
+        labels[t++] = label;
+        counts[label]++;
+        }
+      }
+    }
+
+  int result = static_cast<int>(image->GetScalarComponentAsDouble(
+    ids[0][nearest[0]], ids[1][nearest[1]], ids[2][nearest[2]], 0));
+  int maxcount = counts[result];
+  for (int i = 0; i < t; i++)
+    {
+    if (counts[labels[i]] > maxcount)
+      {
+      maxcount = counts[labels[i]];
+      result = labels[i];
+      }
+    }
+
+  return result;
+}
+
+} // end anonymous namespace
+
+int main(int, char *[])
+{
+  // a random label image with four labels
+  int dims[3] = { 12, 11, 10 };
+  vtkSmartPointer<vtkImageData> image =
+    vtkSmartPointer<vtkImageData>::New();
+  image->SetExtent(0, dims[0] - 1, 0, dims[1] - 1, 0, dims[2] - 1);
+  image->SetSpacing(1.0, 1.0, 1.0);
+  image->SetOrigin(0.0, 0.0, 0.0);
+#if VTK_MAJOR_VERSION >= 6
+  image->AllocateScalars(VTK_UNSIGNED_CHAR, 1);
+#else
+  image->SetScalarTypeToUnsignedChar();
+  image->SetNumberOfScalarComponents(1);
+  image->AllocateScalars();
+#endif
+
+  vtkSmartPointer<vtkMinimalStandardRandomSequence> random =
+    vtkSmartPointer<vtkMinimalStandardRandomSequence>::New();
+  random->SetSeed(1);
+
+  unsigned char *ptr = static_cast<unsigned char *>(image->GetScalarPointer());
+  vtkIdType numVoxels = image->GetNumberOfPoints();
+  for (vtkIdType m = 0; m < numVoxels; m++)
+    {
+    random->Next();
+    *ptr++ = static_cast<unsigned char>(4*random->GetValue());
+    }
+
+  // the output samples never lie halfway between two voxels
+  double spacing = 0.4;
+  double origin = 0.13;
+  int outExt[6] = { 0, 26, 0, 24, 0, 21 };
+
+  int errors = 0;
+  for (int n = 2; n <= 3; n++)
+    {
+    vtkSmartPointer<vtkLabelInterpolator> interpolator =
+      vtkSmartPointer<vtkLabelInterpolator>::New();
+    interpolator->SetKernelTypeToMajority();
+    interpolator->SetMajorityKernelSize(n);
+
+    // the row interpolation
+    vtkSmartPointer<vtkImageReslice> reslice =
+      vtkSmartPointer<vtkImageReslice>::New();
+#if VTK_MAJOR_VERSION >= 6
+    reslice->SetInputData(image);
+#else
+    reslice->SetInput(image);
+#endif
+    reslice->SetInterpolator(interpolator);
+    reslice->SetOutputSpacing(spacing, spacing, spacing);
+    reslice->SetOutputOrigin(origin, origin, origin);
+    reslice->SetOutputExtent(outExt);
+    reslice->Update();
+
+    vtkImageData *output = reslice->GetOutput();
+    unsigned char *outPtr =
+      static_cast<unsigned char *>(output->GetScalarPointer());
+
+    // the point interpolation
+    interpolator->Initialize(image);
+    interpolator->Update();
+
+    int rowErrors = 0;
+    int pointErrors = 0;
+    for (int k = outExt[4]; k <= outExt[5]; k++)
+      {
+      for (int j = outExt[2]; j <= outExt[3]; j++)
+        {
+        for (int i = outExt[0]; i <= outExt[1]; i++)
+          {
+          double point[3];
+          point[0] = origin + i*spacing;
+          point[1] = origin + j*spacing;
+          point[2] = origin + k*spacing;
+          int expected = MajorityLabel(image, point, n);
+
+          rowErrors += (*outPtr++ != expected);
+
+          double value;
+          interpolator->InterpolateIJK(point, &value);
+          pointErrors += (static_cast<int>(value) != expected);
+          }
+        }
+      }
+
+    if (rowErrors)
+      {
+      cerr << rowErrors << " errors in row interpolation with n = "
+           << n << "\n";
+      errors++;
+      }
+    if (pointErrors)
+      {
+      cerr << pointErrors << " errors in point interpolation with n = "
+           << n << "\n";
+      errors++;
+      }
+
+    interpolator->ReleaseData();
+    }
+
+  return (errors == 0 ? EXIT_SUCCESS : EXIT_FAILURE);
+}
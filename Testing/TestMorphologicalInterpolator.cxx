@@ -0,0 +1,188 @@
+/*=========================================================================
+
+  Module: TestMorphologicalInterpolator.cxx
+
+  Copyright (c) 2016 David Gobbi
+  All rights reserved.
+  See Copyright.txt or http://dgobbi.github.io/bsd3.txt for details.
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notice for more information.
+
+=========================================================================*/
+// Test the PrefilterInput option of vtkMorphologicalInterpolator, which
+// applies the operation to the whole input with running min/max filters
+// or with a distance transform.  The voxel centers of a small random mask
+// are sampled with PrefilterInput on and off, for both shapes, for dilate
+// and erode, and for each border mode, and the results must be identical.
+// The same is done for an image with three values, which the ellipsoid
+// cannot prefilter, and GetPrefilterInputUsed() is checked for each case.
+
+#include <vtkSmartPointer.h>
+#include <vtkImageData.h>
+#include <vtkImageReslice.h>
+#include <vtkMinimalStandardRandomSequence.h>
+#include <vtkVersion.h>
+
+#include "AIRSConfig.h"
+#include "vtkMorphologicalInterpolator.h"
+
+namespace {
+
+// Sample the image at its voxel centers with the interpolator.
+vtkSmartPointer<vtkImageData> SampleImage(
+  vtkImageData *image, vtkMorphologicalInterpolator *interpolator)
+{
+  vtkSmartPointer<vtkImageReslice> reslice =
+    vtkSmartPointer<vtkImageReslice>::New();
+#if VTK_MAJOR_VERSION >= 6
+  reslice->SetInputData(image);
+#else
+  reslice->SetInput(image);
+#endif
+  reslice->SetInterpolator(interpolator);
+  reslice->Update();
+
+  vtkSmartPointer<vtkImageData> output =
+    vtkSmartPointer<vtkImageData>::New();
+  output->DeepCopy(reslice->GetOutput());
+  return output;
+}
+
+// Count the voxels that differ between two images.
+int CountDifferences(vtkImageData *image1, vtkImageData *image2)
+{
+  unsigned char *ptr1 =
+    static_cast<unsigned char *>(image1->GetScalarPointer());
+  unsigned char *ptr2 =
+    static_cast<unsigned char *>(image2->GetScalarPointer());
+  vtkIdType n = image1->GetNumberOfPoints();
+  int count = 0;
+  for (vtkIdType m = 0; m < n; m++)
+    {
+    count += (ptr1[m] != ptr2[m]);
+    }
+  return count;
+}
+
+} // end anonymous namespace
+
+int main(int, char *[])
+{
+  int dims[3] = { 17, 15, 13 };
+  vtkSmartPointer<vtkImageData> image =
+    vtkSmartPointer<vtkImageData>::New();
+  image->SetExtent(0, dims[0] - 1, 0, dims[1] - 1, 0, dims[2] - 1);
+  image->SetSpacing(1.0, 1.0, 1.0);
+  image->SetOrigin(0.0, 0.0, 0.0);
+#if VTK_MAJOR_VERSION >= 6
+  image->AllocateScalars(VTK_UNSIGNED_CHAR, 1);
+#else
+  image->SetScalarTypeToUnsignedChar();
+  image->SetNumberOfScalarComponents(1);
+  image->AllocateScalars();
+#endif
+
+  vtkSmartPointer<vtkMinimalStandardRandomSequence> random =
+    vtkSmartPointer<vtkMinimalStandardRandomSequence>::New();
+  random->SetSeed(1);
+
+  // the radius has a fractional part below one half on every axis, so
+  // that both shapes reach the same number of voxels in each direction
+  double radius[3] = { 2.0, 1.4, 1.2 };
+  const char *borderNames[3] = { "Clamp", "Repeat", "Mirror" };
+  const char *operationNames[2] = { "Dilate", "Erode" };
+
+  int errors = 0;
+  for (int numValues = 2; numValues <= 3; numValues++)
+    {
+    // a mask that is sparse for dilation and dense for erosion, since
+    // the values are set to 1 for about 70 percent of the voxels
+    unsigned char *ptr =
+      static_cast<unsigned char *>(image->GetScalarPointer());
+    vtkIdType numVoxels = image->GetNumberOfPoints();
+    for (vtkIdType m = 0; m < numVoxels; m++)
+      {
+      random->Next();
+      double v = random->GetValue();
+      ptr[m] = (v < 0.3 ? 0 : (numValues == 2 || v < 0.9 ? 1 : 2));
+      }
+    image->Modified();
+
+    for (int shape = 0; shape < 2; shape++)
+      {
+      for (int operation = 0; operation < 2; operation++)
+        {
+        for (int border = 0; border < 3; border++)
+          {
+          vtkSmartPointer<vtkImageData> outputs[2];
+          int used[2] = { 0, 0 };
+          for (int prefilter = 0; prefilter < 2; prefilter++)
+            {
+            vtkSmartPointer<vtkMorphologicalInterpolator> interpolator =
+              vtkSmartPointer<vtkMorphologicalInterpolator>::New();
+            if (shape == 0)
+              {
+              interpolator->SetShapeToBox();
+              }
+            else
+              {
+              interpolator->SetShapeToEllipsoid();
+              }
+            if (operation == 0)
+              {
+              interpolator->SetOperationToDilate();
+              }
+            else
+              {
+              interpolator->SetOperationToErode();
+              }
+            if (border == 0)
+              {
+              interpolator->SetBorderModeToClamp();
+              }
+            else if (border == 1)
+              {
+              interpolator->SetBorderModeToRepeat();
+              }
+            else
+              {
+              interpolator->SetBorderModeToMirror();
+              }
+            interpolator->SetRadius(radius);
+            interpolator->SetPrefilterInput(prefilter);
+            outputs[prefilter] = SampleImage(image, interpolator);
+            used[prefilter] = interpolator->GetPrefilterInputUsed();
+            }
+
+          // the ellipsoid can only be prefiltered for binary images
+          // with the Clamp border mode
+          int expected = (shape == 0 || (numValues == 2 && border == 0));
+          const char *shapeName = (shape == 0 ? "Box" : "Ellipsoid");
+
+          if (used[0] != 0 || used[1] != expected)
+            {
+            cerr << "GetPrefilterInputUsed() is wrong for " << shapeName
+                 << " " << operationNames[operation] << " "
+                 << borderNames[border] << " with " << numValues
+                 << " values\n";
+            errors++;
+            }
+
+          int count = CountDifferences(outputs[0], outputs[1]);
+          if (count)
+            {
+            cerr << count << " voxels differ for " << shapeName
+                 << " " << operationNames[operation] << " "
+                 << borderNames[border] << " with " << numValues
+                 << " values\n";
+            errors++;
+            }
+          }
+        }
+      }
+    }
+
+  return (errors == 0 ? EXIT_SUCCESS : EXIT_FAILURE);
+}